@@ -0,0 +1,291 @@
+/*
+ * Copyright (C) 2018 Monument-Software GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "latencytesterserver.h"
+#include <libopenrv/orv_error.h>
+#include <libopenrv/orv_errorcodes.h>
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <mutex>
+
+namespace openrv {
+namespace bench {
+
+static const char* gHelo = "latencytester";
+static const size_t gRequestSize = 4;
+static const size_t gResponseSize = 4 + (4*2) * 4 + (3*2) * 8;
+static const uint32_t gMarkerColors[2] = { 0xffffff, 0xff0000 };
+
+static void writeInt32(uint8_t* dst, int32_t value)
+{
+    const uint32_t v = (uint32_t)value;
+    dst[0] = (uint8_t)v;
+    dst[1] = (uint8_t)(v >> 8);
+    dst[2] = (uint8_t)(v >> 16);
+    dst[3] = (uint8_t)(v >> 24);
+}
+
+static void writeInt64(uint8_t* dst, int64_t value)
+{
+    writeInt32(dst, (int32_t)(uint32_t)((uint64_t)value & 0xffffffff));
+    writeInt32(dst + 4, (int32_t)(uint32_t)((uint64_t)value >> 32));
+}
+
+static void writeTimestamp(uint8_t* dst, const struct timeval& t)
+{
+    writeInt64(dst, (int64_t)t.tv_sec);
+    writeInt64(dst + 8, (int64_t)t.tv_usec);
+}
+
+static void writeRect(uint8_t* dst, const MockRect& rect)
+{
+    writeInt32(dst, rect.mX);
+    writeInt32(dst + 4, rect.mY);
+    writeInt32(dst + 8, (int32_t)rect.mX + rect.mW - 1);
+    writeInt32(dst + 12, (int32_t)rect.mY + rect.mH - 1);
+}
+
+LatencyTesterServer::LatencyTesterServer(MockDesktop* desktop, const LatencyTesterServerOptions& options)
+    : mDesktop(desktop),
+      mOptions(options),
+      mStopping(false),
+      mAnsweredRequests(0)
+{
+    ThreadNotifier::makePipe(&mStopNotifier, &mStopListener);
+}
+
+LatencyTesterServer::~LatencyTesterServer()
+{
+    if (mListenFd >= 0) {
+        ::close(mListenFd);
+    }
+}
+
+/**
+ * Start listening on the TCP port of the options.
+ **/
+bool LatencyTesterServer::listen(orv_error_t* error)
+{
+    struct sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(mOptions.mPort);
+    if (inet_pton(AF_INET, mOptions.mListenAddress.c_str(), &address.sin_addr) != 1) {
+        orv_error_set(error, ORV_ERR_GENERIC, 0, "Invalid listen address '%s'", mOptions.mListenAddress.c_str());
+        return false;
+    }
+    mListenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (mListenFd < 0) {
+        orv_error_set(error, ORV_ERR_GENERIC, errno, "socket() failed with errno=%d", errno);
+        return false;
+    }
+    int reuse = 1;
+    setsockopt(mListenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if (bind(mListenFd, (struct sockaddr*)&address, sizeof(address)) != 0 || ::listen(mListenFd, 4) != 0) {
+        orv_error_set(error, ORV_ERR_GENERIC, errno, "Failed to listen on %s:%d, errno=%d", mOptions.mListenAddress.c_str(), (int)mOptions.mPort, errno);
+        ::close(mListenFd);
+        mListenFd = -1;
+        return false;
+    }
+    socklen_t addressLength = sizeof(address);
+    getsockname(mListenFd, (struct sockaddr*)&address, &addressLength);
+    mPort = ntohs(address.sin_port);
+    return true;
+}
+
+/**
+ * Accept and serve clients until @ref stop() is called.
+ **/
+void LatencyTesterServer::run()
+{
+    while (!mStopping.load()) {
+        if (!waitForFd(mListenFd, POLLIN)) {
+            break;
+        }
+        const int fd = accept(mListenFd, nullptr, nullptr);
+        if (fd < 0) {
+            continue;
+        }
+        int noDelay = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+        serveConnection(fd);
+        ::close(fd);
+    }
+}
+
+/**
+ * Make @ref run() return, thread safe.
+ **/
+void LatencyTesterServer::stop()
+{
+    mStopping = true;
+    mStopNotifier.sendNotification();
+}
+
+void LatencyTesterServer::serveConnection(int fd)
+{
+    if (!writeFully(fd, gHelo, strlen(gHelo))) {
+        return;
+    }
+    uint8_t request[gRequestSize];
+    uint8_t response[gResponseSize];
+    while (readFully(fd, request, gRequestSize)) {
+        struct timeval receiveTimestamp;
+        gettimeofday(&receiveTimestamp, nullptr);
+        if (memcmp(request, "lat", 3) != 0 || request[3] != 1) {
+            fprintf(stderr, "Latency tester: invalid request, closing connection\n");
+            return;
+        }
+        MockRect previous;
+        MockRect next;
+        moveMarker(&previous, &next);
+        struct timeval updateTimestamp;
+        gettimeofday(&updateTimestamp, nullptr);
+
+        memcpy(response, "lat", 3);
+        response[3] = 1;
+        writeRect(response + 4, previous);
+        writeRect(response + 20, next);
+        writeTimestamp(response + 36, updateTimestamp);
+        writeTimestamp(response + 68, receiveTimestamp);
+        struct timeval sendTimestamp;
+        gettimeofday(&sendTimestamp, nullptr);
+        writeTimestamp(response + 52, sendTimestamp);
+        if (!writeFully(fd, response, gResponseSize)) {
+            return;
+        }
+        mAnsweredRequests++;
+    }
+}
+
+/**
+ * Restore the desktop below the current marker and paint the marker at its next position, using
+ * alternating colors so that every move changes all pixels of the marker.
+ **/
+void LatencyTesterServer::moveMarker(MockRect* previous, MockRect* next)
+{
+    std::lock_guard<std::mutex> lock(mDesktop->mutex());
+    const uint16_t size = std::max((uint16_t)1, std::min(mOptions.mMarkerSize, std::min(mDesktop->width(), mDesktop->height())));
+    if (!mMarker.isEmpty()) {
+        for (uint16_t y = 0; y < mMarker.mH; y++) {
+            for (uint16_t x = 0; x < mMarker.mW; x++) {
+                mDesktop->setPixelMutexLocked(mMarker.mX + x, mMarker.mY + y, mSavedPixels[(size_t)y * mMarker.mW + x]);
+            }
+        }
+        mDesktop->markDirtyMutexLocked(mMarker);
+        *previous = mMarker;
+    }
+    else {
+        *previous = MockRect(0, 0, size, size);
+    }
+    uint16_t nextX = 0;
+    if (!mMarker.isEmpty() && mMarker.mX + mMarker.mW + size <= mDesktop->width()) {
+        nextX = mMarker.mX + mMarker.mW;
+    }
+    mMarker = MockRect(nextX, 0, size, size);
+    mSavedPixels.resize((size_t)size * size);
+    for (uint16_t y = 0; y < size; y++) {
+        for (uint16_t x = 0; x < size; x++) {
+            mSavedPixels[(size_t)y * size + x] = mDesktop->pixelMutexLocked(mMarker.mX + x, mMarker.mY + y);
+        }
+    }
+    mDesktop->fillRectMutexLocked(mMarker, gMarkerColors[mMarkerMoves % 2]);
+    mMarkerMoves++;
+    *next = mMarker;
+}
+
+/**
+ * Wait until @p fd is ready for @p events.
+ *
+ * @return TRUE if @p fd is ready, FALSE if @ref stop() was called or waiting failed.
+ **/
+bool LatencyTesterServer::waitForFd(int fd, short events)
+{
+    while (!mStopping.load()) {
+        struct pollfd fds[2] = {};
+        fds[0].fd = mStopListener.pipeReadFd();
+        fds[0].events = POLLIN;
+        fds[1].fd = fd;
+        fds[1].events = events;
+        const int ret = poll(fds, 2, -1);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        if (fds[0].revents & POLLIN) {
+            mStopListener.swallowPipeData();
+            continue;
+        }
+        if (fds[1].revents & (events | POLLHUP | POLLERR)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool LatencyTesterServer::readFully(int fd, void* buffer, size_t size)
+{
+    uint8_t* dst = (uint8_t*)buffer;
+    while (size > 0) {
+        if (!waitForFd(fd, POLLIN)) {
+            return false;
+        }
+        const ssize_t s = ::recv(fd, dst, size, 0);
+        if (s <= 0) {
+            if (s < 0 && errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        dst += s;
+        size -= (size_t)s;
+    }
+    return true;
+}
+
+bool LatencyTesterServer::writeFully(int fd, const void* buffer, size_t size)
+{
+    const uint8_t* src = (const uint8_t*)buffer;
+    while (size > 0) {
+        if (!waitForFd(fd, POLLOUT)) {
+            return false;
+        }
+        const ssize_t s = ::send(fd, src, size, MSG_NOSIGNAL);
+        if (s <= 0) {
+            if (s < 0 && errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        src += s;
+        size -= (size_t)s;
+    }
+    return true;
+}
+
+} // namespace bench
+} // namespace openrv
@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2018 Monument-Software GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OPENRV_BENCH_LATENCYTESTERSERVER_H
+#define OPENRV_BENCH_LATENCYTESTERSERVER_H
+
+#include "mockserver.h"
+#include "threadnotifier.h"
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+struct orv_error_t;
+
+/**
+ * @file latencytesterserver.h
+ *
+ * Reference implementation of the server side of the latency tester protocol (see
+ * orv_latencytesterclient.h), painting into the desktop of a @ref openrv::bench::MockServer.
+ *
+ * The protocol: after connecting, the server sends the HELO "latencytester" (13 bytes). The client
+ * then sends update requests ("lat" followed by the type 1). For each request, the server moves a
+ * marker on its desktop and answers in order with "lat", the type 1, the previous and the new
+ * marker rect (top left and bottom right corner, inclusive, as 8 int32 values) and the update,
+ * send and request receive timestamps of the server (wall clock, each as int64 seconds and int64
+ * microseconds). All values are in little endian byte order, i.e. the response has 84 bytes.
+ **/
+
+namespace openrv {
+namespace bench {
+
+struct LatencyTesterServerOptions
+{
+    std::string mListenAddress = "127.0.0.1";
+    /**
+     * TCP port to listen on, 0 to use any free port (see @ref LatencyTesterServer::port()).
+     **/
+    uint16_t mPort = 5901;
+    /**
+     * Width and height of the marker in pixels. The marker moves by its width per request, along
+     * the top row of the desktop.
+     **/
+    uint16_t mMarkerSize = 16;
+};
+
+/**
+ * Server of the latency tester protocol for a @ref MockDesktop.
+ *
+ * Call @ref listen(), then @ref run() to serve clients until @ref stop() is called. Clients are
+ * served one at a time, as they would all move the same marker.
+ **/
+class LatencyTesterServer
+{
+public:
+    LatencyTesterServer(MockDesktop* desktop, const LatencyTesterServerOptions& options);
+    ~LatencyTesterServer();
+    LatencyTesterServer(const LatencyTesterServer&) = delete;
+    LatencyTesterServer& operator=(const LatencyTesterServer&) = delete;
+
+    bool listen(orv_error_t* error);
+    uint16_t port() const;
+    void run();
+    void stop();
+    uint64_t answeredRequests() const;
+
+private:
+    void serveConnection(int fd);
+    bool waitForFd(int fd, short events);
+    bool readFully(int fd, void* buffer, size_t size);
+    bool writeFully(int fd, const void* buffer, size_t size);
+    void moveMarker(MockRect* previous, MockRect* next);
+
+private:
+    MockDesktop* mDesktop;
+    const LatencyTesterServerOptions mOptions;
+    int mListenFd = -1;
+    uint16_t mPort = 0;
+    std::atomic<bool> mStopping;
+    ThreadNotifierWriter mStopNotifier;
+    ThreadNotifierListener mStopListener;
+    std::atomic<uint64_t> mAnsweredRequests;
+    /**
+     * The current marker position and the desktop pixels below it, restored when the marker moves
+     * on. Only accessed by the thread calling @ref run().
+     **/
+    MockRect mMarker;
+    std::vector<uint32_t> mSavedPixels;
+    uint64_t mMarkerMoves = 0;
+};
+
+/**
+ * @return The port the server listens on, valid after @ref listen() succeeded.
+ **/
+inline uint16_t LatencyTesterServer::port() const
+{
+    return mPort;
+}
+
+inline uint64_t LatencyTesterServer::answeredRequests() const
+{
+    return mAnsweredRequests.load();
+}
+
+} // namespace bench
+} // namespace openrv
+
+#endif
@@ -0,0 +1,1539 @@
+/*
+ * Copyright (C) 2018 Monument-Software GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mockserver.h"
+#include "syntheticencoders.h"
+#include "memorypipe.h"
+#include "reader.h"
+#include "writer.h"
+#include "utils.h"
+#include <libopenrv/orv_error.h>
+#include <libopenrv/orv_errorcodes.h>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+namespace openrv {
+namespace bench {
+
+using vnc::EncodingType;
+
+/**
+ * Maximum number of dirty rects tracked per client. Beyond that, the rects whose bounding rect
+ * adds the fewest pixels are merged.
+ **/
+static const size_t gMaxDirtyRects = 32;
+static const uint32_t gMaxClientCutTextLength = 1024 * 1024;
+static const uint32_t gDesktopBackground = 0x3a6ea5;
+
+static MockRect intersectRects(const MockRect& a, const MockRect& b)
+{
+    const int x1 = std::max((int)a.mX, (int)b.mX);
+    const int y1 = std::max((int)a.mY, (int)b.mY);
+    const int x2 = std::min((int)a.mX + a.mW, (int)b.mX + b.mW);
+    const int y2 = std::min((int)a.mY + a.mH, (int)b.mY + b.mH);
+    if (x2 <= x1 || y2 <= y1) {
+        return MockRect();
+    }
+    return MockRect((uint16_t)x1, (uint16_t)y1, (uint16_t)(x2 - x1), (uint16_t)(y2 - y1));
+}
+
+static bool rectsIntersect(const MockRect& a, const MockRect& b)
+{
+    return !intersectRects(a, b).isEmpty();
+}
+
+/**
+ * @return TRUE if @p outer completely contains @p inner.
+ **/
+static bool rectContains(const MockRect& outer, const MockRect& inner)
+{
+    return inner.mX >= outer.mX && inner.mY >= outer.mY && inner.mX + inner.mW <= outer.mX + outer.mW && inner.mY + inner.mH <= outer.mY + outer.mH;
+}
+
+static MockRect boundingRect(const MockRect& a, const MockRect& b)
+{
+    const int x1 = std::min(a.mX, b.mX);
+    const int y1 = std::min(a.mY, b.mY);
+    const int x2 = std::max((int)a.mX + a.mW, (int)b.mX + b.mW);
+    const int y2 = std::max((int)a.mY + a.mH, (int)b.mY + b.mH);
+    return MockRect((uint16_t)x1, (uint16_t)y1, (uint16_t)(x2 - x1), (uint16_t)(y2 - y1));
+}
+
+static uint64_t rectArea(const MockRect& rect)
+{
+    return (uint64_t)rect.mW * rect.mH;
+}
+
+/**
+ * @return The number of pixels that the bounding rect of @p a and @p b covers in addition to @p a
+ *         and @p b. Overlapping pixels are counted twice, i.e. 0 if the bounding rect covers no
+ *         more pixels than the two rects together.
+ **/
+static uint64_t mergeCost(const MockRect& a, const MockRect& b)
+{
+    const uint64_t bounding = rectArea(boundingRect(a, b));
+    const uint64_t sum = rectArea(a) + rectArea(b);
+    return (bounding > sum) ? bounding - sum : 0;
+}
+
+/**
+ * @return TRUE if @p a and @p b overlap or share (part of) an edge.
+ **/
+static bool rectsTouch(const MockRect& a, const MockRect& b)
+{
+    const int xOverlap = std::min((int)a.mX + a.mW, (int)b.mX + b.mW) - std::max((int)a.mX, (int)b.mX);
+    const int yOverlap = std::min((int)a.mY + a.mH, (int)b.mY + b.mH) - std::max((int)a.mY, (int)b.mY);
+    return xOverlap >= 0 && yOverlap >= 0 && (xOverlap > 0 || yOverlap > 0);
+}
+
+/**
+ * Append the parts of @p rect that are not covered by @p cut (at most 4 rects) to @p out.
+ **/
+static void subtractRect(const MockRect& rect, const MockRect& cut, std::vector<MockRect>* out)
+{
+    const MockRect i = intersectRects(rect, cut);
+    if (i.isEmpty()) {
+        out->push_back(rect);
+        return;
+    }
+    if (i.mY > rect.mY) {
+        out->push_back(MockRect(rect.mX, rect.mY, rect.mW, (uint16_t)(i.mY - rect.mY)));
+    }
+    if (i.mY + i.mH < rect.mY + rect.mH) {
+        out->push_back(MockRect(rect.mX, (uint16_t)(i.mY + i.mH), rect.mW, (uint16_t)(rect.mY + rect.mH - i.mY - i.mH)));
+    }
+    if (i.mX > rect.mX) {
+        out->push_back(MockRect(rect.mX, i.mY, (uint16_t)(i.mX - rect.mX), i.mH));
+    }
+    if (i.mX + i.mW < rect.mX + rect.mW) {
+        out->push_back(MockRect((uint16_t)(i.mX + i.mW), i.mY, (uint16_t)(rect.mX + rect.mW - i.mX - i.mW), i.mH));
+    }
+}
+
+static uint32_t makeRgb(int r, int g, int b)
+{
+    r = std::max(0, std::min(255, r));
+    g = std::max(0, std::min(255, g));
+    b = std::max(0, std::min(255, b));
+    return ((uint32_t)r << 16) | ((uint32_t)g << 8) | (uint32_t)b;
+}
+
+void MockDamage::clear()
+{
+    mCopies.clear();
+    mDirty.clear();
+}
+
+bool MockDamage::isEmpty() const
+{
+    return mCopies.empty() && mDirty.empty();
+}
+
+/**
+ * Add @p rect to the dirty rects. It is merged with the dirty rects it overlaps or adjoins, as long
+ * as their bounding rect covers no additional pixels (e.g. two strips of the same width on top of
+ * each other), so that separate changes remain separate rects.
+ *
+ * If more than @ref gMaxDirtyRects remain, the pairs that are cheapest to merge are merged.
+ **/
+void MockDamage::addDirty(const MockRect& rect)
+{
+    if (rect.isEmpty()) {
+        return;
+    }
+    MockRect merged = rect;
+    bool mergedAny = true;
+    while (mergedAny) {
+        mergedAny = false;
+        for (size_t i = 0; i < mDirty.size(); i++) {
+            if (rectsTouch(merged, mDirty[i]) && mergeCost(merged, mDirty[i]) == 0) {
+                merged = boundingRect(merged, mDirty[i]);
+                mDirty.erase(mDirty.begin() + i);
+                mergedAny = true;
+                break;
+            }
+        }
+    }
+    mDirty.push_back(merged);
+    while (mDirty.size() > gMaxDirtyRects) {
+        size_t bestA = 0;
+        size_t bestB = 1;
+        uint64_t bestCost = UINT64_MAX;
+        for (size_t a = 0; a < mDirty.size(); a++) {
+            for (size_t b = a + 1; b < mDirty.size(); b++) {
+                const uint64_t cost = mergeCost(mDirty[a], mDirty[b]);
+                if (cost < bestCost) {
+                    bestA = a;
+                    bestB = b;
+                    bestCost = cost;
+                }
+            }
+        }
+        mDirty[bestA] = boundingRect(mDirty[bestA], mDirty[bestB]);
+        mDirty.erase(mDirty.begin() + bestB);
+    }
+}
+
+/**
+ * Add a copy of the desktop. The parts of the source area that have not yet been sent to the
+ * client (i.e. that are covered by a dirty rect) would be copied with stale content, so the
+ * corresponding parts of the destination are added as dirty rects. The copy itself is kept, unless
+ * its source is stale completely.
+ *
+ * NOTE: Dirty rects that intersect the destination remain valid: dirty rects are sent after all
+ *       copies, with the content of the desktop at the time they are sent.
+ **/
+void MockDamage::addCopy(const MockCopy& copy)
+{
+    const MockRect src(copy.mSrcX, copy.mSrcY, copy.mDst.mW, copy.mDst.mH);
+    std::vector<MockRect> staleDst;
+    for (const MockRect& dirty : mDirty) {
+        const MockRect stale = intersectRects(dirty, src);
+        if (stale.isEmpty()) {
+            continue;
+        }
+        if (rectContains(stale, src)) {
+            addDirty(copy.mDst);
+            return;
+        }
+        staleDst.push_back(MockRect((uint16_t)(copy.mDst.mX + stale.mX - src.mX), (uint16_t)(copy.mDst.mY + stale.mY - src.mY), stale.mW, stale.mH));
+    }
+    mCopies.push_back(copy);
+    for (const MockRect& rect : staleDst) {
+        addDirty(rect);
+    }
+}
+
+void MockDamage::convertCopiesToDirty()
+{
+    std::vector<MockCopy> copies;
+    copies.swap(mCopies);
+    for (const MockCopy& copy : copies) {
+        addDirty(copy.mDst);
+    }
+}
+
+bool MockDamage::intersects(const MockRect& region) const
+{
+    for (const MockCopy& copy : mCopies) {
+        if (rectsIntersect(copy.mDst, region)) {
+            return true;
+        }
+    }
+    for (const MockRect& dirty : mDirty) {
+        if (rectsIntersect(dirty, region)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Move all changes inside @p region to @p copies and @p dirty, the changes outside of @p region
+ * remain pending.
+ *
+ * Copies are sent only if all of them are inside @p region, as they must be applied in order.
+ **/
+void MockDamage::take(const MockRect& region, std::vector<MockCopy>* copies, std::vector<MockRect>* dirty)
+{
+    for (const MockCopy& copy : mCopies) {
+        if (!rectContains(region, copy.mDst)) {
+            convertCopiesToDirty();
+            break;
+        }
+    }
+    copies->insert(copies->end(), mCopies.begin(), mCopies.end());
+    mCopies.clear();
+    std::vector<MockRect> remaining;
+    for (const MockRect& rect : mDirty) {
+        const MockRect inside = intersectRects(rect, region);
+        if (!inside.isEmpty()) {
+            dirty->push_back(inside);
+        }
+        subtractRect(rect, region, &remaining);
+    }
+    mDirty.swap(remaining);
+}
+
+MockDesktop::MockDesktop(uint16_t width, uint16_t height)
+    : mWidth(width),
+      mHeight(height),
+      mPixels((size_t)width * height, 0)
+{
+}
+
+void MockDesktop::fillRectMutexLocked(const MockRect& rect, uint32_t rgb)
+{
+    for (uint16_t y = rect.mY; y < rect.mY + rect.mH; y++) {
+        std::fill(mPixels.begin() + (size_t)y * mWidth + rect.mX, mPixels.begin() + (size_t)y * mWidth + rect.mX + rect.mW, rgb);
+    }
+    markDirtyMutexLocked(rect);
+}
+
+/**
+ * Copy the @p dst sized area at @p srcX, @p srcY to @p dst. The areas may overlap.
+ **/
+void MockDesktop::copyRectMutexLocked(uint16_t srcX, uint16_t srcY, const MockRect& dst)
+{
+    if (dst.isEmpty() || (srcX == dst.mX && srcY == dst.mY)) {
+        return;
+    }
+    const size_t rowBytes = (size_t)dst.mW * sizeof(uint32_t);
+    if (srcY >= dst.mY) {
+        for (uint16_t y = 0; y < dst.mH; y++) {
+            memmove(&mPixels[(size_t)(dst.mY + y) * mWidth + dst.mX], &mPixels[(size_t)(srcY + y) * mWidth + srcX], rowBytes);
+        }
+    }
+    else {
+        for (int y = dst.mH - 1; y >= 0; y--) {
+            memmove(&mPixels[(size_t)(dst.mY + y) * mWidth + dst.mX], &mPixels[(size_t)(srcY + y) * mWidth + srcX], rowBytes);
+        }
+    }
+    MockCopy copy;
+    copy.mDst = dst;
+    copy.mSrcX = srcX;
+    copy.mSrcY = srcY;
+    for (const Client& client : mClients) {
+        client.mDamage->addCopy(copy);
+        client.mNotifier->sendNotification();
+    }
+}
+
+/**
+ * Record that @p rect has been changed, e.g. after painting it using @ref setPixelMutexLocked().
+ **/
+void MockDesktop::markDirtyMutexLocked(const MockRect& rect)
+{
+    for (const Client& client : mClients) {
+        client.mDamage->addDirty(rect);
+        client.mNotifier->sendNotification();
+    }
+}
+
+/**
+ * Register a client, all subsequent changes of the desktop are recorded in @p damage and @p
+ * notifier is notified about them.
+ **/
+void MockDesktop::addClientMutexLocked(MockDamage* damage, ThreadNotifierWriter* notifier)
+{
+    Client client;
+    client.mDamage = damage;
+    client.mNotifier = notifier;
+    mClients.push_back(client);
+}
+
+void MockDesktop::removeClientMutexLocked(MockDamage* damage)
+{
+    mClients.erase(std::remove_if(mClients.begin(), mClients.end(), [damage](const Client& client) { return client.mDamage == damage; }), mClients.end());
+}
+
+/**
+ * Paint lines of random glyphs (8x12 cells) in @p color on @p background into @p area.
+ *
+ * NOTE: Does not mark the area dirty.
+ **/
+static void paintTextMutexLocked(MockDesktop* desktop, const MockRect& area, Random* random, uint32_t color, uint32_t background)
+{
+    for (uint16_t y = area.mY; y < area.mY + area.mH; y++) {
+        for (uint16_t x = area.mX; x < area.mX + area.mW; x++) {
+            desktop->setPixelMutexLocked(x, y, background);
+        }
+    }
+    for (uint16_t cellY = area.mY; cellY + 12 <= area.mY + area.mH; cellY += 12) {
+        for (uint16_t cellX = area.mX; cellX + 8 <= area.mX + area.mW; cellX += 8) {
+            if (random->next() % 6 == 0) {
+                continue;
+            }
+            const uint32_t glyph = random->next();
+            for (uint16_t j = 0; j < 7; j++) {
+                for (uint16_t i = 0; i < 5; i++) {
+                    if ((glyph >> ((j * 5 + i) % 24)) & 1) {
+                        desktop->setPixelMutexLocked(cellX + 1 + i, cellY + 2 + j, color);
+                    }
+                }
+            }
+        }
+    }
+}
+
+static void paintGradientMutexLocked(MockDesktop* desktop)
+{
+    for (uint16_t y = 0; y < desktop->height(); y++) {
+        for (uint16_t x = 0; x < desktop->width(); x++) {
+            desktop->setPixelMutexLocked(x, y, makeRgb(40, 60 + y * 100 / desktop->height(), 120 + x * 100 / desktop->width()));
+        }
+    }
+    desktop->markDirtyMutexLocked(MockRect(0, 0, desktop->width(), desktop->height()));
+}
+
+/**
+ * Content of @ref MockScenario::Static.
+ **/
+class StaticContent : public MockContent
+{
+public:
+    void paintInitialMutexLocked(MockDesktop* desktop) override
+    {
+        paintGradientMutexLocked(desktop);
+    }
+    void paintFrameMutexLocked(MockDesktop* desktop, uint64_t frame) override
+    {
+        (void)desktop;
+        (void)frame;
+    }
+};
+
+/**
+ * Content of @ref MockScenario::Text.
+ **/
+class TextContent : public MockContent
+{
+public:
+    explicit TextContent(uint32_t seed)
+        : mRandom(seed)
+    {
+    }
+    void paintInitialMutexLocked(MockDesktop* desktop) override
+    {
+        paintTextMutexLocked(desktop, MockRect(0, 0, desktop->width(), desktop->height()), &mRandom, 0xe0e0e0, 0x202020);
+        desktop->markDirtyMutexLocked(MockRect(0, 0, desktop->width(), desktop->height()));
+    }
+    void paintFrameMutexLocked(MockDesktop* desktop, uint64_t frame) override
+    {
+        (void)frame;
+        const uint16_t areaHeight = desktop->height() - desktop->height() % 12;
+        if (areaHeight < 24) {
+            paintInitialMutexLocked(desktop);
+            return;
+        }
+        const MockRect newLine(0, areaHeight - 12, desktop->width(), 12);
+        desktop->copyRectMutexLocked(0, 12, MockRect(0, 0, desktop->width(), areaHeight - 12));
+        paintTextMutexLocked(desktop, newLine, &mRandom, 0xe0e0e0, 0x202020);
+        desktop->markDirtyMutexLocked(newLine);
+    }
+
+private:
+    Random mRandom;
+};
+
+/**
+ * Content of @ref MockScenario::Noise.
+ **/
+class NoiseContent : public MockContent
+{
+public:
+    explicit NoiseContent(uint32_t seed)
+        : mRandom(seed)
+    {
+    }
+    void paintInitialMutexLocked(MockDesktop* desktop) override
+    {
+        paintGradientMutexLocked(desktop);
+        const uint16_t w = std::max(16, desktop->width() / 2);
+        const uint16_t h = std::max(16, desktop->height() / 2);
+        mVideo = intersectRects(MockRect((desktop->width() - w) / 2, (desktop->height() - h) / 2, w, h), MockRect(0, 0, desktop->width(), desktop->height()));
+        paintFrameMutexLocked(desktop, 0);
+    }
+    void paintFrameMutexLocked(MockDesktop* desktop, uint64_t frame) override
+    {
+        // a slowly moving color pattern plus noise, similar to a camera image
+        const int phase = (int)(frame % 512);
+        for (uint16_t y = 0; y < mVideo.mH; y++) {
+            for (uint16_t x = 0; x < mVideo.mW; x++) {
+                const int noise = (int)(mRandom.next() % 49) - 24;
+                const int r = ((x + phase) % 256) / 2 + 40 + noise;
+                const int g = ((y + phase / 2) % 256) / 2 + 60 + noise;
+                const int b = 110 + noise;
+                desktop->setPixelMutexLocked(mVideo.mX + x, mVideo.mY + y, makeRgb(r, g, b));
+            }
+        }
+        desktop->markDirtyMutexLocked(mVideo);
+    }
+
+private:
+    Random mRandom;
+    MockRect mVideo;
+};
+
+/**
+ * Content of @ref MockScenario::Windows. Each window moves horizontally in a lane of its own, so
+ * windows never overlap.
+ **/
+class WindowsContent : public MockContent
+{
+public:
+    explicit WindowsContent(uint32_t seed)
+        : mRandom(seed)
+    {
+    }
+    void paintInitialMutexLocked(MockDesktop* desktop) override
+    {
+        desktop->fillRectMutexLocked(MockRect(0, 0, desktop->width(), desktop->height()), gDesktopBackground);
+        const int count = std::max(1, std::min(4, desktop->height() / 120));
+        const uint16_t laneHeight = desktop->height() / count;
+        mWindows.clear();
+        for (int i = 0; i < count; i++) {
+            Window window;
+            window.mRect.mW = std::max(32, desktop->width() / 3);
+            window.mRect.mH = std::max(32, laneHeight - 16);
+            window.mRect = intersectRects(window.mRect, MockRect(0, 0, desktop->width(), desktop->height()));
+            window.mRect.mX = (uint16_t)(mRandom.next() % std::max(1, desktop->width() - window.mRect.mW + 1));
+            window.mRect.mY = (uint16_t)std::min(laneHeight * i + 8, desktop->height() - window.mRect.mH);
+            window.mDirection = (i % 2 == 0) ? 1 : -1;
+            paintWindowMutexLocked(desktop, window.mRect);
+            mWindows.push_back(window);
+        }
+    }
+    void paintFrameMutexLocked(MockDesktop* desktop, uint64_t frame) override
+    {
+        for (Window& window : mWindows) {
+            const int maxX = desktop->width() - window.mRect.mW;
+            int x = window.mRect.mX + window.mDirection * mStep;
+            if (x < 0 || x > maxX) {
+                window.mDirection = -window.mDirection;
+                x = std::max(0, std::min(maxX, (int)window.mRect.mX + window.mDirection * mStep));
+            }
+            const MockRect old = window.mRect;
+            window.mRect.mX = (uint16_t)x;
+            desktop->copyRectMutexLocked(old.mX, old.mY, window.mRect);
+            if (window.mRect.mX > old.mX) {
+                desktop->fillRectMutexLocked(MockRect(old.mX, old.mY, window.mRect.mX - old.mX, old.mH), gDesktopBackground);
+            }
+            else if (window.mRect.mX < old.mX) {
+                desktop->fillRectMutexLocked(MockRect(window.mRect.mX + window.mRect.mW, old.mY, old.mX - window.mRect.mX, old.mH), gDesktopBackground);
+            }
+        }
+        if (mWindows.empty()) {
+            return;
+        }
+        // "type" a glyph into one of the windows, so there is some dirty content as well
+        const Window& window = mWindows[frame % mWindows.size()];
+        const uint16_t columns = window.mRect.mW / 8;
+        const uint16_t rows = (window.mRect.mH - 16) / 12;
+        if (columns > 0 && rows > 0) {
+            const MockRect cell(window.mRect.mX + 8 * (uint16_t)(mRandom.next() % columns), window.mRect.mY + 16 + 12 * (uint16_t)(mRandom.next() % rows), 8, 12);
+            paintTextMutexLocked(desktop, cell, &mRandom, 0x202020, 0xffffff);
+            desktop->markDirtyMutexLocked(cell);
+        }
+    }
+
+private:
+    void paintWindowMutexLocked(MockDesktop* desktop, const MockRect& rect)
+    {
+        const MockRect titleBar(rect.mX, rect.mY, rect.mW, std::min<uint16_t>(16, rect.mH));
+        desktop->fillRectMutexLocked(titleBar, 0x2050a0);
+        if (rect.mH > 16) {
+            const MockRect body(rect.mX, rect.mY + 16, rect.mW, rect.mH - 16);
+            paintTextMutexLocked(desktop, body, &mRandom, 0x202020, 0xffffff);
+            desktop->markDirtyMutexLocked(body);
+        }
+    }
+
+private:
+    struct Window
+    {
+        MockRect mRect;
+        int mDirection = 1;
+    };
+    static const int mStep = 8;
+    Random mRandom;
+    std::vector<Window> mWindows;
+};
+
+/**
+ * @return A new content generator for @p scenario.
+ **/
+std::unique_ptr<MockContent> MockContent::create(MockScenario scenario, uint32_t seed)
+{
+    switch (scenario) {
+        case MockScenario::Static:
+            break;
+        case MockScenario::Text:
+            return std::unique_ptr<MockContent>(new TextContent(seed));
+        case MockScenario::Noise:
+            return std::unique_ptr<MockContent>(new NoiseContent(seed));
+        case MockScenario::Windows:
+            return std::unique_ptr<MockContent>(new WindowsContent(seed));
+    }
+    return std::unique_ptr<MockContent>(new StaticContent());
+}
+
+static void writePixelFormat(char* buffer, const orv_communication_pixel_format_t& format)
+{
+    memset(buffer, 0, 16);
+    Writer::writeUInt8(buffer + 0, format.mBitsPerPixel);
+    Writer::writeUInt8(buffer + 1, format.mDepth);
+    Writer::writeUInt8(buffer + 2, format.mBigEndian ? 1 : 0);
+    Writer::writeUInt8(buffer + 3, format.mTrueColor ? 1 : 0);
+    Writer::writeUInt16(buffer + 4, format.mColorMax[0]);
+    Writer::writeUInt16(buffer + 6, format.mColorMax[1]);
+    Writer::writeUInt16(buffer + 8, format.mColorMax[2]);
+    Writer::writeUInt8(buffer + 10, format.mColorShift[0]);
+    Writer::writeUInt8(buffer + 11, format.mColorShift[1]);
+    Writer::writeUInt8(buffer + 12, format.mColorShift[2]);
+}
+
+static void readPixelFormat(orv_communication_pixel_format_t* format, const char* buffer)
+{
+    orv_communication_pixel_format_reset(format);
+    format->mBitsPerPixel = Reader::readUInt8(buffer + 0);
+    format->mDepth = Reader::readUInt8(buffer + 1);
+    format->mBigEndian = (Reader::readUInt8(buffer + 2) != 0);
+    format->mTrueColor = (Reader::readUInt8(buffer + 3) != 0);
+    format->mColorMax[0] = Reader::readUInt16(buffer + 4);
+    format->mColorMax[1] = Reader::readUInt16(buffer + 6);
+    format->mColorMax[2] = Reader::readUInt16(buffer + 8);
+    format->mColorShift[0] = Reader::readUInt8(buffer + 10);
+    format->mColorShift[1] = Reader::readUInt8(buffer + 11);
+    format->mColorShift[2] = Reader::readUInt8(buffer + 12);
+}
+
+/**
+ * @return TRUE if the encoders of syntheticencoders.h can produce pixels in @p format.
+ **/
+static bool isSupportedPixelFormat(const orv_communication_pixel_format_t& format)
+{
+    if (!format.mTrueColor || format.mBigEndian) {
+        return false;
+    }
+    if (format.mBitsPerPixel != 8 && format.mBitsPerPixel != 16 && format.mBitsPerPixel != 32) {
+        return false;
+    }
+    for (int i = 0; i < 3; i++) {
+        if (format.mColorMax[i] == 0 || format.mColorMax[i] > 255 || format.mColorShift[i] >= format.mBitsPerPixel) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool isSupportedEncoding(EncodingType encoding)
+{
+    switch (encoding) {
+        case EncodingType::Raw:
+        case EncodingType::CopyRect:
+        case EncodingType::RRE:
+        case EncodingType::CoRRE:
+        case EncodingType::Hextile:
+        case EncodingType::zlib:
+        case EncodingType::ZRLE:
+            return true;
+        default:
+            break;
+    }
+    return false;
+}
+
+/**
+ * A single client connection of a @ref MockServer, served by a thread of its own.
+ **/
+class MockConnection
+{
+public:
+    MockConnection(MockServer* server, int fd);
+    ~MockConnection();
+
+    void start();
+    void abort();
+    void join();
+    bool isFinished() const;
+
+private:
+    void run();
+    bool handshake(orv_error_t* error);
+    bool serve(orv_error_t* error);
+    bool readFully(char* buffer, size_t size, orv_error_t* error);
+    bool writeFully(const char* buffer, size_t size, orv_error_t* error);
+    bool receive(orv_error_t* error);
+    bool processMessages(orv_error_t* error);
+    void setEncodings(const char* buffer, uint16_t count);
+    bool answerRequests(uint64_t nowUs, orv_error_t* error);
+    bool encodeRect(std::vector<char>* out, const MockRect& rect, const Image& image, orv_error_t* error);
+    Image makeImageMutexLocked(const MockRect& rect) const;
+    bool flushOutput(uint64_t nowUs, orv_error_t* error);
+    int pollTimeoutMs(uint64_t nowUs) const;
+
+private:
+    struct Request
+    {
+        bool mIncremental;
+        MockRect mRegion;
+    };
+    struct OutgoingMessage
+    {
+        uint64_t mDueUs = 0;
+        std::vector<char> mData;
+        size_t mOffset = 0;
+    };
+    MockServer* mServer;
+    MockDesktop* mDesktop;
+    const MockServerOptions& mOptions;
+    int mFd;
+    std::thread mThread;
+    std::atomic<bool> mFinished;
+    ThreadNotifierWriter mNotifier;
+    ThreadNotifierListener mNotifierListener;
+    /**
+     * Changes of the desktop not yet sent to the client, protected by the mutex of @ref mDesktop.
+     **/
+    MockDamage mDamage;
+    orv_communication_pixel_format_t mPixelFormat;
+    EncodingType mEncoding = EncodingType::Raw;
+    bool mCopyRectSupported = false;
+    std::vector<char> mReceiveBuffer;
+    std::list<Request> mRequests;
+    std::list<OutgoingMessage> mOutgoing;
+    /**
+     * Number of bytes that may be sent right now, if @ref MockServerOptions::mBandwidthBytesPerSecond
+     * is set (token bucket).
+     **/
+    double mSendTokens = 0.0;
+    uint64_t mSendTokensUpdatedUs = 0;
+    bool mWaitForWritable = false;
+    ZlibStream mZlibStream;
+    ZlibStream mZrleStream;
+};
+
+MockConnection::MockConnection(MockServer* server, int fd)
+    : mServer(server),
+      mDesktop(server->desktop()),
+      mOptions(server->options()),
+      mFd(fd),
+      mFinished(false)
+{
+    ThreadNotifier::makePipe(&mNotifier, &mNotifierListener);
+    makePixelFormat(&mPixelFormat, 32);
+}
+
+MockConnection::~MockConnection()
+{
+    abort();
+    join();
+    if (mFd >= 0) {
+        ::close(mFd);
+    }
+}
+
+void MockConnection::start()
+{
+    mThread = std::thread(&MockConnection::run, this);
+}
+
+/**
+ * Make the connection thread finish soon, thread safe.
+ **/
+void MockConnection::abort()
+{
+    ::shutdown(mFd, SHUT_RDWR);
+    mNotifier.sendNotification();
+}
+
+void MockConnection::join()
+{
+    if (mThread.joinable()) {
+        mThread.join();
+    }
+}
+
+bool MockConnection::isFinished() const
+{
+    return mFinished.load();
+}
+
+void MockConnection::run()
+{
+    orv_error_t error;
+    orv_error_reset(&error);
+    mServer->mActiveConnections++;
+    if (handshake(&error)) {
+        {
+            std::lock_guard<std::mutex> lock(mDesktop->mutex());
+            mDesktop->addClientMutexLocked(&mDamage, &mNotifier);
+        }
+        serve(&error);
+        {
+            std::lock_guard<std::mutex> lock(mDesktop->mutex());
+            mDesktop->removeClientMutexLocked(&mDamage);
+        }
+    }
+    if (error.mHasError && error.mErrorCode != ORV_ERR_CLOSED_BY_REMOTE && !mServer->isStopping()) {
+        fprintf(stderr, "Mock server: connection closed: %s\n", error.mErrorMessage);
+    }
+    mServer->mActiveConnections--;
+    mFinished = true;
+}
+
+bool MockConnection::readFully(char* buffer, size_t size, orv_error_t* error)
+{
+    size_t offset = 0;
+    while (offset < size) {
+        if (mServer->isStopping()) {
+            orv_error_set(error, ORV_ERR_USER_INTERRUPTION, 0, "Server is stopping");
+            return false;
+        }
+        struct pollfd pfd = {};
+        pfd.fd = mFd;
+        pfd.events = POLLIN;
+        if (poll(&pfd, 1, 100) <= 0) {
+            continue;
+        }
+        const ssize_t n = recv(mFd, buffer + offset, size - offset, 0);
+        if (n == 0) {
+            orv_error_set(error, ORV_ERR_CLOSED_BY_REMOTE, 0, "Connection closed by client");
+            return false;
+        }
+        if (n < 0) {
+            if (errno == EINTR || errno == EAGAIN) {
+                continue;
+            }
+            orv_error_set(error, ORV_ERR_READ_FAILED, errno, "recv() failed with errno=%d", errno);
+            return false;
+        }
+        offset += (size_t)n;
+        mServer->mReceivedBytes += (uint64_t)n;
+    }
+    return true;
+}
+
+bool MockConnection::writeFully(const char* buffer, size_t size, orv_error_t* error)
+{
+    size_t offset = 0;
+    while (offset < size) {
+        const ssize_t n = send(mFd, buffer + offset, size - offset, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            orv_error_set(error, ORV_ERR_WRITE_FAILED, errno, "send() failed with errno=%d", errno);
+            return false;
+        }
+        offset += (size_t)n;
+        mServer->mSentBytes += (uint64_t)n;
+    }
+    return true;
+}
+
+/**
+ * Perform the protocol version and security handshake and the initialization messages.
+ *
+ * NOTE: The handshake is not affected by the bandwidth and latency options.
+ **/
+bool MockConnection::handshake(orv_error_t* error)
+{
+    const int offeredMinor = (mOptions.mProtocolMinorVersion >= 8) ? 8 : ((mOptions.mProtocolMinorVersion >= 7) ? 7 : 3);
+    char version[13];
+    snprintf(version, sizeof(version), "RFB 003.%03d\n", offeredMinor);
+    if (!writeFully(version, 12, error)) {
+        return false;
+    }
+    char clientVersion[13] = {};
+    if (!readFully(clientVersion, 12, error)) {
+        return false;
+    }
+    int major = 0;
+    int minor = 0;
+    if (sscanf(clientVersion, "RFB %03d.%03d\n", &major, &minor) != 2 || major != 3) {
+        orv_error_set(error, ORV_ERR_PROTOCOL_ERROR, 0, "Invalid protocol version received from client");
+        return false;
+    }
+    minor = (minor >= 8) ? 8 : ((minor >= 7) ? 7 : 3);
+    minor = std::min(minor, offeredMinor);
+
+    const uint8_t securityTypeNone = 1;
+    if (minor == 3) {
+        char buffer[4];
+        Writer::writeUInt32(buffer, securityTypeNone);
+        if (!writeFully(buffer, 4, error)) {
+            return false;
+        }
+    }
+    else {
+        const char types[2] = { 1, (char)securityTypeNone };
+        if (!writeFully(types, 2, error)) {
+            return false;
+        }
+        char selected = 0;
+        if (!readFully(&selected, 1, error)) {
+            return false;
+        }
+        if ((uint8_t)selected != securityTypeNone) {
+            orv_error_set(error, ORV_ERR_PROTOCOL_ERROR, 0, "Client selected unsupported security type %d", (int)(uint8_t)selected);
+            return false;
+        }
+        if (minor == 8) {
+            char result[4];
+            Writer::writeUInt32(result, 0);
+            if (!writeFully(result, 4, error)) {
+                return false;
+            }
+        }
+    }
+
+    char sharedFlag = 0;
+    if (!readFully(&sharedFlag, 1, error)) {
+        return false;
+    }
+    std::vector<char> serverInit(24 + mOptions.mDesktopName.size());
+    Writer::writeUInt16(serverInit.data() + 0, mDesktop->width());
+    Writer::writeUInt16(serverInit.data() + 2, mDesktop->height());
+    writePixelFormat(serverInit.data() + 4, mPixelFormat);
+    Writer::writeUInt32(serverInit.data() + 20, (uint32_t)mOptions.mDesktopName.size());
+    memcpy(serverInit.data() + 24, mOptions.mDesktopName.data(), mOptions.mDesktopName.size());
+    return writeFully(serverInit.data(), serverInit.size(), error);
+}
+
+bool MockConnection::serve(orv_error_t* error)
+{
+    mSendTokensUpdatedUs = Utils::getTimestampUs();
+    while (!mServer->isStopping()) {
+        uint64_t nowUs = Utils::getTimestampUs();
+        if (!flushOutput(nowUs, error)) {
+            return false;
+        }
+        struct pollfd fds[2] = {};
+        fds[0].fd = mFd;
+        fds[0].events = POLLIN | (mWaitForWritable ? POLLOUT : 0);
+        fds[1].fd = mNotifierListener.pipeReadFd();
+        fds[1].events = POLLIN;
+        const int ret = poll(fds, 2, pollTimeoutMs(nowUs));
+        if (ret < 0 && errno != EINTR) {
+            orv_error_set(error, ORV_ERR_GENERIC, errno, "poll() failed with errno=%d", errno);
+            return false;
+        }
+        if (fds[1].revents & POLLIN) {
+            mNotifierListener.swallowPipeData();
+        }
+        if (fds[0].revents & POLLOUT) {
+            mWaitForWritable = false;
+        }
+        if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+            if (!receive(error) || !processMessages(error)) {
+                return false;
+            }
+        }
+        nowUs = Utils::getTimestampUs();
+        if (!answerRequests(nowUs, error)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool MockConnection::receive(orv_error_t* error)
+{
+    const size_t chunkSize = 64 * 1024;
+    const size_t offset = mReceiveBuffer.size();
+    mReceiveBuffer.resize(offset + chunkSize);
+    const ssize_t n = recv(mFd, mReceiveBuffer.data() + offset, chunkSize, MSG_DONTWAIT);
+    if (n <= 0) {
+        mReceiveBuffer.resize(offset);
+        if (n == 0) {
+            orv_error_set(error, ORV_ERR_CLOSED_BY_REMOTE, 0, "Connection closed by client");
+            return false;
+        }
+        if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK) {
+            return true;
+        }
+        orv_error_set(error, ORV_ERR_READ_FAILED, errno, "recv() failed with errno=%d", errno);
+        return false;
+    }
+    mReceiveBuffer.resize(offset + (size_t)n);
+    mServer->mReceivedBytes += (uint64_t)n;
+    return true;
+}
+
+/**
+ * Handle all complete client messages in @ref mReceiveBuffer.
+ **/
+bool MockConnection::processMessages(orv_error_t* error)
+{
+    size_t offset = 0;
+    while (offset < mReceiveBuffer.size()) {
+        const char* message = mReceiveBuffer.data() + offset;
+        const size_t available = mReceiveBuffer.size() - offset;
+        size_t messageSize = 0;
+        const uint8_t type = Reader::readUInt8(message);
+        switch (type) {
+            case 0: // SetPixelFormat
+            {
+                messageSize = 20;
+                if (available < messageSize) {
+                    break;
+                }
+                orv_communication_pixel_format_t format;
+                readPixelFormat(&format, message + 4);
+                if (!isSupportedPixelFormat(format)) {
+                    orv_error_set(error, ORV_ERR_PROTOCOL_ERROR, 0, "Unsupported pixel format requested by client (only little endian true color formats with 8, 16 or 32 bits per pixel are supported)");
+                    return false;
+                }
+                orv_communication_pixel_format_copy(&mPixelFormat, &format);
+                break;
+            }
+            case 2: // SetEncodings
+                messageSize = 4;
+                if (available < messageSize) {
+                    break;
+                }
+                messageSize += 4 * (size_t)Reader::readUInt16(message + 2);
+                if (available < messageSize) {
+                    break;
+                }
+                setEncodings(message + 4, Reader::readUInt16(message + 2));
+                break;
+            case 3: // FramebufferUpdateRequest
+            {
+                messageSize = 10;
+                if (available < messageSize) {
+                    break;
+                }
+                Request request;
+                request.mIncremental = (Reader::readUInt8(message + 1) != 0);
+                request.mRegion = intersectRects(MockRect(Reader::readUInt16(message + 2), Reader::readUInt16(message + 4), Reader::readUInt16(message + 6), Reader::readUInt16(message + 8)), MockRect(0, 0, mDesktop->width(), mDesktop->height()));
+                if (!request.mIncremental) {
+                    std::lock_guard<std::mutex> lock(mDesktop->mutex());
+                    mDamage.addDirty(request.mRegion);
+                }
+                mRequests.push_back(request);
+                break;
+            }
+            case 4: // KeyEvent
+                messageSize = 8;
+                break;
+            case 5: // PointerEvent
+                messageSize = 6;
+                break;
+            case 6: // ClientCutText
+                messageSize = 8;
+                if (available < messageSize) {
+                    break;
+                }
+                if (Reader::readUInt32(message + 4) > gMaxClientCutTextLength) {
+                    orv_error_set(error, ORV_ERR_PROTOCOL_ERROR, 0, "ClientCutText message too large");
+                    return false;
+                }
+                messageSize += Reader::readUInt32(message + 4);
+                break;
+            default:
+                orv_error_set(error, ORV_ERR_PROTOCOL_ERROR, 0, "Unsupported client message type %d", (int)type);
+                return false;
+        }
+        if (available < messageSize) {
+            break;
+        }
+        offset += messageSize;
+    }
+    mReceiveBuffer.erase(mReceiveBuffer.begin(), mReceiveBuffer.begin() + offset);
+    return true;
+}
+
+/**
+ * Select the encoding for subsequent updates: the first encoding in the list of the client that
+ * is enabled in @ref MockServerOptions::mEncodings, or Raw.
+ **/
+void MockConnection::setEncodings(const char* buffer, uint16_t count)
+{
+    mEncoding = EncodingType::Raw;
+    mCopyRectSupported = false;
+    bool haveEncoding = false;
+    for (uint16_t i = 0; i < count; i++) {
+        const EncodingType encoding = (EncodingType)Reader::readInt32(buffer + 4 * i);
+        if (!isSupportedEncoding(encoding) || std::find(mOptions.mEncodings.begin(), mOptions.mEncodings.end(), encoding) == mOptions.mEncodings.end()) {
+            continue;
+        }
+        if (encoding == EncodingType::CopyRect) {
+            mCopyRectSupported = true;
+        }
+        else if (!haveEncoding) {
+            mEncoding = encoding;
+            haveEncoding = true;
+        }
+    }
+}
+
+/**
+ * @return The pixels of @p rect of the desktop in the pixel format of the client.
+ **/
+Image MockConnection::makeImageMutexLocked(const MockRect& rect) const
+{
+    Image image;
+    image.mWidth = rect.mW;
+    image.mHeight = rect.mH;
+    image.mPixels.resize((size_t)rect.mW * rect.mH);
+    const bool isRgb888 = mPixelFormat.mBitsPerPixel == 32 &&
+            mPixelFormat.mColorMax[0] == 255 && mPixelFormat.mColorMax[1] == 255 && mPixelFormat.mColorMax[2] == 255 &&
+            mPixelFormat.mColorShift[0] == 16 && mPixelFormat.mColorShift[1] == 8 && mPixelFormat.mColorShift[2] == 0;
+    for (uint16_t y = 0; y < rect.mH; y++) {
+        for (uint16_t x = 0; x < rect.mW; x++) {
+            const uint32_t rgb = mDesktop->pixelMutexLocked(rect.mX + x, rect.mY + y);
+            image.mPixels[(size_t)y * rect.mW + x] = isRgb888 ? rgb : toPixel(mPixelFormat, (uint8_t)(rgb >> 16), (uint8_t)(rgb >> 8), (uint8_t)rgb);
+        }
+    }
+    return image;
+}
+
+bool MockConnection::encodeRect(std::vector<char>* out, const MockRect& rect, const Image& image, orv_error_t* error)
+{
+    char header[12];
+    Writer::writeUInt16(header + 0, rect.mX);
+    Writer::writeUInt16(header + 2, rect.mY);
+    Writer::writeUInt16(header + 4, rect.mW);
+    Writer::writeUInt16(header + 6, rect.mH);
+    Writer::writeInt32(header + 8, (int32_t)mEncoding);
+    out->insert(out->end(), header, header + 12);
+    bool ok = true;
+    switch (mEncoding) {
+        case EncodingType::RRE:
+            encodeRRE(out, image, mPixelFormat, false);
+            break;
+        case EncodingType::CoRRE:
+            encodeRRE(out, image, mPixelFormat, true);
+            break;
+        case EncodingType::Hextile:
+            encodeHextile(out, image, mPixelFormat);
+            break;
+        case EncodingType::zlib:
+            ok = encodeZlib(out, image, mPixelFormat, &mZlibStream);
+            break;
+        case EncodingType::ZRLE:
+            ok = encodeZRLE(out, image, mPixelFormat, &mZrleStream);
+            break;
+        default:
+            encodeRaw(out, image, mPixelFormat);
+            break;
+    }
+    if (!ok) {
+        orv_error_set(error, ORV_ERR_GENERIC, 0, "Failed to compress rect data");
+    }
+    return ok;
+}
+
+/**
+ * Answer the pending update requests in order, as long as there are changes in the requested
+ * regions.
+ *
+ * An incremental request without changes does not block the requests queued behind it: like
+ * common servers (which maintain a single requested region), its region is merged into the next
+ * request.
+ **/
+bool MockConnection::answerRequests(uint64_t nowUs, orv_error_t* error)
+{
+    while (!mRequests.empty()) {
+        const Request request = mRequests.front();
+        std::vector<MockCopy> copies;
+        std::vector<MockRect> dirty;
+        std::vector<Image> images;
+        {
+            std::lock_guard<std::mutex> lock(mDesktop->mutex());
+            if (request.mIncremental && !mDamage.intersects(request.mRegion)) {
+                if (mRequests.size() == 1) {
+                    break;
+                }
+                mRequests.pop_front();
+                if (!request.mRegion.isEmpty()) {
+                    Request& next = mRequests.front();
+                    next.mRegion = next.mRegion.isEmpty() ? request.mRegion : boundingRect(next.mRegion, request.mRegion);
+                }
+                continue;
+            }
+            if (!mCopyRectSupported) {
+                mDamage.convertCopiesToDirty();
+            }
+            std::vector<MockRect> rects;
+            mDamage.take(request.mRegion, &copies, &rects);
+            for (const MockRect& rect : rects) {
+                if (mEncoding != EncodingType::CoRRE) {
+                    dirty.push_back(rect);
+                    continue;
+                }
+                // CoRRE uses 8 bit coordinates in the subrects, so the rects must be split
+                for (uint16_t y = 0; y < rect.mH; y += 255) {
+                    for (uint16_t x = 0; x < rect.mW; x += 255) {
+                        dirty.push_back(MockRect(rect.mX + x, rect.mY + y, std::min<uint16_t>(255, rect.mW - x), std::min<uint16_t>(255, rect.mH - y)));
+                    }
+                }
+            }
+            for (const MockRect& rect : dirty) {
+                images.push_back(makeImageMutexLocked(rect));
+            }
+        }
+        mRequests.pop_front();
+
+        OutgoingMessage message;
+        message.mDueUs = nowUs + (uint64_t)mOptions.mLatencyMs * 1000;
+        message.mData.resize(4);
+        Writer::writeUInt8(message.mData.data() + 0, 0); // FramebufferUpdate
+        Writer::writeUInt8(message.mData.data() + 1, 0);
+        Writer::writeUInt16(message.mData.data() + 2, (uint16_t)(copies.size() + dirty.size()));
+        for (const MockCopy& copy : copies) {
+            char header[12];
+            Writer::writeUInt16(header + 0, copy.mDst.mX);
+            Writer::writeUInt16(header + 2, copy.mDst.mY);
+            Writer::writeUInt16(header + 4, copy.mDst.mW);
+            Writer::writeUInt16(header + 6, copy.mDst.mH);
+            Writer::writeInt32(header + 8, (int32_t)EncodingType::CopyRect);
+            message.mData.insert(message.mData.end(), header, header + 12);
+            encodeCopyRect(&message.mData, copy.mSrcX, copy.mSrcY);
+        }
+        for (size_t i = 0; i < dirty.size(); i++) {
+            if (!encodeRect(&message.mData, dirty[i], images[i], error)) {
+                return false;
+            }
+        }
+        mOutgoing.push_back(std::move(message));
+        mServer->mUpdates++;
+        mServer->mRects += copies.size() + dirty.size();
+        mServer->mCopyRects += copies.size();
+    }
+    return true;
+}
+
+/**
+ * Send as much of the queued messages as the latency and bandwidth options allow.
+ **/
+bool MockConnection::flushOutput(uint64_t nowUs, orv_error_t* error)
+{
+    const uint64_t bandwidth = mOptions.mBandwidthBytesPerSecond;
+    if (bandwidth > 0) {
+        // allow bursts of up to 20ms worth of data
+        const double maxTokens = std::max(1500.0, (double)bandwidth / 50.0);
+        mSendTokens = std::min(maxTokens, mSendTokens + (double)(nowUs - mSendTokensUpdatedUs) * (double)bandwidth / 1000000.0);
+        mSendTokensUpdatedUs = nowUs;
+    }
+    while (!mOutgoing.empty() && !mWaitForWritable) {
+        OutgoingMessage& message = mOutgoing.front();
+        if (message.mDueUs > nowUs) {
+            break;
+        }
+        size_t size = message.mData.size() - message.mOffset;
+        if (bandwidth > 0) {
+            if (mSendTokens < 1.0) {
+                break;
+            }
+            size = std::min(size, (size_t)mSendTokens);
+        }
+        const ssize_t n = send(mFd, message.mData.data() + message.mOffset, size, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                mWaitForWritable = true;
+                break;
+            }
+            orv_error_set(error, ORV_ERR_WRITE_FAILED, errno, "send() failed with errno=%d", errno);
+            return false;
+        }
+        message.mOffset += (size_t)n;
+        mSendTokens -= (double)n;
+        mServer->mSentBytes += (uint64_t)n;
+        if (message.mOffset == message.mData.size()) {
+            mOutgoing.pop_front();
+        }
+    }
+    return true;
+}
+
+/**
+ * @return The time until the next queued message may be sent, at most 100ms so that @ref
+ *         MockServer::stop() is noticed.
+ **/
+int MockConnection::pollTimeoutMs(uint64_t nowUs) const
+{
+    int timeoutMs = 100;
+    if (mOutgoing.empty() || mWaitForWritable) {
+        return timeoutMs;
+    }
+    const OutgoingMessage& message = mOutgoing.front();
+    uint64_t waitUs = 0;
+    if (message.mDueUs > nowUs) {
+        waitUs = message.mDueUs - nowUs;
+    }
+    else if (mOptions.mBandwidthBytesPerSecond > 0 && mSendTokens < 1500.0) {
+        waitUs = (uint64_t)((1500.0 - mSendTokens) * 1000000.0 / (double)mOptions.mBandwidthBytesPerSecond);
+    }
+    return std::min(timeoutMs, (int)((waitUs + 999) / 1000));
+}
+
+MockServer::MockServer(const MockServerOptions& options)
+    : mOptions(options),
+      mDesktop(options.mWidth, options.mHeight),
+      mContent(MockContent::create(options.mScenario, options.mSeed)),
+      mStopping(false),
+      mActiveConnections(0),
+      mTotalConnections(0),
+      mFrames(0),
+      mUpdates(0),
+      mRects(0),
+      mCopyRects(0),
+      mSentBytes(0),
+      mReceivedBytes(0)
+{
+    ThreadNotifier::makePipe(&mStopNotifier, &mStopListener);
+}
+
+MockServer::~MockServer()
+{
+    stop();
+    reapConnections(true);
+    if (mListenFd >= 0) {
+        ::close(mListenFd);
+    }
+    if (mUnixListenFd >= 0) {
+        ::close(mUnixListenFd);
+        unlink(mUnixSocketPath.c_str());
+    }
+}
+
+bool parseMockScenario(MockScenario* scenario, const char* name)
+{
+    if (strcmp(name, "static") == 0) {
+        *scenario = MockScenario::Static;
+    }
+    else if (strcmp(name, "text") == 0) {
+        *scenario = MockScenario::Text;
+    }
+    else if (strcmp(name, "noise") == 0) {
+        *scenario = MockScenario::Noise;
+    }
+    else if (strcmp(name, "windows") == 0) {
+        *scenario = MockScenario::Windows;
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Start listening on the TCP port of the options.
+ **/
+bool MockServer::listen(orv_error_t* error)
+{
+    struct sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(mOptions.mPort);
+    if (inet_pton(AF_INET, mOptions.mListenAddress.c_str(), &address.sin_addr) != 1) {
+        orv_error_set(error, ORV_ERR_GENERIC, 0, "Invalid listen address '%s'", mOptions.mListenAddress.c_str());
+        return false;
+    }
+    mListenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (mListenFd < 0) {
+        orv_error_set(error, ORV_ERR_GENERIC, errno, "socket() failed with errno=%d", errno);
+        return false;
+    }
+    int reuse = 1;
+    setsockopt(mListenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if (bind(mListenFd, (struct sockaddr*)&address, sizeof(address)) != 0 || ::listen(mListenFd, 16) != 0) {
+        orv_error_set(error, ORV_ERR_GENERIC, errno, "Failed to listen on %s:%d, errno=%d", mOptions.mListenAddress.c_str(), (int)mOptions.mPort, errno);
+        ::close(mListenFd);
+        mListenFd = -1;
+        return false;
+    }
+    socklen_t addressLength = sizeof(address);
+    getsockname(mListenFd, (struct sockaddr*)&address, &addressLength);
+    mPort = ntohs(address.sin_port);
+    return true;
+}
+
+/**
+ * Start listening on the unix domain socket @p path, in addition to the TCP port (if @ref
+ * listen() is called as well). An existing file @p path is replaced, the socket file is removed
+ * again when the server is destroyed.
+ **/
+bool MockServer::listenUnixSocket(const char* path, orv_error_t* error)
+{
+    struct sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (strlen(path) == 0 || strlen(path) >= sizeof(address.sun_path)) {
+        orv_error_set(error, ORV_ERR_GENERIC, 0, "Invalid unix socket path '%s'", path);
+        return false;
+    }
+    strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+    mUnixListenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (mUnixListenFd < 0) {
+        orv_error_set(error, ORV_ERR_GENERIC, errno, "socket() failed with errno=%d", errno);
+        return false;
+    }
+    unlink(path);
+    if (bind(mUnixListenFd, (struct sockaddr*)&address, sizeof(address)) != 0 || ::listen(mUnixListenFd, 16) != 0) {
+        orv_error_set(error, ORV_ERR_GENERIC, errno, "Failed to listen on unix socket %s, errno=%d", path, errno);
+        ::close(mUnixListenFd);
+        mUnixListenFd = -1;
+        return false;
+    }
+    mUnixSocketPath = path;
+    return true;
+}
+
+/**
+ * Start accepting in-process connections to the memory pipe @p name (see @ref
+ * ORV_TRANSPORT_MEMORY_PIPE), in addition to the other listeners.
+ **/
+bool MockServer::listenMemoryPipe(const char* name, orv_error_t* error)
+{
+    mMemoryPipeListener.reset(MemoryPipeListener::listen(name, error));
+    return mMemoryPipeListener != nullptr;
+}
+
+/**
+ * Paint the frames of the content and accept connections (if any of the listen functions was
+ * called) until @ref stop() is called. All connections are closed before this function returns.
+ *
+ * NOTE: The memory pipe listener cannot be polled, it is checked at least every 10ms.
+ **/
+void MockServer::run()
+{
+    {
+        std::lock_guard<std::mutex> lock(mDesktop.mutex());
+        mContent->paintInitialMutexLocked(&mDesktop);
+    }
+    const uint64_t frameIntervalUs = (mOptions.mFramesPerSecond > 0.0) ? (uint64_t)(1000000.0 / mOptions.mFramesPerSecond) : 0;
+    uint64_t nextFrameUs = Utils::getTimestampUs() + frameIntervalUs;
+    while (!mStopping.load()) {
+        uint64_t nowUs = Utils::getTimestampUs();
+        if (frameIntervalUs > 0 && nowUs >= nextFrameUs) {
+            {
+                std::lock_guard<std::mutex> lock(mDesktop.mutex());
+                mContent->paintFrameMutexLocked(&mDesktop, mFrames.load() + 1);
+            }
+            mFrames++;
+            nextFrameUs += frameIntervalUs;
+            if (nextFrameUs < nowUs) {
+                // too slow to keep up, drop the frames instead of painting them in a burst
+                nextFrameUs = nowUs + frameIntervalUs;
+            }
+        }
+        int timeoutMs = mMemoryPipeListener ? 10 : 100;
+        if (frameIntervalUs > 0) {
+            nowUs = Utils::getTimestampUs();
+            timeoutMs = (nextFrameUs > nowUs) ? std::min(timeoutMs, (int)((nextFrameUs - nowUs + 999) / 1000)) : 0;
+        }
+        // NOTE: a negative fd is ignored by poll()
+        struct pollfd fds[3] = {};
+        fds[0].fd = mStopListener.pipeReadFd();
+        fds[0].events = POLLIN;
+        fds[1].fd = mListenFd;
+        fds[1].events = POLLIN;
+        fds[2].fd = mUnixListenFd;
+        fds[2].events = POLLIN;
+        poll(fds, 3, timeoutMs);
+        if (fds[0].revents & POLLIN) {
+            mStopListener.swallowPipeData();
+        }
+        if (mListenFd >= 0 && (fds[1].revents & POLLIN)) {
+            const int fd = accept(mListenFd, nullptr, nullptr);
+            if (fd >= 0) {
+                int noDelay = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+                serveConnection(fd);
+            }
+        }
+        if (mUnixListenFd >= 0 && (fds[2].revents & POLLIN)) {
+            const int fd = accept(mUnixListenFd, nullptr, nullptr);
+            if (fd >= 0) {
+                serveConnection(fd);
+            }
+        }
+        if (mMemoryPipeListener) {
+            int fd = mMemoryPipeListener->acceptConnection(0);
+            while (fd >= 0) {
+                serveConnection(fd);
+                fd = mMemoryPipeListener->acceptConnection(0);
+            }
+        }
+        reapConnections(false);
+    }
+    reapConnections(true);
+}
+
+/**
+ * Make @ref run() return, thread safe.
+ **/
+void MockServer::stop()
+{
+    mStopping = true;
+    mStopNotifier.sendNotification();
+}
+
+/**
+ * Serve the RFB protocol on the connected socket @p fd in a new thread. The server takes
+ * ownership of @p fd.
+ **/
+void MockServer::serveConnection(int fd)
+{
+    mTotalConnections++;
+    std::unique_ptr<MockConnection> connection(new MockConnection(this, fd));
+    connection->start();
+    std::lock_guard<std::mutex> lock(mConnectionsMutex);
+    mConnections.push_back(std::move(connection));
+}
+
+/**
+ * Replace the content generator of the scenario in the options. Must be called before @ref run().
+ **/
+void MockServer::setContent(std::unique_ptr<MockContent> content)
+{
+    mContent = std::move(content);
+}
+
+MockServerStatistics MockServer::statistics() const
+{
+    MockServerStatistics statistics;
+    statistics.mActiveConnections = mActiveConnections.load();
+    statistics.mConnections = mTotalConnections.load();
+    statistics.mFrames = mFrames.load();
+    statistics.mUpdates = mUpdates.load();
+    statistics.mRects = mRects.load();
+    statistics.mCopyRects = mCopyRects.load();
+    statistics.mSentBytes = mSentBytes.load();
+    statistics.mReceivedBytes = mReceivedBytes.load();
+    return statistics;
+}
+
+/**
+ * Delete finished connections, or all connections if @p all is TRUE.
+ **/
+void MockServer::reapConnections(bool all)
+{
+    std::list<std::unique_ptr<MockConnection>> finished;
+    {
+        std::lock_guard<std::mutex> lock(mConnectionsMutex);
+        for (auto it = mConnections.begin(); it != mConnections.end(); ) {
+            if (all || (*it)->isFinished()) {
+                finished.push_back(std::move(*it));
+                it = mConnections.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+    }
+    // NOTE: destructor aborts and joins the connection thread
+    finished.clear();
+}
+
+} // namespace bench
+} // namespace openrv
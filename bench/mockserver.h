@@ -0,0 +1,360 @@
+/*
+ * Copyright (C) 2018 Monument-Software GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OPENRV_BENCH_MOCKSERVER_H
+#define OPENRV_BENCH_MOCKSERVER_H
+
+#include "rfbtypes.h"
+#include "threadnotifier.h"
+
+#include <stdint.h>
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct orv_error_t;
+
+namespace openrv {
+class MemoryPipeListener;
+}
+
+/**
+ * @file mockserver.h
+ *
+ * A small RFB server that serves synthetic content, meant for end-to-end load tests of the
+ * library on the local machine (see the orv_mockserver tool).
+ *
+ * The server supports the protocol versions 3.3, 3.7 and 3.8 with security type "None" and the
+ * encodings the library decodes (Raw, CopyRect, RRE, CoRRE, Hextile, zlib and ZRLE), using the
+ * encoders of syntheticencoders.h. Frame rate, bandwidth and latency of the server can be limited
+ * to emulate real servers and networks.
+ **/
+
+namespace openrv {
+namespace bench {
+
+enum class MockScenario
+{
+    /**
+     * The desktop does not change at all, only explicit paints (see @ref MockDesktop) are sent.
+     **/
+    Static,
+    /**
+     * A terminal-like text area that scrolls by one line per frame, i.e. one large CopyRect and
+     * a small dirty rect per frame.
+     **/
+    Text,
+    /**
+     * A video window that is repainted with noisy content on every frame, i.e. a large dirty
+     * rect that compresses badly.
+     **/
+    Noise,
+    /**
+     * Several windows that move across the desktop, i.e. many CopyRects with small exposed
+     * areas.
+     **/
+    Windows,
+};
+
+struct MockRect
+{
+    MockRect() = default;
+    MockRect(uint16_t x, uint16_t y, uint16_t w, uint16_t h)
+        : mX(x),
+          mY(y),
+          mW(w),
+          mH(h)
+    {
+    }
+    bool isEmpty() const
+    {
+        return mW == 0 || mH == 0;
+    }
+    uint16_t mX = 0;
+    uint16_t mY = 0;
+    uint16_t mW = 0;
+    uint16_t mH = 0;
+};
+
+/**
+ * A CopyRect operation: the area @p mDst was copied from @p mSrcX, @p mSrcY.
+ **/
+struct MockCopy
+{
+    MockRect mDst;
+    uint16_t mSrcX = 0;
+    uint16_t mSrcY = 0;
+};
+
+/**
+ * The changes of the desktop that have not yet been sent to a client.
+ *
+ * Copies are kept as CopyRects as long as the client can still apply them in order, i.e. as long
+ * as (part of) their source area is not covered by a pending dirty rect. The parts of the
+ * destination whose source is covered are treated as dirty.
+ **/
+class MockDamage
+{
+public:
+    void clear();
+    bool isEmpty() const;
+    void addDirty(const MockRect& rect);
+    void addCopy(const MockCopy& copy);
+    void convertCopiesToDirty();
+    bool intersects(const MockRect& region) const;
+    void take(const MockRect& region, std::vector<MockCopy>* copies, std::vector<MockRect>* dirty);
+
+private:
+    std::vector<MockCopy> mCopies;
+    std::vector<MockRect> mDirty;
+};
+
+/**
+ * The framebuffer of the mock server, shared by all connections.
+ *
+ * Pixels are stored as 0x00RRGGBB. All changes are made with @ref mutex() locked using the
+ * *MutexLocked() functions, which record the changes in the @ref MockDamage of all clients and
+ * wake them up, so that pending update requests are answered immediately.
+ **/
+class MockDesktop
+{
+public:
+    MockDesktop(uint16_t width, uint16_t height);
+    MockDesktop(const MockDesktop&) = delete;
+    MockDesktop& operator=(const MockDesktop&) = delete;
+
+    uint16_t width() const;
+    uint16_t height() const;
+    std::mutex& mutex();
+
+    uint32_t pixelMutexLocked(uint16_t x, uint16_t y) const;
+    void setPixelMutexLocked(uint16_t x, uint16_t y, uint32_t rgb);
+    void fillRectMutexLocked(const MockRect& rect, uint32_t rgb);
+    void copyRectMutexLocked(uint16_t srcX, uint16_t srcY, const MockRect& dst);
+    void markDirtyMutexLocked(const MockRect& rect);
+
+    void addClientMutexLocked(MockDamage* damage, ThreadNotifierWriter* notifier);
+    void removeClientMutexLocked(MockDamage* damage);
+
+private:
+    struct Client
+    {
+        MockDamage* mDamage;
+        ThreadNotifierWriter* mNotifier;
+    };
+    const uint16_t mWidth;
+    const uint16_t mHeight;
+    mutable std::mutex mMutex;
+    std::vector<uint32_t> mPixels;
+    std::vector<Client> mClients;
+};
+
+/**
+ * Generator of the synthetic content of a @ref MockDesktop. @ref paintFrame() is called by @ref
+ * MockServer::run() once per frame.
+ **/
+class MockContent
+{
+public:
+    virtual ~MockContent() = default;
+    virtual void paintInitialMutexLocked(MockDesktop* desktop) = 0;
+    virtual void paintFrameMutexLocked(MockDesktop* desktop, uint64_t frame) = 0;
+
+    static std::unique_ptr<MockContent> create(MockScenario scenario, uint32_t seed);
+};
+
+struct MockServerOptions
+{
+    /**
+     * Address to listen on, "0.0.0.0" to accept connections from other hosts.
+     **/
+    std::string mListenAddress = "127.0.0.1";
+    /**
+     * TCP port to listen on, 0 to use any free port (see @ref MockServer::port()).
+     **/
+    uint16_t mPort = 5900;
+    /**
+     * The minor version of the highest protocol version offered to clients (3, 7 or 8).
+     **/
+    int mProtocolMinorVersion = 8;
+    uint16_t mWidth = 1280;
+    uint16_t mHeight = 720;
+    MockScenario mScenario = MockScenario::Text;
+    uint32_t mSeed = 1;
+    /**
+     * Number of frames of the @ref mScenario per second. 0 to never change the desktop
+     * automatically.
+     **/
+    double mFramesPerSecond = 30.0;
+    /**
+     * Maximum number of bytes per second sent to each client, 0 for no limit.
+     **/
+    uint64_t mBandwidthBytesPerSecond = 0;
+    /**
+     * Delay of each message sent to the client in milliseconds, i.e. the artificial latency a
+     * client observes on top of the actual round trip time.
+     **/
+    uint32_t mLatencyMs = 0;
+    /**
+     * The encodings the server may use in addition to Raw. The first encoding in the SetEncodings
+     * message of the client that is also in this list is used.
+     **/
+    std::vector<vnc::EncodingType> mEncodings = { vnc::EncodingType::CopyRect, vnc::EncodingType::ZRLE, vnc::EncodingType::Hextile, vnc::EncodingType::zlib, vnc::EncodingType::CoRRE, vnc::EncodingType::RRE };
+    std::string mDesktopName = "OpenRV mock server";
+};
+
+/**
+ * Totals of all connections of a @ref MockServer.
+ **/
+struct MockServerStatistics
+{
+    uint64_t mActiveConnections = 0;
+    uint64_t mConnections = 0;
+    uint64_t mFrames = 0;
+    uint64_t mUpdates = 0;
+    uint64_t mRects = 0;
+    uint64_t mCopyRects = 0;
+    uint64_t mSentBytes = 0;
+    uint64_t mReceivedBytes = 0;
+};
+
+class MockConnection;
+
+/**
+ * Parse the scenario @p name ("static", "text", "noise" or "windows") into @p scenario.
+ *
+ * @return TRUE on success, FALSE if @p name is unknown.
+ **/
+bool parseMockScenario(MockScenario* scenario, const char* name);
+
+/**
+ * The mock RFB server.
+ *
+ * Call @ref listen() to accept TCP connections, @ref listenUnixSocket() to accept unix domain
+ * socket connections and/or @ref listenMemoryPipe() to accept in-process connections, then @ref
+ * run() to serve them until @ref stop() is called. Connections made by other means can be added
+ * using @ref serveConnection(). Each connection is served by a thread of its own.
+ **/
+class MockServer
+{
+public:
+    explicit MockServer(const MockServerOptions& options);
+    ~MockServer();
+    MockServer(const MockServer&) = delete;
+    MockServer& operator=(const MockServer&) = delete;
+
+    bool listen(orv_error_t* error);
+    bool listenUnixSocket(const char* path, orv_error_t* error);
+    bool listenMemoryPipe(const char* name, orv_error_t* error);
+    uint16_t port() const;
+    void run();
+    void stop();
+    bool isStopping() const;
+    void serveConnection(int fd);
+
+    const MockServerOptions& options() const;
+    MockDesktop* desktop();
+    void setContent(std::unique_ptr<MockContent> content);
+    MockServerStatistics statistics() const;
+
+private:
+    friend class MockConnection;
+    void reapConnections(bool all);
+
+private:
+    const MockServerOptions mOptions;
+    MockDesktop mDesktop;
+    std::unique_ptr<MockContent> mContent;
+    int mListenFd = -1;
+    uint16_t mPort = 0;
+    int mUnixListenFd = -1;
+    std::string mUnixSocketPath;
+    std::unique_ptr<MemoryPipeListener> mMemoryPipeListener;
+    std::atomic<bool> mStopping;
+    ThreadNotifierWriter mStopNotifier;
+    ThreadNotifierListener mStopListener;
+    std::mutex mConnectionsMutex;
+    std::list<std::unique_ptr<MockConnection>> mConnections;
+
+    std::atomic<uint64_t> mActiveConnections;
+    std::atomic<uint64_t> mTotalConnections;
+    std::atomic<uint64_t> mFrames;
+    std::atomic<uint64_t> mUpdates;
+    std::atomic<uint64_t> mRects;
+    std::atomic<uint64_t> mCopyRects;
+    std::atomic<uint64_t> mSentBytes;
+    std::atomic<uint64_t> mReceivedBytes;
+};
+
+inline uint16_t MockDesktop::width() const
+{
+    return mWidth;
+}
+
+inline uint16_t MockDesktop::height() const
+{
+    return mHeight;
+}
+
+inline std::mutex& MockDesktop::mutex()
+{
+    return mMutex;
+}
+
+inline uint32_t MockDesktop::pixelMutexLocked(uint16_t x, uint16_t y) const
+{
+    return mPixels[(size_t)y * mWidth + x];
+}
+
+/**
+ * NOTE: Does not record the change, call @ref markDirtyMutexLocked() once the area is painted.
+ **/
+inline void MockDesktop::setPixelMutexLocked(uint16_t x, uint16_t y, uint32_t rgb)
+{
+    mPixels[(size_t)y * mWidth + x] = rgb;
+}
+
+/**
+ * @return The port the server listens on, valid after @ref listen() succeeded.
+ **/
+inline uint16_t MockServer::port() const
+{
+    return mPort;
+}
+
+inline bool MockServer::isStopping() const
+{
+    return mStopping.load();
+}
+
+inline const MockServerOptions& MockServer::options() const
+{
+    return mOptions;
+}
+
+inline MockDesktop* MockServer::desktop()
+{
+    return &mDesktop;
+}
+
+} // namespace bench
+} // namespace openrv
+
+#endif
@@ -0,0 +1,300 @@
+/*
+ * Copyright (C) 2018 Monument-Software GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file mockservermain.cpp
+ *
+ * Command line frontend of @ref openrv::bench::MockServer: serves synthetic content to any RFB
+ * client (normally the library itself), e.g. for end-to-end load tests without a real VNC server.
+ *
+ * With --latency-port, the server also runs a @ref openrv::bench::LatencyTesterServer that paints
+ * its marker on the served desktop, so glass-to-glass latency can be measured locally (e.g. using
+ * the --latency-tester mode of the cmdline tool).
+ **/
+
+#include "latencytesterserver.h"
+#include "mockserver.h"
+#include <libopenrv/orv_error.h>
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+using namespace openrv;
+using namespace openrv::bench;
+
+static volatile sig_atomic_t gWantQuit = 0;
+
+static void signalHandler(int)
+{
+    gWantQuit = 1;
+}
+
+struct Options
+{
+    MockServerOptions mServer;
+    /**
+     * If not empty, listen on this unix domain socket instead of the TCP port.
+     **/
+    std::string mUnixSocketPath;
+    bool mLatencyTester = false;
+    LatencyTesterServerOptions mLatencyTesterServer;
+    uint32_t mDurationSeconds = 0;
+    uint32_t mStatisticsIntervalSeconds = 5;
+    bool mShowHelp = false;
+};
+
+static bool parseEncoding(vnc::EncodingType* encoding, const char* name)
+{
+    static const struct
+    {
+        const char* mName;
+        vnc::EncodingType mEncoding;
+    } encodings[] = {
+        { "raw", vnc::EncodingType::Raw },
+        { "rre", vnc::EncodingType::RRE },
+        { "corre", vnc::EncodingType::CoRRE },
+        { "hextile", vnc::EncodingType::Hextile },
+        { "zlib", vnc::EncodingType::zlib },
+        { "zrle", vnc::EncodingType::ZRLE },
+    };
+    for (const auto& e : encodings) {
+        if (strcasecmp(name, e.mName) == 0) {
+            *encoding = e.mEncoding;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Parse a number of bytes with an optional K or M suffix (1024 based).
+ **/
+static uint64_t parseBytes(const char* value)
+{
+    char* end = nullptr;
+    const double v = strtod(value, &end);
+    double factor = 1.0;
+    if (end && (*end == 'k' || *end == 'K')) {
+        factor = 1024.0;
+    }
+    else if (end && (*end == 'm' || *end == 'M')) {
+        factor = 1024.0 * 1024.0;
+    }
+    return (uint64_t)(v * factor);
+}
+
+static bool readArguments(Options* options, int argc, char** argv)
+{
+    bool noCopyRect = false;
+    for (int i = 1; i < argc; i++) {
+        const char* param = argv[i];
+        if (strcmp(param, "--help") == 0 || strcmp(param, "-h") == 0) {
+            options->mShowHelp = true;
+            return true;
+        }
+        if (strcmp(param, "--no-copyrect") == 0) {
+            noCopyRect = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            fprintf(stderr, "Expected argument for %s\n", param);
+            return false;
+        }
+        const char* value = argv[++i];
+        if (strcmp(param, "--listen") == 0) {
+            options->mServer.mListenAddress = value;
+            options->mLatencyTesterServer.mListenAddress = value;
+        }
+        else if (strcmp(param, "--port") == 0) {
+            options->mServer.mPort = (uint16_t)atoi(value);
+        }
+        else if (strcmp(param, "--unix") == 0) {
+            options->mUnixSocketPath = value;
+        }
+        else if (strcmp(param, "--rfb") == 0) {
+            if (strcmp(value, "3.3") == 0) {
+                options->mServer.mProtocolMinorVersion = 3;
+            }
+            else if (strcmp(value, "3.7") == 0) {
+                options->mServer.mProtocolMinorVersion = 7;
+            }
+            else if (strcmp(value, "3.8") == 0) {
+                options->mServer.mProtocolMinorVersion = 8;
+            }
+            else {
+                fprintf(stderr, "Invalid --rfb value, expected 3.3, 3.7 or 3.8\n");
+                return false;
+            }
+        }
+        else if (strcmp(param, "--size") == 0) {
+            int w = 0;
+            int h = 0;
+            if (sscanf(value, "%dx%d", &w, &h) != 2 || w <= 0 || h <= 0 || w > 8192 || h > 8192) {
+                fprintf(stderr, "Invalid --size value, expected <width>x<height>\n");
+                return false;
+            }
+            options->mServer.mWidth = (uint16_t)w;
+            options->mServer.mHeight = (uint16_t)h;
+        }
+        else if (strcmp(param, "--scenario") == 0) {
+            if (!parseMockScenario(&options->mServer.mScenario, value)) {
+                fprintf(stderr, "Invalid --scenario value\n");
+                return false;
+            }
+        }
+        else if (strcmp(param, "--fps") == 0) {
+            options->mServer.mFramesPerSecond = atof(value);
+        }
+        else if (strcmp(param, "--bandwidth") == 0) {
+            options->mServer.mBandwidthBytesPerSecond = parseBytes(value);
+        }
+        else if (strcmp(param, "--latency") == 0) {
+            options->mServer.mLatencyMs = (uint32_t)atoi(value);
+        }
+        else if (strcmp(param, "--encoding") == 0) {
+            vnc::EncodingType encoding;
+            if (!parseEncoding(&encoding, value)) {
+                fprintf(stderr, "Invalid --encoding value\n");
+                return false;
+            }
+            options->mServer.mEncodings = { vnc::EncodingType::CopyRect, encoding };
+        }
+        else if (strcmp(param, "--name") == 0) {
+            options->mServer.mDesktopName = value;
+        }
+        else if (strcmp(param, "--seed") == 0) {
+            options->mServer.mSeed = (uint32_t)strtoul(value, nullptr, 10);
+        }
+        else if (strcmp(param, "--duration") == 0) {
+            options->mDurationSeconds = (uint32_t)atoi(value);
+        }
+        else if (strcmp(param, "--stats") == 0) {
+            options->mStatisticsIntervalSeconds = (uint32_t)atoi(value);
+        }
+        else if (strcmp(param, "--latency-port") == 0) {
+            options->mLatencyTester = true;
+            options->mLatencyTesterServer.mPort = (uint16_t)atoi(value);
+        }
+        else if (strcmp(param, "--marker-size") == 0) {
+            const int size = atoi(value);
+            if (size <= 0 || size > 256) {
+                fprintf(stderr, "Invalid --marker-size value\n");
+                return false;
+            }
+            options->mLatencyTesterServer.mMarkerSize = (uint16_t)size;
+        }
+        else {
+            fprintf(stderr, "Unknown parameter %s\n", param);
+            return false;
+        }
+    }
+    if (noCopyRect) {
+        auto& encodings = options->mServer.mEncodings;
+        encodings.erase(std::remove(encodings.begin(), encodings.end(), vnc::EncodingType::CopyRect), encodings.end());
+    }
+    return true;
+}
+
+static void printStatistics(const MockServerStatistics& current, const MockServerStatistics& previous, double seconds)
+{
+    printf("connections: %llu active, %llu total | %.1f frames/s | %.1f updates/s | %.1f rects/s (%.1f%% CopyRect) | %.2f MB/s sent\n",
+            (unsigned long long)current.mActiveConnections,
+            (unsigned long long)current.mConnections,
+            (double)(current.mFrames - previous.mFrames) / seconds,
+            (double)(current.mUpdates - previous.mUpdates) / seconds,
+            (double)(current.mRects - previous.mRects) / seconds,
+            (current.mRects > previous.mRects) ? 100.0 * (double)(current.mCopyRects - previous.mCopyRects) / (double)(current.mRects - previous.mRects) : 0.0,
+            (double)(current.mSentBytes - previous.mSentBytes) / seconds / (1024.0 * 1024.0));
+    fflush(stdout);
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    const bool argumentsOk = readArguments(&options, argc, argv);
+    if (!argumentsOk || options.mShowHelp) {
+        fprintf(argumentsOk ? stdout : stderr, "Usage: %s [--listen <address>] [--port <port, 0 for any>] [--unix <socket path, instead of TCP>] [--rfb <3.3|3.7|3.8>] [--size <width>x<height>] [--scenario <static|text|noise|windows>] [--fps <frames per second>] [--bandwidth <bytes per second, K/M suffix allowed>] [--latency <milliseconds>] [--encoding <raw|rre|corre|hextile|zlib|zrle>] [--no-copyrect] [--name <desktop name>] [--seed <n>] [--duration <seconds>] [--stats <seconds, 0 to disable>] [--latency-port <port, 0 for any>] [--marker-size <pixels>] [--help]\n", argv[0]);
+        return argumentsOk ? 0 : 1;
+    }
+
+    signal(SIGINT, signalHandler);
+    signal(SIGTERM, signalHandler);
+    signal(SIGPIPE, SIG_IGN);
+
+    MockServer server(options.mServer);
+    orv_error_t error;
+    orv_error_reset(&error);
+    if (!options.mUnixSocketPath.empty()) {
+        if (!server.listenUnixSocket(options.mUnixSocketPath.c_str(), &error)) {
+            fprintf(stderr, "%s\n", error.mErrorMessage);
+            return 1;
+        }
+        printf("Mock RFB server listening on unix socket %s (%dx%d)\n", options.mUnixSocketPath.c_str(), (int)options.mServer.mWidth, (int)options.mServer.mHeight);
+    }
+    else {
+        if (!server.listen(&error)) {
+            fprintf(stderr, "%s\n", error.mErrorMessage);
+            return 1;
+        }
+        printf("Mock RFB server listening on %s:%d (%dx%d)\n", options.mServer.mListenAddress.c_str(), (int)server.port(), (int)options.mServer.mWidth, (int)options.mServer.mHeight);
+    }
+    std::unique_ptr<LatencyTesterServer> latencyTesterServer;
+    if (options.mLatencyTester) {
+        latencyTesterServer.reset(new LatencyTesterServer(server.desktop(), options.mLatencyTesterServer));
+        if (!latencyTesterServer->listen(&error)) {
+            fprintf(stderr, "%s\n", error.mErrorMessage);
+            return 1;
+        }
+        printf("Latency tester server listening on %s:%d\n", options.mLatencyTesterServer.mListenAddress.c_str(), (int)latencyTesterServer->port());
+    }
+    fflush(stdout);
+
+    std::thread serverThread(&MockServer::run, &server);
+    std::thread latencyTesterThread;
+    if (latencyTesterServer) {
+        latencyTesterThread = std::thread(&LatencyTesterServer::run, latencyTesterServer.get());
+    }
+    typedef std::chrono::steady_clock Clock;
+    const Clock::time_point startTime = Clock::now();
+    Clock::time_point statisticsTime = startTime;
+    MockServerStatistics previous = server.statistics();
+    while (!gWantQuit) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        const Clock::time_point now = Clock::now();
+        if (options.mDurationSeconds > 0 && now - startTime >= std::chrono::seconds(options.mDurationSeconds)) {
+            break;
+        }
+        if (options.mStatisticsIntervalSeconds > 0 && now - statisticsTime >= std::chrono::seconds(options.mStatisticsIntervalSeconds)) {
+            const MockServerStatistics current = server.statistics();
+            printStatistics(current, previous, std::chrono::duration<double>(now - statisticsTime).count());
+            previous = current;
+            statisticsTime = now;
+        }
+    }
+    if (latencyTesterServer) {
+        latencyTesterServer->stop();
+        latencyTesterThread.join();
+    }
+    server.stop();
+    serverThread.join();
+    return 0;
+}
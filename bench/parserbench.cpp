@@ -0,0 +1,503 @@
+/*
+ * Copyright (C) 2018 Monument-Software GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file parserbench.cpp
+ *
+ * Microbenchmark for the rect data parsers (@ref openrv::vnc::RectDataParserBase subclasses).
+ *
+ * For every supported encoding, pixel format (8, 16 and 32 bits per pixel) and type of content
+ * (text, gradient, photo, solid fill), a rect is generated and encoded using the synthetic
+ * encoders in syntheticencoders.h. The encoded rect is then decoded repeatedly using
+ * readRectData() and finishRect() of the respective parser, exactly like the connection thread
+ * does it, and the throughput in decoded MPixels/s and consumed (encoded) bytes/s is reported.
+ *
+ * Before measuring, the output of every case is compared to the output of the Raw parser for the
+ * same content, so broken encoders or parsers are reported as failures instead of producing
+ * meaningless numbers.
+ *
+ * NOTE: The zlib based encodings use a persistent zlib stream per connection. Every iteration
+ *       decodes the same rect, which was compressed as the first rect of a new stream, so the
+ *       stream of the parser is reset (resetConnection()) before each iteration and the numbers
+ *       include the cost of initializing the zlib stream.
+ *
+ * Use --json to write machine readable results (e.g. to track regressions across releases).
+ **/
+
+#include <libopenrv/libopenrv.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// NOTE: rectdataparser.h is not self-contained, it requires <mutex> and libopenrv.h
+#include "rectdataparser.h"
+#include "decodearena.h"
+#include "syntheticencoders.h"
+
+using namespace openrv;
+using namespace openrv::vnc;
+using namespace openrv::bench;
+
+enum class Encoding
+{
+    Raw,
+    CopyRect,
+    RRE,
+    CoRRE,
+    Hextile,
+    Zlib,
+    ZRLE,
+};
+
+static const Encoding gAllEncodings[] = { Encoding::Raw, Encoding::CopyRect, Encoding::RRE, Encoding::CoRRE, Encoding::Hextile, Encoding::Zlib, Encoding::ZRLE };
+static const uint8_t gAllBitsPerPixel[] = { 8, 16, 32 };
+static const Content gAllContents[] = { Content::Text, Content::Gradient, Content::Photo, Content::Solid };
+
+struct Options
+{
+    uint16_t mRectSize = 256;
+    uint32_t mDurationMs = 200;
+    std::string mEncodingFilter;
+    uint8_t mBitsPerPixelFilter = 0;
+    std::string mContentFilter;
+    bool mJson = false;
+    bool mShowHelp = false;
+};
+
+struct Result
+{
+    Encoding mEncoding = Encoding::Raw;
+    uint8_t mBitsPerPixel = 0;
+    const char* mContent = nullptr;
+    uint16_t mWidth = 0;
+    uint16_t mHeight = 0;
+    size_t mEncodedBytes = 0;
+    uint64_t mIterations = 0;
+    double mSeconds = 0.0;
+    bool mVerified = false;
+};
+
+static const char* getEncodingString(Encoding encoding)
+{
+    switch (encoding) {
+        case Encoding::Raw:
+            return "Raw";
+        case Encoding::CopyRect:
+            return "CopyRect";
+        case Encoding::RRE:
+            return "RRE";
+        case Encoding::CoRRE:
+            return "CoRRE";
+        case Encoding::Hextile:
+            return "Hextile";
+        case Encoding::Zlib:
+            return "zlib";
+        case Encoding::ZRLE:
+            return "ZRLE";
+    }
+    return "unknown";
+}
+
+static bool usesZlibStream(Encoding encoding)
+{
+    return encoding == Encoding::Zlib || encoding == Encoding::ZRLE;
+}
+
+/**
+ * Provides the state a parser normally receives from the connection thread (framebuffer, pixel
+ * format, decode arena) and decodes rects like @ref MessageParserFramebufferUpdate does.
+ **/
+class ParserHarness
+{
+public:
+    ParserHarness(orv_context_t* ctx, Encoding encoding, const orv_communication_pixel_format_t& format, uint16_t framebufferWidth, uint16_t framebufferHeight)
+        : mPixelFormat(format),
+          mFramebufferWidth(framebufferWidth),
+          mFramebufferHeight(framebufferHeight)
+    {
+        memset(&mFramebuffer, 0, sizeof(orv_framebuffer_t));
+        mFramebuffer.mWidth = framebufferWidth;
+        mFramebuffer.mHeight = framebufferHeight;
+        mFramebuffer.mBytesPerPixel = 3;
+        mFramebuffer.mBitsPerPixel = 24;
+        mFramebuffer.mSize = (size_t)framebufferWidth * framebufferHeight * mFramebuffer.mBytesPerPixel;
+        mFramebuffer.mFramebuffer = (uint8_t*)calloc(1, mFramebuffer.mSize);
+        mDecodeArena.reserve((size_t)framebufferWidth * framebufferHeight * (format.mBitsPerPixel / 8));
+        switch (encoding) {
+            case Encoding::Raw:
+                mParser.reset(new RectDataParserRaw(ctx, &mDecodeArena, &mFramebufferMutex, &mFramebuffer, &mPixelFormat, &mFramebufferWidth, &mFramebufferHeight));
+                break;
+            case Encoding::CopyRect:
+                mParser.reset(new RectDataParserCopyRect(ctx, &mDecodeArena, &mFramebufferMutex, &mFramebuffer, &mPixelFormat, &mFramebufferWidth, &mFramebufferHeight));
+                break;
+            case Encoding::RRE:
+                mParser.reset(new RectDataParserRRE(ctx, &mDecodeArena, &mFramebufferMutex, &mFramebuffer, &mPixelFormat, &mFramebufferWidth, &mFramebufferHeight, false));
+                break;
+            case Encoding::CoRRE:
+                mParser.reset(new RectDataParserRRE(ctx, &mDecodeArena, &mFramebufferMutex, &mFramebuffer, &mPixelFormat, &mFramebufferWidth, &mFramebufferHeight, true));
+                break;
+            case Encoding::Hextile:
+                mParser.reset(new RectDataParserHextile(ctx, &mDecodeArena, &mFramebufferMutex, &mFramebuffer, &mPixelFormat, &mFramebufferWidth, &mFramebufferHeight));
+                break;
+            case Encoding::Zlib:
+                mParser.reset(new RectDataParserZlib(ctx, &mDecodeArena, &mFramebufferMutex, &mFramebuffer, &mPixelFormat, &mFramebufferWidth, &mFramebufferHeight));
+                break;
+            case Encoding::ZRLE:
+                mParser.reset(new RectDataParserZRLE(ctx, &mDecodeArena, &mFramebufferMutex, &mFramebuffer, &mPixelFormat, &mFramebufferWidth, &mFramebufferHeight));
+                break;
+        }
+    }
+
+    ~ParserHarness()
+    {
+        mParser->reset();
+        mParser->resetConnection();
+        mParser.reset();
+        free(mFramebuffer.mFramebuffer);
+    }
+
+    /**
+     * Decode the rect @p x, @p y, @p w, @p h from @p data into the framebuffer.
+     **/
+    bool decodeRect(const std::vector<char>& data, uint16_t x, uint16_t y, uint16_t w, uint16_t h, orv_error_t* error)
+    {
+        mDecodeArena.reset();
+        mParser->reset();
+        mParser->setCurrentRect(x, y, w, h);
+        // NOTE: like MessageParserFramebufferUpdate, always call readRectData() before
+        //       canFinishRect(), some parsers initialize their state on the first call only.
+        uint32_t offset = 0;
+        do {
+            const uint32_t consumed = mParser->readRectData(data.data() + offset, (uint32_t)(data.size() - offset), error);
+            if (error->mHasError) {
+                return false;
+            }
+            if (consumed == 0) {
+                orv_error_set(error, ORV_ERR_GENERIC, 0, "Parser did not consume any data at offset %u of %u, but cannot finish the rect", offset, (uint32_t)data.size());
+                return false;
+            }
+            offset += consumed;
+        } while (!mParser->canFinishRect());
+        mParser->finishRect(error);
+        if (error->mHasError) {
+            return false;
+        }
+        if (offset != data.size()) {
+            orv_error_set(error, ORV_ERR_GENERIC, 0, "Parser consumed %u of %u bytes", offset, (uint32_t)data.size());
+            return false;
+        }
+        return true;
+    }
+
+    RectDataParserBase* parser() const
+    {
+        return mParser.get();
+    }
+
+    /**
+     * Copy the RGB @p data (as returned by @ref framebufferData()) into the rect @p x, @p y, @p
+     * w, @p h of the framebuffer.
+     **/
+    void setFramebufferData(uint16_t x, uint16_t y, uint16_t w, uint16_t h, const std::vector<uint8_t>& data)
+    {
+        const size_t stride = (size_t)mFramebuffer.mWidth * mFramebuffer.mBytesPerPixel;
+        const size_t lineSize = (size_t)w * mFramebuffer.mBytesPerPixel;
+        for (uint16_t row = 0; row < h; row++) {
+            memcpy(mFramebuffer.mFramebuffer + (y + row) * stride + (size_t)x * mFramebuffer.mBytesPerPixel, data.data() + row * lineSize, lineSize);
+        }
+    }
+
+    /**
+     * @return The RGB data of the rect @p x, @p y, @p w, @p h in the framebuffer.
+     **/
+    std::vector<uint8_t> framebufferData(uint16_t x, uint16_t y, uint16_t w, uint16_t h) const
+    {
+        std::vector<uint8_t> data;
+        const size_t stride = (size_t)mFramebuffer.mWidth * mFramebuffer.mBytesPerPixel;
+        for (uint16_t row = y; row < y + h; row++) {
+            const uint8_t* line = mFramebuffer.mFramebuffer + row * stride + (size_t)x * mFramebuffer.mBytesPerPixel;
+            data.insert(data.end(), line, line + (size_t)w * mFramebuffer.mBytesPerPixel);
+        }
+        return data;
+    }
+
+private:
+    orv_communication_pixel_format_t mPixelFormat;
+    uint16_t mFramebufferWidth;
+    uint16_t mFramebufferHeight;
+    orv_framebuffer_t mFramebuffer;
+    std::mutex mFramebufferMutex;
+    DecodeArena mDecodeArena;
+    std::unique_ptr<RectDataParserBase> mParser;
+};
+
+static bool encodeRect(std::vector<char>* out, Encoding encoding, const Image& image, const orv_communication_pixel_format_t& format, uint16_t copyRectSrcX)
+{
+    out->clear();
+    ZlibStream stream;
+    switch (encoding) {
+        case Encoding::Raw:
+            encodeRaw(out, image, format);
+            return true;
+        case Encoding::CopyRect:
+            encodeCopyRect(out, copyRectSrcX, 0);
+            return true;
+        case Encoding::RRE:
+            encodeRRE(out, image, format, false);
+            return true;
+        case Encoding::CoRRE:
+            encodeRRE(out, image, format, true);
+            return true;
+        case Encoding::Hextile:
+            encodeHextile(out, image, format);
+            return true;
+        case Encoding::Zlib:
+            return encodeZlib(out, image, format, &stream);
+        case Encoding::ZRLE:
+            return encodeZRLE(out, image, format, &stream);
+    }
+    return false;
+}
+
+/**
+ * Run a single benchmark case.
+ *
+ * @return TRUE on success, FALSE if encoding, decoding or verification failed, then @p error is
+ *         set accordingly.
+ **/
+static bool runCase(orv_context_t* ctx, const Options& options, Encoding encoding, uint8_t bitsPerPixel, Content content, Result* result, orv_error_t* error)
+{
+    orv_communication_pixel_format_t format;
+    makePixelFormat(&format, bitsPerPixel);
+    // NOTE: CoRRE can encode rects of at most 255x255 pixels
+    const uint16_t size = (encoding == Encoding::CoRRE) ? std::min((uint16_t)255, options.mRectSize) : options.mRectSize;
+    // the rect is decoded at x=0, CopyRect copies from x=size
+    const uint16_t framebufferWidth = size * 2;
+    const uint16_t framebufferHeight = size;
+    const Image image = generateImage(content, size, size, format, 1);
+
+    result->mEncoding = encoding;
+    result->mBitsPerPixel = bitsPerPixel;
+    result->mContent = (encoding == Encoding::CopyRect) ? "any" : getContentString(content);
+    result->mWidth = size;
+    result->mHeight = size;
+
+    // reference output: the same image decoded by the Raw parser at the source position of
+    // CopyRect.
+    std::vector<char> data;
+    encodeRect(&data, Encoding::Raw, image, format, 0);
+    ParserHarness harness(ctx, encoding, format, framebufferWidth, framebufferHeight);
+    ParserHarness reference(ctx, Encoding::Raw, format, framebufferWidth, framebufferHeight);
+    if (!reference.decodeRect(data, size, 0, size, size, error)) {
+        return false;
+    }
+    if (encoding == Encoding::CopyRect) {
+        harness.setFramebufferData(size, 0, size, size, reference.framebufferData(size, 0, size, size));
+    }
+    if (!encodeRect(&data, encoding, image, format, size)) {
+        orv_error_set(error, ORV_ERR_GENERIC, 0, "Failed to encode rect");
+        return false;
+    }
+    result->mEncodedBytes = data.size();
+    if (!harness.decodeRect(data, 0, 0, size, size, error)) {
+        return false;
+    }
+    if (harness.framebufferData(0, 0, size, size) != reference.framebufferData(size, 0, size, size)) {
+        orv_error_set(error, ORV_ERR_GENERIC, 0, "Decoded data differs from reference data");
+        return false;
+    }
+    result->mVerified = true;
+
+    typedef std::chrono::steady_clock Clock;
+    const Clock::time_point start = Clock::now();
+    const Clock::time_point end = start + std::chrono::milliseconds(options.mDurationMs);
+    Clock::time_point now = start;
+    uint64_t iterations = 0;
+    do {
+        if (usesZlibStream(encoding)) {
+            harness.parser()->resetConnection();
+        }
+        if (!harness.decodeRect(data, 0, 0, size, size, error)) {
+            return false;
+        }
+        iterations++;
+        now = Clock::now();
+    } while (now < end || iterations < 3);
+    result->mIterations = iterations;
+    result->mSeconds = std::chrono::duration_cast<std::chrono::duration<double>>(now - start).count();
+    return true;
+}
+
+static double megaPixelsPerSecond(const Result& result)
+{
+    return (double)result.mWidth * result.mHeight * result.mIterations / result.mSeconds / (1000.0 * 1000.0);
+}
+
+static double bytesPerSecond(const Result& result)
+{
+    return (double)result.mEncodedBytes * result.mIterations / result.mSeconds;
+}
+
+static void printResultText(const Result& result)
+{
+    printf("%-9s %2d bpp  %-9s %4dx%-4d %10.1f MPixels/s %10.1f MB/s  %9u bytes/rect %6.3f bytes/pixel\n",
+            getEncodingString(result.mEncoding),
+            (int)result.mBitsPerPixel,
+            result.mContent,
+            (int)result.mWidth,
+            (int)result.mHeight,
+            megaPixelsPerSecond(result),
+            bytesPerSecond(result) / (1000.0 * 1000.0),
+            (unsigned int)result.mEncodedBytes,
+            (double)result.mEncodedBytes / ((double)result.mWidth * result.mHeight));
+}
+
+static void printResultsJson(const std::vector<Result>& results, bool failed)
+{
+    printf("{\n");
+    printf("  \"libopenrvVersion\": \"%s\",\n", LIBOPENRV_VERSION_STRING);
+    printf("  \"failed\": %s,\n", failed ? "true" : "false");
+    printf("  \"results\": [\n");
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result& r = results[i];
+        printf("    {\"encoding\": \"%s\", \"bitsPerPixel\": %d, \"content\": \"%s\", \"width\": %d, \"height\": %d, \"encodedBytes\": %u, \"iterations\": %llu, \"seconds\": %.6f, \"megaPixelsPerSecond\": %.3f, \"bytesPerSecond\": %.1f}%s\n",
+                getEncodingString(r.mEncoding),
+                (int)r.mBitsPerPixel,
+                r.mContent,
+                (int)r.mWidth,
+                (int)r.mHeight,
+                (unsigned int)r.mEncodedBytes,
+                (unsigned long long)r.mIterations,
+                r.mSeconds,
+                megaPixelsPerSecond(r),
+                bytesPerSecond(r),
+                (i + 1 < results.size()) ? "," : "");
+    }
+    printf("  ]\n");
+    printf("}\n");
+}
+
+static bool readArguments(Options* options, int argc, char** argv)
+{
+    for (int i = 1; i < argc; i++) {
+        const char* param = argv[i];
+        if (strcmp(param, "--help") == 0 || strcmp(param, "-h") == 0) {
+            options->mShowHelp = true;
+            return true;
+        }
+        if (strcmp(param, "--json") == 0) {
+            options->mJson = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            fprintf(stderr, "Expected argument for %s\n", param);
+            return false;
+        }
+        if (strcmp(param, "--size") == 0) {
+            options->mRectSize = (uint16_t)atoi(argv[++i]);
+        }
+        else if (strcmp(param, "--duration") == 0) {
+            options->mDurationMs = (uint32_t)atoi(argv[++i]);
+        }
+        else if (strcmp(param, "--encoding") == 0) {
+            options->mEncodingFilter = argv[++i];
+        }
+        else if (strcmp(param, "--bpp") == 0) {
+            options->mBitsPerPixelFilter = (uint8_t)atoi(argv[++i]);
+        }
+        else if (strcmp(param, "--content") == 0) {
+            options->mContentFilter = argv[++i];
+        }
+        else {
+            fprintf(stderr, "Unknown parameter %s\n", param);
+            return false;
+        }
+    }
+    if (options->mRectSize == 0 || options->mRectSize > 4096) {
+        fprintf(stderr, "Invalid --size value\n");
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    const bool argumentsOk = readArguments(&options, argc, argv);
+    if (!argumentsOk || options.mShowHelp) {
+        fprintf(argumentsOk ? stdout : stderr, "Usage: %s [--size <rect width and height>] [--duration <milliseconds per case>] [--encoding <name>] [--bpp <8|16|32>] [--content <text|gradient|photo|solid>] [--json] [--help]\n", argv[0]);
+        return argumentsOk ? 0 : 1;
+    }
+
+    orv_config_t config;
+    orv_config_default(&config);
+    config.mLogCallback = nullptr;
+    orv_context_t* ctx = orv_init(&config);
+    if (!ctx) {
+        fprintf(stderr, "Failed to initialize libopenrv context\n");
+        return 1;
+    }
+
+    std::vector<Result> results;
+    bool failed = false;
+    for (Encoding encoding : gAllEncodings) {
+        if (!options.mEncodingFilter.empty() && strcasecmp(options.mEncodingFilter.c_str(), getEncodingString(encoding)) != 0) {
+            continue;
+        }
+        for (uint8_t bitsPerPixel : gAllBitsPerPixel) {
+            if (options.mBitsPerPixelFilter != 0 && options.mBitsPerPixelFilter != bitsPerPixel) {
+                continue;
+            }
+            for (Content content : gAllContents) {
+                if (!options.mContentFilter.empty() && options.mContentFilter != getContentString(content)) {
+                    continue;
+                }
+                Result result;
+                orv_error_t error;
+                orv_error_reset(&error);
+                if (!runCase(ctx, options, encoding, bitsPerPixel, content, &result, &error)) {
+                    fprintf(stderr, "FAILED: %s, %d bpp, %s: %s\n", getEncodingString(encoding), (int)bitsPerPixel, getContentString(content), error.mErrorMessage);
+                    failed = true;
+                }
+                else {
+                    results.push_back(result);
+                    if (!options.mJson) {
+                        printResultText(result);
+                    }
+                }
+                if (encoding == Encoding::CopyRect) {
+                    // CopyRect does not depend on the content
+                    break;
+                }
+            }
+        }
+    }
+    if (options.mJson) {
+        printResultsJson(results, failed);
+    }
+    orv_destroy(ctx);
+    return failed ? 1 : 0;
+}
+
@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2018 Monument-Software GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file replaybench.cpp
+ *
+ * Replays a connection captured using @ref orv_set_capture_file() (see @ref
+ * openrv::vnc::SessionReplay) and reports how fast the captured data was decoded.
+ *
+ * By default the capture is replayed as fast as possible, so running the same capture with two
+ * builds of the library shows exactly how much faster (or slower) one of them decodes the workload
+ * of the captured connection. Use --recorded-speed to replay the data at the times it was received
+ * originally instead.
+ **/
+
+#include <libopenrv/libopenrv.h>
+#include "sessionreplay.h"
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+struct Options
+{
+    const char* mFileName = nullptr;
+    bool mRecordedSpeed = false;
+    uint32_t mRepeat = 1;
+};
+
+static void eventCallback(orv_context_t* ctx, orv_event_t* event)
+{
+    (void)ctx;
+    orv_event_destroy(event);
+}
+
+static void printResult(uint32_t run, const openrv::vnc::SessionReplayResult& result)
+{
+    const double processingSeconds = result.mProcessingTimeUs / (1000.0 * 1000.0);
+    uint64_t pixels = 0;
+    for (uint32_t i = 0; i < result.mStatistics.mEncodingCount; i++) {
+        pixels += result.mStatistics.mEncodings[i].mPixels;
+    }
+    printf("Run %u: %" PRIu64 " bytes, %" PRIu64 " messages, %" PRIu64 " framebuffer updates, %" PRIu64 " rects\n",
+            (unsigned int)run + 1, result.mBytes, result.mMessages, result.mStatistics.mFramebufferUpdates, result.mStatistics.mFramebufferUpdateRects);
+    printf("  Processing time: %.3f ms (replay %.3f ms, recorded %.3f ms)\n",
+            result.mProcessingTimeUs / 1000.0, result.mReplayDurationUs / 1000.0, result.mRecordedDurationUs / 1000.0);
+    if (processingSeconds > 0.0) {
+        printf("  Throughput: %.2f MB/s, %.2f MPixels/s, %.1f updates/s\n",
+                result.mBytes / processingSeconds / (1000.0 * 1000.0),
+                pixels / processingSeconds / (1000.0 * 1000.0),
+                result.mStatistics.mFramebufferUpdates / processingSeconds);
+    }
+    for (uint32_t i = 0; i < result.mStatistics.mEncodingCount; i++) {
+        const orv_encoding_statistics_t& e = result.mStatistics.mEncodings[i];
+        printf("  %-12s %8" PRIu64 " rects %12" PRIu64 " pixels %12" PRIu64 " bytes  read %9.3f ms  finish %9.3f ms\n",
+                orv_get_vnc_encoding_type_string(e.mEncodingType), e.mRects, e.mPixels, e.mCompressedBytes,
+                e.mReadTimeUs / 1000.0, e.mFinishTimeUs / 1000.0);
+    }
+}
+
+static bool readArguments(Options* options, int argc, char** argv)
+{
+    for (int i = 1; i < argc; i++) {
+        const char* param = argv[i];
+        if (strcmp(param, "--recorded-speed") == 0) {
+            options->mRecordedSpeed = true;
+        }
+        else if (strcmp(param, "--repeat") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Expected argument for %s\n", param);
+                return false;
+            }
+            options->mRepeat = (uint32_t)atoi(argv[++i]);
+        }
+        else if (param[0] == '-') {
+            fprintf(stderr, "Unknown parameter %s\n", param);
+            return false;
+        }
+        else {
+            options->mFileName = param;
+        }
+    }
+    if (!options->mFileName) {
+        fprintf(stderr, "No capture file specified\n");
+        return false;
+    }
+    if (options->mRepeat == 0) {
+        options->mRepeat = 1;
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if (!readArguments(&options, argc, argv)) {
+        fprintf(stderr, "Usage: %s [--recorded-speed] [--repeat <count>] <capture file>\n", argv[0]);
+        return 1;
+    }
+
+    orv_config_t config;
+    orv_config_default(&config);
+    config.mEventCallback = eventCallback;
+    config.mLogCallback = nullptr;
+    config.mMeasureDecodeTimes = 1;
+    orv_context_t* ctx = orv_init(&config);
+    if (!ctx) {
+        fprintf(stderr, "Failed to initialize libopenrv context\n");
+        return 1;
+    }
+
+    int ret = 0;
+    uint64_t bestProcessingTimeUs = 0;
+    {
+        openrv::vnc::SessionReplay replay(ctx);
+        for (uint32_t run = 0; run < options.mRepeat; run++) {
+            openrv::vnc::SessionReplayResult result;
+            orv_error_t error;
+            orv_error_reset(&error);
+            const bool ok = replay.replay(options.mFileName, options.mRecordedSpeed, &result, &error);
+            printResult(run, result);
+            if (!ok) {
+                fprintf(stderr, "Replay failed: %s\n", error.mErrorMessage);
+                ret = 1;
+                break;
+            }
+            if (!result.mComplete) {
+                printf("  NOTE: Capture is truncated\n");
+            }
+            if (run == 0 || result.mProcessingTimeUs < bestProcessingTimeUs) {
+                bestProcessingTimeUs = result.mProcessingTimeUs;
+            }
+        }
+        if (ret == 0 && options.mRepeat > 1) {
+            printf("Best processing time of %u runs: %.3f ms\n", (unsigned int)options.mRepeat, bestProcessingTimeUs / 1000.0);
+        }
+    }
+    orv_destroy(ctx);
+    return ret;
+}
+
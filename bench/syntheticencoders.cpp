@@ -0,0 +1,576 @@
+/*
+ * Copyright (C) 2018 Monument-Software GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "syntheticencoders.h"
+#include "writer.h"
+
+#include <zlib.h>
+#include <string.h>
+#include <algorithm>
+#include <map>
+#include <unordered_map>
+
+namespace openrv {
+namespace bench {
+
+/**
+ * @return The pixel value of the color @p r, @p g, @p b in the true color @p format.
+ **/
+uint32_t toPixel(const orv_communication_pixel_format_t& format, uint8_t r, uint8_t g, uint8_t b)
+{
+    const uint8_t rgb[3] = { r, g, b };
+    uint32_t pixel = 0;
+    for (int i = 0; i < 3; i++) {
+        const uint32_t value = ((uint32_t)rgb[i] * format.mColorMax[i] + 127) / 255;
+        pixel |= value << format.mColorShift[i];
+    }
+    return pixel;
+}
+
+static void appendUInt8(std::vector<char>* out, uint8_t v)
+{
+    out->push_back((char)v);
+}
+
+static void appendUInt16(std::vector<char>* out, uint16_t v)
+{
+    char buffer[2];
+    Writer::writeUInt16(buffer, v);
+    out->insert(out->end(), buffer, buffer + 2);
+}
+
+static void appendUInt32(std::vector<char>* out, uint32_t v)
+{
+    char buffer[4];
+    Writer::writeUInt32(buffer, v);
+    out->insert(out->end(), buffer, buffer + 4);
+}
+
+/**
+ * Append @p pixel in little endian byte order using @p bytes bytes.
+ **/
+static void appendPixelBytes(std::vector<char>* out, uint32_t pixel, uint8_t bytes)
+{
+    for (uint8_t i = 0; i < bytes; i++) {
+        out->push_back((char)((pixel >> (8 * i)) & 0xff));
+    }
+}
+
+static void appendPixel(std::vector<char>* out, uint32_t pixel, const orv_communication_pixel_format_t& format)
+{
+    appendPixelBytes(out, pixel, format.mBitsPerPixel / 8);
+}
+
+/**
+ * @return The number of bytes of a "compressed pixel" (CPIXEL) in ZRLE. This implementation only
+ *         supports pixel formats that use the least significant bytes, see @ref makePixelFormat().
+ **/
+static uint8_t zrleBytesPerCPixel(const orv_communication_pixel_format_t& format)
+{
+    if (format.mBitsPerPixel == 32 && format.mDepth <= 24) {
+        return 3;
+    }
+    return format.mBitsPerPixel / 8;
+}
+
+/**
+ * @return The most frequent pixel in the @p w x @p h area of @p image at @p x, @p y.
+ **/
+static uint32_t findBackgroundPixel(const Image& image, uint16_t x, uint16_t y, uint16_t w, uint16_t h)
+{
+    std::unordered_map<uint32_t, uint32_t> counts;
+    uint32_t best = image.pixel(x, y);
+    uint32_t bestCount = 0;
+    for (uint16_t j = y; j < y + h; j++) {
+        for (uint16_t i = x; i < x + w; i++) {
+            const uint32_t pixel = image.pixel(i, j);
+            const uint32_t count = ++counts[pixel];
+            if (count > bestCount) {
+                best = pixel;
+                bestCount = count;
+            }
+        }
+    }
+    return best;
+}
+
+struct Run
+{
+    uint16_t mX;
+    uint16_t mY;
+    uint16_t mW;
+    uint32_t mPixel;
+};
+
+/**
+ * Collect the horizontal runs of pixels that differ from @p background in the @p w x @p h area of
+ * @p image at @p x, @p y. The run positions are relative to the area.
+ **/
+static void findRuns(std::vector<Run>* runs, const Image& image, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint32_t background)
+{
+    runs->clear();
+    for (uint16_t j = 0; j < h; j++) {
+        uint16_t i = 0;
+        while (i < w) {
+            const uint32_t pixel = image.pixel(x + i, y + j);
+            uint16_t length = 1;
+            while (i + length < w && image.pixel(x + i + length, y + j) == pixel) {
+                length++;
+            }
+            if (pixel != background) {
+                runs->push_back(Run{i, j, length, pixel});
+            }
+            i += length;
+        }
+    }
+}
+
+ZlibStream::ZlibStream()
+{
+    mStream = (struct z_stream_s*)calloc(1, sizeof(struct z_stream_s));
+    if (deflateInit(mStream, Z_DEFAULT_COMPRESSION) != Z_OK) {
+        free(mStream);
+        mStream = nullptr;
+    }
+}
+
+ZlibStream::~ZlibStream()
+{
+    if (mStream) {
+        deflateEnd(mStream);
+        free(mStream);
+    }
+}
+
+/**
+ * Compress @p data and append the result to @p out.
+ **/
+bool ZlibStream::compress(const std::vector<char>& data, std::vector<char>* out)
+{
+    if (!mStream) {
+        return false;
+    }
+    std::vector<char> buffer(deflateBound(mStream, data.size()) + 64);
+    mStream->next_in = (Bytef*)data.data();
+    mStream->avail_in = (uInt)data.size();
+    size_t produced = 0;
+    do {
+        if (produced == buffer.size()) {
+            buffer.resize(buffer.size() * 2);
+        }
+        mStream->next_out = (Bytef*)buffer.data() + produced;
+        mStream->avail_out = (uInt)(buffer.size() - produced);
+        if (deflate(mStream, Z_SYNC_FLUSH) == Z_STREAM_ERROR) {
+            return false;
+        }
+        produced = buffer.size() - mStream->avail_out;
+    } while (mStream->avail_out == 0);
+    out->insert(out->end(), buffer.begin(), buffer.begin() + produced);
+    return true;
+}
+
+const char* getContentString(Content content)
+{
+    switch (content) {
+        case Content::Text:
+            return "text";
+        case Content::Gradient:
+            return "gradient";
+        case Content::Photo:
+            return "photo";
+        case Content::Solid:
+            return "solid";
+    }
+    return "unknown";
+}
+
+/**
+ * Initialize @p format to a true color little endian format with @p bitsPerPixel (8: BGR233,
+ * 16: RGB565, 32: RGB888 in the least significant bytes).
+ **/
+void makePixelFormat(orv_communication_pixel_format_t* format, uint8_t bitsPerPixel)
+{
+    orv_communication_pixel_format_reset(format);
+    format->mBitsPerPixel = bitsPerPixel;
+    format->mBigEndian = 0;
+    format->mTrueColor = 1;
+    switch (bitsPerPixel) {
+        case 8:
+            format->mDepth = 8;
+            format->mColorMax[0] = 7;
+            format->mColorMax[1] = 7;
+            format->mColorMax[2] = 3;
+            format->mColorShift[0] = 0;
+            format->mColorShift[1] = 3;
+            format->mColorShift[2] = 6;
+            break;
+        case 16:
+            format->mDepth = 16;
+            format->mColorMax[0] = 31;
+            format->mColorMax[1] = 63;
+            format->mColorMax[2] = 31;
+            format->mColorShift[0] = 11;
+            format->mColorShift[1] = 5;
+            format->mColorShift[2] = 0;
+            break;
+        default:
+        case 32:
+            format->mBitsPerPixel = 32;
+            format->mDepth = 24;
+            format->mColorMax[0] = 255;
+            format->mColorMax[1] = 255;
+            format->mColorMax[2] = 255;
+            format->mColorShift[0] = 16;
+            format->mColorShift[1] = 8;
+            format->mColorShift[2] = 0;
+            break;
+    }
+}
+
+Image generateImage(Content content, uint16_t width, uint16_t height, const orv_communication_pixel_format_t& format, uint32_t seed)
+{
+    Image image;
+    image.mWidth = width;
+    image.mHeight = height;
+    image.mPixels.resize((size_t)width * height);
+    Random random(seed);
+    switch (content) {
+        case Content::Text:
+        {
+            // lines of 8x12 glyph cells, each glyph a random 5x7 pattern. Some words are
+            // highlighted in a different color (e.g. links or syntax highlighting).
+            const uint32_t background = toPixel(format, 255, 255, 255);
+            std::fill(image.mPixels.begin(), image.mPixels.end(), background);
+            const uint32_t colors[3] = { toPixel(format, 30, 30, 30), toPixel(format, 20, 60, 200), toPixel(format, 160, 30, 30) };
+            uint32_t color = colors[0];
+            for (uint16_t cellY = 0; cellY + 12 <= height; cellY += 12) {
+                for (uint16_t cellX = 0; cellX + 8 <= width; cellX += 8) {
+                    if (random.next() % 6 == 0) {
+                        // space between words, maybe switch color for the next word
+                        color = colors[(random.next() % 8 == 0) ? 1 + random.next() % 2 : 0];
+                        continue;
+                    }
+                    const uint32_t glyph = random.next();
+                    for (uint16_t j = 0; j < 7; j++) {
+                        for (uint16_t i = 0; i < 5; i++) {
+                            if ((glyph >> ((j * 5 + i) % 24)) & 1) {
+                                image.mPixels[(size_t)(cellY + 2 + j) * width + cellX + 1 + i] = color;
+                            }
+                        }
+                    }
+                }
+            }
+            break;
+        }
+        case Content::Gradient:
+            for (uint16_t y = 0; y < height; y++) {
+                for (uint16_t x = 0; x < width; x++) {
+                    image.mPixels[(size_t)y * width + x] = toPixel(format, (uint8_t)((uint32_t)x * 255 / std::max(1, width - 1)), (uint8_t)((uint32_t)y * 255 / std::max(1, height - 1)), 128);
+                }
+            }
+            break;
+        case Content::Photo:
+            for (uint16_t y = 0; y < height; y++) {
+                for (uint16_t x = 0; x < width; x++) {
+                    uint8_t rgb[3];
+                    const int base[3] = { (int)x * 200 / std::max(1, (int)width), (int)y * 200 / std::max(1, (int)height), 100 };
+                    for (int c = 0; c < 3; c++) {
+                        const int value = base[c] + (int)(random.next() % 49) - 24;
+                        rgb[c] = (uint8_t)std::max(0, std::min(255, value + 28));
+                    }
+                    image.mPixels[(size_t)y * width + x] = toPixel(format, rgb[0], rgb[1], rgb[2]);
+                }
+            }
+            break;
+        case Content::Solid:
+            std::fill(image.mPixels.begin(), image.mPixels.end(), toPixel(format, 40, 90, 160));
+            break;
+    }
+    return image;
+}
+
+void encodeRaw(std::vector<char>* out, const Image& image, const orv_communication_pixel_format_t& format)
+{
+    out->reserve(out->size() + image.mPixels.size() * (format.mBitsPerPixel / 8));
+    for (uint32_t pixel : image.mPixels) {
+        appendPixel(out, pixel, format);
+    }
+}
+
+void encodeCopyRect(std::vector<char>* out, uint16_t srcX, uint16_t srcY)
+{
+    appendUInt16(out, srcX);
+    appendUInt16(out, srcY);
+}
+
+/**
+ * Encode @p image in RRE, or CoRRE if @p compressed is TRUE (then @p image must not be larger than
+ * 255x255). Each horizontal run of non-background pixels is sent as a subrect.
+ **/
+void encodeRRE(std::vector<char>* out, const Image& image, const orv_communication_pixel_format_t& format, bool compressed)
+{
+    const uint32_t background = findBackgroundPixel(image, 0, 0, image.mWidth, image.mHeight);
+    std::vector<Run> runs;
+    findRuns(&runs, image, 0, 0, image.mWidth, image.mHeight, background);
+    appendUInt32(out, (uint32_t)runs.size());
+    appendPixel(out, background, format);
+    for (const Run& run : runs) {
+        appendPixel(out, run.mPixel, format);
+        if (compressed) {
+            appendUInt8(out, (uint8_t)run.mX);
+            appendUInt8(out, (uint8_t)run.mY);
+            appendUInt8(out, (uint8_t)run.mW);
+            appendUInt8(out, 1);
+        }
+        else {
+            appendUInt16(out, run.mX);
+            appendUInt16(out, run.mY);
+            appendUInt16(out, run.mW);
+            appendUInt16(out, 1);
+        }
+    }
+}
+
+/**
+ * Encode @p image in Hextile. Solid tiles only send the background, other tiles send their
+ * horizontal runs as subrects (with a single foreground color if possible), unless raw data is
+ * smaller.
+ **/
+void encodeHextile(std::vector<char>* out, const Image& image, const orv_communication_pixel_format_t& format)
+{
+    enum
+    {
+        Raw = 1,
+        BackgroundSpecified = 2,
+        ForegroundSpecified = 4,
+        AnySubrects = 8,
+        SubrectsColoured = 16,
+    };
+    const uint8_t bytesPerPixel = format.mBitsPerPixel / 8;
+    std::vector<Run> runs;
+    for (uint16_t tileY = 0; tileY < image.mHeight; tileY += 16) {
+        for (uint16_t tileX = 0; tileX < image.mWidth; tileX += 16) {
+            const uint16_t w = std::min(16, image.mWidth - tileX);
+            const uint16_t h = std::min(16, image.mHeight - tileY);
+            const uint32_t background = findBackgroundPixel(image, tileX, tileY, w, h);
+            findRuns(&runs, image, tileX, tileY, w, h, background);
+            if (runs.empty()) {
+                appendUInt8(out, BackgroundSpecified);
+                appendPixel(out, background, format);
+                continue;
+            }
+            bool singleForeground = true;
+            for (const Run& run : runs) {
+                if (run.mPixel != runs[0].mPixel) {
+                    singleForeground = false;
+                    break;
+                }
+            }
+            const size_t subrectSize = singleForeground ? 2 : 2 + bytesPerPixel;
+            const size_t encodedSize = 1 + bytesPerPixel * (singleForeground ? 2 : 1) + 1 + runs.size() * subrectSize;
+            const size_t rawSize = 1 + (size_t)w * h * bytesPerPixel;
+            if (runs.size() > 255 || encodedSize >= rawSize) {
+                appendUInt8(out, Raw);
+                for (uint16_t y = tileY; y < tileY + h; y++) {
+                    for (uint16_t x = tileX; x < tileX + w; x++) {
+                        appendPixel(out, image.pixel(x, y), format);
+                    }
+                }
+                continue;
+            }
+            if (singleForeground) {
+                appendUInt8(out, BackgroundSpecified | ForegroundSpecified | AnySubrects);
+                appendPixel(out, background, format);
+                appendPixel(out, runs[0].mPixel, format);
+            }
+            else {
+                appendUInt8(out, BackgroundSpecified | AnySubrects | SubrectsColoured);
+                appendPixel(out, background, format);
+            }
+            appendUInt8(out, (uint8_t)runs.size());
+            for (const Run& run : runs) {
+                if (!singleForeground) {
+                    appendPixel(out, run.mPixel, format);
+                }
+                appendUInt8(out, (uint8_t)((run.mX << 4) | run.mY));
+                appendUInt8(out, (uint8_t)(((run.mW - 1) << 4) | 0));
+            }
+        }
+    }
+}
+
+/**
+ * Encode @p image in the zlib encoding, i.e. raw pixel data compressed using @p stream.
+ **/
+bool encodeZlib(std::vector<char>* out, const Image& image, const orv_communication_pixel_format_t& format, ZlibStream* stream)
+{
+    std::vector<char> raw;
+    encodeRaw(&raw, image, format);
+    std::vector<char> compressed;
+    if (!stream->compress(raw, &compressed)) {
+        return false;
+    }
+    appendUInt32(out, (uint32_t)compressed.size());
+    out->insert(out->end(), compressed.begin(), compressed.end());
+    return true;
+}
+
+static void appendZrleRunLength(std::vector<char>* out, uint32_t length)
+{
+    length--;
+    while (length >= 255) {
+        appendUInt8(out, 255);
+        length -= 255;
+    }
+    appendUInt8(out, (uint8_t)length);
+}
+
+/**
+ * Encode a single ZRLE tile. Uses the solid, packed palette, palette RLE, plain RLE or raw
+ * subencoding, whichever is appropriate (roughly like a real server would choose).
+ **/
+static void encodeZrleTile(std::vector<char>* out, const Image& image, uint16_t tileX, uint16_t tileY, uint16_t w, uint16_t h, uint8_t cpixelBytes)
+{
+    std::vector<uint32_t> pixels;
+    pixels.reserve((size_t)w * h);
+    for (uint16_t y = tileY; y < tileY + h; y++) {
+        for (uint16_t x = tileX; x < tileX + w; x++) {
+            pixels.push_back(image.pixel(x, y));
+        }
+    }
+    std::map<uint32_t, uint8_t> palette;
+    for (uint32_t pixel : pixels) {
+        if (palette.size() > 127) {
+            break;
+        }
+        if (palette.find(pixel) == palette.end()) {
+            palette.insert(std::make_pair(pixel, (uint8_t)palette.size()));
+        }
+    }
+    std::vector<std::pair<uint32_t, uint32_t>> runs; // pixel, length
+    for (uint32_t pixel : pixels) {
+        if (!runs.empty() && runs.back().first == pixel) {
+            runs.back().second++;
+        }
+        else {
+            runs.push_back(std::make_pair(pixel, 1u));
+        }
+    }
+    const size_t rawSize = pixels.size() * cpixelBytes;
+    size_t plainRleSize = 0;
+    for (const auto& run : runs) {
+        plainRleSize += cpixelBytes + 1 + (run.second - 1) / 255;
+    }
+
+    if (palette.size() == 1) {
+        appendUInt8(out, 1);
+        appendPixelBytes(out, pixels[0], cpixelBytes);
+        return;
+    }
+    if (palette.size() <= 16) {
+        const uint8_t bitsPerIndex = (palette.size() == 2) ? 1 : (palette.size() <= 4 ? 2 : 4);
+        appendUInt8(out, (uint8_t)palette.size());
+        std::vector<uint32_t> entries(palette.size());
+        for (const auto& entry : palette) {
+            entries[entry.second] = entry.first;
+        }
+        for (uint32_t pixel : entries) {
+            appendPixelBytes(out, pixel, cpixelBytes);
+        }
+        for (uint16_t y = 0; y < h; y++) {
+            uint8_t byte = 0;
+            int bits = 0;
+            for (uint16_t x = 0; x < w; x++) {
+                byte = (uint8_t)((byte << bitsPerIndex) | palette[pixels[(size_t)y * w + x]]);
+                bits += bitsPerIndex;
+                if (bits == 8) {
+                    appendUInt8(out, byte);
+                    byte = 0;
+                    bits = 0;
+                }
+            }
+            if (bits > 0) {
+                appendUInt8(out, (uint8_t)(byte << (8 - bits)));
+            }
+        }
+        return;
+    }
+    if (palette.size() <= 127) {
+        size_t paletteRleSize = palette.size() * cpixelBytes;
+        for (const auto& run : runs) {
+            paletteRleSize += (run.second == 1) ? 1 : 2 + (run.second - 1) / 255;
+        }
+        if (paletteRleSize < plainRleSize && paletteRleSize < rawSize) {
+            appendUInt8(out, (uint8_t)(128 + palette.size()));
+            std::vector<uint32_t> entries(palette.size());
+            for (const auto& entry : palette) {
+                entries[entry.second] = entry.first;
+            }
+            for (uint32_t pixel : entries) {
+                appendPixelBytes(out, pixel, cpixelBytes);
+            }
+            for (const auto& run : runs) {
+                const uint8_t index = palette[run.first];
+                if (run.second == 1) {
+                    appendUInt8(out, index);
+                }
+                else {
+                    appendUInt8(out, index | 128);
+                    appendZrleRunLength(out, run.second);
+                }
+            }
+            return;
+        }
+    }
+    if (plainRleSize < rawSize) {
+        appendUInt8(out, 128);
+        for (const auto& run : runs) {
+            appendPixelBytes(out, run.first, cpixelBytes);
+            appendZrleRunLength(out, run.second);
+        }
+        return;
+    }
+    appendUInt8(out, 0);
+    for (uint32_t pixel : pixels) {
+        appendPixelBytes(out, pixel, cpixelBytes);
+    }
+}
+
+/**
+ * Encode @p image in ZRLE, i.e. 64x64 tiles (see @ref encodeZrleTile()) compressed using @p
+ * stream.
+ **/
+bool encodeZRLE(std::vector<char>* out, const Image& image, const orv_communication_pixel_format_t& format, ZlibStream* stream)
+{
+    const uint8_t cpixelBytes = zrleBytesPerCPixel(format);
+    std::vector<char> tiles;
+    for (uint16_t tileY = 0; tileY < image.mHeight; tileY += 64) {
+        for (uint16_t tileX = 0; tileX < image.mWidth; tileX += 64) {
+            encodeZrleTile(&tiles, image, tileX, tileY, std::min(64, image.mWidth - tileX), std::min(64, image.mHeight - tileY), cpixelBytes);
+        }
+    }
+    std::vector<char> compressed;
+    if (!stream->compress(tiles, &compressed)) {
+        return false;
+    }
+    appendUInt32(out, (uint32_t)compressed.size());
+    out->insert(out->end(), compressed.begin(), compressed.end());
+    return true;
+}
+
+} // namespace bench
+} // namespace openrv
+
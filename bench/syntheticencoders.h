@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2018 Monument-Software GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OPENRV_BENCH_SYNTHETICENCODERS_H
+#define OPENRV_BENCH_SYNTHETICENCODERS_H
+
+#include <libopenrv/libopenrv.h>
+
+#include <stdint.h>
+#include <vector>
+
+struct z_stream_s;
+
+/**
+ * @file syntheticencoders.h
+ *
+ * Generators for synthetic screen content and minimal server-side implementations of the RFB
+ * encodings supported by the library, used to produce realistic rect data for the benchmarks
+ * without a VNC server.
+ *
+ * The encoders favour simplicity over compression ratio, but use the same subencodings a real
+ * server would use for the respective content (e.g. solid and palette tiles in Hextile and ZRLE),
+ * so that the corresponding code paths of the rect data parsers are exercised.
+ **/
+
+namespace openrv {
+namespace bench {
+
+enum class Content
+{
+    /**
+     * Dark glyphs on a white background, i.e. few colors and short runs.
+     **/
+    Text,
+    /**
+     * Smooth two-dimensional gradient, i.e. many colors and short runs.
+     **/
+    Gradient,
+    /**
+     * Gradient with random noise, i.e. (nearly) every pixel differs from its neighbours.
+     **/
+    Photo,
+    /**
+     * A single color.
+     **/
+    Solid,
+};
+
+/**
+ * Minimal linear congruential generator, so that the generated content is identical on all
+ * platforms.
+ **/
+class Random
+{
+public:
+    explicit Random(uint32_t seed)
+        : mState(seed)
+    {
+    }
+    uint32_t next()
+    {
+        mState = mState * 1664525u + 1013904223u;
+        return mState >> 8;
+    }
+private:
+    uint32_t mState;
+};
+
+/**
+ * An image in a communication pixel format, i.e. the pixels are stored as the pixel values that
+ * are sent to the client (one uint32_t per pixel, regardless of the bits per pixel).
+ **/
+struct Image
+{
+    uint16_t mWidth = 0;
+    uint16_t mHeight = 0;
+    std::vector<uint32_t> mPixels;
+
+    uint32_t pixel(uint16_t x, uint16_t y) const
+    {
+        return mPixels[(size_t)y * mWidth + x];
+    }
+};
+
+/**
+ * Persistent deflate stream, as used by a server for the zlib based encodings. The stream is
+ * flushed after every rect (Z_SYNC_FLUSH), so the client can decode each rect once it has been
+ * received.
+ **/
+class ZlibStream
+{
+public:
+    ZlibStream();
+    ~ZlibStream();
+    ZlibStream(const ZlibStream&) = delete;
+    ZlibStream& operator=(const ZlibStream&) = delete;
+
+    bool compress(const std::vector<char>& data, std::vector<char>* out);
+
+private:
+    struct z_stream_s* mStream = nullptr;
+};
+
+const char* getContentString(Content content);
+void makePixelFormat(orv_communication_pixel_format_t* format, uint8_t bitsPerPixel);
+uint32_t toPixel(const orv_communication_pixel_format_t& format, uint8_t r, uint8_t g, uint8_t b);
+Image generateImage(Content content, uint16_t width, uint16_t height, const orv_communication_pixel_format_t& format, uint32_t seed);
+
+void encodeRaw(std::vector<char>* out, const Image& image, const orv_communication_pixel_format_t& format);
+void encodeCopyRect(std::vector<char>* out, uint16_t srcX, uint16_t srcY);
+void encodeRRE(std::vector<char>* out, const Image& image, const orv_communication_pixel_format_t& format, bool compressed);
+void encodeHextile(std::vector<char>* out, const Image& image, const orv_communication_pixel_format_t& format);
+bool encodeZlib(std::vector<char>* out, const Image& image, const orv_communication_pixel_format_t& format, ZlibStream* stream);
+bool encodeZRLE(std::vector<char>* out, const Image& image, const orv_communication_pixel_format_t& format, ZlibStream* stream);
+
+} // namespace bench
+} // namespace openrv
+
+#endif
+
@@ -0,0 +1,177 @@
+/*
+ * Copyright (C) 2018 Monument-Software GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file wakeupbench.cpp
+ *
+ * Microbenchmark for the cost of @ref openrv::ThreadNotifierWriter::sendNotification(), i.e. the
+ * cost of waking up the connection thread on every key, pointer and update request.
+ *
+ * A writer thread sends notifications at a fixed rate (default 10000 per second, optionally in
+ * bursts), a listener thread waits on the pipe like the connection thread does. The benchmark
+ * reports the average cost of a sendNotification() call and the number of wakeups of the listener
+ * for every available mechanism (pipe, eventfd).
+ *
+ * The "baseline" variant uses a pipe without coalescing of redundant notifications, i.e. every
+ * notification is a write() syscall. This is the behaviour before notifications were coalesced.
+ **/
+
+#include "threadnotifier.h"
+
+#include <sys/select.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+struct Options
+{
+    uint32_t mRate = 10000;
+    uint32_t mBurst = 1;
+    uint32_t mDurationSeconds = 2;
+};
+
+struct Result
+{
+    uint64_t mNotifications = 0;
+    uint64_t mNotifyTimeNs = 0;
+    uint64_t mListenerWakeups = 0;
+};
+
+static void listenerRun(openrv::ThreadNotifierListener* listener, std::atomic<bool>* quit, uint64_t* wakeups)
+{
+    const int fd = listener->pipeReadFd();
+    while (!quit->load()) {
+        fd_set readfds;
+        FD_ZERO(&readfds);
+        FD_SET(fd, &readfds);
+        struct timeval timeout;
+        timeout.tv_sec = 0;
+        timeout.tv_usec = 100 * 1000;
+        int ret = select(fd + 1, &readfds, nullptr, nullptr, &timeout);
+        if (ret > 0) {
+            listener->swallowPipeData();
+            (*wakeups)++;
+        }
+    }
+}
+
+static bool runBenchmark(const Options& options, bool allowEventFd, bool coalesceNotifications, Result* result)
+{
+    openrv::ThreadNotifierWriter writer;
+    openrv::ThreadNotifierListener listener;
+    if (!openrv::ThreadNotifier::makePipe(&writer, &listener, allowEventFd, coalesceNotifications)) {
+        fprintf(stderr, "Failed to create pipe\n");
+        return false;
+    }
+    std::atomic<bool> quit(false);
+    uint64_t wakeups = 0;
+    std::thread listenerThread(listenerRun, &listener, &quit, &wakeups);
+
+    typedef std::chrono::steady_clock Clock;
+    const uint64_t bursts = ((uint64_t)options.mRate * options.mDurationSeconds) / options.mBurst;
+    const std::chrono::nanoseconds burstInterval((1000ull * 1000 * 1000 * options.mBurst) / options.mRate);
+    Clock::time_point next = Clock::now();
+    for (uint64_t i = 0; i < bursts; i++) {
+        std::this_thread::sleep_until(next);
+        next += burstInterval;
+        for (uint32_t j = 0; j < options.mBurst; j++) {
+            Clock::time_point start = Clock::now();
+            writer.sendNotification();
+            Clock::time_point end = Clock::now();
+            result->mNotifyTimeNs += std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+            result->mNotifications++;
+        }
+    }
+    quit.store(true);
+    listenerThread.join();
+    result->mListenerWakeups = wakeups;
+    return true;
+}
+
+static void printResult(const char* name, const Result& result)
+{
+    double avgNs = 0.0;
+    if (result.mNotifications > 0) {
+        avgNs = (double)result.mNotifyTimeNs / (double)result.mNotifications;
+    }
+    printf("%-8s notifications: %10llu, avg cost: %8.1f ns/call, listener wakeups: %10llu\n",
+            name,
+            (unsigned long long)result.mNotifications,
+            avgNs,
+            (unsigned long long)result.mListenerWakeups);
+}
+
+static bool readArguments(Options* options, int argc, char** argv)
+{
+    for (int i = 1; i < argc; i++) {
+        const char* param = argv[i];
+        if (i + 1 >= argc) {
+            fprintf(stderr, "Expected argument for %s\n", param);
+            return false;
+        }
+        if (strcmp(param, "--rate") == 0) {
+            options->mRate = (uint32_t)atoi(argv[++i]);
+        }
+        else if (strcmp(param, "--burst") == 0) {
+            options->mBurst = (uint32_t)atoi(argv[++i]);
+        }
+        else if (strcmp(param, "--duration") == 0) {
+            options->mDurationSeconds = (uint32_t)atoi(argv[++i]);
+        }
+        else {
+            fprintf(stderr, "Unknown parameter %s\n", param);
+            return false;
+        }
+    }
+    if (options->mRate == 0 || options->mBurst == 0 || options->mBurst > options->mRate) {
+        fprintf(stderr, "Invalid --rate or --burst value\n");
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if (!readArguments(&options, argc, argv)) {
+        fprintf(stderr, "Usage: %s [--rate <notifications per second>] [--burst <notifications per burst>] [--duration <seconds>]\n", argv[0]);
+        return 1;
+    }
+    printf("Sending %u notifications per second in bursts of %u for %u seconds\n", options.mRate, options.mBurst, options.mDurationSeconds);
+
+    Result baselineResult;
+    if (!runBenchmark(options, false, false, &baselineResult)) {
+        return 1;
+    }
+    printResult("baseline", baselineResult);
+    Result pipeResult;
+    if (!runBenchmark(options, false, true, &pipeResult)) {
+        return 1;
+    }
+    printResult("pipe", pipeResult);
+#if defined(__linux__)
+    Result eventFdResult;
+    if (!runBenchmark(options, true, true, &eventFdResult)) {
+        return 1;
+    }
+    printResult("eventfd", eventFdResult);
+#endif // __linux__
+    return 0;
+}
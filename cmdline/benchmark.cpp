@@ -0,0 +1,344 @@
+/*
+ * Copyright (C) 2018 Monument-Software GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "benchmark.h"
+
+#include <libopenrv/orv_errorcodes.h>
+
+#include <sys/resource.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+
+/**
+ * Maximum time to wait for the response to the warm-up request.
+ **/
+static const uint64_t gWarmupTimeoutUs = 30 * 1000 * 1000;
+
+uint64_t benchmarkTimestampUs()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @return The nearest-rank @p percentile (0..100) of @p sortedValues, 0 if @p sortedValues is
+ *         empty.
+ **/
+uint64_t benchmarkPercentile(const std::vector<uint64_t>& sortedValues, double percentile)
+{
+    if (sortedValues.empty()) {
+        return 0;
+    }
+    size_t rank = (size_t)(percentile / 100.0 * (double)sortedValues.size() + 0.999999);
+    rank = std::max((size_t)1, std::min(rank, sortedValues.size()));
+    return sortedValues[rank - 1];
+}
+
+/**
+ * Write @p string as JSON string literal (including quotes) to @p file.
+ **/
+void benchmarkPrintJsonString(FILE* file, const char* string)
+{
+    fputc('"', file);
+    for (const char* c = string; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            fprintf(file, "\\%c", *c);
+        }
+        else if ((unsigned char)*c < 0x20) {
+            fprintf(file, "\\u%04x", (unsigned int)(unsigned char)*c);
+        }
+        else {
+            fputc(*c, file);
+        }
+    }
+    fputc('"', file);
+}
+
+static uint64_t cpuTimeUs(const struct timeval& t)
+{
+    return (uint64_t)t.tv_sec * 1000000 + (uint64_t)t.tv_usec;
+}
+
+/**
+ * Obtain the CPU time consumed by the whole process so far, i.e. including the threads of the
+ * library.
+ **/
+void benchmarkCpuTime(uint64_t* userUs, uint64_t* systemUs)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    *userUs = cpuTimeUs(usage.ru_utime);
+    *systemUs = cpuTimeUs(usage.ru_stime);
+}
+
+BenchmarkSession::BenchmarkSession(orv_context_t* ctx, const BenchmarkOptions& options, uint16_t framebufferWidth, uint16_t framebufferHeight)
+    : mContext(ctx),
+      mOptions(options)
+{
+    mResult.mNonIncremental = options.mNonIncremental && !options.mAutoRefresh;
+    mResult.mAutoRefresh = options.mAutoRefresh;
+    mResult.mFramebufferWidth = framebufferWidth;
+    mResult.mFramebufferHeight = framebufferHeight;
+}
+
+/**
+ * Send the warm-up request. The measurement starts once it has been answered.
+ **/
+void BenchmarkSession::start()
+{
+    mWarmup = true;
+    mStartUs = benchmarkTimestampUs();
+    mRequestSentUs = mStartUs;
+    if (mOptions.mViewport) {
+        orv_set_viewport(mContext, mOptions.mViewportX, mOptions.mViewportY, mOptions.mViewportWidth, mOptions.mViewportHeight, 0);
+    }
+    orv_request_framebuffer_update_non_incremental(mContext, 0, 0, mResult.mFramebufferWidth, mResult.mFramebufferHeight);
+}
+
+void BenchmarkSession::sendRequest()
+{
+    mRequestSentUs = benchmarkTimestampUs();
+    if (mOptions.mNonIncremental) {
+        orv_request_framebuffer_update_non_incremental(mContext, 0, 0, mResult.mFramebufferWidth, mResult.mFramebufferHeight);
+    }
+    else {
+        orv_request_framebuffer_update(mContext, 0, 0, mResult.mFramebufferWidth, mResult.mFramebufferHeight);
+    }
+}
+
+/**
+ * Read the current totals of the connection that the result is calculated from.
+ **/
+void BenchmarkSession::readCounters(uint64_t* receivedBytes, uint64_t* decodedPixels, uint64_t* rects) const
+{
+    orv_connection_info_t info;
+    orv_vnc_server_capabilities_t capabilities;
+    orv_get_vnc_connection_info(mContext, &info, &capabilities);
+    *receivedBytes = info.mReceivedBytes;
+    orv_statistics_t statistics;
+    orv_get_statistics(mContext, &statistics);
+    *decodedPixels = 0;
+    for (uint32_t i = 0; i < statistics.mEncodingCount; i++) {
+        *decodedPixels += statistics.mEncodings[i].mPixels;
+    }
+    *rects = statistics.mFramebufferUpdateRects;
+}
+
+void BenchmarkSession::handleEvent(const orv_event_t* event)
+{
+    if (mFinished) {
+        return;
+    }
+    switch (event->mEventType) {
+        case ORV_EVENT_FRAMEBUFFER_UPDATE_REQUEST_FINISHED:
+        {
+            const uint64_t nowUs = benchmarkTimestampUs();
+            // "present" the frame, like a real application would
+            orv_acquire_framebuffer(mContext);
+            orv_release_framebuffer(mContext);
+            if (mWarmup) {
+                mWarmup = false;
+                mStartUs = benchmarkTimestampUs();
+                readCounters(&mStartReceivedBytes, &mStartDecodedPixels, &mStartRects);
+                orv_set_activity_state(mContext, mOptions.mActivityState);
+            }
+            else {
+                mResult.mFrames++;
+                if (!mOptions.mAutoRefresh) {
+                    mResult.mLatenciesUs.push_back(nowUs - mRequestSentUs);
+                }
+                if (mOptions.mMaxFrames > 0 && mResult.mFrames >= mOptions.mMaxFrames) {
+                    finish();
+                    return;
+                }
+            }
+            if (mOptions.mAutoRefresh) {
+                // NOTE: started after the warm-up, so that the warm-up is answered first
+                orv_start_auto_refresh(mContext, &mOptions.mAutoRefreshOptions);
+                break;
+            }
+            sendRequest();
+            break;
+        }
+        case ORV_EVENT_DISCONNECTED:
+        {
+            const orv_disconnected_t* data = (const orv_disconnected_t*)event->mEventData;
+            mResult.mDisconnected = true;
+            orv_error_copy(&mResult.mError, &data->mError);
+            finish();
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+/**
+ * @return TRUE if the measurement has ended, either because the duration or frame limit was
+ *         reached or because the connection was lost. Call @ref finish() afterwards.
+ **/
+bool BenchmarkSession::isFinished() const
+{
+    return mFinished || remainingUs() == 0;
+}
+
+/**
+ * @return The time until the measurement ends due to the duration limit (or the warm-up times out).
+ **/
+uint64_t BenchmarkSession::remainingUs() const
+{
+    if (mFinished) {
+        return 0;
+    }
+    const uint64_t limitUs = mWarmup ? gWarmupTimeoutUs : (uint64_t)mOptions.mDurationMs * 1000;
+    if (limitUs == 0) {
+        return UINT64_MAX;
+    }
+    const uint64_t elapsedUs = benchmarkTimestampUs() - mStartUs;
+    return (elapsedUs >= limitUs) ? 0 : limitUs - elapsedUs;
+}
+
+/**
+ * End the measurement and calculate the result.
+ **/
+void BenchmarkSession::finish()
+{
+    if (mFinished) {
+        return;
+    }
+    mFinished = true;
+    if (mOptions.mAutoRefresh) {
+        orv_stop_auto_refresh(mContext);
+    }
+    if (mWarmup) {
+        if (!mResult.mError.mHasError) {
+            orv_error_set(&mResult.mError, ORV_ERR_GENERIC, 0, "No response to the initial framebuffer update request");
+        }
+        return;
+    }
+    mResult.mElapsedUs = benchmarkTimestampUs() - mStartUs;
+    // NOTE: the counters remain valid after a disconnect, until the next connection is made
+    uint64_t receivedBytes = 0;
+    uint64_t decodedPixels = 0;
+    uint64_t rects = 0;
+    readCounters(&receivedBytes, &decodedPixels, &rects);
+    mResult.mReceivedBytes = receivedBytes - mStartReceivedBytes;
+    mResult.mDecodedPixels = decodedPixels - mStartDecodedPixels;
+    mResult.mRects = rects - mStartRects;
+    std::sort(mResult.mLatenciesUs.begin(), mResult.mLatenciesUs.end());
+}
+
+/**
+ * Run the benchmark on the connected @p ctx, which must use the polling event callback.
+ *
+ * @return TRUE if the measurement completed, FALSE if the connection was lost or the server did
+ *         not respond, then @ref BenchmarkResult::mError of @p result is set.
+ **/
+bool runBenchmark(orv_context_t* ctx, const BenchmarkOptions& options, uint16_t framebufferWidth, uint16_t framebufferHeight, BenchmarkResult* result)
+{
+    BenchmarkSession session(ctx, options, framebufferWidth, framebufferHeight);
+    uint64_t cpuUserStartUs = 0;
+    uint64_t cpuSystemStartUs = 0;
+    benchmarkCpuTime(&cpuUserStartUs, &cpuSystemStartUs);
+    session.start();
+    while (!session.isFinished()) {
+        orv_wait_events(ctx, (int)std::min((uint64_t)100, (session.remainingUs() + 999) / 1000));
+        orv_event_t* event = orv_poll_event(ctx);
+        while (event) {
+            session.handleEvent(event);
+            orv_event_destroy(event);
+            event = orv_poll_event(ctx);
+        }
+    }
+    session.finish();
+    uint64_t cpuUserEndUs = 0;
+    uint64_t cpuSystemEndUs = 0;
+    benchmarkCpuTime(&cpuUserEndUs, &cpuSystemEndUs);
+    *result = session.result();
+    result->mCpuUserUs = cpuUserEndUs - cpuUserStartUs;
+    result->mCpuSystemUs = cpuSystemEndUs - cpuSystemStartUs;
+    return !result->mError.mHasError;
+}
+
+void printBenchmarkResult(FILE* file, const BenchmarkResult& result, bool json)
+{
+    const double seconds = std::max(1e-6, (double)result.mElapsedUs / 1000000.0);
+    const double framesPerSecond = (double)result.mFrames / seconds;
+    const double megaBytesPerSecond = (double)result.mReceivedBytes / seconds / (1024.0 * 1024.0);
+    const double megaPixelsPerSecond = (double)result.mDecodedPixels / seconds / 1000000.0;
+    const double cpuPercent = 100.0 * (double)(result.mCpuUserUs + result.mCpuSystemUs) / 1000000.0 / seconds;
+    const std::vector<uint64_t>& latencies = result.mLatenciesUs;
+    const uint64_t latencyMin = latencies.empty() ? 0 : latencies.front();
+    const uint64_t latencyMax = latencies.empty() ? 0 : latencies.back();
+    if (json) {
+        fprintf(file, "{\n");
+        fprintf(file, "  \"framebuffer_width\": %d,\n", (int)result.mFramebufferWidth);
+        fprintf(file, "  \"framebuffer_height\": %d,\n", (int)result.mFramebufferHeight);
+        fprintf(file, "  \"incremental\": %s,\n", result.mNonIncremental ? "false" : "true");
+        fprintf(file, "  \"auto_refresh\": %s,\n", result.mAutoRefresh ? "true" : "false");
+        fprintf(file, "  \"seconds\": %.3f,\n", seconds);
+        fprintf(file, "  \"frames\": %llu,\n", (unsigned long long)result.mFrames);
+        fprintf(file, "  \"frames_per_second\": %.2f,\n", framesPerSecond);
+        fprintf(file, "  \"received_bytes\": %llu,\n", (unsigned long long)result.mReceivedBytes);
+        fprintf(file, "  \"mbytes_per_second\": %.3f,\n", megaBytesPerSecond);
+        fprintf(file, "  \"decoded_pixels\": %llu,\n", (unsigned long long)result.mDecodedPixels);
+        fprintf(file, "  \"mpixels_per_second\": %.3f,\n", megaPixelsPerSecond);
+        fprintf(file, "  \"rects\": %llu,\n", (unsigned long long)result.mRects);
+        if (result.mAutoRefresh) {
+            fprintf(file, "  \"latency_us\": null,\n");
+        }
+        else {
+            fprintf(file, "  \"latency_us\": { \"min\": %llu, \"p50\": %llu, \"p90\": %llu, \"p99\": %llu, \"max\": %llu },\n",
+                    (unsigned long long)latencyMin,
+                    (unsigned long long)benchmarkPercentile(latencies, 50.0),
+                    (unsigned long long)benchmarkPercentile(latencies, 90.0),
+                    (unsigned long long)benchmarkPercentile(latencies, 99.0),
+                    (unsigned long long)latencyMax);
+        }
+        fprintf(file, "  \"cpu_user_us\": %llu,\n", (unsigned long long)result.mCpuUserUs);
+        fprintf(file, "  \"cpu_system_us\": %llu,\n", (unsigned long long)result.mCpuSystemUs);
+        fprintf(file, "  \"cpu_percent\": %.1f,\n", cpuPercent);
+        fprintf(file, "  \"error\": ");
+        if (result.mError.mHasError) {
+            benchmarkPrintJsonString(file, result.mError.mErrorMessage);
+        }
+        else {
+            fprintf(file, "null");
+        }
+        fprintf(file, "\n");
+        fprintf(file, "}\n");
+        return;
+    }
+    fprintf(file, "Benchmark of %dx%d framebuffer, %s update requests%s:\n", (int)result.mFramebufferWidth, (int)result.mFramebufferHeight, result.mNonIncremental ? "non-incremental" : "incremental", result.mAutoRefresh ? " sent by the library" : "");
+    fprintf(file, "  Frames:         %llu in %.2f s (%.2f fps)\n", (unsigned long long)result.mFrames, seconds, framesPerSecond);
+    fprintf(file, "  Received:       %.2f MB (%.2f MB/s)\n", (double)result.mReceivedBytes / (1024.0 * 1024.0), megaBytesPerSecond);
+    fprintf(file, "  Decoded:        %.2f MPixels (%.2f MPixels/s), %llu rects\n", (double)result.mDecodedPixels / 1000000.0, megaPixelsPerSecond, (unsigned long long)result.mRects);
+    if (result.mAutoRefresh) {
+        fprintf(file, "  Latency:        n/a (requests sent by the library)\n");
+    }
+    else {
+        fprintf(file, "  Latency:        min %.2f ms, p50 %.2f ms, p90 %.2f ms, p99 %.2f ms, max %.2f ms\n",
+                (double)latencyMin / 1000.0,
+                (double)benchmarkPercentile(latencies, 50.0) / 1000.0,
+                (double)benchmarkPercentile(latencies, 90.0) / 1000.0,
+                (double)benchmarkPercentile(latencies, 99.0) / 1000.0,
+                (double)latencyMax / 1000.0);
+    }
+    fprintf(file, "  CPU time:       user %.2f s, system %.2f s (%.1f%% of one core)\n", (double)result.mCpuUserUs / 1000000.0, (double)result.mCpuSystemUs / 1000000.0, cpuPercent);
+    if (result.mError.mHasError) {
+        fprintf(file, "  Error:          %s\n", result.mError.mErrorMessage);
+    }
+}
@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2018 Monument-Software GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OPENRV_CMDLINE_BENCHMARK_H
+#define OPENRV_CMDLINE_BENCHMARK_H
+
+#include <libopenrv/libopenrv.h>
+#include <libopenrv/orv_error.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+/**
+ * @file benchmark.h
+ *
+ * The --bench mode of the cmdline tool: requests framebuffer updates from a connected server in a
+ * tight loop and measures the throughput and latency of the updates.
+ **/
+
+struct BenchmarkOptions
+{
+    /**
+     * Duration of the measurement in milliseconds, 0 for no limit (then @ref mMaxFrames must be
+     * set).
+     **/
+    uint32_t mDurationMs = 10000;
+    /**
+     * Number of frames (i.e. answered update requests) after which the measurement ends, 0 for no
+     * limit.
+     **/
+    uint64_t mMaxFrames = 0;
+    /**
+     * If TRUE, non-incremental update requests are sent, i.e. the server sends the full
+     * framebuffer for each request. Otherwise the server sends changes only.
+     **/
+    bool mNonIncremental = false;
+    /**
+     * If TRUE, the library does not maintain the framebuffer (see @ref
+     * orv_config_t::mSkipFramebuffer), i.e. rects are decoded only.
+     **/
+    bool mSkipFramebuffer = false;
+    /**
+     * Number of downscaled framebuffer copies the library maintains (see @ref
+     * orv_config_t::mMipmapLevels).
+     **/
+    uint8_t mMipmapLevels = 0;
+    /**
+     * If TRUE, incremental requests are restricted to the viewport @ref mViewportX, @ref
+     * mViewportY, @ref mViewportWidth, @ref mViewportHeight (see @ref orv_set_viewport()).
+     **/
+    bool mViewport = false;
+    uint16_t mViewportX = 0;
+    uint16_t mViewportY = 0;
+    uint16_t mViewportWidth = 0;
+    uint16_t mViewportHeight = 0;
+    /**
+     * If TRUE, the library requests the updates after the warm-up (see @ref
+     * orv_start_auto_refresh()) using @ref mAutoRefreshOptions. The latency per request cannot be
+     * measured then.
+     **/
+    bool mAutoRefresh = false;
+    orv_auto_refresh_options_t mAutoRefreshOptions = {};
+    /**
+     * Activity state set after the warm-up (see @ref orv_set_activity_state()), e.g. to measure
+     * the load of connections in the background.
+     **/
+    orv_activity_state_t mActivityState = ORV_ACTIVITY_STATE_VISIBLE;
+    bool mJson = false;
+};
+
+struct BenchmarkResult
+{
+    bool mNonIncremental = false;
+    bool mAutoRefresh = false;
+    uint16_t mFramebufferWidth = 0;
+    uint16_t mFramebufferHeight = 0;
+    uint64_t mFrames = 0;
+    uint64_t mElapsedUs = 0;
+    uint64_t mReceivedBytes = 0;
+    uint64_t mDecodedPixels = 0;
+    uint64_t mRects = 0;
+    /**
+     * Time from sending each update request until the application received the
+     * ORV_EVENT_FRAMEBUFFER_UPDATE_REQUEST_FINISHED event for it.
+     **/
+    std::vector<uint64_t> mLatenciesUs;
+    /**
+     * CPU time of the whole process (i.e. including the threads of the library) during the
+     * measurement.
+     **/
+    uint64_t mCpuUserUs = 0;
+    uint64_t mCpuSystemUs = 0;
+    bool mDisconnected = false;
+    orv_error_t mError;
+
+    BenchmarkResult()
+    {
+        orv_error_reset(&mError);
+    }
+};
+
+/**
+ * Benchmark of a single connected @ref orv_context_t.
+ *
+ * The owner polls the events of the context and forwards them to @ref handleEvent(), until @ref
+ * isFinished() returns TRUE. This allows a single thread to drive multiple sessions.
+ *
+ * The first update request is a warm-up (the library always requests the full framebuffer
+ * initially) and is not part of the measurement.
+ **/
+class BenchmarkSession
+{
+public:
+    BenchmarkSession(orv_context_t* ctx, const BenchmarkOptions& options, uint16_t framebufferWidth, uint16_t framebufferHeight);
+
+    void start();
+    void handleEvent(const orv_event_t* event);
+    bool isFinished() const;
+    void finish();
+    uint64_t remainingUs() const;
+    const BenchmarkResult& result() const;
+
+private:
+    void sendRequest();
+    void readCounters(uint64_t* receivedBytes, uint64_t* decodedPixels, uint64_t* rects) const;
+
+private:
+    orv_context_t* mContext;
+    const BenchmarkOptions mOptions;
+    BenchmarkResult mResult;
+    bool mWarmup = true;
+    bool mFinished = false;
+    uint64_t mStartUs = 0;
+    uint64_t mRequestSentUs = 0;
+    uint64_t mStartReceivedBytes = 0;
+    uint64_t mStartDecodedPixels = 0;
+    uint64_t mStartRects = 0;
+};
+
+uint64_t benchmarkTimestampUs();
+uint64_t benchmarkPercentile(const std::vector<uint64_t>& sortedValues, double percentile);
+void benchmarkCpuTime(uint64_t* userUs, uint64_t* systemUs);
+void benchmarkPrintJsonString(FILE* file, const char* string);
+bool runBenchmark(orv_context_t* ctx, const BenchmarkOptions& options, uint16_t framebufferWidth, uint16_t framebufferHeight, BenchmarkResult* result);
+void printBenchmarkResult(FILE* file, const BenchmarkResult& result, bool json);
+
+inline const BenchmarkResult& BenchmarkSession::result() const
+{
+    return mResult;
+}
+
+#endif
@@ -0,0 +1,254 @@
+/*
+ * Copyright (C) 2018 Monument-Software GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "latencytest.h"
+#include "benchmark.h"
+
+#include <libopenrv/orv_errorcodes.h>
+
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+/**
+ * Maximum time to wait for the connection to the latency tester server.
+ **/
+static const uint64_t gConnectTimeoutUs = 10 * 1000 * 1000;
+
+namespace
+{
+/**
+ * State shared with the thread of the latency tester client, which calls @ref
+ * latencyTesterEventCallback().
+ **/
+struct LatencyTesterState
+{
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    bool mConnectResult = false;
+    bool mDisconnected = false;
+    orv_error_t mError;
+};
+} // anonymous namespace
+
+static void latencyTesterEventCallback(struct orv_latency_tester_client_t*, orv_latency_tester_event_type_t event, const void* eventData, void* userData)
+{
+    LatencyTesterState* state = (LatencyTesterState*)userData;
+    std::lock_guard<std::mutex> lock(state->mMutex);
+    switch (event) {
+        case ORV_LATENCY_TESTER_CONNECT_RESULT:
+        {
+            const orv_connect_result_t* data = (const orv_connect_result_t*)eventData;
+            state->mConnectResult = true;
+            if (data->mError.mHasError) {
+                orv_error_copy(&state->mError, &data->mError);
+            }
+            break;
+        }
+        case ORV_LATENCY_TESTER_DISCONNECTED:
+            state->mDisconnected = true;
+            if (!state->mError.mHasError) {
+                orv_error_set(&state->mError, ORV_ERR_GENERIC, 0, "Disconnected from latency tester");
+            }
+            break;
+        case ORV_LATENCY_TESTER_UPDATE_RESPONSE:
+            // NOTE: evaluated by the statistics of the client
+            break;
+    }
+    state->mCondition.notify_all();
+}
+
+/**
+ * Connect to the latency tester server of @p options and run its continuous mode for the
+ * configured duration. In the meantime, incremental framebuffer updates are requested from @p ctx
+ * in a loop and reported to the latency tester client, to measure the VNC delivery latency.
+ *
+ * @return TRUE on success, FALSE if the connection to the latency tester or the VNC server failed,
+ *         then @ref LatencyTestResult::mError of @p result is set.
+ **/
+bool runLatencyTest(orv_context_t* ctx, const LatencyTestOptions& options, uint16_t framebufferWidth, uint16_t framebufferHeight, LatencyTestResult* result)
+{
+    LatencyTesterState state;
+    orv_error_reset(&state.mError);
+    orv_latency_tester_client_t* client = orv_latency_tester_connect(ctx, latencyTesterEventCallback, &state, options.mHostName.c_str(), options.mPort);
+    if (!client) {
+        orv_error_set(&result->mError, ORV_ERR_GENERIC, 0, "Invalid latency tester address %s:%d", options.mHostName.c_str(), (int)options.mPort);
+        return false;
+    }
+    {
+        std::unique_lock<std::mutex> lock(state.mMutex);
+        state.mCondition.wait_for(lock, std::chrono::microseconds(gConnectTimeoutUs), [&state]() { return state.mConnectResult || state.mDisconnected; });
+        if (!state.mConnectResult || state.mError.mHasError) {
+            if (state.mError.mHasError) {
+                orv_error_copy(&result->mError, &state.mError);
+            }
+            else {
+                orv_error_set(&result->mError, ORV_ERR_GENERIC, 0, "Timeout while connecting to latency tester");
+            }
+            lock.unlock();
+            orv_latency_tester_disconnect(client);
+            return false;
+        }
+    }
+
+    orv_latency_tester_start_continuous(client, &options.mContinuous);
+    const uint64_t startUs = benchmarkTimestampUs();
+    const uint64_t durationUs = (uint64_t)options.mDurationMs * 1000;
+    orv_request_framebuffer_update(ctx, 0, 0, framebufferWidth, framebufferHeight);
+    bool failed = false;
+    while (!failed && benchmarkTimestampUs() - startUs < durationUs) {
+        const uint64_t remainingUs = durationUs - (benchmarkTimestampUs() - startUs);
+        orv_wait_events(ctx, (int)std::min((uint64_t)100, (remainingUs + 999) / 1000));
+        orv_event_t* event = orv_poll_event(ctx);
+        while (event) {
+            switch (event->mEventType) {
+                case ORV_EVENT_FRAMEBUFFER_UPDATED:
+                {
+                    const orv_event_framebuffer_t* data = (const orv_event_framebuffer_t*)event->mEventData;
+                    orv_latency_tester_report_framebuffer_update(client, data->mX, data->mY, data->mWidth, data->mHeight);
+                    break;
+                }
+                case ORV_EVENT_FRAMEBUFFER_UPDATED_BATCH:
+                {
+                    const orv_event_framebuffer_batch_t* data = (const orv_event_framebuffer_batch_t*)event->mEventData;
+                    for (uint32_t i = 0; i < data->mRectCount; i++) {
+                        orv_latency_tester_report_framebuffer_update(client, data->mRects[i].mX, data->mRects[i].mY, data->mRects[i].mWidth, data->mRects[i].mHeight);
+                    }
+                    break;
+                }
+                case ORV_EVENT_FRAMEBUFFER_UPDATE_REQUEST_FINISHED:
+                    orv_acquire_framebuffer(ctx);
+                    orv_release_framebuffer(ctx);
+                    orv_request_framebuffer_update(ctx, 0, 0, framebufferWidth, framebufferHeight);
+                    break;
+                case ORV_EVENT_DISCONNECTED:
+                {
+                    const orv_disconnected_t* data = (const orv_disconnected_t*)event->mEventData;
+                    orv_error_copy(&result->mError, &data->mError);
+                    failed = true;
+                    break;
+                }
+                default:
+                    break;
+            }
+            orv_event_destroy(event);
+            event = orv_poll_event(ctx);
+        }
+        std::lock_guard<std::mutex> lock(state.mMutex);
+        if (state.mDisconnected) {
+            orv_error_copy(&result->mError, &state.mError);
+            failed = true;
+        }
+    }
+    orv_latency_tester_stop_continuous(client);
+    result->mElapsedUs = benchmarkTimestampUs() - startUs;
+    orv_latency_tester_get_statistics(client, &result->mStatistics);
+    orv_latency_tester_disconnect(client);
+    return !failed;
+}
+
+static void printHistogram(FILE* file, const char* name, const orv_latency_tester_histogram_t& h, bool json, bool last)
+{
+    const uint64_t meanUs = h.mCount > 0 ? h.mTotalUs / h.mCount : 0;
+    if (json) {
+        fprintf(file, "  \"%s\": { \"count\": %llu, \"min_us\": %llu, \"mean_us\": %llu, \"max_us\": %llu, \"p50_us\": %llu, \"p95_us\": %llu, \"p99_us\": %llu, \"buckets\": [",
+                name,
+                (unsigned long long)h.mCount,
+                (unsigned long long)h.mMinUs,
+                (unsigned long long)meanUs,
+                (unsigned long long)h.mMaxUs,
+                (unsigned long long)h.mPercentiles.mP50Us,
+                (unsigned long long)h.mPercentiles.mP95Us,
+                (unsigned long long)h.mPercentiles.mP99Us);
+        for (int i = 0; i < ORV_LATENCY_TESTER_HISTOGRAM_BUCKETS; i++) {
+            fprintf(file, "%s%llu", i > 0 ? ", " : "", (unsigned long long)h.mBuckets[i]);
+        }
+        fprintf(file, "] }%s\n", last ? "" : ",");
+        return;
+    }
+    fprintf(file, "  %-14s %6llu samples, min %8.2f ms, mean %8.2f ms, p50 %8.2f ms, p95 %8.2f ms, p99 %8.2f ms, max %8.2f ms\n",
+            name,
+            (unsigned long long)h.mCount,
+            (double)h.mMinUs / 1000.0,
+            (double)meanUs / 1000.0,
+            (double)h.mPercentiles.mP50Us / 1000.0,
+            (double)h.mPercentiles.mP95Us / 1000.0,
+            (double)h.mPercentiles.mP99Us / 1000.0,
+            (double)h.mMaxUs / 1000.0);
+    if (h.mCount == 0) {
+        return;
+    }
+    int firstBucket = 0;
+    int lastBucket = ORV_LATENCY_TESTER_HISTOGRAM_BUCKETS - 1;
+    while (h.mBuckets[firstBucket] == 0) {
+        firstBucket++;
+    }
+    while (h.mBuckets[lastBucket] == 0) {
+        lastBucket--;
+    }
+    const uint64_t maxCount = *std::max_element(h.mBuckets, h.mBuckets + ORV_LATENCY_TESTER_HISTOGRAM_BUCKETS);
+    for (int i = firstBucket; i <= lastBucket; i++) {
+        const uint64_t lowerUs = (i == 0) ? 0 : ((uint64_t)1 << i);
+        char bar[41] = {};
+        const int barLength = (int)((h.mBuckets[i] * 40 + maxCount - 1) / maxCount);
+        memset(bar, '#', barLength);
+        fprintf(file, "    >= %10.3f ms %6llu %s\n", (double)lowerUs / 1000.0, (unsigned long long)h.mBuckets[i], bar);
+    }
+}
+
+void printLatencyTestResult(FILE* file, const LatencyTestResult& result, bool json)
+{
+    const orv_latency_tester_statistics_t& s = result.mStatistics;
+    if (json) {
+        fprintf(file, "{\n");
+        fprintf(file, "  \"seconds\": %.3f,\n", (double)result.mElapsedUs / 1000000.0);
+        fprintf(file, "  \"requests_sent\": %llu,\n", (unsigned long long)s.mRequestsSent);
+        fprintf(file, "  \"responses_received\": %llu,\n", (unsigned long long)s.mResponsesReceived);
+        fprintf(file, "  \"skipped_requests\": %llu,\n", (unsigned long long)s.mSkippedRequests);
+        fprintf(file, "  \"delivered_updates\": %llu,\n", (unsigned long long)s.mDeliveredUpdates);
+        fprintf(file, "  \"clock_offset_us\": %lld,\n", (long long)s.mClockOffsetUs);
+        fprintf(file, "  \"clock_offset_error_us\": %llu,\n", (unsigned long long)(s.mClockOffsetDelayUs / 2));
+        printHistogram(file, "round_trip", s.mRoundTrip, true, false);
+        printHistogram(file, "network", s.mNetwork, true, false);
+        printHistogram(file, "server_paint", s.mServerPaint, true, false);
+        printHistogram(file, "vnc_delivery", s.mVncDelivery, true, false);
+        fprintf(file, "  \"error\": ");
+        if (result.mError.mHasError) {
+            benchmarkPrintJsonString(file, result.mError.mErrorMessage);
+        }
+        else {
+            fprintf(file, "null");
+        }
+        fprintf(file, "\n}\n");
+        return;
+    }
+    fprintf(file, "Latency test over %.2f s:\n", (double)result.mElapsedUs / 1000000.0);
+    fprintf(file, "  Requests:      %llu sent, %llu answered, %llu skipped (too many outstanding), %llu delivered via VNC\n",
+            (unsigned long long)s.mRequestsSent,
+            (unsigned long long)s.mResponsesReceived,
+            (unsigned long long)s.mSkippedRequests,
+            (unsigned long long)s.mDeliveredUpdates);
+    fprintf(file, "  Clock offset:  %lld us (+/- %llu us)\n", (long long)s.mClockOffsetUs, (unsigned long long)(s.mClockOffsetDelayUs / 2));
+    printHistogram(file, "Round trip", s.mRoundTrip, false, false);
+    printHistogram(file, "Network", s.mNetwork, false, false);
+    printHistogram(file, "Server paint", s.mServerPaint, false, false);
+    printHistogram(file, "VNC delivery", s.mVncDelivery, false, true);
+    if (result.mError.mHasError) {
+        fprintf(file, "  Error:         %s\n", result.mError.mErrorMessage);
+    }
+}
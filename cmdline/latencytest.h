@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2018 Monument-Software GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OPENRV_CMDLINE_LATENCYTEST_H
+#define OPENRV_CMDLINE_LATENCYTEST_H
+
+#include <libopenrv/libopenrv.h>
+#include <libopenrv/orv_error.h>
+#include <libopenrv/orv_latencytesterclient.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+/**
+ * @file latencytest.h
+ *
+ * The --latency-tester mode of the cmdline tool: runs the latency tester client (see
+ * orv_latencytesterclient.h) in continuous mode against the latency tester server that paints on
+ * the desktop of the connected VNC server, while receiving the framebuffer updates of the desktop.
+ **/
+
+struct LatencyTestOptions
+{
+    std::string mHostName;
+    uint16_t mPort = 0;
+    orv_latency_tester_continuous_options_t mContinuous;
+    uint32_t mDurationMs = 10000;
+    bool mJson = false;
+
+    LatencyTestOptions()
+    {
+        orv_latency_tester_continuous_options_default(&mContinuous);
+    }
+};
+
+struct LatencyTestResult
+{
+    uint64_t mElapsedUs = 0;
+    orv_latency_tester_statistics_t mStatistics;
+    orv_error_t mError;
+
+    LatencyTestResult()
+    {
+        memset(&mStatistics, 0, sizeof(mStatistics));
+        orv_error_reset(&mError);
+    }
+};
+
+bool runLatencyTest(orv_context_t* ctx, const LatencyTestOptions& options, uint16_t framebufferWidth, uint16_t framebufferHeight, LatencyTestResult* result);
+void printLatencyTestResult(FILE* file, const LatencyTestResult& result, bool json);
+
+#endif
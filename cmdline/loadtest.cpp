@@ -0,0 +1,397 @@
+/*
+ * Copyright (C) 2018 Monument-Software GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "loadtest.h"
+
+#include <libopenrv/orv_errorcodes.h>
+#include <libopenrv/orv_logging.h>
+
+#include <poll.h>
+#include <string.h>
+#include <algorithm>
+#include <memory>
+
+/**
+ * Maximum time to wait for the ORV_EVENT_CONNECT_RESULT event of a session.
+ **/
+static const uint64_t gConnectTimeoutUs = 30 * 1000 * 1000;
+static const int gMaxEventsPerPoll = 64;
+
+namespace
+{
+enum class SessionState
+{
+    Idle,
+    Connecting,
+    Connected,
+    Failed,
+};
+
+struct Session
+{
+    orv_context_t* mContext = nullptr;
+    LoadTestSessionResult* mResult = nullptr;
+    SessionState mState = SessionState::Idle;
+    uint64_t mConnectStartUs = 0;
+    uint16_t mFramebufferWidth = 0;
+    uint16_t mFramebufferHeight = 0;
+    std::unique_ptr<BenchmarkSession> mBenchmark;
+};
+} // anonymous namespace
+
+static LoadTestProcessSample sampleProcess()
+{
+    LoadTestProcessSample sample;
+#if defined(__linux__)
+    FILE* file = fopen("/proc/self/status", "r");
+    if (!file) {
+        return sample;
+    }
+    char line[256];
+    while (fgets(line, sizeof(line), file)) {
+        unsigned long long value = 0;
+        if (sscanf(line, "VmRSS: %llu", &value) == 1) {
+            sample.mResidentKiB = value;
+        }
+        else if (sscanf(line, "VmHWM: %llu", &value) == 1) {
+            sample.mPeakResidentKiB = value;
+        }
+        else if (sscanf(line, "Threads: %llu", &value) == 1) {
+            sample.mThreads = value;
+        }
+    }
+    fclose(file);
+#endif // __linux__
+    return sample;
+}
+
+/**
+ * Handle the events of a session that is still connecting.
+ **/
+static void handleConnectEvent(Session* session, const orv_event_t* event)
+{
+    if (event->mEventType != ORV_EVENT_CONNECT_RESULT) {
+        return;
+    }
+    const orv_connect_result_t* data = (const orv_connect_result_t*)event->mEventData;
+    session->mResult->mConnectUs = benchmarkTimestampUs() - session->mConnectStartUs;
+    if (data->mError.mHasError) {
+        session->mState = SessionState::Failed;
+        orv_error_copy(&session->mResult->mConnectError, &data->mError);
+        return;
+    }
+    session->mState = SessionState::Connected;
+    session->mResult->mConnected = true;
+    session->mFramebufferWidth = data->mFramebufferWidth;
+    session->mFramebufferHeight = data->mFramebufferHeight;
+}
+
+/**
+ * Poll the events of all @p sessions for at most @p timeoutUs and forward them to @p handler.
+ **/
+template<typename Handler>
+static void dispatchEvents(std::vector<Session>& sessions, uint64_t timeoutUs, Handler handler)
+{
+    std::vector<struct pollfd> fds(sessions.size());
+    bool allFds = true;
+    for (size_t i = 0; i < sessions.size(); i++) {
+        fds[i].fd = orv_get_event_fd(sessions[i].mContext);
+        fds[i].events = POLLIN;
+        fds[i].revents = 0;
+        allFds = allFds && fds[i].fd >= 0;
+    }
+    uint64_t timeoutMs = std::min((uint64_t)100, (timeoutUs + 999) / 1000);
+    if (!allFds) {
+        // NOTE: no event fd available on this platform, fall back to polling the queues
+        timeoutMs = std::min(timeoutMs, (uint64_t)5);
+    }
+    poll(fds.data(), fds.size(), (int)timeoutMs);
+    orv_event_t* events[gMaxEventsPerPoll];
+    for (size_t i = 0; i < sessions.size(); i++) {
+        if (fds[i].fd >= 0 && !(fds[i].revents & POLLIN)) {
+            continue;
+        }
+        int count = 0;
+        do {
+            count = orv_poll_events(sessions[i].mContext, events, gMaxEventsPerPoll);
+            for (int j = 0; j < count; j++) {
+                handler(&sessions[i], events[j]);
+                orv_event_destroy(events[j]);
+            }
+        } while (count == gMaxEventsPerPoll);
+    }
+}
+
+/**
+ * Connect all sessions of @p options, one every @ref LoadTestOptions::mStaggerMs, and wait until
+ * every connection attempt has completed (or timed out).
+ **/
+static void connectSessions(const LoadTestOptions& options, std::vector<Session>& sessions)
+{
+    orv_connect_options_t connectOptions;
+    orv_connect_options_default(&connectOptions);
+    connectOptions.mTransportType = options.mTransportType;
+    const uint64_t staggerUs = (uint64_t)options.mStaggerMs * 1000;
+    size_t nextSession = 0;
+    uint64_t nextStartUs = benchmarkTimestampUs();
+    while (true) {
+        uint64_t nowUs = benchmarkTimestampUs();
+        while (nextSession < sessions.size() && nowUs >= nextStartUs) {
+            Session& session = sessions[nextSession];
+            const LoadTestTarget& target = session.mResult->mTarget;
+            session.mState = SessionState::Connecting;
+            session.mConnectStartUs = nowUs;
+            if (orv_connect(session.mContext, target.mHostName.c_str(), target.mPort, &connectOptions, &session.mResult->mConnectError) != 0) {
+                session.mState = SessionState::Failed;
+            }
+            nextSession++;
+            nextStartUs += staggerUs;
+        }
+
+        bool pending = nextSession < sessions.size();
+        for (Session& session : sessions) {
+            if (session.mState == SessionState::Connecting && nowUs - session.mConnectStartUs >= gConnectTimeoutUs) {
+                orv_disconnect(session.mContext);
+                session.mState = SessionState::Failed;
+                session.mResult->mConnectUs = nowUs - session.mConnectStartUs;
+                orv_error_set(&session.mResult->mConnectError, ORV_ERR_GENERIC, 0, "Timeout while connecting");
+            }
+            pending = pending || session.mState == SessionState::Connecting;
+        }
+        if (!pending) {
+            break;
+        }
+        uint64_t timeoutUs = gConnectTimeoutUs;
+        if (nextSession < sessions.size()) {
+            timeoutUs = nextStartUs - std::min(nextStartUs, nowUs);
+        }
+        dispatchEvents(sessions, timeoutUs, [](Session* session, const orv_event_t* event) {
+            if (session->mState == SessionState::Connecting) {
+                handleConnectEvent(session, event);
+            }
+        });
+    }
+}
+
+/**
+ * Run the load test configured by @p options: connect all sessions, then run a @ref
+ * BenchmarkSession on every connected session at the same time. All sessions are driven by the
+ * calling thread, by polling the event fds (see orv_get_event_fd()) of their contexts.
+ *
+ * @return TRUE if all sessions connected and completed their measurement, otherwise FALSE. The
+ *         results of all sessions are stored in @p result in either case.
+ **/
+bool runLoadTest(const LoadTestOptions& options, LoadTestResult* result)
+{
+    *result = LoadTestResult();
+    result->mBeforeConnect = sampleProcess();
+
+    orv_config_t config;
+    orv_config_default(&config);
+    // debug output of the library would distort the measurement
+    config.mMinLogSeverity = ORV_LOGGING_SEVERITY_WARNING;
+    config.mSkipFramebuffer = options.mBenchmark.mSkipFramebuffer ? 1 : 0;
+    config.mMipmapLevels = options.mBenchmark.mMipmapLevels;
+    result->mSessions.resize(options.mSessions);
+    std::vector<Session> sessions(options.mSessions);
+    for (size_t i = 0; i < sessions.size(); i++) {
+        sessions[i].mResult = &result->mSessions[i];
+        sessions[i].mResult->mTarget = options.mTargets[i % options.mTargets.size()];
+        sessions[i].mContext = orv_init(&config);
+        orv_set_credentials(sessions[i].mContext, nullptr, options.mPassword);
+    }
+
+    connectSessions(options, sessions);
+    result->mAfterConnect = sampleProcess();
+
+    uint64_t cpuUserStartUs = 0;
+    uint64_t cpuSystemStartUs = 0;
+    benchmarkCpuTime(&cpuUserStartUs, &cpuSystemStartUs);
+    const uint64_t startUs = benchmarkTimestampUs();
+    for (Session& session : sessions) {
+        if (session.mState == SessionState::Connected) {
+            session.mBenchmark.reset(new BenchmarkSession(session.mContext, options.mBenchmark, session.mFramebufferWidth, session.mFramebufferHeight));
+            session.mBenchmark->start();
+        }
+    }
+    while (true) {
+        uint64_t timeoutUs = UINT64_MAX;
+        for (Session& session : sessions) {
+            if (session.mBenchmark && !session.mBenchmark->isFinished()) {
+                timeoutUs = std::min(timeoutUs, session.mBenchmark->remainingUs());
+            }
+        }
+        if (timeoutUs == UINT64_MAX) {
+            break;
+        }
+        dispatchEvents(sessions, timeoutUs, [](Session* session, const orv_event_t* event) {
+            if (session->mBenchmark) {
+                session->mBenchmark->handleEvent(event);
+            }
+        });
+    }
+    result->mAfterMeasurement = sampleProcess();
+    result->mElapsedUs = benchmarkTimestampUs() - startUs;
+    uint64_t cpuUserEndUs = 0;
+    uint64_t cpuSystemEndUs = 0;
+    benchmarkCpuTime(&cpuUserEndUs, &cpuSystemEndUs);
+    result->mCpuUserUs = cpuUserEndUs - cpuUserStartUs;
+    result->mCpuSystemUs = cpuSystemEndUs - cpuSystemStartUs;
+
+    bool success = true;
+    for (Session& session : sessions) {
+        if (session.mBenchmark) {
+            session.mBenchmark->finish();
+            session.mResult->mBenchmark = session.mBenchmark->result();
+            success = success && !session.mResult->mBenchmark.mError.mHasError;
+        }
+        else {
+            success = false;
+        }
+        orv_destroy(session.mContext);
+    }
+    return success;
+}
+
+void printLoadTestResult(FILE* file, const LoadTestResult& result, bool json)
+{
+    const double seconds = std::max(1e-6, (double)result.mElapsedUs / 1000000.0);
+    size_t connected = 0;
+    uint64_t frames = 0;
+    uint64_t receivedBytes = 0;
+    uint64_t decodedPixels = 0;
+    std::vector<uint64_t> connectTimes;
+    std::vector<uint64_t> latencies;
+    for (const LoadTestSessionResult& session : result.mSessions) {
+        if (!session.mConnected) {
+            continue;
+        }
+        connected++;
+        connectTimes.push_back(session.mConnectUs);
+        frames += session.mBenchmark.mFrames;
+        receivedBytes += session.mBenchmark.mReceivedBytes;
+        decodedPixels += session.mBenchmark.mDecodedPixels;
+        latencies.insert(latencies.end(), session.mBenchmark.mLatenciesUs.begin(), session.mBenchmark.mLatenciesUs.end());
+    }
+    std::sort(connectTimes.begin(), connectTimes.end());
+    std::sort(latencies.begin(), latencies.end());
+    const double cpuPercent = 100.0 * (double)(result.mCpuUserUs + result.mCpuSystemUs) / 1000000.0 / seconds;
+    const uint64_t sessionMemoryKiB = (connected > 0 && result.mAfterConnect.mResidentKiB > result.mBeforeConnect.mResidentKiB) ? (result.mAfterConnect.mResidentKiB - result.mBeforeConnect.mResidentKiB) / connected : 0;
+    const uint64_t sessionThreads = (connected > 0 && result.mAfterConnect.mThreads > result.mBeforeConnect.mThreads) ? (result.mAfterConnect.mThreads - result.mBeforeConnect.mThreads) / connected : 0;
+
+    if (json) {
+        fprintf(file, "{\n");
+        fprintf(file, "  \"sessions\": %d,\n", (int)result.mSessions.size());
+        fprintf(file, "  \"connected\": %d,\n", (int)connected);
+        fprintf(file, "  \"seconds\": %.3f,\n", seconds);
+        fprintf(file, "  \"frames\": %llu,\n", (unsigned long long)frames);
+        fprintf(file, "  \"frames_per_second\": %.2f,\n", (double)frames / seconds);
+        fprintf(file, "  \"received_bytes\": %llu,\n", (unsigned long long)receivedBytes);
+        fprintf(file, "  \"mbytes_per_second\": %.3f,\n", (double)receivedBytes / seconds / (1024.0 * 1024.0));
+        fprintf(file, "  \"decoded_pixels\": %llu,\n", (unsigned long long)decodedPixels);
+        fprintf(file, "  \"mpixels_per_second\": %.3f,\n", (double)decodedPixels / seconds / 1000000.0);
+        fprintf(file, "  \"connect_us\": { \"min\": %llu, \"p50\": %llu, \"max\": %llu },\n",
+                (unsigned long long)(connectTimes.empty() ? 0 : connectTimes.front()),
+                (unsigned long long)benchmarkPercentile(connectTimes, 50.0),
+                (unsigned long long)(connectTimes.empty() ? 0 : connectTimes.back()));
+        fprintf(file, "  \"latency_us\": { \"p50\": %llu, \"p90\": %llu, \"p99\": %llu },\n",
+                (unsigned long long)benchmarkPercentile(latencies, 50.0),
+                (unsigned long long)benchmarkPercentile(latencies, 90.0),
+                (unsigned long long)benchmarkPercentile(latencies, 99.0));
+        fprintf(file, "  \"cpu_user_us\": %llu,\n", (unsigned long long)result.mCpuUserUs);
+        fprintf(file, "  \"cpu_system_us\": %llu,\n", (unsigned long long)result.mCpuSystemUs);
+        fprintf(file, "  \"cpu_percent\": %.1f,\n", cpuPercent);
+        fprintf(file, "  \"resident_kib\": { \"before_connect\": %llu, \"after_connect\": %llu, \"after_measurement\": %llu, \"peak\": %llu, \"per_session\": %llu },\n",
+                (unsigned long long)result.mBeforeConnect.mResidentKiB,
+                (unsigned long long)result.mAfterConnect.mResidentKiB,
+                (unsigned long long)result.mAfterMeasurement.mResidentKiB,
+                (unsigned long long)result.mAfterMeasurement.mPeakResidentKiB,
+                (unsigned long long)sessionMemoryKiB);
+        fprintf(file, "  \"threads\": { \"before_connect\": %llu, \"after_connect\": %llu, \"per_session\": %llu },\n",
+                (unsigned long long)result.mBeforeConnect.mThreads,
+                (unsigned long long)result.mAfterConnect.mThreads,
+                (unsigned long long)sessionThreads);
+        fprintf(file, "  \"per_session\": [\n");
+        for (size_t i = 0; i < result.mSessions.size(); i++) {
+            const LoadTestSessionResult& session = result.mSessions[i];
+            const BenchmarkResult& benchmark = session.mBenchmark;
+            const double sessionSeconds = std::max(1e-6, (double)benchmark.mElapsedUs / 1000000.0);
+            fprintf(file, "    { \"host\": ");
+            benchmarkPrintJsonString(file, session.mTarget.mHostName.c_str());
+            fprintf(file, ", \"port\": %d, \"connected\": %s, \"connect_us\": %llu, \"frames\": %llu, \"frames_per_second\": %.2f, \"mbytes_per_second\": %.3f, \"latency_p50_us\": %llu, \"error\": ",
+                    (int)session.mTarget.mPort,
+                    session.mConnected ? "true" : "false",
+                    (unsigned long long)session.mConnectUs,
+                    (unsigned long long)benchmark.mFrames,
+                    (double)benchmark.mFrames / sessionSeconds,
+                    (double)benchmark.mReceivedBytes / sessionSeconds / (1024.0 * 1024.0),
+                    (unsigned long long)benchmarkPercentile(benchmark.mLatenciesUs, 50.0));
+            const orv_error_t& error = session.mConnected ? benchmark.mError : session.mConnectError;
+            if (error.mHasError) {
+                benchmarkPrintJsonString(file, error.mErrorMessage);
+            }
+            else {
+                fprintf(file, "null");
+            }
+            fprintf(file, " }%s\n", (i + 1 < result.mSessions.size()) ? "," : "");
+        }
+        fprintf(file, "  ]\n");
+        fprintf(file, "}\n");
+        return;
+    }
+    fprintf(file, "Load test with %d sessions, %d connected:\n", (int)result.mSessions.size(), (int)connected);
+    fprintf(file, "  Frames:         %llu in %.2f s (%.2f fps total)\n", (unsigned long long)frames, seconds, (double)frames / seconds);
+    fprintf(file, "  Received:       %.2f MB (%.2f MB/s total)\n", (double)receivedBytes / (1024.0 * 1024.0), (double)receivedBytes / seconds / (1024.0 * 1024.0));
+    fprintf(file, "  Decoded:        %.2f MPixels (%.2f MPixels/s total)\n", (double)decodedPixels / 1000000.0, (double)decodedPixels / seconds / 1000000.0);
+    fprintf(file, "  Connect time:   min %.2f ms, p50 %.2f ms, max %.2f ms\n",
+            (double)(connectTimes.empty() ? 0 : connectTimes.front()) / 1000.0,
+            (double)benchmarkPercentile(connectTimes, 50.0) / 1000.0,
+            (double)(connectTimes.empty() ? 0 : connectTimes.back()) / 1000.0);
+    fprintf(file, "  Latency:        p50 %.2f ms, p90 %.2f ms, p99 %.2f ms\n",
+            (double)benchmarkPercentile(latencies, 50.0) / 1000.0,
+            (double)benchmarkPercentile(latencies, 90.0) / 1000.0,
+            (double)benchmarkPercentile(latencies, 99.0) / 1000.0);
+    fprintf(file, "  CPU time:       user %.2f s, system %.2f s (%.1f%% of one core)\n", (double)result.mCpuUserUs / 1000000.0, (double)result.mCpuSystemUs / 1000000.0, cpuPercent);
+    fprintf(file, "  Resident:       %.1f MB before connecting, %.1f MB connected (%.1f KB per session), %.1f MB peak\n",
+            (double)result.mBeforeConnect.mResidentKiB / 1024.0,
+            (double)result.mAfterConnect.mResidentKiB / 1024.0,
+            (double)sessionMemoryKiB,
+            (double)result.mAfterMeasurement.mPeakResidentKiB / 1024.0);
+    fprintf(file, "  Threads:        %llu before connecting, %llu connected (%llu per session)\n",
+            (unsigned long long)result.mBeforeConnect.mThreads,
+            (unsigned long long)result.mAfterConnect.mThreads,
+            (unsigned long long)sessionThreads);
+    fprintf(file, "  Sessions:\n");
+    for (size_t i = 0; i < result.mSessions.size(); i++) {
+        const LoadTestSessionResult& session = result.mSessions[i];
+        if (!session.mConnected) {
+            fprintf(file, "    #%-4d %s:%d  not connected: %s\n", (int)i, session.mTarget.mHostName.c_str(), (int)session.mTarget.mPort, session.mConnectError.mErrorMessage);
+            continue;
+        }
+        const BenchmarkResult& benchmark = session.mBenchmark;
+        const double sessionSeconds = std::max(1e-6, (double)benchmark.mElapsedUs / 1000000.0);
+        fprintf(file, "    #%-4d %s:%d  connect %.2f ms, %.2f fps, %.2f MB/s, latency p50 %.2f ms%s%s\n",
+                (int)i,
+                session.mTarget.mHostName.c_str(),
+                (int)session.mTarget.mPort,
+                (double)session.mConnectUs / 1000.0,
+                (double)benchmark.mFrames / sessionSeconds,
+                (double)benchmark.mReceivedBytes / sessionSeconds / (1024.0 * 1024.0),
+                (double)benchmarkPercentile(benchmark.mLatenciesUs, 50.0) / 1000.0,
+                benchmark.mError.mHasError ? ", error: " : "",
+                benchmark.mError.mHasError ? benchmark.mError.mErrorMessage : "");
+    }
+}
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2018 Monument-Software GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OPENRV_CMDLINE_LOADTEST_H
+#define OPENRV_CMDLINE_LOADTEST_H
+
+#include "benchmark.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+/**
+ * @file loadtest.h
+ *
+ * The --sessions mode of the cmdline tool: runs the benchmark of benchmark.h on many connections
+ * at once, to find out how many sessions a single viewer host can sustain.
+ **/
+
+struct LoadTestTarget
+{
+    std::string mHostName;
+    uint16_t mPort = 5900;
+};
+
+struct LoadTestOptions
+{
+    uint32_t mSessions = 1;
+    /**
+     * Delay between starting two connections in milliseconds, so that the servers are not hit by
+     * all handshakes at once.
+     **/
+    uint32_t mStaggerMs = 100;
+    /**
+     * The hosts to connect to, the sessions are distributed round-robin.
+     **/
+    std::vector<LoadTestTarget> mTargets;
+    /**
+     * Transport used for all targets, see @ref orv_connect_options_t::mTransportType.
+     **/
+    orv_transport_type_t mTransportType = ORV_TRANSPORT_TCP;
+    const char* mPassword = nullptr;
+    BenchmarkOptions mBenchmark;
+};
+
+/**
+ * Memory footprint and thread count of the process, as far as the platform reports it (all values
+ * are 0 otherwise).
+ **/
+struct LoadTestProcessSample
+{
+    uint64_t mResidentKiB = 0;
+    uint64_t mPeakResidentKiB = 0;
+    uint64_t mThreads = 0;
+};
+
+struct LoadTestSessionResult
+{
+    LoadTestTarget mTarget;
+    bool mConnected = false;
+    /**
+     * Time from calling orv_connect() until the ORV_EVENT_CONNECT_RESULT event was received.
+     **/
+    uint64_t mConnectUs = 0;
+    orv_error_t mConnectError;
+    /**
+     * The measurement of the session, only valid if @ref mConnected is TRUE. The CPU time is
+     * reported for the whole process only, see @ref LoadTestResult.
+     **/
+    BenchmarkResult mBenchmark;
+
+    LoadTestSessionResult()
+    {
+        orv_error_reset(&mConnectError);
+    }
+};
+
+struct LoadTestResult
+{
+    std::vector<LoadTestSessionResult> mSessions;
+    /**
+     * Duration of the measurement, which starts once all connection attempts have completed.
+     **/
+    uint64_t mElapsedUs = 0;
+    uint64_t mCpuUserUs = 0;
+    uint64_t mCpuSystemUs = 0;
+    LoadTestProcessSample mBeforeConnect;
+    LoadTestProcessSample mAfterConnect;
+    LoadTestProcessSample mAfterMeasurement;
+};
+
+bool runLoadTest(const LoadTestOptions& options, LoadTestResult* result);
+void printLoadTestResult(FILE* file, const LoadTestResult& result, bool json);
+
+#endif
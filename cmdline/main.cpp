@@ -22,17 +22,64 @@
 #include <sys/stat.h>
 #include <errno.h>
 #include <algorithm>
+#include <memory>
+#include <string>
+#if defined(ORV_CMDLINE_MOCKSERVER)
+#include <thread>
+#endif // ORV_CMDLINE_MOCKSERVER
 
 #include <libopenrv/orv_error.h>
 #include <libopenrv/orv_logging.h>
 #include <libopenrv/libopenrv.h>
 
+#include "benchmark.h"
+#include "latencytest.h"
+#include "loadtest.h"
+#if defined(ORV_CMDLINE_MOCKSERVER)
+#include "mockserver.h"
+#endif // ORV_CMDLINE_MOCKSERVER
+
 struct Options
 {
     static const size_t mMaxHostNameLen = 256;
     char mHostName[mMaxHostNameLen + 1] = {};
     uint16_t mPort = 5900;
+    /**
+     * Transport used to reach @ref mHostName. For unix domain sockets (--unix) the host name is the
+     * socket path, for memory pipes (--memory-pipe) the name of the in-process listener.
+     **/
+    orv_transport_type_t mTransportType = ORV_TRANSPORT_TCP;
+    /**
+     * Scenario of the in-process mock server started for --memory-pipe.
+     **/
+    std::string mMemoryPipeScenario;
+    /**
+     * File the data received from the server is captured to (see @ref orv_set_capture_file()),
+     * empty to disable.
+     **/
+    std::string mCaptureFile;
     char* mPassword = nullptr;
+    /**
+     * If TRUE, run the benchmark (see benchmark.h) once connected, configured by @ref mBenchmark.
+     **/
+    bool mBench = false;
+    BenchmarkOptions mBenchmark;
+    /**
+     * Number of sessions of the load test (see loadtest.h), 0 to run the benchmark on a single
+     * connection. Implies @ref mBench.
+     **/
+    uint32_t mSessions = 0;
+    uint32_t mStaggerMs = 100;
+    /**
+     * Hosts of the load test, given by --hosts. If empty, @ref mHostName and @ref mPort are used.
+     **/
+    std::vector<LoadTestTarget> mTargets;
+    /**
+     * If TRUE, run the latency test (see latencytest.h) once connected, configured by @ref
+     * mLatencyTest.
+     **/
+    bool mLatencyTester = false;
+    LatencyTestOptions mLatencyTest;
 
     ~Options()
     {
@@ -40,6 +87,72 @@ struct Options
     }
 };
 
+#if defined(ORV_CMDLINE_MOCKSERVER)
+/**
+ * The mock server of --memory-pipe, served by a thread of this process during the lifetime of this
+ * object.
+ **/
+class InProcessMockServer
+{
+public:
+    explicit InProcessMockServer(const openrv::bench::MockServerOptions& options)
+        : mServer(options)
+    {
+    }
+    ~InProcessMockServer()
+    {
+        if (mThread.joinable()) {
+            mServer.stop();
+            mThread.join();
+        }
+    }
+    bool start(const char* memoryPipeName, orv_error_t* error)
+    {
+        if (!mServer.listenMemoryPipe(memoryPipeName, error)) {
+            return false;
+        }
+        mThread = std::thread(&openrv::bench::MockServer::run, &mServer);
+        return true;
+    }
+
+private:
+    openrv::bench::MockServer mServer;
+    std::thread mThread;
+};
+#endif // ORV_CMDLINE_MOCKSERVER
+
+/**
+ * Parse a comma separated list of host[:port] entries into @p targets.
+ *
+ * @return TRUE on success, FALSE on failure
+ **/
+static bool parseTargets(std::vector<LoadTestTarget>* targets, const char* list, orv_error_t* error)
+{
+    std::string remaining = list;
+    while (!remaining.empty()) {
+        const size_t comma = remaining.find(',');
+        const std::string entry = remaining.substr(0, comma);
+        remaining = (comma == std::string::npos) ? std::string() : remaining.substr(comma + 1);
+        LoadTestTarget target;
+        const size_t colon = entry.rfind(':');
+        target.mHostName = entry.substr(0, colon);
+        if (colon != std::string::npos) {
+            const int port = atoi(entry.c_str() + colon + 1);
+            if (port <= 0 || port > 65535) {
+                orv_error_set(error, ORV_ERR_GENERIC, 0, "Invalid port in --hosts entry '%s'", entry.c_str());
+                return false;
+            }
+            target.mPort = (uint16_t)port;
+        }
+        if (target.mHostName.empty() || target.mHostName.size() > ORV_MAX_HOSTNAME_LEN) {
+            orv_error_set(error, ORV_ERR_GENERIC, 0, "Invalid host in --hosts entry '%s'", entry.c_str());
+            return false;
+        }
+        targets->push_back(target);
+    }
+    return true;
+}
+
 /**
  * Parse the specified command line arguments and store the results in @p options.
  *
@@ -66,6 +179,43 @@ static bool readArguments(Options* options, orv_error_t* error, int argc, char**
             i++;
             options->mPort = atoi(argv[i]);
         }
+        else if (strcmp(param, "--unix") == 0) {
+            if (i + 1 >= argc) {
+                orv_error_set(error, ORV_ERR_GENERIC, 0, "Expected argument for --unix");
+                return !error->mHasError;
+            }
+            i++;
+            options->mTransportType = ORV_TRANSPORT_UNIX_SOCKET;
+            strncpy(options->mHostName, argv[i], Options::mMaxHostNameLen);
+        }
+        else if (strcmp(param, "--memory-pipe") == 0) {
+            if (i + 1 >= argc) {
+                orv_error_set(error, ORV_ERR_GENERIC, 0, "Expected argument for --memory-pipe");
+                return !error->mHasError;
+            }
+            i++;
+#if defined(ORV_CMDLINE_MOCKSERVER)
+            openrv::bench::MockScenario scenario;
+            if (!openrv::bench::parseMockScenario(&scenario, argv[i])) {
+                orv_error_set(error, ORV_ERR_GENERIC, 0, "Invalid scenario %s, expected static, text, noise or windows", argv[i]);
+                return !error->mHasError;
+            }
+            options->mTransportType = ORV_TRANSPORT_MEMORY_PIPE;
+            options->mMemoryPipeScenario = argv[i];
+            strncpy(options->mHostName, "openrv_cmdline", Options::mMaxHostNameLen);
+#else // ORV_CMDLINE_MOCKSERVER
+            orv_error_set(error, ORV_ERR_GENERIC, 0, "--memory-pipe requires the mock server, build with ORV_BUILD_BENCHMARKS");
+            return !error->mHasError;
+#endif // ORV_CMDLINE_MOCKSERVER
+        }
+        else if (strcmp(param, "--capture") == 0) {
+            if (i + 1 >= argc) {
+                orv_error_set(error, ORV_ERR_GENERIC, 0, "Expected argument for --capture");
+                return !error->mHasError;
+            }
+            i++;
+            options->mCaptureFile = argv[i];
+        }
         else if (strcmp(param, "--passwordfile") == 0) {
             if (i + 1 >= argc) {
                 orv_error_set(error, ORV_ERR_GENERIC, 0, "Expected argument for --passwordfile");
@@ -102,10 +252,200 @@ static bool readArguments(Options* options, orv_error_t* error, int argc, char**
                 options->mPassword[read - 1] = '\0';
             }
         }
+        else if (strcmp(param, "--bench") == 0) {
+            options->mBench = true;
+        }
+        else if (strcmp(param, "--duration") == 0) {
+            if (i + 1 >= argc) {
+                orv_error_set(error, ORV_ERR_GENERIC, 0, "Expected argument for --duration");
+                return !error->mHasError;
+            }
+            i++;
+            options->mBenchmark.mDurationMs = (uint32_t)(atof(argv[i]) * 1000.0);
+        }
+        else if (strcmp(param, "--frames") == 0) {
+            if (i + 1 >= argc) {
+                orv_error_set(error, ORV_ERR_GENERIC, 0, "Expected argument for --frames");
+                return !error->mHasError;
+            }
+            i++;
+            options->mBenchmark.mMaxFrames = strtoull(argv[i], nullptr, 10);
+        }
+        else if (strcmp(param, "--non-incremental") == 0) {
+            options->mBenchmark.mNonIncremental = true;
+        }
+        else if (strcmp(param, "--skip-framebuffer") == 0) {
+            options->mBenchmark.mSkipFramebuffer = true;
+        }
+        else if (strcmp(param, "--mipmaps") == 0) {
+            if (i + 1 >= argc) {
+                orv_error_set(error, ORV_ERR_GENERIC, 0, "Expected argument for --mipmaps");
+                return !error->mHasError;
+            }
+            i++;
+            const int levels = atoi(argv[i]);
+            if (levels < 0 || levels > ORV_MAX_MIPMAP_LEVELS) {
+                orv_error_set(error, ORV_ERR_GENERIC, 0, "Invalid number of mipmap levels %s, expected 0 to %d", argv[i], ORV_MAX_MIPMAP_LEVELS);
+                return !error->mHasError;
+            }
+            options->mBenchmark.mMipmapLevels = (uint8_t)levels;
+        }
+        else if (strcmp(param, "--auto-refresh") == 0) {
+            if (i + 1 >= argc) {
+                orv_error_set(error, ORV_ERR_GENERIC, 0, "Expected argument for --auto-refresh");
+                return !error->mHasError;
+            }
+            i++;
+            if (!options->mBenchmark.mAutoRefresh) {
+                orv_auto_refresh_options_default(&options->mBenchmark.mAutoRefreshOptions);
+            }
+            options->mBenchmark.mAutoRefresh = true;
+            options->mBenchmark.mAutoRefreshOptions.mTargetFps = (uint32_t)atoi(argv[i]);
+        }
+        else if (strcmp(param, "--auto-refresh-outstanding") == 0) {
+            if (i + 1 >= argc) {
+                orv_error_set(error, ORV_ERR_GENERIC, 0, "Expected argument for --auto-refresh-outstanding");
+                return !error->mHasError;
+            }
+            i++;
+            if (!options->mBenchmark.mAutoRefresh) {
+                orv_auto_refresh_options_default(&options->mBenchmark.mAutoRefreshOptions);
+            }
+            options->mBenchmark.mAutoRefresh = true;
+            options->mBenchmark.mAutoRefreshOptions.mMaxOutstandingRequests = (uint32_t)atoi(argv[i]);
+        }
+        else if (strcmp(param, "--viewport") == 0) {
+            if (i + 1 >= argc) {
+                orv_error_set(error, ORV_ERR_GENERIC, 0, "Expected argument for --viewport");
+                return !error->mHasError;
+            }
+            i++;
+            unsigned int w = 0;
+            unsigned int h = 0;
+            unsigned int x = 0;
+            unsigned int y = 0;
+            if (sscanf(argv[i], "%ux%u+%u+%u", &w, &h, &x, &y) != 4 || w > 0xffff || h > 0xffff || x > 0xffff || y > 0xffff) {
+                orv_error_set(error, ORV_ERR_GENERIC, 0, "Invalid viewport %s, expected <width>x<height>+<x>+<y>", argv[i]);
+                return !error->mHasError;
+            }
+            options->mBenchmark.mViewport = true;
+            options->mBenchmark.mViewportX = (uint16_t)x;
+            options->mBenchmark.mViewportY = (uint16_t)y;
+            options->mBenchmark.mViewportWidth = (uint16_t)w;
+            options->mBenchmark.mViewportHeight = (uint16_t)h;
+        }
+        else if (strcmp(param, "--activity") == 0) {
+            if (i + 1 >= argc) {
+                orv_error_set(error, ORV_ERR_GENERIC, 0, "Expected argument for --activity");
+                return !error->mHasError;
+            }
+            i++;
+            if (strcmp(argv[i], "visible") == 0) {
+                options->mBenchmark.mActivityState = ORV_ACTIVITY_STATE_VISIBLE;
+            }
+            else if (strcmp(argv[i], "background") == 0) {
+                options->mBenchmark.mActivityState = ORV_ACTIVITY_STATE_BACKGROUND;
+            }
+            else if (strcmp(argv[i], "paused") == 0) {
+                options->mBenchmark.mActivityState = ORV_ACTIVITY_STATE_PAUSED;
+            }
+            else {
+                orv_error_set(error, ORV_ERR_GENERIC, 0, "Invalid activity state %s, expected visible, background or paused", argv[i]);
+                return !error->mHasError;
+            }
+        }
+        else if (strcmp(param, "--json") == 0) {
+            options->mBenchmark.mJson = true;
+        }
+        else if (strcmp(param, "--sessions") == 0) {
+            if (i + 1 >= argc) {
+                orv_error_set(error, ORV_ERR_GENERIC, 0, "Expected argument for --sessions");
+                return !error->mHasError;
+            }
+            i++;
+            const int sessions = atoi(argv[i]);
+            if (sessions <= 0) {
+                orv_error_set(error, ORV_ERR_GENERIC, 0, "Invalid number of sessions %s", argv[i]);
+                return !error->mHasError;
+            }
+            options->mSessions = (uint32_t)sessions;
+            options->mBench = true;
+        }
+        else if (strcmp(param, "--stagger") == 0) {
+            if (i + 1 >= argc) {
+                orv_error_set(error, ORV_ERR_GENERIC, 0, "Expected argument for --stagger");
+                return !error->mHasError;
+            }
+            i++;
+            options->mStaggerMs = (uint32_t)atoi(argv[i]);
+        }
+        else if (strcmp(param, "--latency-tester") == 0) {
+            if (i + 1 >= argc) {
+                orv_error_set(error, ORV_ERR_GENERIC, 0, "Expected argument for --latency-tester");
+                return !error->mHasError;
+            }
+            i++;
+            std::vector<LoadTestTarget> targets;
+            if (!parseTargets(&targets, argv[i], error)) {
+                return !error->mHasError;
+            }
+            if (targets.size() != 1 || strchr(argv[i], ':') == nullptr) {
+                orv_error_set(error, ORV_ERR_GENERIC, 0, "Expected <host>:<port> for --latency-tester");
+                return !error->mHasError;
+            }
+            options->mLatencyTester = true;
+            options->mLatencyTest.mHostName = targets[0].mHostName;
+            options->mLatencyTest.mPort = targets[0].mPort;
+        }
+        else if (strcmp(param, "--latency-rate") == 0) {
+            if (i + 1 >= argc) {
+                orv_error_set(error, ORV_ERR_GENERIC, 0, "Expected argument for --latency-rate");
+                return !error->mHasError;
+            }
+            i++;
+            options->mLatencyTest.mContinuous.mRequestsPerSecond = (uint32_t)atoi(argv[i]);
+        }
+        else if (strcmp(param, "--latency-outstanding") == 0) {
+            if (i + 1 >= argc) {
+                orv_error_set(error, ORV_ERR_GENERIC, 0, "Expected argument for --latency-outstanding");
+                return !error->mHasError;
+            }
+            i++;
+            options->mLatencyTest.mContinuous.mMaxOutstandingRequests = (uint32_t)atoi(argv[i]);
+        }
+        else if (strcmp(param, "--hosts") == 0) {
+            if (i + 1 >= argc) {
+                orv_error_set(error, ORV_ERR_GENERIC, 0, "Expected argument for --hosts");
+                return !error->mHasError;
+            }
+            i++;
+            if (!parseTargets(&options->mTargets, argv[i], error)) {
+                return !error->mHasError;
+            }
+        }
         else {
             orv_error_set(error, ORV_ERR_GENERIC, 0, "Unknown argument %s", param);
         }
     }
+    if (!error->mHasError && options->mBench && options->mBenchmark.mDurationMs == 0 && options->mBenchmark.mMaxFrames == 0) {
+        orv_error_set(error, ORV_ERR_GENERIC, 0, "--bench requires a --duration or --frames limit");
+    }
+    if (!error->mHasError && !options->mCaptureFile.empty() && options->mSessions > 0) {
+        orv_error_set(error, ORV_ERR_GENERIC, 0, "--capture cannot be combined with --sessions");
+    }
+    if (!error->mHasError && options->mLatencyTester) {
+        if (options->mBench) {
+            orv_error_set(error, ORV_ERR_GENERIC, 0, "--latency-tester cannot be combined with --bench or --sessions");
+        }
+        else if (options->mBenchmark.mDurationMs == 0) {
+            orv_error_set(error, ORV_ERR_GENERIC, 0, "--latency-tester requires a --duration");
+        }
+        else if (options->mLatencyTest.mContinuous.mRequestsPerSecond == 0 || options->mLatencyTest.mContinuous.mMaxOutstandingRequests == 0) {
+            orv_error_set(error, ORV_ERR_GENERIC, 0, "--latency-rate and --latency-outstanding must be positive");
+        }
+        options->mLatencyTest.mDurationMs = options->mBenchmark.mDurationMs;
+        options->mLatencyTest.mJson = options->mBenchmark.mJson;
+    }
     return !error->mHasError;
 }
 
@@ -120,13 +460,62 @@ int main(int argc, char** argv)
     if (options.mHostName[0] == '\0') {
         strncpy(options.mHostName, "localhost", Options::mMaxHostNameLen);
     }
+#if defined(ORV_CMDLINE_MOCKSERVER)
+    // NOTE: memory pipes work within the process only, so the server has to be started here.
+    std::unique_ptr<InProcessMockServer> mockServer;
+    if (options.mTransportType == ORV_TRANSPORT_MEMORY_PIPE) {
+        openrv::bench::MockServerOptions mockServerOptions;
+        openrv::bench::parseMockScenario(&mockServerOptions.mScenario, options.mMemoryPipeScenario.c_str());
+        mockServer.reset(new InProcessMockServer(mockServerOptions));
+        if (!mockServer->start(options.mHostName, &error)) {
+            fprintf(stderr, "Failed to start the in-process mock server. Error message: %s\n", error.mErrorMessage);
+            return 1;
+        }
+    }
+#endif // ORV_CMDLINE_MOCKSERVER
+
+    if (options.mSessions > 0) {
+        LoadTestOptions loadTestOptions;
+        loadTestOptions.mSessions = options.mSessions;
+        loadTestOptions.mStaggerMs = options.mStaggerMs;
+        loadTestOptions.mTargets = options.mTargets;
+        loadTestOptions.mTransportType = options.mTransportType;
+        if (loadTestOptions.mTargets.empty()) {
+            LoadTestTarget target;
+            target.mHostName = options.mHostName;
+            target.mPort = options.mPort;
+            loadTestOptions.mTargets.push_back(target);
+        }
+        loadTestOptions.mPassword = options.mPassword;
+        loadTestOptions.mBenchmark = options.mBenchmark;
+        LoadTestResult result;
+        const bool success = runLoadTest(loadTestOptions, &result);
+        printLoadTestResult(stdout, result, options.mBenchmark.mJson);
+        fflush(stdout);
+        return success ? 0 : 1;
+    }
 
     orv_config_t orvConfig;
     orv_config_default(&orvConfig);
+    if (options.mBench || options.mLatencyTester) {
+        // debug output of the library would distort the measurement
+        orvConfig.mMinLogSeverity = ORV_LOGGING_SEVERITY_WARNING;
+    }
+    orvConfig.mSkipFramebuffer = options.mBenchmark.mSkipFramebuffer ? 1 : 0;
+    orvConfig.mMipmapLevels = options.mBenchmark.mMipmapLevels;
+    // NOTE: in JSON mode stdout is reserved for the JSON document
+    FILE* infoOutput = ((options.mBench || options.mLatencyTester) && options.mBenchmark.mJson) ? stderr : stdout;
     orv_context_t* orvContext = orv_init(&orvConfig);
     orv_error_t connectError;
     orv_connect_options_t connectOptions;
     orv_connect_options_default(&connectOptions);
+    connectOptions.mTransportType = options.mTransportType;
+    if (!options.mCaptureFile.empty() && orv_set_capture_file(orvContext, options.mCaptureFile.c_str(), &error) != 0) {
+        fprintf(stderr, "Failed to create the capture file. Error message: %s\n", error.mErrorMessage);
+        fflush(stderr);
+        orv_destroy(orvContext);
+        return 1;
+    }
     if (orv_set_credentials(orvContext, nullptr, options.mPassword)) {
         fprintf(stderr, "Failed to set credentials");
         fflush(stderr);
@@ -154,9 +543,9 @@ int main(int argc, char** argv)
                     fflush(stderr);
                 }
                 else {
-                    fprintf(stdout, "Connected to host '%s' on port %d.\n  Reported framebuffer: %dx%d\n  Desktop name: %s\n", data->mHostName, (int)data->mPort, (int)data->mFramebufferWidth, (int)data->mFramebufferHeight, data->mDesktopName);
+                    fprintf(infoOutput, "Connected to host '%s' on port %d.\n  Reported framebuffer: %dx%d\n  Desktop name: %s\n", data->mHostName, (int)data->mPort, (int)data->mFramebufferWidth, (int)data->mFramebufferHeight, data->mDesktopName);
                     const orv_communication_pixel_format_t* cpf = &data->mCommunicationPixelFormat;
-                    fprintf(stdout, "  Reported communication pixel format: TrueColor: %s, BitsPerPixel: %d, Depth: %d, max r/g/b: %d/%d/%d, r/g/b shift: %d/%d/%d, BigEndian: %s\n",
+                    fprintf(infoOutput, "  Reported communication pixel format: TrueColor: %s, BitsPerPixel: %d, Depth: %d, max r/g/b: %d/%d/%d, r/g/b shift: %d/%d/%d, BigEndian: %s\n",
                             cpf->mTrueColor ? "true" : "false",
                             (int)cpf->mBitsPerPixel,
                             (int)cpf->mDepth,
@@ -167,7 +556,7 @@ int main(int argc, char** argv)
                             (int)cpf->mColorShift[1],
                             (int)cpf->mColorShift[2],
                             cpf->mBigEndian ? "true" : "false");
-                    fflush(stdout);
+                    fflush(infoOutput);
                     connected = true;
                     framebufferWidth = data->mFramebufferWidth;
                     framebufferHeight = data->mFramebufferHeight;
@@ -191,6 +580,24 @@ int main(int argc, char** argv)
         }
     }
 
+    if (options.mBench) {
+        BenchmarkResult result;
+        const bool success = runBenchmark(orvContext, options.mBenchmark, framebufferWidth, framebufferHeight, &result);
+        printBenchmarkResult(stdout, result, options.mBenchmark.mJson);
+        fflush(stdout);
+        orv_destroy(orvContext);
+        return success ? 0 : 1;
+    }
+
+    if (options.mLatencyTester) {
+        LatencyTestResult result;
+        const bool success = runLatencyTest(orvContext, options.mLatencyTest, framebufferWidth, framebufferHeight, &result);
+        printLatencyTestResult(stdout, result, options.mLatencyTest.mJson);
+        fflush(stdout);
+        orv_destroy(orvContext);
+        return success ? 0 : 1;
+    }
+
     uint8_t x = 0;
     uint8_t y = 0;
     orv_request_framebuffer_update(orvContext, x, y, framebufferWidth, framebufferHeight);
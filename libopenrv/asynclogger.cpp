@@ -0,0 +1,432 @@
+/*
+ * Copyright (C) 2018 Monument-Software GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "asynclogger.h"
+
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <chrono>
+
+static_assert((ORV_LOG_ASYNC_CAPACITY & (ORV_LOG_ASYNC_CAPACITY - 1)) == 0, "ORV_LOG_ASYNC_CAPACITY must be a power of two");
+
+/**
+ * First bytes of a log file written in the @ref ORV_LOG_ASYNC_FORMAT_BINARY format.
+ **/
+#define ORV_LOG_ASYNC_BINARY_MAGIC "ORVLOG01"
+
+namespace openrv {
+
+/**
+ * Time in milliseconds the writer thread sleeps at most if the ring buffer is empty.
+ **/
+static const int gWriterIdleTimeoutMs = 50;
+
+static const char* getSeverityString(int severity)
+{
+    switch (severity) {
+        case ORV_LOGGING_SEVERITY_DEBUG:
+            return "DEBUG";
+        case ORV_LOGGING_SEVERITY_INFO:
+            return "INFO";
+        case ORV_LOGGING_SEVERITY_WARNING:
+            return "WARNING";
+        default:
+        case ORV_LOGGING_SEVERITY_ERROR:
+            return "ERROR";
+    }
+}
+
+/**
+ * Copy at most @p maxLength bytes of @p string (which may be NULL) to @p dst.
+ *
+ * @return The number of copied bytes.
+ **/
+static uint16_t copyTruncated(char* dst, const char* string, size_t maxLength)
+{
+    if (!string) {
+        return 0;
+    }
+    size_t length = strlen(string);
+    length = std::min(length, maxLength);
+    memcpy(dst, string, length);
+    return (uint16_t)length;
+}
+
+AsyncLogger::AsyncLogger()
+{
+    mCells = new Cell[ORV_LOG_ASYNC_CAPACITY];
+    for (size_t i = 0; i < ORV_LOG_ASYNC_CAPACITY; i++) {
+        mCells[i].mSequence.store(i, std::memory_order_relaxed);
+    }
+    for (std::atomic<uint64_t>& dropped : mDropped) {
+        dropped.store(0, std::memory_order_relaxed);
+    }
+}
+
+AsyncLogger::~AsyncLogger()
+{
+    stop();
+    delete[] mCells;
+}
+
+/**
+ * @return The global logger instance. The instance lives until the process exits, so that
+ *         logging threads never access a destroyed object.
+ **/
+AsyncLogger& AsyncLogger::instance()
+{
+    static AsyncLogger logger;
+    return logger;
+}
+
+/**
+ * Start the writer thread using @p config. If the logger is already running, it is stopped first.
+ *
+ * @return TRUE on success, FALSE if the log file could not be opened.
+ **/
+bool AsyncLogger::start(const orv_log_async_config_t* config)
+{
+    std::lock_guard<std::mutex> lock(mStartStopMutex);
+    if (mWriterThread.joinable()) {
+        mRunning.store(false, std::memory_order_release);
+        mWantStop.store(true, std::memory_order_release);
+        mWakeCondition.notify_one();
+        mWriterThread.join();
+    }
+    if (mFile) {
+        fclose(mFile);
+        mFile = nullptr;
+    }
+    orv_log_async_config_t defaultConfig;
+    if (!config) {
+        orv_log_async_config_default(&defaultConfig);
+        config = &defaultConfig;
+    }
+    mFormat = config->mFormat;
+    if (config->mFileName) {
+        mFile = fopen(config->mFileName, (mFormat == ORV_LOG_ASYNC_FORMAT_BINARY) ? "wb" : "w");
+        if (!mFile) {
+            return false;
+        }
+        if (mFormat == ORV_LOG_ASYNC_FORMAT_BINARY) {
+            fwrite(ORV_LOG_ASYNC_BINARY_MAGIC, 1, strlen(ORV_LOG_ASYNC_BINARY_MAGIC), mFile);
+        }
+    }
+    else {
+        // NOTE: binary output is only supported for files.
+        mFormat = ORV_LOG_ASYNC_FORMAT_TEXT;
+    }
+    mWantStop.store(false, std::memory_order_release);
+    mWriterThread = std::thread(&AsyncLogger::run, this);
+    mRunning.store(true, std::memory_order_release);
+    return true;
+}
+
+/**
+ * Stop the writer thread after writing all queued records and close the log file (if any).
+ *
+ * Records that are logged concurrently with this call may remain in the ring buffer, they are
+ * written once the logger is started again.
+ **/
+void AsyncLogger::stop()
+{
+    std::lock_guard<std::mutex> lock(mStartStopMutex);
+    mRunning.store(false, std::memory_order_release);
+    if (mWriterThread.joinable()) {
+        mWantStop.store(true, std::memory_order_release);
+        mWakeCondition.notify_one();
+        mWriterThread.join();
+    }
+    if (mFile) {
+        fclose(mFile);
+        mFile = nullptr;
+    }
+}
+
+/**
+ * Queue a record for the writer thread. Never blocks: if no space is available, the record is
+ * dropped.
+ *
+ * This function is thread-safe.
+ **/
+void AsyncLogger::log(int severity, const char* func, const char* file, int line, const char* msg)
+{
+    severity = std::max((int)ORV_LOGGING_SEVERITY_DEBUG, std::min(severity, (int)ORV_LOGGING_SEVERITY_ERROR));
+    size_t position = 0;
+    Record* record = beginPush(severity, &position);
+    if (!record) {
+        mDropped[severity].fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    record->mTimestampUs = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    record->mLine = line;
+    record->mSeverity = (uint8_t)severity;
+    size_t offset = 0;
+    record->mMessageLength = copyTruncated(record->mText, msg, ORV_LOG_ASYNC_RECORD_TEXT_SIZE);
+    offset += record->mMessageLength;
+    record->mFunctionLength = copyTruncated(record->mText + offset, func, ORV_LOG_ASYNC_RECORD_TEXT_SIZE - offset);
+    offset += record->mFunctionLength;
+    record->mFileLength = copyTruncated(record->mText + offset, file, ORV_LOG_ASYNC_RECORD_TEXT_SIZE - offset);
+    endPush(position);
+    if (mWriterSleeping.load(std::memory_order_acquire)) {
+        mWakeCondition.notify_one();
+    }
+}
+
+void AsyncLogger::getStatistics(orv_log_async_statistics_t* statistics) const
+{
+    memset(statistics, 0, sizeof(orv_log_async_statistics_t));
+    statistics->mWritten = mWritten.load(std::memory_order_relaxed);
+    for (int i = 0; i <= ORV_LOGGING_SEVERITY_ERROR; i++) {
+        statistics->mDropped[i] = mDropped[i].load(std::memory_order_relaxed);
+    }
+}
+
+/**
+ * Reserve the next cell of the ring buffer (multiple producers).
+ *
+ * @return The record of the reserved cell, which must be passed to @ref endPush() after it has
+ *         been filled. NULL if the ring is too full for a record of @p severity.
+ **/
+AsyncLogger::Record* AsyncLogger::beginPush(int severity, size_t* position)
+{
+    size_t pos = mEnqueuePosition.load(std::memory_order_relaxed);
+    Cell* cell = nullptr;
+    while (true) {
+        if (severity < ORV_LOGGING_SEVERITY_WARNING) {
+            const size_t used = pos - mDequeuePosition.load(std::memory_order_relaxed);
+            if (used >= ORV_LOG_ASYNC_CAPACITY / 4 * 3) {
+                return nullptr;
+            }
+        }
+        cell = &mCells[pos & mMask];
+        const size_t sequence = cell->mSequence.load(std::memory_order_acquire);
+        const intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+        if (diff == 0) {
+            if (mEnqueuePosition.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        }
+        else if (diff < 0) {
+            // ring is full
+            return nullptr;
+        }
+        else {
+            pos = mEnqueuePosition.load(std::memory_order_relaxed);
+        }
+    }
+    *position = pos;
+    return &cell->mRecord;
+}
+
+void AsyncLogger::endPush(size_t position)
+{
+    mCells[position & mMask].mSequence.store(position + 1, std::memory_order_release);
+}
+
+/**
+ * @return The next record in the ring, or NULL if the ring is empty. Must be followed by @ref
+ *         endPop() once the record is not needed anymore. Called by the writer thread only
+ *         (single consumer).
+ **/
+const AsyncLogger::Record* AsyncLogger::beginPop()
+{
+    const size_t position = mDequeuePosition.load(std::memory_order_relaxed);
+    Cell* cell = &mCells[position & mMask];
+    if (cell->mSequence.load(std::memory_order_acquire) != position + 1) {
+        return nullptr;
+    }
+    return &cell->mRecord;
+}
+
+void AsyncLogger::endPop()
+{
+    const size_t position = mDequeuePosition.load(std::memory_order_relaxed);
+    mCells[position & mMask].mSequence.store(position + mMask + 1, std::memory_order_release);
+    mDequeuePosition.store(position + 1, std::memory_order_relaxed);
+}
+
+void AsyncLogger::run()
+{
+    while (true) {
+        const bool wrote = writeRecords();
+        if (mWantStop.load(std::memory_order_acquire)) {
+            // NOTE: writeRecords() above was called after the stop request was made, so all records
+            //       queued before stop() have been written.
+            if (!writeRecords()) {
+                break;
+            }
+            continue;
+        }
+        if (wrote) {
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(mWakeMutex);
+        mWriterSleeping.store(true, std::memory_order_seq_cst);
+        if (!beginPop() && !mWantStop.load(std::memory_order_acquire)) {
+            mWakeCondition.wait_for(lock, std::chrono::milliseconds(gWriterIdleTimeoutMs));
+        }
+        mWriterSleeping.store(false, std::memory_order_relaxed);
+    }
+    fflush(mFile ? mFile : stdout);
+}
+
+/**
+ * Write all records that are currently in the ring.
+ *
+ * @return TRUE if at least one record was written.
+ **/
+bool AsyncLogger::writeRecords()
+{
+    bool wrote = false;
+    const Record* record = nullptr;
+    while ((record = beginPop()) != nullptr) {
+        writeRecord(*record);
+        endPop();
+        mWritten.fetch_add(1, std::memory_order_relaxed);
+        wrote = true;
+    }
+    uint64_t dropped = 0;
+    for (const std::atomic<uint64_t>& d : mDropped) {
+        dropped += d.load(std::memory_order_relaxed);
+    }
+    if (dropped != mReportedDropped) {
+        writeDroppedRecordsMessage(dropped - mReportedDropped);
+        mReportedDropped = dropped;
+        wrote = true;
+    }
+    if (wrote) {
+        if (mFile) {
+            fflush(mFile);
+        }
+        else {
+            fflush(stdout);
+            fflush(stderr);
+        }
+    }
+    return wrote;
+}
+
+void AsyncLogger::writeRecord(const Record& record)
+{
+    if (mFormat == ORV_LOG_ASYNC_FORMAT_BINARY) {
+        // NOTE: all fields are written in host byte order, see ORV_LOG_ASYNC_FORMAT_BINARY.
+        const uint8_t reserved = 0;
+        fwrite(&record.mTimestampUs, sizeof(record.mTimestampUs), 1, mFile);
+        fwrite(&record.mLine, sizeof(record.mLine), 1, mFile);
+        fwrite(&record.mSeverity, sizeof(record.mSeverity), 1, mFile);
+        fwrite(&reserved, sizeof(reserved), 1, mFile);
+        fwrite(&record.mMessageLength, sizeof(record.mMessageLength), 1, mFile);
+        fwrite(&record.mFunctionLength, sizeof(record.mFunctionLength), 1, mFile);
+        fwrite(&record.mFileLength, sizeof(record.mFileLength), 1, mFile);
+        fwrite(record.mText, 1, record.mMessageLength + record.mFunctionLength + record.mFileLength, mFile);
+        return;
+    }
+    FILE* f = mFile;
+    if (!f) {
+        f = (record.mSeverity >= ORV_LOGGING_SEVERITY_WARNING) ? stderr : stdout;
+    }
+    const time_t seconds = (time_t)(record.mTimestampUs / 1000000);
+    struct tm localTime;
+#if defined(_MSC_VER)
+    localtime_s(&localTime, &seconds);
+#else // _MSC_VER
+    localtime_r(&seconds, &localTime);
+#endif // _MSC_VER
+    char timeString[64] = {};
+    strftime(timeString, sizeof(timeString) - 1, "%Y-%m-%d %H:%M:%S", &localTime);
+    const char* message = record.mText;
+    const char* function = record.mText + record.mMessageLength;
+    const char* file = function + record.mFunctionLength;
+    if (record.mFunctionLength > 0) {
+        fprintf(f, "%s[%s:%03d]: %.*s (%.*s in %.*s:%d)\n", getSeverityString(record.mSeverity), timeString, (int)((record.mTimestampUs / 1000) % 1000), (int)record.mMessageLength, message, (int)record.mFunctionLength, function, (int)record.mFileLength, file, (int)record.mLine);
+    }
+    else {
+        fprintf(f, "%s[%s:%03d]: %.*s (%.*s:%d)\n", getSeverityString(record.mSeverity), timeString, (int)((record.mTimestampUs / 1000) % 1000), (int)record.mMessageLength, message, (int)record.mFileLength, file, (int)record.mLine);
+    }
+}
+
+void AsyncLogger::writeDroppedRecordsMessage(uint64_t dropped)
+{
+    char message[128];
+    snprintf(message, sizeof(message), "%llu log messages were dropped, because the log writer could not keep up", (unsigned long long)dropped);
+    Record record;
+    record.mTimestampUs = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    record.mLine = __LINE__;
+    record.mSeverity = ORV_LOGGING_SEVERITY_WARNING;
+    record.mMessageLength = copyTruncated(record.mText, message, ORV_LOG_ASYNC_RECORD_TEXT_SIZE);
+    record.mFunctionLength = 0;
+    record.mFileLength = copyTruncated(record.mText + record.mMessageLength, __FILE__, ORV_LOG_ASYNC_RECORD_TEXT_SIZE - record.mMessageLength);
+    writeRecord(record);
+}
+
+} // namespace openrv
+
+extern "C" {
+
+void orv_log_async_config_default(orv_log_async_config_t* config)
+{
+    memset(config, 0, sizeof(orv_log_async_config_t));
+    config->mFileName = nullptr;
+    config->mFormat = ORV_LOG_ASYNC_FORMAT_TEXT;
+}
+
+/**
+ * Start the asynchronous logging backend using @p config (may be NULL to use the defaults, see
+ * @ref orv_log_async_config_default()). Afterwards @ref orv_log_async() queues the messages for a
+ * background writer thread instead of writing them on the calling thread.
+ *
+ * If the backend is already running, it is restarted with the new @p config.
+ *
+ * @return 0 on success, non-zero if the log file could not be opened.
+ **/
+int orv_log_async_start(const orv_log_async_config_t* config)
+{
+    if (!openrv::AsyncLogger::instance().start(config)) {
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Write all queued messages and stop the writer thread of the asynchronous logging backend.
+ * Afterwards @ref orv_log_async() behaves like @ref orv_log_stdoutstderr().
+ *
+ * Should be called before the application exits, after all contexts have been destroyed.
+ **/
+void orv_log_async_stop(void)
+{
+    openrv::AsyncLogger::instance().stop();
+}
+
+void orv_log_async_get_statistics(orv_log_async_statistics_t* statistics)
+{
+    openrv::AsyncLogger::instance().getStatistics(statistics);
+}
+
+void orv_log_async(int severity, const char* func, const char* file, int line, const char* msg)
+{
+    openrv::AsyncLogger& logger = openrv::AsyncLogger::instance();
+    if (!logger.isRunning()) {
+        orv_log_stdoutstderr(severity, func, file, line, msg);
+        return;
+    }
+    logger.log(severity, func, file, line, msg);
+}
+
+} // extern "C"
+
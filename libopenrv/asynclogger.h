@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2018 Monument-Software GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OPENRV_ASYNCLOGGER_H
+#define OPENRV_ASYNCLOGGER_H
+
+#include <libopenrv/orv_logging.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+/**
+ * Number of records the ring buffer of @ref openrv::AsyncLogger can hold. Must be a power of two.
+ **/
+#define ORV_LOG_ASYNC_CAPACITY 4096
+/**
+ * Maximum number of bytes of message, function and file name stored per record. Longer messages
+ * are truncated.
+ **/
+#define ORV_LOG_ASYNC_RECORD_TEXT_SIZE 480
+
+namespace openrv {
+
+/**
+ * Backend of @ref orv_log_async(): log records are copied into a bounded lock-free ring buffer
+ * by the logging threads and written to stdout/stderr or a file by a background writer thread,
+ * so that logging never blocks the calling thread (normally the connection thread) on I/O.
+ *
+ * If the ring buffer is full, new records are dropped and counted instead of waiting for the
+ * writer. Debug and info records are already dropped when the ring is 3/4 full, to leave room for
+ * warnings and errors. The writer reports the number of dropped records in the log.
+ *
+ * There is exactly one instance, see @ref instance().
+ **/
+class AsyncLogger
+{
+public:
+    ~AsyncLogger();
+    static AsyncLogger& instance();
+
+    bool start(const orv_log_async_config_t* config);
+    void stop();
+    bool isRunning() const;
+    void log(int severity, const char* func, const char* file, int line, const char* msg);
+    void getStatistics(orv_log_async_statistics_t* statistics) const;
+
+private:
+    struct Record
+    {
+        uint64_t mTimestampUs;
+        int32_t mLine;
+        uint8_t mSeverity;
+        uint16_t mMessageLength;
+        uint16_t mFunctionLength;
+        uint16_t mFileLength;
+        char mText[ORV_LOG_ASYNC_RECORD_TEXT_SIZE];
+    };
+    struct Cell
+    {
+        std::atomic<size_t> mSequence;
+        Record mRecord;
+    };
+
+private:
+    AsyncLogger();
+    Record* beginPush(int severity, size_t* position);
+    void endPush(size_t position);
+    const Record* beginPop();
+    void endPop();
+    void run();
+    bool writeRecords();
+    void writeRecord(const Record& record);
+    void writeDroppedRecordsMessage(uint64_t dropped);
+
+private:
+    static const size_t mMask = ORV_LOG_ASYNC_CAPACITY - 1;
+    Cell* mCells = nullptr;
+    // NOTE: the positions are written by different threads, keep them on separate cache lines.
+    char mPadding0[64];
+    std::atomic<size_t> mEnqueuePosition{0};
+    char mPadding1[64];
+    std::atomic<size_t> mDequeuePosition{0};
+    char mPadding2[64];
+    std::atomic<bool> mRunning{false};
+    std::atomic<uint64_t> mWritten{0};
+    std::atomic<uint64_t> mDropped[ORV_LOGGING_SEVERITY_ERROR + 1];
+    /**
+     * Number of dropped records the writer thread already reported in the log.
+     **/
+    uint64_t mReportedDropped = 0;
+
+    /**
+     * Serializes @ref start() and @ref stop().
+     **/
+    std::mutex mStartStopMutex;
+    std::thread mWriterThread;
+    /**
+     * Used by the writer thread to sleep while the ring is empty. The logging threads never lock
+     * @ref mWakeMutex, they only notify @ref mWakeCondition if @ref mWriterSleeping is set.
+     * Wakeups that are lost this way are caught by the timeout of the writer.
+     **/
+    std::mutex mWakeMutex;
+    std::condition_variable mWakeCondition;
+    std::atomic<bool> mWriterSleeping{false};
+    std::atomic<bool> mWantStop{false};
+    orv_log_async_format_t mFormat = ORV_LOG_ASYNC_FORMAT_TEXT;
+    FILE* mFile = nullptr;
+};
+
+inline bool AsyncLogger::isRunning() const
+{
+    return mRunning.load(std::memory_order_acquire);
+}
+
+} // namespace openrv
+
+#endif
+
@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2018 Monument-Software GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "decodearena.h"
+
+#include <algorithm>
+
+namespace openrv {
+namespace vnc {
+
+DecodeArena::~DecodeArena()
+{
+    release();
+}
+
+/**
+ * Make sure the arena can hold at least @p capacity bytes without further heap allocations.
+ *
+ * This should be called once the size of the framebuffer is known, i.e. on ServerInit.
+ *
+ * NOTE: Must not be called while pointers obtained from @ref allocate() are still in use.
+ **/
+void DecodeArena::reserve(size_t capacity)
+{
+    reset();
+    if (capacity <= mCapacity) {
+        return;
+    }
+    free(mBlock);
+    mBlock = (uint8_t*)malloc(capacity);
+    mCapacity = mBlock ? capacity : 0;
+    mUsed = 0;
+    mHeapAllocations++;
+}
+
+/**
+ * @return A buffer of at least @p size bytes (aligned to 16 bytes), valid until the next call to
+ *         @ref reset(). NULL if the heap allocation failed.
+ **/
+void* DecodeArena::allocate(size_t size)
+{
+    size = std::max(size, (size_t)1);
+    size = (size + mAlignment - 1) & ~(mAlignment - 1);
+    if (mBlock && mCapacity - mUsed >= size) {
+        void* p = mBlock + mUsed;
+        mUsed += size;
+        return p;
+    }
+    void* p = malloc(size);
+    if (!p) {
+        return nullptr;
+    }
+    mHeapAllocations++;
+    mOverflowBlocks.push_back(p);
+    mOverflowBytes += size;
+    return p;
+}
+
+/**
+ * Release all allocations made since the last reset. All pointers obtained from @ref allocate()
+ * become invalid.
+ *
+ * If the arena was too small since the last reset, it is grown so that the same allocations fit
+ * in the arena next time.
+ **/
+void DecodeArena::reset()
+{
+    if (!mOverflowBlocks.empty()) {
+        const size_t requiredCapacity = mUsed + mOverflowBytes;
+        for (void* p : mOverflowBlocks) {
+            free(p);
+        }
+        mOverflowBlocks.clear();
+        mOverflowBytes = 0;
+        if (requiredCapacity > mCapacity) {
+            free(mBlock);
+            mBlock = (uint8_t*)malloc(requiredCapacity);
+            mCapacity = mBlock ? requiredCapacity : 0;
+            mHeapAllocations++;
+        }
+    }
+    mUsed = 0;
+}
+
+/**
+ * Free all memory of the arena and reset @ref heapAllocations(), e.g. when the connection is
+ * closed.
+ **/
+void DecodeArena::release()
+{
+    for (void* p : mOverflowBlocks) {
+        free(p);
+    }
+    mOverflowBlocks.clear();
+    mOverflowBytes = 0;
+    free(mBlock);
+    mBlock = nullptr;
+    mCapacity = 0;
+    mUsed = 0;
+    mHeapAllocations = 0;
+}
+
+} // namespace vnc
+} // namespace openrv
+
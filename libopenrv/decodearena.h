@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2018 Monument-Software GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OPENRV_DECODEARENA_H
+#define OPENRV_DECODEARENA_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <vector>
+
+namespace openrv {
+namespace vnc {
+
+/**
+ * Simple arena ("bump") allocator for the temporary buffers of the rect data parsers (see @ref
+ * RectDataParserBase).
+ *
+ * A connection owns exactly one arena, which is shared by all parsers of the connection. The
+ * buffers of a rect are only needed until the rect has been finished, so the arena is @ref reset()
+ * after every rect (and therefore also for every FramebufferUpdate message), which invalidates all
+ * pointers obtained from @ref allocate().
+ *
+ * The arena is initially sized from the framebuffer dimensions (see @ref reserve()). If a rect
+ * requires more memory, additional blocks are allocated from the heap and on the next @ref reset()
+ * the arena is grown to the required size, i.e. after the first few updates no more heap
+ * allocations are made at all. @ref heapAllocations() counts all heap allocations of the arena.
+ *
+ * This class is not thread safe, it is used by the connection thread only.
+ **/
+class DecodeArena
+{
+public:
+    DecodeArena() = default;
+    ~DecodeArena();
+    DecodeArena(const DecodeArena&) = delete;
+    DecodeArena& operator=(const DecodeArena&) = delete;
+
+    void reserve(size_t capacity);
+    void* allocate(size_t size);
+    void reset();
+    void release();
+
+    size_t capacity() const;
+    uint64_t heapAllocations() const;
+
+private:
+    static constexpr size_t mAlignment = 16;
+    uint8_t* mBlock = nullptr;
+    size_t mCapacity = 0;
+    size_t mUsed = 0;
+    /**
+     * Blocks allocated because @ref mBlock was too small. Freed (and merged into @ref mBlock) on
+     * @ref reset().
+     **/
+    std::vector<void*> mOverflowBlocks;
+    size_t mOverflowBytes = 0;
+    uint64_t mHeapAllocations = 0;
+};
+
+inline size_t DecodeArena::capacity() const
+{
+    return mCapacity;
+}
+
+inline uint64_t DecodeArena::heapAllocations() const
+{
+    return mHeapAllocations;
+}
+
+} // namespace vnc
+} // namespace openrv
+
+#endif
+
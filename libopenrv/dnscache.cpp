@@ -0,0 +1,227 @@
+/*
+ * Copyright (C) 2018 Monument-Software GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "dnscache.h"
+#include "utils.h"
+#include <libopenrv/orv_error.h>
+#include <libopenrv/orv_errorcodes.h>
+
+#if !defined(_MSC_VER)
+#include <netdb.h>
+#include <netinet/in.h>
+#endif // _MSC_VER
+#include <stdio.h>
+#include <string.h>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace openrv {
+
+namespace {
+
+struct DnsCacheEntry
+{
+    /**
+     * TRUE while a thread is performing the lookup for this entry. Other threads wait on @ref
+     * gDnsCacheCondition until it is finished.
+     **/
+    bool mPending = false;
+    uint64_t mExpireTimeUs = 0;
+    std::vector<ResolvedAddress> mAddresses;
+};
+
+} // anonymous namespace
+
+/**
+ * The cached entries, by "host:port". All data is protected by @ref gDnsCacheMutex.
+ **/
+static std::map<std::string, DnsCacheEntry> gDnsCache;
+static std::mutex gDnsCacheMutex;
+static std::condition_variable gDnsCacheCondition;
+
+static std::string makeKey(const char* hostName, uint16_t port)
+{
+    char portString[8] = {};
+    snprintf(portString, sizeof(portString), ":%d", (int)port);
+    return std::string(hostName) + portString;
+}
+
+/**
+ * Remove expired entries and, if the cache is still full, the entry that expires first.
+ *
+ * @pre @ref gDnsCacheMutex is locked.
+ **/
+static void pruneMutexLocked(uint64_t nowUs)
+{
+    for (auto it = gDnsCache.begin(); it != gDnsCache.end(); ) {
+        if (!it->second.mPending && it->second.mExpireTimeUs <= nowUs) {
+            it = gDnsCache.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+    while (gDnsCache.size() >= ORV_DNS_CACHE_MAX_ENTRIES) {
+        auto oldest = gDnsCache.end();
+        for (auto it = gDnsCache.begin(); it != gDnsCache.end(); ++it) {
+            if (!it->second.mPending && (oldest == gDnsCache.end() || it->second.mExpireTimeUs < oldest->second.mExpireTimeUs)) {
+                oldest = it;
+            }
+        }
+        if (oldest == gDnsCache.end()) {
+            // all entries pending
+            break;
+        }
+        gDnsCache.erase(oldest);
+    }
+}
+
+/**
+ * Resolve @p hostName and write all IPv4 and IPv6 addresses (in the order returned by
+ * getaddrinfo(), i.e. sorted by RFC 6724 preference) to @p addresses, using a cached result if
+ * possible.
+ *
+ * This function blocks while the lookup is performed (possibly by another thread).
+ *
+ * @return TRUE on success (then @p addresses contains at least one entry), otherwise FALSE and
+ *         @p error is set accordingly.
+ **/
+bool DnsCache::resolve(const char* hostName, uint16_t port, std::vector<ResolvedAddress>* addresses, orv_error_t* error)
+{
+    addresses->clear();
+    const std::string key = makeKey(hostName, port);
+    std::unique_lock<std::mutex> lock(gDnsCacheMutex);
+    while (true) {
+        auto it = gDnsCache.find(key);
+        if (it == gDnsCache.end()) {
+            break;
+        }
+        if (it->second.mPending) {
+            gDnsCacheCondition.wait(lock);
+            continue;
+        }
+        if (it->second.mExpireTimeUs > Utils::getTimestampUs()) {
+            *addresses = it->second.mAddresses;
+            return true;
+        }
+        gDnsCache.erase(it);
+        break;
+    }
+    pruneMutexLocked(Utils::getTimestampUs());
+    gDnsCache[key].mPending = true;
+    lock.unlock();
+
+    std::vector<ResolvedAddress> result;
+    const bool success = lookup(hostName, port, &result, error);
+
+    lock.lock();
+    auto it = gDnsCache.find(key);
+    if (it != gDnsCache.end()) {
+        if (success) {
+            it->second.mPending = false;
+            it->second.mExpireTimeUs = Utils::getTimestampUs() + (uint64_t)ORV_DNS_CACHE_TTL_SECONDS * 1000 * 1000;
+            it->second.mAddresses = result;
+        }
+        else {
+            // Failed lookups are not cached, waiting threads perform the lookup themselves.
+            gDnsCache.erase(it);
+        }
+    }
+    lock.unlock();
+    gDnsCacheCondition.notify_all();
+    *addresses = std::move(result);
+    return success;
+}
+
+/**
+ * Remove the entry for @p hostName and @p port from the cache, if any. Should be called if none of
+ * the cached addresses could be connected to, as the host may have moved.
+ **/
+void DnsCache::invalidate(const char* hostName, uint16_t port)
+{
+    const std::string key = makeKey(hostName, port);
+    std::lock_guard<std::mutex> lock(gDnsCacheMutex);
+    auto it = gDnsCache.find(key);
+    if (it != gDnsCache.end() && !it->second.mPending) {
+        gDnsCache.erase(it);
+    }
+}
+
+/**
+ * Remove all entries from the cache. Lookups that are currently being performed are not
+ * affected.
+ **/
+void DnsCache::clear()
+{
+    std::lock_guard<std::mutex> lock(gDnsCacheMutex);
+    for (auto it = gDnsCache.begin(); it != gDnsCache.end(); ) {
+        if (!it->second.mPending) {
+            it = gDnsCache.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+}
+
+/**
+ * Internal helper function for @ref resolve() that performs the actual getaddrinfo() call.
+ **/
+bool DnsCache::lookup(const char* hostName, uint16_t port, std::vector<ResolvedAddress>* addresses, orv_error_t* error)
+{
+    char portString[11] = {};
+    snprintf(portString, 10, "%d", (int)port);
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(struct addrinfo));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+    hints.ai_flags = 0; // FIXME:  AI_DEFAULT is not available on windows, is 0 sufficient?
+    struct addrinfo* firstInfo = nullptr;
+    int ret = getaddrinfo(hostName, portString, &hints, &firstInfo);
+    if (ret != 0 || !firstInfo) {
+        if (firstInfo) {
+            freeaddrinfo(firstInfo);
+        }
+        orv_error_set(error, ORV_ERR_CONNECT_ERROR_NO_SUCH_HOST, 0, "No such host: '%s'", hostName);
+        return false;
+    }
+    for (struct addrinfo* addr = firstInfo; addr; addr = addr->ai_next) {
+        if (addr->ai_family != AF_INET && addr->ai_family != AF_INET6) {
+            continue;
+        }
+        if (addr->ai_addrlen > sizeof(struct sockaddr_storage)) {
+            continue;
+        }
+        ResolvedAddress a;
+        memset(&a.mAddress, 0, sizeof(a.mAddress));
+        memcpy(&a.mAddress, addr->ai_addr, addr->ai_addrlen);
+        a.mAddressLength = (socklen_t)addr->ai_addrlen;
+        addresses->push_back(a);
+    }
+    freeaddrinfo(firstInfo);
+    if (addresses->empty()) {
+        orv_error_set(error, ORV_ERR_CONNECT_ERROR_NO_SUCH_HOST, 0, "No such host: '%s' (no supported address family found for host)", hostName);
+        return false;
+    }
+    return true;
+}
+
+} // namespace openrv
+
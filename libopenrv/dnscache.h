@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2018 Monument-Software GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OPENRV_DNSCACHE_H
+#define OPENRV_DNSCACHE_H
+
+#if !defined(_MSC_VER)
+#include <sys/socket.h>
+#else // _MSC_VER
+#include <WinSock2.h>
+#include <Ws2tcpip.h>
+#endif // _MSC_VER
+#include <stdint.h>
+#include <vector>
+
+struct orv_error_t;
+
+/**
+ * Number of seconds a successful lookup remains in the @ref openrv::DnsCache.
+ *
+ * getaddrinfo() does not provide the TTL of the DNS records, so a fixed (short) value is used.
+ **/
+#define ORV_DNS_CACHE_TTL_SECONDS 30
+/**
+ * Maximum number of host/port pairs held by the @ref openrv::DnsCache. If exceeded, the entry that
+ * expires first is dropped.
+ **/
+#define ORV_DNS_CACHE_MAX_ENTRIES 64
+
+namespace openrv {
+
+/**
+ * A single address obtained from getaddrinfo(), including the port.
+ **/
+struct ResolvedAddress
+{
+    struct sockaddr_storage mAddress;
+    socklen_t mAddressLength = 0;
+};
+
+/**
+ * Process-wide cache of getaddrinfo() results for TCP connections, shared by all contexts.
+ *
+ * Applications that open many connections to the same host(s) (e.g. a console showing many
+ * sessions) otherwise perform one lookup per connection, which often dominates the connect time.
+ * Concurrent lookups of the same host/port are merged: Only the first caller calls getaddrinfo(),
+ * the others wait for its result.
+ *
+ * Only successful lookups are cached, for at most @ref ORV_DNS_CACHE_TTL_SECONDS seconds. Callers
+ * should @ref invalidate() an entry if none of the addresses could be connected to.
+ *
+ * This class is thread safe.
+ **/
+class DnsCache
+{
+public:
+    static bool resolve(const char* hostName, uint16_t port, std::vector<ResolvedAddress>* addresses, orv_error_t* error);
+    static void invalidate(const char* hostName, uint16_t port);
+    static void clear();
+
+private:
+    static bool lookup(const char* hostName, uint16_t port, std::vector<ResolvedAddress>* addresses, orv_error_t* error);
+};
+
+} // namespace openrv
+
+#endif
+
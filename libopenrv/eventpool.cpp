@@ -0,0 +1,161 @@
+/*
+ * Copyright (C) 2018 Monument-Software GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "eventpool.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <type_traits>
+
+namespace openrv {
+
+static_assert(std::is_standard_layout<EventStorage>::value, "EventStorage must be standard layout, orv_event_t pointers are cast to EventStorage");
+
+EventPool::~EventPool()
+{
+    EventStorage* lists[2] = { mFree, mReturned.load(std::memory_order_acquire) };
+    for (EventStorage* s : lists) {
+        while (s) {
+            EventStorage* next = s->mNext;
+            free(s->mBatchRects);
+            delete s;
+            s = next;
+        }
+    }
+}
+
+/**
+ * @return The internal storage of @p event. The @p event must have been created by this library,
+ *         i.e. by @ref orv_event_init() (or a function using it) or by @ref EventPool::acquire().
+ **/
+EventStorage* EventStorage::fromEvent(orv_event_t* event)
+{
+    return reinterpret_cast<EventStorage*>(event);
+}
+
+/**
+ * Append a rect to the @ref ORV_EVENT_FRAMEBUFFER_UPDATED_BATCH @p event, growing the rect array
+ * if required.
+ *
+ * @return TRUE on success, FALSE if memory for the rect could not be allocated. The @p event
+ *         remains valid (without the new rect) in that case.
+ **/
+bool EventStorage::appendBatchRect(orv_event_t* event, uint16_t x, uint16_t y, uint16_t w, uint16_t h)
+{
+    EventStorage* s = fromEvent(event);
+    orv_event_framebuffer_batch_t* data = (orv_event_framebuffer_batch_t*)event->mEventData;
+    if (data->mRectCount >= s->mBatchCapacity) {
+        const uint32_t capacity = std::max((uint32_t)16, s->mBatchCapacity * 2);
+        orv_event_framebuffer_t* rects = (orv_event_framebuffer_t*)realloc(s->mBatchRects, capacity * sizeof(orv_event_framebuffer_t));
+        if (!rects) {
+            return false;
+        }
+        s->mBatchRects = rects;
+        s->mBatchCapacity = capacity;
+    }
+    data->mRects = s->mBatchRects;
+    orv_event_framebuffer_t* rect = &data->mRects[data->mRectCount];
+    rect->mX = x;
+    rect->mY = y;
+    rect->mWidth = w;
+    rect->mHeight = h;
+    data->mRectCount++;
+    return true;
+}
+
+/**
+ * @return A new event of the specified @p type, taken from the pool if possible. The event data
+ *         is zero-initialized (@ref orv_event_framebuffer_batch_t::mRects may point to a
+ *         previously allocated array, with @ref orv_event_framebuffer_batch_t::mRectCount being 0).
+ *         The event must be destroyed using @ref orv_event_destroy(), which returns it to this
+ *         pool.
+ *
+ *         NOTE: Must always be called by the same thread (normally the connection thread of the
+ *         context).
+ **/
+orv_event_t* EventPool::acquire(orv_event_type_t type)
+{
+    if (!mFree) {
+        mFree = mReturned.exchange(nullptr, std::memory_order_acquire);
+    }
+    EventStorage* s = mFree;
+    if (s) {
+        mFree = s->mNext;
+    }
+    else {
+        s = new EventStorage();
+        mHeapAllocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    mReferences.fetch_add(1, std::memory_order_relaxed);
+    s->mPool = this;
+    s->mNext = nullptr;
+    memset(&s->mData, 0, sizeof(s->mData));
+    s->mEvent.mEventType = type;
+    switch (type) {
+        case ORV_EVENT_FRAMEBUFFER_UPDATED:
+            s->mEvent.mEventData = &s->mData.mFramebuffer;
+            break;
+        case ORV_EVENT_FRAMEBUFFER_UPDATED_BATCH:
+            s->mData.mFramebufferBatch.mRects = s->mBatchRects;
+            s->mEvent.mEventData = &s->mData.mFramebufferBatch;
+            break;
+        default:
+            s->mEvent.mEventData = nullptr;
+            break;
+    }
+    return &s->mEvent;
+}
+
+/**
+ * Return @p event to the pool it was taken from. This is called by @ref orv_event_destroy() and
+ * may be called by any thread.
+ *
+ * @return TRUE if @p event was a pooled event and has been released. FALSE if the event was not
+ *         created by an @ref EventPool, the caller has to free it then.
+ **/
+bool EventPool::release(orv_event_t* event)
+{
+    EventStorage* s = EventStorage::fromEvent(event);
+    EventPool* pool = s->mPool;
+    if (!pool) {
+        return false;
+    }
+    s->mNext = pool->mReturned.load(std::memory_order_relaxed);
+    while (!pool->mReturned.compare_exchange_weak(s->mNext, s, std::memory_order_release, std::memory_order_relaxed)) {
+    }
+    pool->unref();
+    return true;
+}
+
+/**
+ * Drop the reference of the context. Called when the context is destroyed, the pool is deleted
+ * once all events have been released as well.
+ **/
+void EventPool::detach()
+{
+    unref();
+}
+
+void EventPool::unref()
+{
+    if (mReferences.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        delete this;
+    }
+}
+
+} // namespace openrv
+
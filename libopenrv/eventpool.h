@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2018 Monument-Software GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OPENRV_EVENTPOOL_H
+#define OPENRV_EVENTPOOL_H
+
+#include <libopenrv/libopenrv.h>
+
+#include <atomic>
+
+namespace openrv {
+
+class EventPool;
+
+/**
+ * Internal memory layout of every @ref orv_event_t created by this library.
+ *
+ * The public @ref orv_event_t is the first member, so a pointer to the event can be cast back to
+ * its storage in @ref orv_event_destroy().
+ *
+ * Events created by @ref orv_event_init() have @ref mPool set to NULL and own a malloc()ed
+ * @ref orv_event_t::mEventData, just like before. Events obtained from an @ref EventPool store
+ * their data in @ref mData instead and are returned to the pool when destroyed.
+ **/
+struct EventStorage
+{
+    orv_event_t mEvent;
+    /**
+     * The pool this event belongs to, or NULL if the event is not pooled.
+     **/
+    EventPool* mPool = nullptr;
+    /**
+     * Next entry in the freelist of @ref mPool, only valid while the event is in the freelist.
+     **/
+    EventStorage* mNext = nullptr;
+    /**
+     * Rect array of a @ref ORV_EVENT_FRAMEBUFFER_UPDATED_BATCH event, see @ref appendBatchRect().
+     * @ref orv_event_framebuffer_batch_t::mRects points to this array. The array is kept when a
+     * pooled event is recycled, so it grows to the largest number of rects per update.
+     **/
+    orv_event_framebuffer_t* mBatchRects = nullptr;
+    uint32_t mBatchCapacity = 0;
+    union Data
+    {
+        orv_event_framebuffer_t mFramebuffer;
+        orv_event_framebuffer_batch_t mFramebufferBatch;
+    };
+    /**
+     * Data of pooled events, @ref orv_event_t::mEventData points here.
+     **/
+    Data mData;
+
+    static EventStorage* fromEvent(orv_event_t* event);
+    static bool appendBatchRect(orv_event_t* event, uint16_t x, uint16_t y, uint16_t w, uint16_t h);
+};
+
+/**
+ * Per-context pool of recyclable event objects for the high-frequency events, i.e. @ref
+ * ORV_EVENT_FRAMEBUFFER_UPDATED, @ref ORV_EVENT_FRAMEBUFFER_UPDATED_BATCH, @ref
+ * ORV_EVENT_FRAMEBUFFER_UPDATE_REQUEST_FINISHED, @ref ORV_EVENT_CURSOR_UPDATED and @ref
+ * ORV_EVENT_BELL. All other event types are rare and still use @ref orv_event_init().
+ *
+ * Events are obtained by the connection thread using @ref acquire() and are returned to the pool
+ * by @ref orv_event_destroy(), which is normally called by the user thread. Returned events are
+ * pushed onto a lock-free stack. The connection thread takes the whole stack at once whenever its
+ * private freelist is empty, so there is exactly one consumer and the stack is not affected by the
+ * ABA problem.
+ *
+ * Events may outlive the context (e.g. if the user destroys an event after @ref orv_destroy()),
+ * so the pool is reference counted: The context holds one reference (see @ref detach()), and
+ * every event that is currently in use holds one reference. The pool deletes itself when the last
+ * reference is dropped.
+ **/
+class EventPool
+{
+public:
+    EventPool() = default;
+    EventPool(const EventPool&) = delete;
+    EventPool& operator=(const EventPool&) = delete;
+
+    orv_event_t* acquire(orv_event_type_t type);
+    void detach();
+    static bool release(orv_event_t* event);
+
+    uint64_t heapAllocations() const;
+
+private:
+    ~EventPool();
+    void unref();
+
+private:
+    std::atomic<uint32_t> mReferences{1};
+    /**
+     * Events returned by @ref release(), may be pushed by any thread.
+     **/
+    std::atomic<EventStorage*> mReturned{nullptr};
+    /**
+     * Freelist of the thread calling @ref acquire(), not accessed by any other thread.
+     **/
+    EventStorage* mFree = nullptr;
+    std::atomic<uint64_t> mHeapAllocations{0};
+};
+
+/**
+ * @return The number of events allocated from the heap by this pool. Stops increasing once the
+ *         pool holds as many events as are in use at the same time.
+ **/
+inline uint64_t EventPool::heapAllocations() const
+{
+    return mHeapAllocations.load(std::memory_order_relaxed);
+}
+
+} // namespace openrv
+
+#endif
+
@@ -16,19 +16,42 @@
 
 #include "eventqueue.h"
 
+#include <libopenrv/orv_logging.h>
+
+#include <algorithm>
+#include <chrono>
+
+#if !defined(_MSC_VER)
+#include <sys/select.h>
+#else // _MSC_VER
+#include <Windows.h>
+#endif // _MSC_VER
+
+static_assert((ORV_EVENT_QUEUE_CAPACITY & (ORV_EVENT_QUEUE_CAPACITY - 1)) == 0, "ORV_EVENT_QUEUE_CAPACITY must be a power of two");
+
 namespace openrv {
 
 EventQueue::EventQueue(orv_context_t* ctx)
     : mContext(ctx)
 {
+    mCells = new Cell[ORV_EVENT_QUEUE_CAPACITY];
+    for (size_t i = 0; i < ORV_EVENT_QUEUE_CAPACITY; i++) {
+        mCells[i].mSequence.store(i, std::memory_order_relaxed);
+        mCells[i].mEvent = nullptr;
+    }
+    if (!ThreadNotifier::makePipe(&mNotifierWriter, &mNotifierListener)) {
+        ORV_ERROR(mContext, "Failed to create notification pipe for event queue, waiting for events is not possible.");
+    }
 }
 
 EventQueue::~EventQueue()
 {
-    while (!mQueue.empty()) {
-        orv_event_destroy(mQueue.front());
-        mQueue.pop();
+    orv_event_t* event = dequeue();
+    while (event) {
+        orv_event_destroy(event);
+        event = dequeue();
     }
+    delete[] mCells;
 }
 
 /**
@@ -41,8 +64,19 @@ EventQueue::~EventQueue()
  **/
 void EventQueue::queue(orv_event_t* event)
 {
-    std::unique_lock<std::mutex> lock(mMutex);
-    mQueue.push(event);
+    if (mOverflowing.load(std::memory_order_acquire) || !pushRing(event)) {
+        std::unique_lock<std::mutex> lock(mOverflowMutex);
+        // NOTE: the consumer may have drained the overflow list in the meantime, in that case the
+        //       ring can be used again.
+        if (mOverflowing.load(std::memory_order_relaxed) || !pushRing(event)) {
+            mOverflowing.store(true, std::memory_order_release);
+            mOverflow.push_back(event);
+        }
+    }
+    // NOTE: pairs with the fence in swallowNotifications(): either the consumer sees the event, or
+    //       this thread sees the cleared "wake pending" flag and signals the notifier.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    mNotifierWriter.sendNotification();
 }
 
 /**
@@ -56,15 +90,178 @@ void EventQueue::queue(orv_event_t* event)
  **/
 orv_event_t* EventQueue::dequeue()
 {
-    //ORV_DEBUG(mContext, "Dequeue");
-    std::unique_lock<std::mutex> lock(mMutex);
-    if (mQueue.empty()) {
-        return nullptr;
+    orv_event_t* event = popRing();
+    if (event) {
+        return event;
+    }
+    if (mOverflowing.load(std::memory_order_acquire)) {
+        std::unique_lock<std::mutex> lock(mOverflowMutex);
+        // the ring may have received more events by producers that did not yet see the
+        // overflow flag, those are older than the events in the overflow list.
+        event = popRing();
+        if (!event && !mOverflow.empty()) {
+            event = mOverflow.front();
+            mOverflow.pop_front();
+        }
+        if (mOverflow.empty()) {
+            mOverflowing.store(false, std::memory_order_release);
+        }
+        if (event) {
+            return event;
+        }
+    }
+    swallowNotifications();
+    return nullptr;
+}
+
+/**
+ * Obtain up to @p maxCount events at once and store them in @p events. Ownership of the events is
+ * transferred to the caller.
+ *
+ * This function is thread-safe.
+ *
+ * @return The number of events stored in @p events.
+ **/
+uint32_t EventQueue::dequeue(orv_event_t** events, uint32_t maxCount)
+{
+    uint32_t count = 0;
+    while (count < maxCount) {
+        orv_event_t* event = dequeue();
+        if (!event) {
+            break;
+        }
+        events[count] = event;
+        count++;
+    }
+    return count;
+}
+
+/**
+ * Wait until at least one event is in the queue, at most @p timeoutMs milliseconds (a negative
+ * value waits indefinitely, 0 does not wait at all).
+ *
+ * @return TRUE if events are available, FALSE if the timeout expired.
+ **/
+bool EventQueue::wait(int timeoutMs)
+{
+    if (hasPendingEvents()) {
+        return true;
     }
-    orv_event_t* event = mQueue.front();
-    mQueue.pop();
+    if (!mNotifierListener.isValid()) {
+        return false;
+    }
+    typedef std::chrono::steady_clock Clock;
+    const Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(std::max(timeoutMs, 0));
+    while (true) {
+        // drop stale notifications (for events that have been dequeued already), so that the
+        // wait below does not return immediately.
+        swallowNotifications();
+        if (hasPendingEvents()) {
+            return true;
+        }
+        int remainingMs = -1;
+        if (timeoutMs >= 0) {
+            remainingMs = (int)std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+            if (remainingMs <= 0) {
+                return false;
+            }
+        }
+#if !defined(_MSC_VER)
+        const int fd = mNotifierListener.pipeReadFd();
+        fd_set readfds;
+        FD_ZERO(&readfds);
+        FD_SET(fd, &readfds);
+        struct timeval timeout;
+        timeout.tv_sec = remainingMs / 1000;
+        timeout.tv_usec = (remainingMs % 1000) * 1000;
+        select(fd + 1, &readfds, nullptr, nullptr, remainingMs < 0 ? nullptr : &timeout);
+#else // _MSC_VER
+        WaitForSingleObject((HANDLE)mNotifierListener.pipeReadHandle(), remainingMs < 0 ? INFINITE : (DWORD)remainingMs);
+#endif // _MSC_VER
+    }
+}
+
+bool EventQueue::pushRing(orv_event_t* event)
+{
+    size_t position = mEnqueuePosition.load(std::memory_order_relaxed);
+    Cell* cell = nullptr;
+    while (true) {
+        cell = &mCells[position & mMask];
+        const size_t sequence = cell->mSequence.load(std::memory_order_acquire);
+        const intptr_t diff = (intptr_t)sequence - (intptr_t)position;
+        if (diff == 0) {
+            if (mEnqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        }
+        else if (diff < 0) {
+            // ring is full
+            return false;
+        }
+        else {
+            position = mEnqueuePosition.load(std::memory_order_relaxed);
+        }
+    }
+    cell->mEvent = event;
+    cell->mSequence.store(position + 1, std::memory_order_release);
+    return true;
+}
+
+orv_event_t* EventQueue::popRing()
+{
+    size_t position = mDequeuePosition.load(std::memory_order_relaxed);
+    Cell* cell = nullptr;
+    while (true) {
+        cell = &mCells[position & mMask];
+        const size_t sequence = cell->mSequence.load(std::memory_order_acquire);
+        const intptr_t diff = (intptr_t)sequence - (intptr_t)(position + 1);
+        if (diff == 0) {
+            if (mDequeuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        }
+        else if (diff < 0) {
+            // ring is empty
+            return nullptr;
+        }
+        else {
+            position = mDequeuePosition.load(std::memory_order_relaxed);
+        }
+    }
+    orv_event_t* event = cell->mEvent;
+    cell->mEvent = nullptr;
+    cell->mSequence.store(position + mMask + 1, std::memory_order_release);
     return event;
 }
 
-} // namespace openrv
+/**
+ * @return TRUE if at least one event is queued. The result may be outdated immediately if other
+ *         threads access the queue concurrently.
+ **/
+bool EventQueue::hasPendingEvents() const
+{
+    const size_t position = mDequeuePosition.load(std::memory_order_relaxed);
+    const Cell* cell = &mCells[position & mMask];
+    if (cell->mSequence.load(std::memory_order_acquire) == position + 1) {
+        return true;
+    }
+    return mOverflowing.load(std::memory_order_acquire);
+}
+
+/**
+ * Reset the notifier once the queue has been found empty. If an event was queued concurrently, the
+ * notifier is signalled again, so that it never stays unsignalled while events are pending.
+ **/
+void EventQueue::swallowNotifications()
+{
+    if (!mNotifierListener.isNotificationPending()) {
+        return;
+    }
+    mNotifierListener.swallowPipeData();
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (hasPendingEvents()) {
+        mNotifierWriter.sendNotification();
+    }
+}
 
+} // namespace openrv
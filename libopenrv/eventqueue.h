@@ -18,12 +18,34 @@
 #define OPENRV_EVENTQUEUE_H
 
 #include <libopenrv/libopenrv.h>
+#include "threadnotifier.h"
 
-#include <queue>
+#include <atomic>
+#include <deque>
 #include <mutex>
 
+/**
+ * Number of events the lock-free part of @ref openrv::EventQueue can hold. Must be a power of two.
+ * If the application does not poll events fast enough, further events are queued in a (locked)
+ * overflow list, so no events are ever dropped.
+ **/
+#define ORV_EVENT_QUEUE_CAPACITY 4096
+
 namespace openrv {
 
+/**
+ * Queue of the events for the polling API, see @ref orv_event_callback_polling() and @ref
+ * orv_poll_event().
+ *
+ * The queue is a bounded lock-free ring buffer (each slot carries a sequence number, so that
+ * multiple producers and consumers can use the queue concurrently). Normally the connection thread
+ * is the only producer and the application thread the only consumer, so neither side ever takes a
+ * lock. Only if the ring is full, events are appended to a mutex-protected overflow list, which
+ * is drained before the ring is used again to preserve the order of the events.
+ *
+ * In addition the queue provides a notifier that is signalled when events are queued, see @ref
+ * wait().
+ **/
 class EventQueue
 {
 public:
@@ -32,14 +54,55 @@ public:
 
     void queue(orv_event_t* event);
     orv_event_t* dequeue();
+    uint32_t dequeue(orv_event_t** events, uint32_t maxCount);
+    bool wait(int timeoutMs);
+#if !defined(_MSC_VER)
+    int notificationFd() const;
+#endif // _MSC_VER
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> mSequence;
+        orv_event_t* mEvent;
+    };
+    bool pushRing(orv_event_t* event);
+    orv_event_t* popRing();
+    bool hasPendingEvents() const;
+    void swallowNotifications();
 
 private:
+    static const size_t mMask = ORV_EVENT_QUEUE_CAPACITY - 1;
     orv_context_t* mContext = nullptr;
-    mutable std::mutex mMutex; // TODO: use lock-free queue instead?
-    std::queue<orv_event_t*> mQueue;
+    Cell* mCells = nullptr;
+    // NOTE: the positions are written by different threads, keep them on separate cache lines.
+    char mPadding0[64];
+    std::atomic<size_t> mEnqueuePosition{0};
+    char mPadding1[64];
+    std::atomic<size_t> mDequeuePosition{0};
+    char mPadding2[64];
+    /**
+     * TRUE while @ref mOverflow is in use, i.e. new events must be appended to @ref mOverflow
+     * instead of the ring. Modified while holding @ref mOverflowMutex only.
+     **/
+    std::atomic<bool> mOverflowing{false};
+    std::mutex mOverflowMutex;
+    std::deque<orv_event_t*> mOverflow;
+    ThreadNotifierWriter mNotifierWriter;
+    ThreadNotifierListener mNotifierListener;
 };
 
+#if !defined(_MSC_VER)
+/**
+ * @return The fd of the notifier of this queue, which is readable while events are pending (see
+ *         @ref orv_get_event_fd()), or -1 if the notifier could not be created.
+ **/
+inline int EventQueue::notificationFd() const
+{
+    return mNotifierListener.pipeReadFd();
+}
+#endif // _MSC_VER
+
 } // namespace openrv
 
 #endif
-
@@ -0,0 +1,267 @@
+/*
+ * Copyright (C) 2018 Monument-Software GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "framebuffermipmaps.h"
+#include <libopenrv/orv_error.h>
+#include <libopenrv/orv_errorcodes.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace openrv {
+namespace vnc {
+
+/**
+ * Bytes per pixel of all levels, identical to the internal framebuffer (RGB).
+ **/
+static const uint8_t gBytesPerPixel = 3;
+
+/**
+ * Calculate the rounded average of @p a and @p b byte by byte into @p dst. @p dst may be identical
+ * to @p a, and may also overlap @p b if @p b starts behind @p dst (the values are read before they
+ * are overwritten).
+ **/
+static void averageBytes(const uint8_t* a, const uint8_t* b, uint8_t* dst, size_t size)
+{
+    size_t i = 0;
+#if defined(__SSE2__)
+    for (; i + 16 <= size; i += 16) {
+        const __m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+        const __m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_avg_epu8(va, vb));
+    }
+#endif
+    for (; i < size; i++) {
+        dst[i] = (uint8_t)((a[i] + b[i] + 1) >> 1);
+    }
+}
+
+FramebufferMipmaps::FramebufferMipmaps()
+{
+    memset(mLevel, 0, sizeof(mLevel));
+    memset(&mStaging, 0, sizeof(mStaging));
+}
+
+FramebufferMipmaps::~FramebufferMipmaps()
+{
+    freeLevelsMutexLocked();
+}
+
+/**
+ * Allocate @p levels levels (at most ORV_MAX_MIPMAP_LEVELS) for a framebuffer of size @p width x
+ * @p height. All levels are initially black, until updated using @ref update().
+ *
+ * @return TRUE on success, FALSE if memory could not be allocated (then no levels are
+ *         maintained and @p error is set).
+ **/
+bool FramebufferMipmaps::resize(uint16_t width, uint16_t height, uint8_t levels, orv_error_t* error)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    freeLevelsMutexLocked();
+    levels = std::min(levels, (uint8_t)ORV_MAX_MIPMAP_LEVELS);
+    for (uint8_t i = 0; i < levels; i++) {
+        width = (uint16_t)((width + 1) / 2);
+        height = (uint16_t)((height + 1) / 2);
+        orv_framebuffer_t& level = mLevel[i];
+        level.mWidth = width;
+        level.mHeight = height;
+        level.mBytesPerPixel = gBytesPerPixel;
+        level.mBitsPerPixel = gBytesPerPixel * 8;
+        level.mSize = (size_t)width * height * gBytesPerPixel;
+        level.mFramebuffer = (uint8_t*)calloc(std::max(level.mSize, (size_t)1), 1);
+        if (!level.mFramebuffer) {
+            orv_error_set(error, ORV_ERR_GENERIC, 0, "Failed to allocate mipmap level %d of size %dx%d", (int)i + 1, (int)width, (int)height);
+            freeLevelsMutexLocked();
+            return false;
+        }
+    }
+    if (levels > 0) {
+        mStaging = mLevel[0];
+        mStaging.mFramebuffer = (uint8_t*)calloc(std::max(mStaging.mSize, (size_t)1), 1);
+        if (!mStaging.mFramebuffer) {
+            orv_error_set(error, ORV_ERR_GENERIC, 0, "Failed to allocate mipmap staging level of size %dx%d", (int)mStaging.mWidth, (int)mStaging.mHeight);
+            freeLevelsMutexLocked();
+            return false;
+        }
+    }
+    mLevels = levels;
+    return true;
+}
+
+/**
+ * Free all levels.
+ **/
+void FramebufferMipmaps::clear()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    freeLevelsMutexLocked();
+}
+
+void FramebufferMipmaps::freeLevelsMutexLocked()
+{
+    for (int i = 0; i < ORV_MAX_MIPMAP_LEVELS; i++) {
+        free(mLevel[i].mFramebuffer);
+    }
+    memset(mLevel, 0, sizeof(mLevel));
+    free(mStaging.mFramebuffer);
+    memset(&mStaging, 0, sizeof(mStaging));
+    mPendingW = 0;
+    mPendingH = 0;
+    mLevels = 0;
+    mLineBuffer.clear();
+    mLineBuffer.shrink_to_fit();
+}
+
+/**
+ * @pre The mutex of @p framebuffer is LOCKED, @ref mMutex is NOT locked
+ *
+ * First step of updating all levels in the region that corresponds to the rect @p x, @p y, @p w,
+ * @p h of @p framebuffer, which was modified: box filter the region of the first level into @ref
+ * mStaging. Release the framebuffer and call @ref finishUpdate() afterwards.
+ *
+ * NOTE: @ref mLevels and the sizes of the levels are read without @ref mMutex, they are modified
+ *       by the calling thread only.
+ **/
+void FramebufferMipmaps::beginUpdateFramebufferMutexLocked(const orv_framebuffer_t& framebuffer, uint16_t x, uint16_t y, uint16_t w, uint16_t h)
+{
+    mPendingW = 0;
+    mPendingH = 0;
+    if (!framebuffer.mFramebuffer || w == 0 || h == 0 || mLevels == 0 || framebuffer.mBytesPerPixel != gBytesPerPixel) {
+        return;
+    }
+    const uint32_t x1 = x / 2;
+    const uint32_t y1 = y / 2;
+    const uint32_t x2 = std::min((std::min((uint32_t)x + w, (uint32_t)framebuffer.mWidth) + 1) / 2, (uint32_t)mStaging.mWidth);
+    const uint32_t y2 = std::min((std::min((uint32_t)y + h, (uint32_t)framebuffer.mHeight) + 1) / 2, (uint32_t)mStaging.mHeight);
+    if (x1 >= x2 || y1 >= y2) {
+        return;
+    }
+    downscale(framebuffer, &mStaging, (uint16_t)x1, (uint16_t)y1, (uint16_t)(x2 - x1), (uint16_t)(y2 - y1));
+    mPendingX = (uint16_t)x1;
+    mPendingY = (uint16_t)y1;
+    mPendingW = (uint16_t)(x2 - x1);
+    mPendingH = (uint16_t)(y2 - y1);
+}
+
+/**
+ * @pre The mutex of the framebuffer is NOT locked
+ *
+ * Second step of the update started by @ref beginUpdateFramebufferMutexLocked(): copy the region
+ * of @ref mStaging to the first level and update the region of all other levels, each from the
+ * previous level, so the work for all further levels is at most 1/3 of the work for the first
+ * level.
+ **/
+void FramebufferMipmaps::finishUpdate()
+{
+    if (mPendingW == 0 || mPendingH == 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mMutex);
+    const size_t stride = (size_t)mStaging.mWidth * gBytesPerPixel;
+    for (uint32_t y = mPendingY; y < (uint32_t)mPendingY + mPendingH; y++) {
+        const size_t offset = y * stride + (size_t)mPendingX * gBytesPerPixel;
+        memcpy(mLevel[0].mFramebuffer + offset, mStaging.mFramebuffer + offset, (size_t)mPendingW * gBytesPerPixel);
+    }
+    uint32_t x1 = mPendingX;
+    uint32_t y1 = mPendingY;
+    uint32_t x2 = (uint32_t)mPendingX + mPendingW;
+    uint32_t y2 = (uint32_t)mPendingY + mPendingH;
+    mPendingW = 0;
+    mPendingH = 0;
+    for (uint8_t i = 1; i < mLevels; i++) {
+        orv_framebuffer_t* dst = &mLevel[i];
+        x1 = x1 / 2;
+        y1 = y1 / 2;
+        x2 = std::min((x2 + 1) / 2, (uint32_t)dst->mWidth);
+        y2 = std::min((y2 + 1) / 2, (uint32_t)dst->mHeight);
+        if (x1 >= x2 || y1 >= y2) {
+            return;
+        }
+        downscale(mLevel[i - 1], dst, (uint16_t)x1, (uint16_t)y1, (uint16_t)(x2 - x1), (uint16_t)(y2 - y1));
+    }
+}
+
+/**
+ * Box filter the 2x2 pixel blocks of @p src that correspond to the rect @p dstX, @p dstY, @p dstW,
+ * @p dstH of @p dst. At the right and bottom edge of an odd sized @p src, the last column/line is
+ * used twice.
+ *
+ * Each line pair is first averaged vertically into @ref mLineBuffer, then the buffer is averaged
+ * with itself shifted by one pixel, so both passes work on contiguous bytes (and use SSE2, if
+ * available). Only every second pixel of the result is used.
+ *
+ * NOTE: As both passes round, the result may be up to 1 larger than the exact average. This is
+ *       irrelevant for thumbnails.
+ **/
+void FramebufferMipmaps::downscale(const orv_framebuffer_t& src, orv_framebuffer_t* dst, uint16_t dstX, uint16_t dstY, uint16_t dstW, uint16_t dstH)
+{
+    const uint32_t srcX = (uint32_t)dstX * 2;
+    const uint32_t srcPixels = std::min((uint32_t)dstW * 2, (uint32_t)src.mWidth - srcX);
+    const size_t srcStride = (size_t)src.mWidth * gBytesPerPixel;
+    const size_t dstStride = (size_t)dst->mWidth * gBytesPerPixel;
+    if (mLineBuffer.size() < (size_t)srcPixels * gBytesPerPixel) {
+        mLineBuffer.resize((size_t)srcPixels * gBytesPerPixel);
+    }
+    uint8_t* line = mLineBuffer.data();
+    for (uint32_t y = dstY; y < (uint32_t)dstY + dstH; y++) {
+        const uint32_t srcY1 = y * 2;
+        const uint32_t srcY2 = std::min(srcY1 + 1, (uint32_t)src.mHeight - 1);
+        const uint8_t* srcLine1 = src.mFramebuffer + srcY1 * srcStride + srcX * gBytesPerPixel;
+        const uint8_t* srcLine2 = src.mFramebuffer + srcY2 * srcStride + srcX * gBytesPerPixel;
+        averageBytes(srcLine1, srcLine2, line, (size_t)srcPixels * gBytesPerPixel);
+        if (srcPixels > 1) {
+            // pixel i becomes the average of pixels i and i+1, the last pixel remains unchanged
+            averageBytes(line, line + gBytesPerPixel, line, (size_t)(srcPixels - 1) * gBytesPerPixel);
+        }
+        uint8_t* dstLine = dst->mFramebuffer + y * dstStride + (size_t)dstX * gBytesPerPixel;
+        for (uint32_t i = 0; i < dstW; i++) {
+            const uint8_t* p = line + (size_t)i * 2 * gBytesPerPixel;
+            dstLine[i * gBytesPerPixel + 0] = p[0];
+            dstLine[i * gBytesPerPixel + 1] = p[1];
+            dstLine[i * gBytesPerPixel + 2] = p[2];
+        }
+    }
+}
+
+/**
+ * Lock the levels and return @p level (1 to ORV_MAX_MIPMAP_LEVELS). The caller must call @ref
+ * release() afterwards, unless NULL is returned.
+ *
+ * @return The requested level, with a NULL orv_framebuffer_t::mFramebuffer if the level is not
+ *         maintained. NULL if @p level is out of range, then the levels are not locked.
+ **/
+const orv_framebuffer_t* FramebufferMipmaps::acquire(int level)
+{
+    if (level < 1 || level > ORV_MAX_MIPMAP_LEVELS) {
+        return nullptr;
+    }
+    mMutex.lock();
+    return &mLevel[level - 1];
+}
+
+void FramebufferMipmaps::release()
+{
+    mMutex.unlock();
+}
+
+} // namespace vnc
+} // namespace openrv
+
@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2018 Monument-Software GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OPENRV_FRAMEBUFFERMIPMAPS_H
+#define OPENRV_FRAMEBUFFERMIPMAPS_H
+
+#include <libopenrv/libopenrv.h>
+
+#include <mutex>
+#include <vector>
+
+struct orv_error_t;
+
+namespace openrv {
+namespace vnc {
+
+/**
+ * Downscaled copies of the framebuffer (see @ref orv_config_t::mMipmapLevels), e.g. for
+ * thumbnails.
+ *
+ * Level n has 1/2^n of the framebuffer size (rounded up) and is box filtered from level n-1 (level
+ * 0 being the framebuffer itself). The connection thread updates the levels incrementally using
+ * @ref beginUpdateFramebufferMutexLocked() and @ref finishUpdate() for every decoded rect, the
+ * application reads them using @ref acquire() and @ref release(), independently of the framebuffer
+ * lock.
+ *
+ * The application may lock the framebuffer and the levels in any order, as the library never locks
+ * both at the same time: the first level is box filtered into @ref mStaging while the framebuffer
+ * is locked, and copied to the levels after the framebuffer was released.
+ *
+ * This class is thread safe, it uses an internal mutex for all levels. @ref resize(), @ref clear()
+ * and the update functions must be called by the same thread (the connection thread).
+ **/
+class FramebufferMipmaps
+{
+public:
+    FramebufferMipmaps();
+    ~FramebufferMipmaps();
+    FramebufferMipmaps(const FramebufferMipmaps&) = delete;
+    FramebufferMipmaps& operator=(const FramebufferMipmaps&) = delete;
+
+    bool resize(uint16_t width, uint16_t height, uint8_t levels, orv_error_t* error);
+    void clear();
+    void beginUpdateFramebufferMutexLocked(const orv_framebuffer_t& framebuffer, uint16_t x, uint16_t y, uint16_t w, uint16_t h);
+    void finishUpdate();
+    const orv_framebuffer_t* acquire(int level);
+    void release();
+
+private:
+    void freeLevelsMutexLocked();
+    void downscale(const orv_framebuffer_t& src, orv_framebuffer_t* dst, uint16_t dstX, uint16_t dstY, uint16_t dstW, uint16_t dstH);
+
+private:
+    std::mutex mMutex;
+    uint8_t mLevels = 0;
+    /**
+     * Level n is stored at index n-1. Levels above @ref mLevels are zeroed, i.e. have a NULL
+     * orv_framebuffer_t::mFramebuffer.
+     **/
+    orv_framebuffer_t mLevel[ORV_MAX_MIPMAP_LEVELS];
+    /**
+     * Copy of the first level that @ref beginUpdateFramebufferMutexLocked() writes to without
+     * locking @ref mMutex. The region @ref mPendingX, @ref mPendingY, @ref mPendingW, @ref
+     * mPendingH of it is copied to the first level by @ref finishUpdate().
+     **/
+    orv_framebuffer_t mStaging;
+    uint16_t mPendingX = 0;
+    uint16_t mPendingY = 0;
+    uint16_t mPendingW = 0;
+    uint16_t mPendingH = 0;
+    /**
+     * Temporary buffer for one line of the source level, see @ref downscale().
+     **/
+    std::vector<uint8_t> mLineBuffer;
+};
+
+} // namespace vnc
+} // namespace openrv
+
+#endif
+
@@ -0,0 +1,230 @@
+/*
+ * Copyright (C) 2018 Monument-Software GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "latencytesterstatistics.h"
+#include "latencytracer.h"
+
+#include <string.h>
+#include <algorithm>
+
+namespace openrv {
+
+/**
+ * Maximum number of responses waiting for their framebuffer update (and of framebuffer updates
+ * waiting for their response). Older entries are dropped.
+ **/
+static const size_t gMaxPendingDeliveries = 256;
+/**
+ * Maximum time between sending a request and the framebuffer update containing its paint, older
+ * entries are dropped.
+ **/
+static const uint64_t gMaxDeliveryUs = 10 * 1000 * 1000;
+
+static int64_t toMicroseconds(int64_t sec, int64_t usec)
+{
+    return sec * 1000 * 1000 + usec;
+}
+
+LatencyTesterHistogram::LatencyTesterHistogram()
+{
+    reset();
+}
+
+void LatencyTesterHistogram::reset()
+{
+    memset(&mHistogram, 0, sizeof(orv_latency_tester_histogram_t));
+    memset(mWindow, 0, sizeof(mWindow));
+}
+
+void LatencyTesterHistogram::add(uint64_t valueUs)
+{
+    mWindow[mHistogram.mCount % ORV_LATENCY_TESTER_WINDOW_SIZE] = valueUs;
+    if (mHistogram.mCount == 0 || valueUs < mHistogram.mMinUs) {
+        mHistogram.mMinUs = valueUs;
+    }
+    mHistogram.mMaxUs = std::max(mHistogram.mMaxUs, valueUs);
+    mHistogram.mTotalUs += valueUs;
+    mHistogram.mCount++;
+    int bucket = 0;
+    while (bucket + 1 < ORV_LATENCY_TESTER_HISTOGRAM_BUCKETS && (valueUs >> (bucket + 1)) != 0) {
+        bucket++;
+    }
+    mHistogram.mBuckets[bucket]++;
+}
+
+void LatencyTesterHistogram::fill(orv_latency_tester_histogram_t* histogram) const
+{
+    *histogram = mHistogram;
+    uint64_t values[ORV_LATENCY_TESTER_WINDOW_SIZE];
+    const uint32_t count = (uint32_t)std::min(mHistogram.mCount, (uint64_t)ORV_LATENCY_TESTER_WINDOW_SIZE);
+    memcpy(values, mWindow, count * sizeof(uint64_t));
+    vnc::LatencyTracer::calculatePercentiles(values, count, &histogram->mPercentiles);
+}
+
+void LatencyTesterStatistics::reset()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mRequestsSent = 0;
+    mSkippedRequests = 0;
+    mDeliveredUpdates = 0;
+    mRoundTrip.reset();
+    mNetwork.reset();
+    mServerPaint.reset();
+    mVncDelivery.reset();
+    mResponseCount = 0;
+    mClockOffsetUs = 0;
+    mClockOffsetDelayUs = 0;
+    mPendingDeliveries.clear();
+    mRecentUpdates.clear();
+}
+
+void LatencyTesterStatistics::addSentRequest()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mRequestsSent++;
+}
+
+void LatencyTesterStatistics::addSkippedRequest()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mSkippedRequests++;
+}
+
+/**
+ * Add the @p response of the server to a request that was sent at @p clientSendUs and answered at
+ * @p clientReceiveUs. The client timestamps of @p response itself are ignored.
+ **/
+void LatencyTesterStatistics::addResponse(const orv_latency_tester_update_response_t& response, uint64_t clientSendUs, uint64_t clientReceiveUs)
+{
+    const int64_t serverReceiveUs = toMicroseconds(response.mServerRequestReceiveTimestampSec, response.mServerRequestReceiveTimestampUSec);
+    const int64_t serverUpdateUs = toMicroseconds(response.mServerUpdateTimestampSec, response.mServerUpdateTimestampUSec);
+    const int64_t serverSendUs = toMicroseconds(response.mServerSendTimestampSec, response.mServerSendTimestampUSec);
+    const uint64_t roundTripUs = clientReceiveUs - clientSendUs;
+    const uint64_t serverProcessingUs = (uint64_t)std::max((int64_t)0, serverSendUs - serverReceiveUs);
+    ClockSample sample;
+    sample.mDelayUs = roundTripUs - std::min(roundTripUs, serverProcessingUs);
+    sample.mOffsetUs = ((serverReceiveUs - (int64_t)clientSendUs) + (serverSendUs - (int64_t)clientReceiveUs)) / 2;
+
+    PendingDelivery delivery;
+    delivery.mX1 = std::min(response.mNewTopLeftX, response.mNewBottomRightX);
+    delivery.mY1 = std::min(response.mNewTopLeftY, response.mNewBottomRightY);
+    delivery.mX2 = std::max(response.mNewTopLeftX, response.mNewBottomRightX);
+    delivery.mY2 = std::max(response.mNewTopLeftY, response.mNewBottomRightY);
+    delivery.mClientSendUs = clientSendUs;
+    delivery.mServerUpdateUs = serverUpdateUs;
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    mRoundTrip.add(roundTripUs);
+    mNetwork.add(sample.mDelayUs);
+    mServerPaint.add((uint64_t)std::max((int64_t)0, serverUpdateUs - serverReceiveUs));
+    mClockSamples[mResponseCount % ORV_LATENCY_TESTER_WINDOW_SIZE] = sample;
+    mResponseCount++;
+    updateClockOffsetMutexLocked();
+
+    // the framebuffer update may have been received before the response
+    for (const FramebufferUpdate& update : mRecentUpdates) {
+        if (update.mTimestampUs >= clientSendUs && intersects(delivery, update)) {
+            addDeliveryMutexLocked(delivery, update.mTimestampUs);
+            return;
+        }
+    }
+    mPendingDeliveries.push_back(delivery);
+    if (mPendingDeliveries.size() > gMaxPendingDeliveries) {
+        mPendingDeliveries.pop_front();
+    }
+}
+
+/**
+ * Add a framebuffer update of the VNC connection that was received at @p timestampUs. All pending
+ * responses whose paint intersects the update are delivered.
+ **/
+void LatencyTesterStatistics::addFramebufferUpdate(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint64_t timestampUs)
+{
+    FramebufferUpdate update;
+    update.mX = x;
+    update.mY = y;
+    update.mW = w;
+    update.mH = h;
+    update.mTimestampUs = timestampUs;
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (auto it = mPendingDeliveries.begin(); it != mPendingDeliveries.end();) {
+        if (timestampUs - std::min(timestampUs, it->mClientSendUs) > gMaxDeliveryUs) {
+            it = mPendingDeliveries.erase(it);
+        }
+        else if (intersects(*it, update)) {
+            addDeliveryMutexLocked(*it, timestampUs);
+            it = mPendingDeliveries.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+    while (!mRecentUpdates.empty() && (mRecentUpdates.size() >= gMaxPendingDeliveries || timestampUs - mRecentUpdates.front().mTimestampUs > gMaxDeliveryUs)) {
+        mRecentUpdates.pop_front();
+    }
+    mRecentUpdates.push_back(update);
+}
+
+bool LatencyTesterStatistics::intersects(const PendingDelivery& delivery, const FramebufferUpdate& update)
+{
+    return (int32_t)update.mX <= delivery.mX2 && (int32_t)update.mX + update.mW > delivery.mX1 &&
+            (int32_t)update.mY <= delivery.mY2 && (int32_t)update.mY + update.mH > delivery.mY1;
+}
+
+void LatencyTesterStatistics::addDeliveryMutexLocked(const PendingDelivery& delivery, uint64_t clientUpdateUs)
+{
+    // convert to server time using the current offset estimate
+    const int64_t serverTimeUs = (int64_t)clientUpdateUs + mClockOffsetUs;
+    mVncDelivery.add((uint64_t)std::max((int64_t)0, serverTimeUs - delivery.mServerUpdateUs));
+    mDeliveredUpdates++;
+}
+
+/**
+ * Use the offset of the sample with the lowest delay in the window, as NTP does: its offset has
+ * the smallest error bound.
+ **/
+void LatencyTesterStatistics::updateClockOffsetMutexLocked()
+{
+    const uint64_t count = std::min(mResponseCount, (uint64_t)ORV_LATENCY_TESTER_WINDOW_SIZE);
+    const ClockSample* best = nullptr;
+    for (uint64_t i = 0; i < count; i++) {
+        if (!best || mClockSamples[i].mDelayUs < best->mDelayUs) {
+            best = &mClockSamples[i];
+        }
+    }
+    if (best) {
+        mClockOffsetUs = best->mOffsetUs;
+        mClockOffsetDelayUs = best->mDelayUs;
+    }
+}
+
+void LatencyTesterStatistics::getStatistics(orv_latency_tester_statistics_t* statistics) const
+{
+    memset(statistics, 0, sizeof(orv_latency_tester_statistics_t));
+    std::lock_guard<std::mutex> lock(mMutex);
+    statistics->mRequestsSent = mRequestsSent;
+    statistics->mResponsesReceived = mResponseCount;
+    statistics->mSkippedRequests = mSkippedRequests;
+    statistics->mDeliveredUpdates = mDeliveredUpdates;
+    statistics->mClockOffsetUs = mClockOffsetUs;
+    statistics->mClockOffsetDelayUs = mClockOffsetDelayUs;
+    mRoundTrip.fill(&statistics->mRoundTrip);
+    mNetwork.fill(&statistics->mNetwork);
+    mServerPaint.fill(&statistics->mServerPaint);
+    mVncDelivery.fill(&statistics->mVncDelivery);
+}
+
+} // namespace openrv
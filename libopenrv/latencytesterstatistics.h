@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2018 Monument-Software GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OPENRV_LATENCYTESTERSTATISTICS_H
+#define OPENRV_LATENCYTESTERSTATISTICS_H
+
+#include <libopenrv/orv_latencytesterclient.h>
+
+#include <stdint.h>
+#include <deque>
+#include <mutex>
+
+namespace openrv {
+
+/**
+ * Accumulates the samples of one latency component for @ref orv_latency_tester_histogram_t.
+ **/
+class LatencyTesterHistogram
+{
+public:
+    LatencyTesterHistogram();
+    void reset();
+    void add(uint64_t valueUs);
+    void fill(orv_latency_tester_histogram_t* histogram) const;
+
+private:
+    orv_latency_tester_histogram_t mHistogram;
+    /**
+     * Ring buffer of the most recent samples, the sample with index n (0 being the first sample)
+     * is stored at n % ORV_LATENCY_TESTER_WINDOW_SIZE.
+     **/
+    uint64_t mWindow[ORV_LATENCY_TESTER_WINDOW_SIZE];
+};
+
+/**
+ * Calculates the @ref orv_latency_tester_statistics_t of a latency tester client.
+ *
+ * The client thread adds the responses of the server (@ref addResponse()), the application adds
+ * the framebuffer updates of its VNC connection (@ref addFramebufferUpdate()). A response is
+ * "delivered" once a framebuffer update intersects the area the server painted for it, regardless
+ * of which of the two arrives first.
+ *
+ * All client timestamps are in microseconds of @ref Utils::getTimestampUs(), the server timestamps
+ * in microseconds of the (unrelated) server clock.
+ *
+ * This class is thread safe, it uses an internal mutex.
+ **/
+class LatencyTesterStatistics
+{
+public:
+    void reset();
+    void addSentRequest();
+    void addSkippedRequest();
+    void addResponse(const orv_latency_tester_update_response_t& response, uint64_t clientSendUs, uint64_t clientReceiveUs);
+    void addFramebufferUpdate(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint64_t timestampUs);
+    void getStatistics(orv_latency_tester_statistics_t* statistics) const;
+
+private:
+    /**
+     * Network delay and clock offset calculated from the timestamps of a response.
+     **/
+    struct ClockSample
+    {
+        uint64_t mDelayUs = 0;
+        int64_t mOffsetUs = 0;
+    };
+    /**
+     * A response whose paint has not been seen in a framebuffer update yet. The rect is
+     * inclusive, as in @ref orv_latency_tester_update_response_t.
+     **/
+    struct PendingDelivery
+    {
+        int32_t mX1 = 0;
+        int32_t mY1 = 0;
+        int32_t mX2 = 0;
+        int32_t mY2 = 0;
+        uint64_t mClientSendUs = 0;
+        int64_t mServerUpdateUs = 0;
+    };
+    struct FramebufferUpdate
+    {
+        uint16_t mX = 0;
+        uint16_t mY = 0;
+        uint16_t mW = 0;
+        uint16_t mH = 0;
+        uint64_t mTimestampUs = 0;
+    };
+    static bool intersects(const PendingDelivery& delivery, const FramebufferUpdate& update);
+    void addDeliveryMutexLocked(const PendingDelivery& delivery, uint64_t clientUpdateUs);
+    void updateClockOffsetMutexLocked();
+
+private:
+    mutable std::mutex mMutex;
+    uint64_t mRequestsSent = 0;
+    uint64_t mSkippedRequests = 0;
+    uint64_t mDeliveredUpdates = 0;
+    LatencyTesterHistogram mRoundTrip;
+    LatencyTesterHistogram mNetwork;
+    LatencyTesterHistogram mServerPaint;
+    LatencyTesterHistogram mVncDelivery;
+    /**
+     * Ring buffer of the clock samples of the most recent responses, see @ref mResponseCount.
+     **/
+    ClockSample mClockSamples[ORV_LATENCY_TESTER_WINDOW_SIZE];
+    uint64_t mResponseCount = 0;
+    int64_t mClockOffsetUs = 0;
+    uint64_t mClockOffsetDelayUs = 0;
+    std::deque<PendingDelivery> mPendingDeliveries;
+    /**
+     * The most recent framebuffer updates, for responses that arrive after the framebuffer update
+     * containing their paint.
+     **/
+    std::deque<FramebufferUpdate> mRecentUpdates;
+};
+
+} // namespace openrv
+
+#endif
@@ -0,0 +1,277 @@
+/*
+ * Copyright (C) 2018 Monument-Software GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "latencytracer.h"
+#include <libopenrv/orv_error.h>
+#include <libopenrv/orv_errorcodes.h>
+
+#include <errno.h>
+#include <inttypes.h>
+#include <string.h>
+#include <algorithm>
+
+namespace openrv {
+namespace vnc {
+
+/**
+ * The stages of an update in the trace file. Each stage is written as a separate "thread" of the
+ * trace, as the stages of consecutive updates may overlap.
+ **/
+enum class TraceStage
+{
+    Network = 1,
+    Decode = 2,
+    Present = 3,
+};
+
+static const char* getTraceStageName(TraceStage stage)
+{
+    switch (stage) {
+        case TraceStage::Network:
+            return "network";
+        case TraceStage::Decode:
+            return "decode";
+        case TraceStage::Present:
+            return "present";
+    }
+    return "unknown";
+}
+
+/**
+ * Calculate the percentiles of the @p count values in @p values. The order of @p values is
+ * modified.
+ **/
+void LatencyTracer::calculatePercentiles(uint64_t* values, uint32_t count, orv_latency_percentiles_t* percentiles)
+{
+    memset(percentiles, 0, sizeof(orv_latency_percentiles_t));
+    if (count == 0) {
+        return;
+    }
+    // nearest-rank method
+    auto percentile = [values, count](uint32_t p) {
+        uint32_t rank = (p * count + 99) / 100;
+        uint32_t index = rank > 0 ? rank - 1 : 0;
+        std::nth_element(values, values + index, values + count);
+        return values[index];
+    };
+    percentiles->mP50Us = percentile(50);
+    percentiles->mP95Us = percentile(95);
+    percentiles->mP99Us = percentile(99);
+}
+
+LatencyTracer::LatencyTracer()
+    : mHaveUnpresentedUpdates(false)
+{
+    memset(mWindow, 0, sizeof(mWindow));
+}
+
+LatencyTracer::~LatencyTracer()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    closeTraceFileMutexLocked();
+}
+
+/**
+ * Remove all updates, e.g. on connection start. The trace file (if any) is kept open.
+ **/
+void LatencyTracer::reset()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    memset(mWindow, 0, sizeof(mWindow));
+    mUpdateCount = 0;
+    mFirstUnpresentedUpdate = 0;
+    mFirstUntracedPresentedUpdate = 0;
+    mHaveUnpresentedUpdates = false;
+}
+
+/**
+ * Add a completely decoded framebuffer update with the specified timestamps (see @ref
+ * orv_update_latency_t). Called by the connection thread.
+ **/
+void LatencyTracer::addUpdate(uint64_t requestSentUs, uint64_t firstByteUs, uint64_t decodeFinishedUs)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mTraceFile) {
+        // NOTE: must happen before the slot of the new update is overwritten below.
+        writePresentedTraceEventsMutexLocked();
+    }
+    orv_update_latency_t* update = &mWindow[mUpdateCount % ORV_LATENCY_WINDOW_SIZE];
+    update->mSequence = mUpdateCount;
+    update->mRequestSentUs = requestSentUs;
+    update->mFirstByteUs = firstByteUs;
+    update->mDecodeFinishedUs = decodeFinishedUs;
+    update->mPresentedUs = 0;
+    mUpdateCount++;
+    if (mUpdateCount - mFirstUnpresentedUpdate > ORV_LATENCY_WINDOW_SIZE) {
+        // the oldest unpresented update left the window, it will never be presented
+        mFirstUnpresentedUpdate = mUpdateCount - ORV_LATENCY_WINDOW_SIZE;
+    }
+    mHaveUnpresentedUpdates = true;
+    if (mTraceFile) {
+        writeTraceEventMutexLocked(TraceStage::Network, update->mSequence, update->mRequestSentUs, update->mFirstByteUs);
+        writeTraceEventMutexLocked(TraceStage::Decode, update->mSequence, update->mFirstByteUs, update->mDecodeFinishedUs);
+    }
+}
+
+/**
+ * Mark all updates that have not been presented yet as presented at @p timestampUs. Called by the
+ * application thread when it acquired the framebuffer.
+ *
+ * NOTE: The "present" stages are written to the trace file later by the connection thread, see
+ *       @ref writePendingTraceEvents().
+ **/
+void LatencyTracer::markPresented(uint64_t timestampUs)
+{
+    if (!mHaveUnpresentedUpdates.load(std::memory_order_relaxed)) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (uint64_t sequence = mFirstUnpresentedUpdate; sequence < mUpdateCount; sequence++) {
+        mWindow[sequence % ORV_LATENCY_WINDOW_SIZE].mPresentedUs = timestampUs;
+    }
+    mFirstUnpresentedUpdate = mUpdateCount;
+    mHaveUnpresentedUpdates = false;
+}
+
+/**
+ * Write the "present" stages of the updates presented since the last call to the trace file (if
+ * any) and flush the file. Called by the connection thread, e.g. before it waits for data.
+ **/
+void LatencyTracer::writePendingTraceEvents()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (!mTraceFile) {
+        return;
+    }
+    writePresentedTraceEventsMutexLocked();
+    if (mTraceFileNeedsFlush) {
+        fflush(mTraceFile);
+        mTraceFileNeedsFlush = false;
+    }
+}
+
+/**
+ * Fill @p report from the updates added so far.
+ **/
+void LatencyTracer::getReport(orv_latency_report_t* report) const
+{
+    orv_latency_report_reset(report);
+    uint64_t network[ORV_LATENCY_WINDOW_SIZE];
+    uint64_t decode[ORV_LATENCY_WINDOW_SIZE];
+    uint64_t present[ORV_LATENCY_WINDOW_SIZE];
+    uint64_t total[ORV_LATENCY_WINDOW_SIZE];
+    uint32_t count = 0;
+    uint32_t presentedCount = 0;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        report->mUpdateCount = mUpdateCount;
+        if (mUpdateCount == 0) {
+            return;
+        }
+        report->mLastUpdate = mWindow[(mUpdateCount - 1) % ORV_LATENCY_WINDOW_SIZE];
+        count = (uint32_t)std::min(mUpdateCount, (uint64_t)ORV_LATENCY_WINDOW_SIZE);
+        for (uint32_t i = 0; i < count; i++) {
+            const orv_update_latency_t* update = &mWindow[i];
+            network[i] = update->mFirstByteUs - update->mRequestSentUs;
+            decode[i] = update->mDecodeFinishedUs - update->mFirstByteUs;
+            if (update->mPresentedUs != 0) {
+                present[presentedCount] = update->mPresentedUs - update->mDecodeFinishedUs;
+                total[presentedCount] = update->mPresentedUs - update->mRequestSentUs;
+                presentedCount++;
+            }
+        }
+    }
+    report->mSampleCount = count;
+    report->mPresentedSampleCount = presentedCount;
+    calculatePercentiles(network, count, &report->mNetwork);
+    calculatePercentiles(decode, count, &report->mDecode);
+    calculatePercentiles(present, presentedCount, &report->mPresent);
+    calculatePercentiles(total, presentedCount, &report->mTotal);
+}
+
+/**
+ * Write all subsequent updates to @p fileName in the Chrome trace event format (JSON array
+ * format). Any previously set file is closed. If @p fileName is NULL, tracing is stopped.
+ *
+ * @return TRUE on success, FALSE if the file could not be opened, then @p error is set
+ *         accordingly.
+ **/
+bool LatencyTracer::setTraceFile(const char* fileName, orv_error_t* error)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    closeTraceFileMutexLocked();
+    if (!fileName) {
+        orv_error_reset(error);
+        return true;
+    }
+    mTraceFile = fopen(fileName, "w");
+    if (!mTraceFile) {
+        orv_error_set(error, ORV_ERR_GENERIC, 0, "Failed to open latency trace file '%s', errno=%d", fileName, errno);
+        return false;
+    }
+    fprintf(mTraceFile, "[");
+    mTraceFileHasEvents = false;
+    mFirstUntracedPresentedUpdate = mFirstUnpresentedUpdate;
+    for (TraceStage stage : { TraceStage::Network, TraceStage::Decode, TraceStage::Present }) {
+        fprintf(mTraceFile, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                mTraceFileHasEvents ? "," : "", (int)stage, getTraceStageName(stage));
+        mTraceFileHasEvents = true;
+    }
+    orv_error_reset(error);
+    return true;
+}
+
+void LatencyTracer::closeTraceFileMutexLocked()
+{
+    if (!mTraceFile) {
+        return;
+    }
+    writePresentedTraceEventsMutexLocked();
+    fprintf(mTraceFile, "\n]\n");
+    fclose(mTraceFile);
+    mTraceFile = nullptr;
+}
+
+/**
+ * Write the "present" stages of all updates that have been presented but not written yet to @ref
+ * mTraceFile.
+ **/
+void LatencyTracer::writePresentedTraceEventsMutexLocked()
+{
+    const uint64_t firstInWindow = (mUpdateCount > ORV_LATENCY_WINDOW_SIZE) ? mUpdateCount - ORV_LATENCY_WINDOW_SIZE : 0;
+    for (uint64_t sequence = std::max(mFirstUntracedPresentedUpdate, firstInWindow); sequence < mFirstUnpresentedUpdate; sequence++) {
+        const orv_update_latency_t* update = &mWindow[sequence % ORV_LATENCY_WINDOW_SIZE];
+        if (update->mPresentedUs != 0) {
+            writeTraceEventMutexLocked(TraceStage::Present, update->mSequence, update->mDecodeFinishedUs, update->mPresentedUs);
+        }
+    }
+    mFirstUntracedPresentedUpdate = std::max(mFirstUntracedPresentedUpdate, mFirstUnpresentedUpdate);
+}
+
+/**
+ * Write a "complete" event (phase "X") from @p startUs to @p endUs to @ref mTraceFile.
+ **/
+void LatencyTracer::writeTraceEventMutexLocked(TraceStage stage, uint64_t sequence, uint64_t startUs, uint64_t endUs)
+{
+    fprintf(mTraceFile, "%s\n{\"name\":\"%s\",\"cat\":\"openrv\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%" PRIu64 ",\"dur\":%" PRIu64 ",\"args\":{\"update\":%" PRIu64 "}}",
+            mTraceFileHasEvents ? "," : "", getTraceStageName(stage), (int)stage, startUs, endUs - startUs, sequence);
+    mTraceFileHasEvents = true;
+    mTraceFileNeedsFlush = true;
+}
+
+} // namespace vnc
+} // namespace openrv
+
@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2018 Monument-Software GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OPENRV_LATENCYTRACER_H
+#define OPENRV_LATENCYTRACER_H
+
+#include <libopenrv/libopenrv.h>
+
+#include <stdio.h>
+#include <atomic>
+#include <mutex>
+
+struct orv_error_t;
+
+namespace openrv {
+namespace vnc {
+
+enum class TraceStage;
+
+/**
+ * Collects the @ref orv_update_latency_t timestamps of the framebuffer updates of a connection and
+ * calculates the percentiles of @ref orv_latency_report_t over the most recent @ref
+ * ORV_LATENCY_WINDOW_SIZE updates.
+ *
+ * The connection thread adds each update using @ref addUpdate() once it has been decoded, the
+ * application thread completes the updates using @ref markPresented() when it acquires the
+ * framebuffer.
+ *
+ * Optionally, all stages are written to a file in the Chrome trace event format (see @ref
+ * setTraceFile()), which can be viewed in chrome://tracing or Perfetto. The file is written by the
+ * connection thread only (@ref addUpdate() and @ref writePendingTraceEvents()), so that @ref
+ * markPresented() never performs file I/O on the application thread.
+ *
+ * This class is thread safe, it uses an internal mutex.
+ **/
+class LatencyTracer
+{
+public:
+    LatencyTracer();
+    ~LatencyTracer();
+    LatencyTracer(const LatencyTracer&) = delete;
+    LatencyTracer& operator=(const LatencyTracer&) = delete;
+
+    void reset();
+    void addUpdate(uint64_t requestSentUs, uint64_t firstByteUs, uint64_t decodeFinishedUs);
+    void markPresented(uint64_t timestampUs);
+    void writePendingTraceEvents();
+    void getReport(orv_latency_report_t* report) const;
+    bool setTraceFile(const char* fileName, orv_error_t* error);
+
+    static void calculatePercentiles(uint64_t* values, uint32_t count, orv_latency_percentiles_t* percentiles);
+
+private:
+    void closeTraceFileMutexLocked();
+    void writePresentedTraceEventsMutexLocked();
+    void writeTraceEventMutexLocked(TraceStage stage, uint64_t sequence, uint64_t startUs, uint64_t endUs);
+
+private:
+    mutable std::mutex mMutex;
+    /**
+     * TRUE if at least one update in @ref mWindow has not been presented yet. Allows @ref
+     * markPresented() to return without locking @ref mMutex in the common case.
+     **/
+    std::atomic<bool> mHaveUnpresentedUpdates;
+    /**
+     * Ring buffer of the most recent updates, the update with sequence number n is stored at index
+     * n % ORV_LATENCY_WINDOW_SIZE.
+     **/
+    orv_update_latency_t mWindow[ORV_LATENCY_WINDOW_SIZE];
+    uint64_t mUpdateCount = 0;
+    /**
+     * Sequence number of the oldest update that has not been presented yet.
+     **/
+    uint64_t mFirstUnpresentedUpdate = 0;
+    /**
+     * Sequence number of the oldest presented update whose "present" stage has not been written to
+     * @ref mTraceFile yet.
+     **/
+    uint64_t mFirstUntracedPresentedUpdate = 0;
+    FILE* mTraceFile = nullptr;
+    bool mTraceFileHasEvents = false;
+    /**
+     * TRUE if events have been written to @ref mTraceFile since it was last flushed.
+     **/
+    bool mTraceFileNeedsFlush = false;
+};
+
+} // namespace vnc
+} // namespace openrv
+
+#endif
+
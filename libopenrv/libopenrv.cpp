@@ -19,9 +19,12 @@
 #include "orvvncclient.h"
 #include "orv_context.h"
 #include "eventqueue.h"
+#include "eventpool.h"
 #include "keys.h"
+#include "dnscache.h"
 
 #include <string.h>
+#include <inttypes.h>
 
 int androidKeyEventToXKeyCode(int keycode, int metastate);
 
@@ -52,14 +55,19 @@ void orv_config_default(orv_config_t* cfg)
     orv_config_zero(cfg);
     cfg->mLogCallback = orv_log_stdoutstderr;
     cfg->mEventCallback = orv_event_callback_polling;
+    cfg->mMinLogSeverity = ORV_LOGGING_SEVERITY_DEBUG;
+    cfg->mDisabledLogCategories = 0;
 }
 
 orv_event_t* orv_event_init(orv_event_type_t type)
 {
-    // NOTE: we use malloc()/free() in this function, to simplify code:
+    // NOTE: we use malloc()/free() for the event data, to simplify code:
     //       we can simply free() the mEventData void* pointer, no need to cast to the actual type
     //       (contrary to delete)
-    orv_event_t* e = (orv_event_t*)malloc(sizeof(orv_event_t));
+    //       The event itself is always embedded in an openrv::EventStorage, see
+    //       orv_event_destroy().
+    openrv::EventStorage* storage = new openrv::EventStorage();
+    orv_event_t* e = &storage->mEvent;
     memset(e, 0, sizeof(orv_event_t));
     e->mEventType = type;
     switch (type) {
@@ -88,6 +96,10 @@ orv_event_t* orv_event_init(orv_event_type_t type)
             e->mEventData = malloc(sizeof(orv_event_framebuffer_t));
             memset(e->mEventData, 0, sizeof(orv_event_framebuffer_t));
             break;
+        case ORV_EVENT_FRAMEBUFFER_UPDATED_BATCH:
+            e->mEventData = malloc(sizeof(orv_event_framebuffer_batch_t));
+            memset(e->mEventData, 0, sizeof(orv_event_framebuffer_batch_t));
+            break;
     }
     return e;
 }
@@ -196,12 +208,19 @@ orv_event_t* orv_event_cut_text_init(const char* text)
 
 /**
  * Free the specified event. This in particular also frees the event data (if any).
+ *
+ * Events of the frequent types are recycled by the context that created them, in that case this
+ * function returns the event to the pool of the context (see openrv::EventPool). This is safe even
+ * if the context has been destroyed already.
  **/
 void orv_event_destroy(orv_event_t* event)
 {
     if (!event) {
         return;
     }
+    if (openrv::EventPool::release(event)) {
+        return;
+    }
     if (event->mEventData) {
         switch (event->mEventType) {
             case ORV_EVENT_CONNECT_RESULT:
@@ -221,7 +240,9 @@ void orv_event_destroy(orv_event_t* event)
         }
         free(event->mEventData);
     }
-    free(event);
+    openrv::EventStorage* storage = openrv::EventStorage::fromEvent(event);
+    free(storage->mBatchRects);
+    delete storage;
 }
 
 /**
@@ -264,6 +285,16 @@ void orv_event_print_to_log(const struct orv_context_t* ctx, const orv_event_t*
             ORV_DEBUG(ctx, "ORV_EVENT_FRAMEBUFFER_UPDATED at x=%d y=%d size=%dx%d", (int)data->mX, (int)data->mY, (int)data->mWidth, (int)data->mHeight);
             break;
         }
+        case ORV_EVENT_FRAMEBUFFER_UPDATED_BATCH:
+        {
+            orv_event_framebuffer_batch_t* data = (orv_event_framebuffer_batch_t*)event->mEventData;
+            ORV_DEBUG(ctx, "ORV_EVENT_FRAMEBUFFER_UPDATED_BATCH with %u rects", (unsigned int)data->mRectCount);
+            for (uint32_t i = 0; i < data->mRectCount; i++) {
+                const orv_event_framebuffer_t* rect = &data->mRects[i];
+                ORV_DEBUG(ctx, "  rect %u at x=%d y=%d size=%dx%d", (unsigned int)i, (int)rect->mX, (int)rect->mY, (int)rect->mWidth, (int)rect->mHeight);
+            }
+            break;
+        }
         case ORV_EVENT_THREAD_STARTED:
             ORV_DEBUG(ctx, "ORV_EVENT_THREAD_STARTED, thread name: %s", (const char*)event->mEventData);
             break;
@@ -307,6 +338,7 @@ orv_context_t* orv_init(const orv_config_t* cfg)
     if (ctx->mConfig.mEventCallback == orv_event_callback_polling) {
         ctx->mEventQueue = new openrv::EventQueue(ctx);
     }
+    ctx->mEventPool = new openrv::EventPool();
     ctx->mClient = new openrv::vnc::OrvVncClient(ctx, &error);
     if (error.mHasError) {
         ORV_ERROR(ctx, "Failed to construct the internal ORV client object, error:");
@@ -315,6 +347,7 @@ orv_context_t* orv_init(const orv_config_t* cfg)
         //       however this would *require* the callback to be thread-safe, because we are not yet
         //       in the connection thread at this point
         //       (and may never have started such a thread)
+        ctx->mEventPool->detach();
         delete ctx;
         return nullptr;
     }
@@ -328,10 +361,22 @@ void orv_destroy(orv_context_t* ctx)
     if (ctx) {
         delete ctx->mClient;
         delete ctx->mEventQueue;
+        ctx->mEventPool->detach();
         delete ctx;
     }
 }
 
+/**
+ * Clear the process-wide cache of host name lookups that is shared by all contexts.
+ *
+ * Lookups are cached for a short time only, but applications may want to call this when the
+ * network configuration changed.
+ **/
+void orv_clear_dns_cache(void)
+{
+    openrv::DnsCache::clear();
+}
+
 /**
  * @return A string representation of @p qualityProfile.
  *         This string can be used to serialize the @p qualityProfile into some settings, as it is
@@ -447,6 +492,35 @@ void orv_connection_info_print_to_log(const struct orv_context_t* ctx, const orv
     const orv_communication_pixel_format_t* p = &info->mCommunicationPixelFormat;
     ORV_DEBUG(ctx, "  Pixel format of communication: %d BitsPerPixel, %d bits depth, TrueColor: %s, r/g/b max: %d/%d/%d, r/g/b shift: %d/%d/%d, BigEndian: %s", p->mBitsPerPixel, p->mDepth, p->mTrueColor ? "true" : "false", (int)p->mColorMax[0], (int)p->mColorMax[1], (int)p->mColorMax[2], (int)p->mColorShift[0], (int)p->mColorShift[1], (int)p->mColorShift[2], p->mBigEndian ? "true" : "false");
     ORV_DEBUG(ctx, "  Received bytes: %u, sent bytes: %u, total: %u", info->mReceivedBytes, info->mSentBytes, (info->mReceivedBytes + info->mSentBytes));
+    ORV_DEBUG(ctx, "  Sent pointer events: %" PRIu64 ", sent key events: %" PRIu64 ", coalesced pointer events: %" PRIu64, info->mSentPointerEvents, info->mSentKeyEvents, info->mCoalescedPointerEvents);
+    ORV_DEBUG(ctx, "  Decode buffer size: %" PRIu64 " bytes, decode buffer allocations: %" PRIu64 ", event allocations: %" PRIu64, info->mDecodeBufferSize, info->mDecodeBufferAllocations, info->mEventAllocations);
+    const orv_socket_options_t* s = &info->mSocketOptions;
+    ORV_DEBUG(ctx, "  Socket options: TCP_NODELAY: %s, TCP_QUICKACK: %s, receive buffer: %d, send buffer: %d, busy poll: %u us", s->mTcpNoDelay ? "true" : "false", s->mTcpQuickAck ? "true" : "false", (int)s->mReceiveBufferSize, (int)s->mSendBufferSize, (unsigned int)s->mBusyPollUs);
+}
+
+void orv_statistics_reset(orv_statistics_t* statistics)
+{
+    if (statistics) {
+        memset(statistics, 0, sizeof(orv_statistics_t));
+    }
+}
+
+/**
+ * Convenience/debugging function that dumps @p statistics to the log callback in @p ctx.
+ **/
+void orv_statistics_print_to_log(const struct orv_context_t* ctx, const orv_statistics_t* statistics)
+{
+    const orv_statistics_t* s = statistics;
+    ORV_DEBUG(ctx, "Statistics:");
+    ORV_DEBUG(ctx, "  Framebuffer updates: %" PRIu64 ", rects: %" PRIu64 ", rects per update: %.1f, updates per second: %.1f", s->mFramebufferUpdates, s->mFramebufferUpdateRects, s->mFramebufferUpdates > 0 ? (double)s->mFramebufferUpdateRects / (double)s->mFramebufferUpdates : 0.0, s->mUpdatesPerSecond);
+    if (s->mUpdateLatencyCount > 0) {
+        ORV_DEBUG(ctx, "  Update latency: avg: %" PRIu64 " us, min: %" PRIu64 " us, max: %" PRIu64 " us, last: %" PRIu64 " us", s->mUpdateLatencyTotalUs / s->mUpdateLatencyCount, s->mUpdateLatencyMinUs, s->mUpdateLatencyMaxUs, s->mUpdateLatencyLastUs);
+    }
+    ORV_DEBUG(ctx, "  Framebuffer lock wait: %" PRIu64 " us, contentions: %" PRIu64, s->mFramebufferLockWaitUs, s->mFramebufferLockContentions);
+    for (uint32_t i = 0; i < s->mEncodingCount && i < ORV_MAX_ENCODING_STATISTICS; i++) {
+        const orv_encoding_statistics_t* e = &s->mEncodings[i];
+        ORV_DEBUG(ctx, "  %s: rects: %" PRIu64 ", pixels: %" PRIu64 ", compressed: %" PRIu64 " bytes, decompressed: %" PRIu64 " bytes, read: %" PRIu64 " us, finish: %" PRIu64 " us", orv_get_vnc_encoding_type_string(e->mEncodingType), e->mRects, e->mPixels, e->mCompressedBytes, e->mDecompressedBytes, e->mReadTimeUs, e->mFinishTimeUs);
+    }
 }
 
 void orv_vnc_server_capabilities_reset(orv_vnc_server_capabilities_t* capabilities)
@@ -514,6 +588,85 @@ void orv_get_vnc_connection_info(const struct orv_context_t* ctx, orv_connection
     ctx->mClient->getInfo(info, capabilities);
 }
 
+/**
+ * Retrieve decoding statistics of the current connection of @p ctx. The statistics are updated by
+ * the connection thread regularly, so they may lag behind a little bit.
+ *
+ * If @p ctx is not connected, @p statistics is reset.
+ **/
+void orv_get_statistics(const struct orv_context_t* ctx, orv_statistics_t* statistics)
+{
+    ctx->mClient->getStatistics(statistics);
+}
+
+void orv_latency_report_reset(orv_latency_report_t* report)
+{
+    if (report) {
+        memset(report, 0, sizeof(orv_latency_report_t));
+    }
+}
+
+/**
+ * Convenience/debugging function that dumps @p report to the log callback in @p ctx.
+ **/
+void orv_latency_report_print_to_log(const struct orv_context_t* ctx, const orv_latency_report_t* report)
+{
+    const orv_latency_report_t* r = report;
+    ORV_DEBUG(ctx, "Latency report: %" PRIu64 " updates, %u samples, %u presented samples", r->mUpdateCount, (unsigned int)r->mSampleCount, (unsigned int)r->mPresentedSampleCount);
+    ORV_DEBUG(ctx, "  Network: p50: %" PRIu64 " us, p95: %" PRIu64 " us, p99: %" PRIu64 " us", r->mNetwork.mP50Us, r->mNetwork.mP95Us, r->mNetwork.mP99Us);
+    ORV_DEBUG(ctx, "  Decode:  p50: %" PRIu64 " us, p95: %" PRIu64 " us, p99: %" PRIu64 " us", r->mDecode.mP50Us, r->mDecode.mP95Us, r->mDecode.mP99Us);
+    ORV_DEBUG(ctx, "  Present: p50: %" PRIu64 " us, p95: %" PRIu64 " us, p99: %" PRIu64 " us", r->mPresent.mP50Us, r->mPresent.mP95Us, r->mPresent.mP99Us);
+    ORV_DEBUG(ctx, "  Total:   p50: %" PRIu64 " us, p95: %" PRIu64 " us, p99: %" PRIu64 " us", r->mTotal.mP50Us, r->mTotal.mP95Us, r->mTotal.mP99Us);
+}
+
+/**
+ * Retrieve the latency breakdown of the framebuffer updates of the current connection of @p ctx,
+ * see @ref orv_latency_report_t.
+ *
+ * The "present" stage of an update is completed when the application calls @ref
+ * orv_acquire_framebuffer() after the update has been decoded, so it is only meaningful if the
+ * application acquires the framebuffer in response to the framebuffer events.
+ *
+ * If @p ctx is not connected, @p report is reset.
+ **/
+void orv_get_latency_report(const struct orv_context_t* ctx, orv_latency_report_t* report)
+{
+    ctx->mClient->getLatencyReport(report);
+}
+
+/**
+ * Write the stages of all subsequent framebuffer updates of @p ctx (see @ref orv_update_latency_t)
+ * to @p fileName in the Chrome trace event format, which can be viewed using chrome://tracing or
+ * Perfetto. A previously set trace file is closed, if @p fileName is NULL, tracing is stopped.
+ *
+ * The file is written by the connection thread only, i.e. the "present" stage of an update is
+ * written once the connection thread handles the next update or wakes up otherwise. The file is
+ * closed when tracing is stopped or @p ctx is destroyed.
+ *
+ * @return 0 on success, otherwise a non-zero value and @p error is set accordingly.
+ **/
+int orv_set_latency_trace_file(orv_context_t* ctx, const char* fileName, orv_error_t* error)
+{
+    orv_error_t dummyError;
+    if (!error) {
+        error = &dummyError;
+    }
+    if (!ctx->mClient->setLatencyTraceFile(fileName, error)) {
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Reset the @p options to default values provided by this library, i.e. TCP_NODELAY enabled and
+ * system defaults for all other options.
+ **/
+void orv_socket_options_default(orv_socket_options_t* options)
+{
+    memset(options, 0, sizeof(orv_socket_options_t));
+    options->mTcpNoDelay = 1;
+}
+
 /**
  * Reset the @p options to default values provided by this library.
  **/
@@ -524,6 +677,24 @@ void orv_connect_options_default(orv_connect_options_t* options)
     orv_communication_pixel_format_reset(&options->mCommunicationPixelFormat);
     // TODO: which one to use as default? probably use an adaptive type by default
     options->mCommunicationQualityProfile = ORV_COMM_QUALITY_PROFILE_SERVER;
+    options->mMaxPointerEventsPerSecond = ORV_DEFAULT_MAX_POINTER_EVENTS_PER_SECOND;
+    options->mTransportType = ORV_TRANSPORT_TCP;
+    orv_socket_options_default(&options->mSocketOptions);
+}
+
+/**
+ * Reset @p options to the defaults: at most 60 requests per second, one outstanding request and
+ * no ticks.
+ **/
+void orv_auto_refresh_options_default(orv_auto_refresh_options_t* options)
+{
+    if (!options) {
+        return;
+    }
+    memset(options, 0, sizeof(orv_auto_refresh_options_t));
+    options->mTargetFps = 60;
+    options->mMaxOutstandingRequests = 1;
+    options->mWaitForTick = 0;
 }
 
 /**
@@ -717,6 +888,146 @@ void orv_request_framebuffer_update(orv_context_t* ctx, uint16_t x, uint16_t y,
     ctx->mClient->sendFramebufferUpdateRequest(incremental, x, y, w, h);
 }
 
+/**
+ * Like @ref orv_request_framebuffer_update(), but the request is not incremental, i.e. the server
+ * sends the complete contents of the specified rectangle immediately, regardless of whether it
+ * changed.
+ *
+ * This is normally required only if the contents of the local framebuffer got lost, or to measure
+ * the throughput of a connection.
+ **/
+void orv_request_framebuffer_update_non_incremental(orv_context_t* ctx, uint16_t x, uint16_t y, uint16_t w, uint16_t h)
+{
+    const bool incremental = false;
+    ctx->mClient->sendFramebufferUpdateRequest(incremental, x, y, w, h);
+}
+
+/**
+ * Set the region of the framebuffer that is currently visible to the user, e.g. the visible part
+ * of a scrolled or zoomed view.
+ *
+ * Incremental update requests (see @ref orv_request_framebuffer_update()) are then restricted by
+ * the library to the viewport @p x, @p y, @p w, @p h, enlarged by @p margin pixels on each side
+ * (and further to an internal tile size), so the server sends and this library decodes changes of
+ * that region only. Non-incremental requests are not modified. Areas that were excluded from
+ * requests are considered outdated: once they become part of the viewport again, they are
+ * refreshed automatically by an additional non-incremental request. To make this happen
+ * immediately, this function repeats the most recent update request if the viewport changed.
+ *
+ * As a consequence, a single call to @ref orv_request_framebuffer_update() may result in zero
+ * (if the requested rect lies completely outside of the viewport), one or two
+ * ORV_EVENT_FRAMEBUFFER_UPDATE_REQUEST_FINISHED events and changing the viewport may cause an
+ * additional event.
+ *
+ * An empty viewport (@p w or @p h is 0) suspends incremental updates. The viewport is kept across
+ * connections, until @ref orv_clear_viewport() is called.
+ **/
+void orv_set_viewport(orv_context_t* ctx, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint16_t margin)
+{
+    ctx->mClient->setViewport(true, x, y, w, h, margin);
+}
+
+/**
+ * Remove the viewport set by @ref orv_set_viewport(), i.e. update requests are sent unmodified
+ * again. Outdated areas are refreshed by the next incremental request that contains them.
+ **/
+void orv_clear_viewport(orv_context_t* ctx)
+{
+    ctx->mClient->setViewport(false, 0, 0, 0, 0, 0);
+}
+
+/**
+ * Let the library request the framebuffer updates, instead of calling @ref
+ * orv_request_framebuffer_update() for every ORV_EVENT_FRAMEBUFFER_UPDATE_REQUEST_FINISHED event.
+ *
+ * The connection thread then sends an incremental request for the full framebuffer (restricted
+ * to the viewport, see @ref orv_set_viewport()) as soon as an update completes, limited by the
+ * target frame rate and the maximum number of outstanding requests of @p options. This avoids
+ * the round trip through the event queue of the application per frame. The events are sent as
+ * usual. Explicit requests of the application are still possible.
+ *
+ * If an update is not answered for a long time (e.g. because the server answered multiple
+ * requests with a single update), another request is sent regardless of the outstanding
+ * requests, so the refresh never stalls.
+ *
+ * The automatic refresh remains active across connections, until @ref orv_stop_auto_refresh() is
+ * called. If it is active when a connection is established, the initial (non-incremental)
+ * request is sent automatically as well. Calling this function again changes the options only.
+ *
+ * @param options The options to use, NULL to use the defaults (see @ref
+ *        orv_auto_refresh_options_default()).
+ **/
+void orv_start_auto_refresh(orv_context_t* ctx, const orv_auto_refresh_options_t* options)
+{
+    orv_auto_refresh_options_t o;
+    if (options) {
+        o = *options;
+    }
+    else {
+        orv_auto_refresh_options_default(&o);
+    }
+    ctx->mClient->setAutoRefresh(true, o);
+}
+
+/**
+ * Stop the automatic refresh started by @ref orv_start_auto_refresh(). Requests that have
+ * already been sent are still answered by the server.
+ **/
+void orv_stop_auto_refresh(orv_context_t* ctx)
+{
+    orv_auto_refresh_options_t o;
+    orv_auto_refresh_options_default(&o);
+    ctx->mClient->setAutoRefresh(false, o);
+}
+
+/**
+ * Allow the next request of the automatic refresh, if @ref
+ * orv_auto_refresh_options_t::mWaitForTick is set. Normally called on every vertical sync of the
+ * display. The request is sent immediately, unless the maximum number of outstanding requests is
+ * reached or the target frame rate would be exceeded, then it is sent as soon as this is no
+ * longer the case. Ticks do not accumulate, i.e. at most one request is sent per tick.
+ *
+ * This function is thread safe and cheap, it can be called from any thread.
+ **/
+void orv_auto_refresh_tick(orv_context_t* ctx)
+{
+    ctx->mClient->autoRefreshTick();
+}
+
+/**
+ * Tell the library how visible the connection currently is, so that connections the user does not
+ * look at cause less network traffic and CPU load on both sides. This affects the requests of the
+ * application as well as those of the automatic refresh (see @ref orv_start_auto_refresh()):
+ *
+ * - @ref ORV_ACTIVITY_STATE_BACKGROUND: Update requests are delayed, so that at most a few
+ *   requests per second are sent. The pixel format of @ref ORV_COMM_QUALITY_PROFILE_LOW is used,
+ *   the format selected by the application is restored when the connection becomes visible again.
+ *   At that point the areas received in the low quality are refreshed by a non-incremental
+ *   request (restricted to the viewport, see @ref orv_set_viewport()).
+ * - @ref ORV_ACTIVITY_STATE_PAUSED: Update requests are held back until the state changes, the
+ *   connection remains established and input events are still sent. When resumed, the most
+ *   recent update request is repeated as an incremental request, i.e. the server sends only what
+ *   changed in the meantime.
+ *
+ * Requests of the application that are held back are not lost, but only the most recent one is
+ * sent once permitted. Requests that have already been sent are still answered by the server.
+ *
+ * The state is kept across connections. This function is thread safe and cheap.
+ **/
+void orv_set_activity_state(orv_context_t* ctx, orv_activity_state_t state)
+{
+    ctx->mClient->setActivityState(state);
+}
+
+/**
+ * @return The state set by @ref orv_set_activity_state(), initially @ref
+ *         ORV_ACTIVITY_STATE_VISIBLE.
+ **/
+orv_activity_state_t orv_get_activity_state(orv_context_t* ctx)
+{
+    return ctx->mClient->activityState();
+}
+
 /**
  * Implementation of an event callback function that queues all events into an internal event queue
  * and provides access to it using the @ref orv_poll_event() function.
@@ -763,6 +1074,104 @@ orv_event_t* orv_poll_event(orv_context_t* ctx)
     return ctx->mEventQueue->dequeue();
 }
 
+/**
+ * Like @ref orv_poll_event(), but obtains up to @p maxCount events at once. This is considerably
+ * cheaper than calling @ref orv_poll_event() for every event, if many events are pending.
+ *
+ * @param events Array of at least @p maxCount elements that receives the events. The caller
+ *        takes ownership of the events and must destroy each using @ref orv_event_destroy().
+ * @return The number of events stored in @p events, 0 if no event is available.
+ *         This function always returns 0, if @ref orv_context_t::mEventCallback of @p ctx is not
+ *         @ref orv_event_callback_polling.
+ **/
+int orv_poll_events(orv_context_t* ctx, orv_event_t** events, int maxCount)
+{
+    if (!ctx || !events || maxCount <= 0) {
+        return 0;
+    }
+    if (!ctx->mEventQueue) {
+        return 0;
+    }
+    return (int)ctx->mEventQueue->dequeue(events, (uint32_t)maxCount);
+}
+
+/**
+ * Block the calling thread until an event can be obtained using @ref orv_poll_event() or @ref
+ * orv_poll_events(), but at most @p timeoutMs milliseconds. A negative @p timeoutMs waits
+ * indefinitely, 0 does not block at all.
+ *
+ * This function does not remove any event from the queue.
+ *
+ * @return 1 if events are available, 0 if the timeout expired. Always 0 if @ref
+ *         orv_context_t::mEventCallback of @p ctx is not @ref orv_event_callback_polling.
+ **/
+int orv_wait_events(orv_context_t* ctx, int timeoutMs)
+{
+    if (!ctx) {
+        return 0;
+    }
+    if (!ctx->mEventQueue) {
+        return 0;
+    }
+    return ctx->mEventQueue->wait(timeoutMs) ? 1 : 0;
+}
+
+/**
+ * Obtain a file descriptor that can be used to integrate the event queue of @p ctx into an
+ * external event loop (select(), poll(), epoll, ...).
+ *
+ * The fd becomes readable when events are queued and remains readable until the queue has been
+ * emptied using @ref orv_poll_event() or @ref orv_poll_events(), i.e. it can be used level
+ * triggered. When the fd is readable, the application should call @ref orv_poll_events() until it
+ * returns fewer events than requested. On linux this is an eventfd, on other unix platforms the
+ * read end of a pipe.
+ *
+ * The fd is owned by @p ctx and remains valid until @ref orv_destroy() is called. The application
+ * must never read from, write to or close the fd.
+ *
+ * @return The fd, or -1 if @ref orv_context_t::mEventCallback of @p ctx is not @ref
+ *         orv_event_callback_polling or if no fd is available (always on windows, use @ref
+ *         orv_wait_events() instead).
+ **/
+int orv_get_event_fd(orv_context_t* ctx)
+{
+    if (!ctx) {
+        return -1;
+    }
+    if (!ctx->mEventQueue) {
+        return -1;
+    }
+#if !defined(_MSC_VER)
+    return ctx->mEventQueue->notificationFd();
+#else // _MSC_VER
+    return -1;
+#endif // _MSC_VER
+}
+
+/**
+ * Capture the data received from the server by the next connection of @p ctx to @p fileName, so
+ * that it can be replayed later without the server (e.g. to measure the decoding performance of a
+ * new build for the workload of that connection).
+ *
+ * The file is created immediately. The capture starts once the next connection has been
+ * established (a connection that is established already is not captured) and ends when that
+ * connection is closed, then the file is closed. The handshake is not captured, only the
+ * parameters negotiated by it. If @p fileName is NULL, a previously set capture file is closed.
+ *
+ * @return 0 on success, otherwise a non-zero value and @p error is set accordingly.
+ **/
+int orv_set_capture_file(orv_context_t* ctx, const char* fileName, orv_error_t* error)
+{
+    orv_error_t dummyError;
+    if (!error) {
+        error = &dummyError;
+    }
+    if (!ctx->mClient->setCaptureFile(fileName, error)) {
+        return 1;
+    }
+    return 0;
+}
+
 /**
  * Convenience and debugging function to map a message type value of the RFB protocol to a human
  * readable string.
@@ -804,6 +1213,9 @@ const char* orv_get_vnc_encoding_type_string(int32_t encodingType)
 /**
  * Obtain the framebuffer pointer and lock it for reading. The caller @em must release the
  * framebuffer using @ref orv_release_framebuffer() after use, otherwise the library is deadlocked.
+ *
+ * If @ref orv_config_t::mSkipFramebuffer is set, the @ref orv_framebuffer_t::mFramebuffer of the
+ * returned framebuffer is NULL.
  **/
 const orv_framebuffer_t* orv_acquire_framebuffer(orv_context_t* ctx)
 {
@@ -830,6 +1242,38 @@ void orv_release_framebuffer(orv_context_t* ctx)
     ctx->mClient->releaseFramebuffer();
 }
 
+/**
+ * Obtain the downscaled copy @p level (1 to ORV_MAX_MIPMAP_LEVELS) of the framebuffer, see @ref
+ * orv_config_t::mMipmapLevels, and lock it for reading. The caller @em must release it using @ref
+ * orv_release_mipmap() after use.
+ *
+ * The mipmaps use a lock separate from the framebuffer, which may be acquired at the same time and
+ * in any order (see @ref orv_config_t::mMipmapLevels). All levels share a single lock, so acquire
+ * only one level at a time.
+ *
+ * @return The framebuffer of @p level, with a NULL @ref orv_framebuffer_t::mFramebuffer if the
+ *         level is not maintained (e.g. if not connected). NULL if @p level is out of range, then
+ *         nothing is locked and @ref orv_release_mipmap() must not be called.
+ **/
+const orv_framebuffer_t* orv_acquire_mipmap(orv_context_t* ctx, int level)
+{
+    if (!ctx) {
+        return nullptr;
+    }
+    return ctx->mClient->acquireMipmap(level);
+}
+
+/**
+ * Release a mipmap level previously locked by @ref orv_acquire_mipmap().
+ **/
+void orv_release_mipmap(orv_context_t* ctx)
+{
+    if (!ctx) {
+        return;
+    }
+    ctx->mClient->releaseMipmap();
+}
+
 /**
  * Obtain the cursor data pointer and lock it for reading. This function is similar to @ref
  * orv_acquire_framebuffer() but for cursor data. The library notifies when new cursor data is
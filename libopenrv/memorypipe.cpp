@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2018 Monument-Software GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "memorypipe.h"
+#include <libopenrv/orv_error.h>
+#include <libopenrv/orv_errorcodes.h>
+
+#if !defined(_MSC_VER)
+#include <sys/socket.h>
+#include <unistd.h>
+#endif // _MSC_VER
+#include <errno.h>
+#include <chrono>
+#include <map>
+
+namespace openrv {
+
+/**
+ * All currently listening @ref MemoryPipeListener objects, by name. Protected by @ref
+ * gListenersMutex.
+ **/
+static std::map<std::string, MemoryPipeListener*> gListeners;
+static std::mutex gListenersMutex;
+
+MemoryPipeListener::MemoryPipeListener(const char* name)
+    : mName(name)
+{
+}
+
+/**
+ * Stop listening and close all connections that have not been accepted yet.
+ **/
+MemoryPipeListener::~MemoryPipeListener()
+{
+    {
+        std::lock_guard<std::mutex> lock(gListenersMutex);
+        gListeners.erase(mName);
+    }
+    close();
+}
+
+void MemoryPipeListener::close()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (int fd : mPendingConnections) {
+#if !defined(_MSC_VER)
+        ::close(fd);
+#endif // _MSC_VER
+    }
+    mPendingConnections.clear();
+}
+
+/**
+ * Create a new listener with the specified @p name. Clients can then connect to @p name using the
+ * @ref TransportType::MemoryPipe transport.
+ *
+ * @return A new listener object, the caller takes ownership and deletes it to stop listening.
+ *         NULL on error (e.g. a listener with the same name already exists), then @p error is set
+ *         accordingly.
+ **/
+MemoryPipeListener* MemoryPipeListener::listen(const char* name, orv_error_t* error)
+{
+#if defined(_MSC_VER)
+    orv_error_set(error, ORV_ERR_GENERIC, 0, "Memory pipe transport is not supported on this platform");
+    return nullptr;
+#else // _MSC_VER
+    if (!name || name[0] == '\0') {
+        orv_error_set(error, ORV_ERR_GENERIC, 0, "Invalid memory pipe name");
+        return nullptr;
+    }
+    std::lock_guard<std::mutex> lock(gListenersMutex);
+    if (gListeners.find(name) != gListeners.end()) {
+        orv_error_set(error, ORV_ERR_GENERIC, 0, "Memory pipe '%s' is already in use", name);
+        return nullptr;
+    }
+    MemoryPipeListener* listener = new MemoryPipeListener(name);
+    gListeners[listener->mName] = listener;
+    return listener;
+#endif // _MSC_VER
+}
+
+/**
+ * Connect to the listener with the specified @p name.
+ *
+ * @return The client-side fd of the new connection (blocking, the caller takes ownership), or -1
+ *         on error, then @p error is set accordingly. The server-side fd is queued in the
+ *         listener until it is accepted by @ref acceptConnection().
+ **/
+int MemoryPipeListener::connectTo(const char* name, orv_error_t* error)
+{
+#if defined(_MSC_VER)
+    orv_error_set(error, ORV_ERR_CONNECT_ERROR_GENERIC, 0, "Memory pipe transport is not supported on this platform");
+    return -1;
+#else // _MSC_VER
+    std::lock_guard<std::mutex> lock(gListenersMutex);
+    auto it = gListeners.find(name);
+    if (it == gListeners.end()) {
+        orv_error_set(error, ORV_ERR_CONNECT_ERROR_CONNECTION_REFUSED, 0, "Connection to memory pipe '%s' failed, no such listener", name);
+        return -1;
+    }
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        orv_error_set(error, ORV_ERR_CONNECT_ERROR_GENERIC, 0, "Connection to memory pipe '%s' failed, socketpair() failed with errno=%d", name, errno);
+        return -1;
+    }
+    MemoryPipeListener* listener = it->second;
+    {
+        std::lock_guard<std::mutex> listenerLock(listener->mMutex);
+        listener->mPendingConnections.push_back(fds[1]);
+    }
+    listener->mPendingConnectionsCondition.notify_all();
+    return fds[0];
+#endif // _MSC_VER
+}
+
+/**
+ * Wait for a client to connect, at most @p timeoutMs milliseconds (a negative value waits
+ * indefinitely).
+ *
+ * @return The server-side fd (blocking) of the connection, the caller takes ownership. -1 if no
+ *         connection was made within the timeout.
+ **/
+int MemoryPipeListener::acceptConnection(int timeoutMs)
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    if (timeoutMs < 0) {
+        mPendingConnectionsCondition.wait(lock, [this]() { return !mPendingConnections.empty(); });
+    }
+    else {
+        mPendingConnectionsCondition.wait_for(lock, std::chrono::milliseconds(timeoutMs), [this]() { return !mPendingConnections.empty(); });
+    }
+    if (mPendingConnections.empty()) {
+        return -1;
+    }
+    int fd = mPendingConnections.front();
+    mPendingConnections.pop_front();
+    return fd;
+}
+
+} // namespace openrv
+
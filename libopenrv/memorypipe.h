@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2018 Monument-Software GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OPENRV_MEMORYPIPE_H
+#define OPENRV_MEMORYPIPE_H
+
+#include <stdint.h>
+#include <list>
+#include <mutex>
+#include <condition_variable>
+#include <string>
+
+struct orv_error_t;
+
+namespace openrv {
+
+/**
+ * Listening end of an in-process "memory pipe" transport (see @ref TransportType::MemoryPipe).
+ *
+ * A server running in the same process (e.g. a mock server used for benchmarks) creates a
+ * listener using @ref listen() and accepts connections using @ref acceptConnection(). Clients
+ * connect to the listener by its name using @ref connectTo(), which is normally called by @ref
+ * Socket.
+ *
+ * Each connection is a connected socket pair (AF_UNIX), i.e. no network is involved at all, but
+ * both ends are normal fds that can be used with select() and encryption libraries, just like TCP
+ * sockets.
+ *
+ * NOTE: Not available on windows (@ref listen() fails).
+ **/
+class MemoryPipeListener
+{
+public:
+    ~MemoryPipeListener();
+
+    static MemoryPipeListener* listen(const char* name, orv_error_t* error);
+    static int connectTo(const char* name, orv_error_t* error);
+
+    int acceptConnection(int timeoutMs);
+    const char* name() const;
+
+private:
+    explicit MemoryPipeListener(const char* name);
+    void close();
+
+private:
+    std::string mName;
+    std::mutex mMutex;
+    std::condition_variable mPendingConnectionsCondition;
+    /**
+     * Server-side fds of connections that have been made by clients, but not yet been accepted.
+     * Protected by @ref mMutex.
+     **/
+    std::list<int> mPendingConnections;
+};
+
+inline const char* MemoryPipeListener::name() const
+{
+    return mName.c_str();
+}
+
+} // namespace openrv
+
+#endif
+
@@ -14,6 +14,8 @@
  * limitations under the License.
  */
 
+#define ORV_LOG_FILE_CATEGORY ORV_LOG_CATEGORY_PARSER
+
 #include "messageparser.h"
 #include <libopenrv/orv_logging.h>
 #include <libopenrv/libopenrv.h>
@@ -22,6 +24,9 @@
 #include "writer.h"
 #include "orv_context.h"
 #include "rectdataparser.h"
+#include "eventpool.h"
+#include "framebuffermipmaps.h"
+#include "utils.h"
 
 #include <algorithm>
 #include <string.h>
@@ -72,20 +77,21 @@ MessageParserFramebufferUpdate::MessageParserFramebufferUpdate(struct orv_contex
       mCurrentFramebufferWidth(*currentFramebufferWidth),
       mCurrentFramebufferHeight(*currentFramebufferHeight)
 {
+    orv_statistics_reset(&mStatistics);
     mAllRectDataParsers.reserve(10);
-    mParserRawIndex = addRectDataParser(new RectDataParserRaw(mContext, &mFramebufferMutex, &mFramebuffer, &mCurrentPixelFormat, &mCurrentFramebufferWidth, &mCurrentFramebufferHeight));
-    mParserCopyRectIndex = addRectDataParser(new RectDataParserCopyRect(mContext, &mFramebufferMutex, &mFramebuffer, &mCurrentPixelFormat, &mCurrentFramebufferWidth, &mCurrentFramebufferHeight));
-    mParserRREIndex = addRectDataParser(new RectDataParserRRE(mContext, &mFramebufferMutex, &mFramebuffer, &mCurrentPixelFormat, &mCurrentFramebufferWidth, &mCurrentFramebufferHeight, false));
-    mParserCoRREIndex = addRectDataParser(new RectDataParserRRE(mContext, &mFramebufferMutex, &mFramebuffer, &mCurrentPixelFormat, &mCurrentFramebufferWidth, &mCurrentFramebufferHeight, true));
-    mParserCursorIndex = addRectDataParser(new RectDataParserCursor(mContext, &mCursorMutex, &mCursorData, &mCurrentPixelFormat, &mCurrentFramebufferWidth, &mCurrentFramebufferHeight));
-    mParserZlibIndex = addRectDataParser(new RectDataParserZlib(mContext, &mFramebufferMutex, &mFramebuffer, &mCurrentPixelFormat, &mCurrentFramebufferWidth, &mCurrentFramebufferHeight));
-    mParserHextileIndex = addRectDataParser(new RectDataParserHextile(mContext, &mFramebufferMutex, &mFramebuffer, &mCurrentPixelFormat, &mCurrentFramebufferWidth, &mCurrentFramebufferHeight));
-    mParserZRLEIndex = addRectDataParser(new RectDataParserZRLE(mContext, &mFramebufferMutex, &mFramebuffer, &mCurrentPixelFormat, &mCurrentFramebufferWidth, &mCurrentFramebufferHeight));
+    mParserRawIndex = addRectDataParser(new RectDataParserRaw(mContext, &mDecodeArena, &mFramebufferMutex, &mFramebuffer, &mCurrentPixelFormat, &mCurrentFramebufferWidth, &mCurrentFramebufferHeight));
+    mParserCopyRectIndex = addRectDataParser(new RectDataParserCopyRect(mContext, &mDecodeArena, &mFramebufferMutex, &mFramebuffer, &mCurrentPixelFormat, &mCurrentFramebufferWidth, &mCurrentFramebufferHeight));
+    mParserRREIndex = addRectDataParser(new RectDataParserRRE(mContext, &mDecodeArena, &mFramebufferMutex, &mFramebuffer, &mCurrentPixelFormat, &mCurrentFramebufferWidth, &mCurrentFramebufferHeight, false));
+    mParserCoRREIndex = addRectDataParser(new RectDataParserRRE(mContext, &mDecodeArena, &mFramebufferMutex, &mFramebuffer, &mCurrentPixelFormat, &mCurrentFramebufferWidth, &mCurrentFramebufferHeight, true));
+    mParserCursorIndex = addRectDataParser(new RectDataParserCursor(mContext, &mDecodeArena, &mCursorMutex, &mCursorData, &mCurrentPixelFormat, &mCurrentFramebufferWidth, &mCurrentFramebufferHeight));
+    mParserZlibIndex = addRectDataParser(new RectDataParserZlib(mContext, &mDecodeArena, &mFramebufferMutex, &mFramebuffer, &mCurrentPixelFormat, &mCurrentFramebufferWidth, &mCurrentFramebufferHeight));
+    mParserHextileIndex = addRectDataParser(new RectDataParserHextile(mContext, &mDecodeArena, &mFramebufferMutex, &mFramebuffer, &mCurrentPixelFormat, &mCurrentFramebufferWidth, &mCurrentFramebufferHeight));
+    mParserZRLEIndex = addRectDataParser(new RectDataParserZRLE(mContext, &mDecodeArena, &mFramebufferMutex, &mFramebuffer, &mCurrentPixelFormat, &mCurrentFramebufferWidth, &mCurrentFramebufferHeight));
 }
 
 MessageParserFramebufferUpdate::~MessageParserFramebufferUpdate()
 {
-    clearRectEvents();
+    freeRectEvents();
     for (RectDataParserBase* parser : mAllRectDataParsers) {
         parser->reset();
         delete parser;
@@ -203,19 +209,33 @@ RectDataParserBase* MessageParserFramebufferUpdate::findRectParserForEncoding(En
 }
 
 
+/**
+ * Destroy all pending rect events, but keep the @ref mRectEvent array for the next message.
+ **/
 void MessageParserFramebufferUpdate::clearRectEvents()
 {
+    if (mBatchEvent) {
+        orv_event_destroy(mBatchEvent);
+        mBatchEvent = nullptr;
+    }
     if (mRectEvent) {
-        for (uint16_t i = 0; i < mNumberOfRectanglesSent; i++) {
+        for (uint32_t i = 0; i < mRectEventCapacity; i++) {
             if (mRectEvent[i]) {
                 orv_event_destroy(mRectEvent[i]);
+                mRectEvent[i] = nullptr;
             }
         }
-        free(mRectEvent);
-        mRectEvent = nullptr;
     }
 }
 
+void MessageParserFramebufferUpdate::freeRectEvents()
+{
+    clearRectEvents();
+    free(mRectEvent);
+    mRectEvent = nullptr;
+    mRectEventCapacity = 0;
+}
+
 void MessageParserFramebufferUpdate::reset()
 {
     MessageParserBase::reset();
@@ -223,6 +243,12 @@ void MessageParserFramebufferUpdate::reset()
     mNumberOfRectanglesSent = 0;
     mCurrentRectIndex = 0;
     mCurrentRectHeader = RectHeader();
+    if (mCurrentRectParser) {
+        mCurrentRectParser->reset();
+        mCurrentRectParser = nullptr;
+    }
+    mDecodeArena.reset();
+    mCurrentEncodingStatistics = nullptr;
     clearRectEvents();
     mSentRectEvents = 0;
 }
@@ -240,6 +266,69 @@ void MessageParserFramebufferUpdate::resetConnection()
     for (RectDataParserBase* r : mAllRectDataParsers) {
         r->resetConnection();
     }
+    freeRectEvents();
+    mDecodeArena.release();
+    orv_statistics_reset(&mStatistics);
+    mStatisticsGeneration++;
+    mUpdatesPerSecondIntervalStartUs = 0;
+    mUpdatesPerSecondIntervalStartUpdates = 0;
+}
+
+/**
+ * Add a measured time between sending a FramebufferUpdateRequest and receiving the complete
+ * response to the statistics.
+ **/
+void MessageParserFramebufferUpdate::addUpdateLatency(uint64_t latencyUs)
+{
+    if (mStatistics.mUpdateLatencyCount == 0 || latencyUs < mStatistics.mUpdateLatencyMinUs) {
+        mStatistics.mUpdateLatencyMinUs = latencyUs;
+    }
+    mStatistics.mUpdateLatencyMaxUs = std::max(mStatistics.mUpdateLatencyMaxUs, latencyUs);
+    mStatistics.mUpdateLatencyLastUs = latencyUs;
+    mStatistics.mUpdateLatencyTotalUs += latencyUs;
+    mStatistics.mUpdateLatencyCount++;
+    mStatisticsGeneration++;
+}
+
+/**
+ * Set the @p mipmaps that are updated for every finished rect, NULL to disable. Must be called
+ * before any message is parsed.
+ **/
+void MessageParserFramebufferUpdate::setMipmaps(FramebufferMipmaps* mipmaps)
+{
+    mMipmaps = mipmaps;
+}
+
+/**
+ * @return The entry in @ref mStatistics for @p encodingType, a new entry is added if required.
+ *         NULL if no more entries are available.
+ **/
+orv_encoding_statistics_t* MessageParserFramebufferUpdate::findEncodingStatistics(int32_t encodingType)
+{
+    for (uint32_t i = 0; i < mStatistics.mEncodingCount; i++) {
+        if (mStatistics.mEncodings[i].mEncodingType == encodingType) {
+            return &mStatistics.mEncodings[i];
+        }
+    }
+    if (mStatistics.mEncodingCount >= ORV_MAX_ENCODING_STATISTICS) {
+        return nullptr;
+    }
+    orv_encoding_statistics_t* statistics = &mStatistics.mEncodings[mStatistics.mEncodingCount];
+    mStatistics.mEncodingCount++;
+    statistics->mEncodingType = encodingType;
+    return statistics;
+}
+
+/**
+ * Pre-allocate the temporary buffers of the rect data parsers for the current framebuffer size and
+ * pixel format, so that normally no heap allocations are required while decoding updates.
+ *
+ * Should be called whenever the framebuffer size is (re-)initialized, i.e. on ServerInit.
+ **/
+void MessageParserFramebufferUpdate::reserveDecodeBuffers()
+{
+    const size_t bytesPerPixel = std::max(1, (int)mCurrentPixelFormat.mBitsPerPixel / 8);
+    mDecodeArena.reserve((size_t)mCurrentFramebufferWidth * (size_t)mCurrentFramebufferHeight * bytesPerPixel);
 }
 
 uint32_t MessageParserFramebufferUpdate::readData(const char* buffer, uint32_t bufferSize, orv_error_t* error)
@@ -258,8 +347,11 @@ uint32_t MessageParserFramebufferUpdate::readData(const char* buffer, uint32_t b
             mIsFinished = true;
         }
         clearRectEvents();
-        mRectEvent = (orv_event_t**)malloc(mNumberOfRectanglesSent * sizeof(orv_event_t*));
-        memset(mRectEvent, 0, mNumberOfRectanglesSent * sizeof(orv_event_t*));
+        if (mNumberOfRectanglesSent > mRectEventCapacity) {
+            free(mRectEvent);
+            mRectEvent = (orv_event_t**)calloc(mNumberOfRectanglesSent, sizeof(orv_event_t*));
+            mRectEventCapacity = mRectEvent ? mNumberOfRectanglesSent : 0;
+        }
         mSentRectEvents = 0;
         ORV_DEBUG(mContext, "Received header of FramebufferUpdate message, numberOfRectangles: %d", (int)mNumberOfRectanglesSent);
     }
@@ -301,6 +393,11 @@ orv_event_t* MessageParserFramebufferUpdate::processFinishedMessage(orv_error_t*
     //       add processPartialMessage(), that sends events up to the mCurrentRectIndex and sets
     //       mSentRectEvents accordingly
     //       -> this way we can process data even before all rects have arrived
+    if (mBatchEvent) {
+        // NOTE: ownership of event is passed
+        sendEvent(mBatchEvent);
+        mBatchEvent = nullptr;
+    }
     for (uint16_t i = mSentRectEvents; i < mNumberOfRectanglesSent; i++) {
         orv_event_t* e = mRectEvent[i];
         if (!e) {
@@ -315,7 +412,21 @@ orv_event_t* MessageParserFramebufferUpdate::processFinishedMessage(orv_error_t*
         mSentRectEvents++;
     }
     if (mSentRectEvents >= mNumberOfRectanglesSent) {
-        return orv_event_init(ORV_EVENT_FRAMEBUFFER_UPDATE_REQUEST_FINISHED);
+        mStatistics.mFramebufferUpdates++;
+        mStatistics.mFramebufferUpdateRects += mNumberOfRectanglesSent;
+        const uint64_t nowUs = Utils::getTimestampUs();
+        if (mUpdatesPerSecondIntervalStartUs == 0) {
+            mUpdatesPerSecondIntervalStartUs = nowUs;
+            mUpdatesPerSecondIntervalStartUpdates = mStatistics.mFramebufferUpdates;
+        }
+        else if (nowUs - mUpdatesPerSecondIntervalStartUs >= 1000 * 1000) {
+            const uint64_t updates = mStatistics.mFramebufferUpdates - mUpdatesPerSecondIntervalStartUpdates;
+            mStatistics.mUpdatesPerSecond = (double)updates * 1000.0 * 1000.0 / (double)(nowUs - mUpdatesPerSecondIntervalStartUs);
+            mUpdatesPerSecondIntervalStartUs = nowUs;
+            mUpdatesPerSecondIntervalStartUpdates = mStatistics.mFramebufferUpdates;
+        }
+        mStatisticsGeneration++;
+        return mContext->mEventPool->acquire(ORV_EVENT_FRAMEBUFFER_UPDATE_REQUEST_FINISHED);
     }
     return nullptr;
 }
@@ -335,6 +446,7 @@ uint32_t MessageParserFramebufferUpdate::readRect(const char* buffer, uint32_t b
             mCurrentRectParser->reset();
             mCurrentRectParser = nullptr;
         }
+        mDecodeArena.reset();
 
         // each rect has 12 bytes header + n bytes encoding-specific data
         if (bufferSize < 12) {
@@ -363,6 +475,19 @@ uint32_t MessageParserFramebufferUpdate::readRect(const char* buffer, uint32_t b
         }
         mCurrentRectParser->reset();
         mCurrentRectParser->setCurrentRect(mCurrentRectHeader.mX, mCurrentRectHeader.mY, mCurrentRectHeader.mW, mCurrentRectHeader.mH);
+        mCurrentRectParser->setCurrentEncodingType(mCurrentRectHeader.mEncodingType);
+        // NOTE: pseudo-encodings (cursor, DesktopSize, ...) transfer no framebuffer data, so they
+        //       are not counted.
+        mCurrentEncodingStatistics = nullptr;
+        if (!mCurrentRectParser->isPseudoEncoding()) {
+            mCurrentEncodingStatistics = findEncodingStatistics(mCurrentRectHeader.mEncodingType);
+        }
+        if (mCurrentEncodingStatistics) {
+            const uint64_t pixels = (uint64_t)mCurrentRectHeader.mW * (uint64_t)mCurrentRectHeader.mH;
+            mCurrentEncodingStatistics->mRects++;
+            mCurrentEncodingStatistics->mPixels += pixels;
+            mCurrentEncodingStatistics->mDecompressedBytes += pixels * (mCurrentPixelFormat.mBitsPerPixel / 8);
+        }
     }
 
     // sanity checks
@@ -383,17 +508,36 @@ uint32_t MessageParserFramebufferUpdate::readRect(const char* buffer, uint32_t b
         return 0;
     }
 
-    consumed += mCurrentRectParser->readRectData(buffer + consumed, bufferSize - consumed, error);
+    const bool measureTimes = mCurrentEncodingStatistics && mContext->mConfig.mMeasureDecodeTimes;
+    const uint64_t readStartUs = measureTimes ? Utils::getTimestampUs() : 0;
+    const uint32_t rectDataConsumed = mCurrentRectParser->readRectData(buffer + consumed, bufferSize - consumed, error);
+    consumed += rectDataConsumed;
+    if (mCurrentEncodingStatistics) {
+        mCurrentEncodingStatistics->mCompressedBytes += rectDataConsumed;
+    }
+    if (measureTimes) {
+        mCurrentEncodingStatistics->mReadTimeUs += Utils::getTimestampUs() - readStartUs;
+    }
     if (error->mHasError) {
         mCurrentRectParser->reset();
+        mDecodeArena.reset();
         return 0;
     }
     // TODO: support for partial rects.
     //       probably rename canFinishRect() to canFinishPartialRect()
     if (mCurrentRectParser->canFinishRect()) {
         const bool isPseudoEncoding = mCurrentRectParser->isPseudoEncoding();
+        const uint64_t finishStartUs = measureTimes ? Utils::getTimestampUs() : 0;
         mCurrentRectParser->finishRect(error);
+        if (measureTimes) {
+            mCurrentEncodingStatistics->mFinishTimeUs += Utils::getTimestampUs() - finishStartUs;
+        }
+        if (mCurrentRectParser->framebufferLockWaitUs() > 0) {
+            mStatistics.mFramebufferLockWaitUs += mCurrentRectParser->framebufferLockWaitUs();
+            mStatistics.mFramebufferLockContentions++;
+        }
         mCurrentRectParser->reset();
+        mDecodeArena.reset();
         if (error->mHasError) {
             return 0;
         }
@@ -404,7 +548,34 @@ uint32_t MessageParserFramebufferUpdate::readRect(const char* buffer, uint32_t b
             mRectEvent[mCurrentRectIndex] = nullptr;
         }
         if (!isPseudoEncoding) {
-            mRectEvent[mCurrentRectIndex] = orv_event_framebuffer_init(mCurrentRectHeader.mX, mCurrentRectHeader.mY, mCurrentRectHeader.mW, mCurrentRectHeader.mH);
+            if (mMipmaps && mContext->mConfig.mMipmapLevels > 0 && !mContext->mConfig.mSkipFramebuffer) {
+                const uint64_t mipmapStartUs = measureTimes ? Utils::getTimestampUs() : 0;
+                std::unique_lock<std::mutex> lock(mFramebufferMutex);
+                mMipmaps->beginUpdateFramebufferMutexLocked(mFramebuffer, mCurrentRectHeader.mX, mCurrentRectHeader.mY, mCurrentRectHeader.mW, mCurrentRectHeader.mH);
+                lock.unlock();
+                mMipmaps->finishUpdate();
+                if (measureTimes) {
+                    mCurrentEncodingStatistics->mFinishTimeUs += Utils::getTimestampUs() - mipmapStartUs;
+                }
+            }
+            if (mContext->mConfig.mBatchFramebufferEvents) {
+                if (!mBatchEvent) {
+                    mBatchEvent = mContext->mEventPool->acquire(ORV_EVENT_FRAMEBUFFER_UPDATED_BATCH);
+                }
+                if (!EventStorage::appendBatchRect(mBatchEvent, mCurrentRectHeader.mX, mCurrentRectHeader.mY, mCurrentRectHeader.mW, mCurrentRectHeader.mH)) {
+                    orv_error_set(error, ORV_ERR_GENERIC, 0, "Failed to allocate memory for framebuffer update event");
+                    return 0;
+                }
+            }
+            else {
+                orv_event_t* e = mContext->mEventPool->acquire(ORV_EVENT_FRAMEBUFFER_UPDATED);
+                orv_event_framebuffer_t* data = (orv_event_framebuffer_t*)e->mEventData;
+                data->mX = mCurrentRectHeader.mX;
+                data->mY = mCurrentRectHeader.mY;
+                data->mWidth = mCurrentRectHeader.mW;
+                data->mHeight = mCurrentRectHeader.mH;
+                mRectEvent[mCurrentRectIndex] = e;
+            }
         }
         else {
             // pseudo-encodings.
@@ -420,7 +591,7 @@ uint32_t MessageParserFramebufferUpdate::readRect(const char* buffer, uint32_t b
                 case EncodingType::Cursor:
                     // a single event is generated, we use mRectEvent for delivery (as convenience
                     // only, this is not actually a rect event).
-                    mRectEvent[mCurrentRectIndex] = orv_event_init(ORV_EVENT_CURSOR_UPDATED);
+                    mRectEvent[mCurrentRectIndex] = mContext->mEventPool->acquire(ORV_EVENT_CURSOR_UPDATED);
                     break;
             }
         }
@@ -564,6 +735,118 @@ orv_event_t* MessageParserServerCutText::processFinishedMessage(orv_error_t* err
     return event;
 }
 
+ServerMessageReader::ServerMessageReader(orv_context_t* ctx, MessageParserFramebufferUpdate* framebufferUpdate, MessageParserSetColourMapEntries* setColourMapEntries, MessageParserServerCutText* serverCutText, Listener* listener)
+    : mContext(ctx),
+      mMessageFramebufferUpdate(framebufferUpdate),
+      mMessageSetColourMapEntries(setColourMapEntries),
+      mMessageServerCutText(serverCutText),
+      mListener(listener)
+{
+}
+
+/**
+ * Discard the partially parsed message (if any), e.g. on connection start.
+ **/
+void ServerMessageReader::reset()
+{
+    if (mCurrentMessageParser) {
+        mCurrentMessageParser->reset();
+        mCurrentMessageParser = nullptr;
+    }
+}
+
+/**
+ * Process as many messages in the @p bufferSize bytes of @p buffer as possible. The last message
+ * may remain incomplete, the parser of that message keeps its state until the remaining data is
+ * provided by the next call.
+ *
+ * @return The number of bytes consumed from @p buffer. The caller must provide the remaining bytes
+ *         again (followed by new data) in the next call. On error, @p error is set and the return
+ *         value is undefined.
+ **/
+size_t ServerMessageReader::processData(const char* buffer, size_t bufferSize, orv_error_t* error)
+{
+    orv_error_reset(error);
+    size_t offset = 0;
+    while (offset < bufferSize) {
+        const size_t consumed = processMessageData(buffer + offset, bufferSize - offset, error);
+        if (error->mHasError) {
+            ORV_DEBUG(mContext, "Error in processMessageData");
+            return offset;
+        }
+        if (consumed == 0) {
+            // wait for more data
+            break;
+        }
+        offset += consumed;
+    }
+    return offset;
+}
+
+/**
+ * @return The number of bytes consumed from @p buffer.
+ *         If more data is required, 0 is returned.
+ **/
+size_t ServerMessageReader::processMessageData(const char* buffer, size_t bufferSize, orv_error_t* error)
+{
+    orv_error_reset(error);
+    if (bufferSize == 0) {
+        return 0;
+    }
+    if (!mCurrentMessageParser) {
+        const uint8_t messageType = buffer[0];
+        ORV_DEBUG(mContext, "Have new message of type %d (%s)", (int)messageType, OrvVncClient::getServerMessageTypeString((ServerMessage)messageType));
+        switch ((ServerMessage)messageType) {
+            case ServerMessage::FramebufferUpdate:
+                mCurrentMessageParser = mMessageFramebufferUpdate;
+                break;
+            case ServerMessage::SetColourMapEntries:
+                mCurrentMessageParser = mMessageSetColourMapEntries;
+                break;
+            case ServerMessage::Bell:
+                // message already complete
+                mListener->serverMessageStarted(ServerMessage::Bell);
+                mListener->serverMessageFinished(ServerMessage::Bell, mContext->mEventPool->acquire(ORV_EVENT_BELL));
+                return 1;
+            case ServerMessage::ServerCutText:
+                mCurrentMessageParser = mMessageServerCutText;
+                break;
+            default:
+                ORV_ERROR(mContext, "Unexpected message type %d, cannot handle message. Protocol error.", (int)messageType);
+                orv_error_set(error, ORV_ERR_PROTOCOL_ERROR, 100, "Unexpected message type %d, cannot handle message.", (int)messageType);
+                return 0;
+        }
+        mCurrentMessageParser->reset();
+        mListener->serverMessageStarted((ServerMessage)messageType);
+    }
+    ORV_DEBUG(mContext, "processing data for message type %d (%s), bytes in buffer: %d", (int)mCurrentMessageParser->messageType(), mCurrentMessageParser->messageTypeString(), (int)bufferSize);
+    const uint32_t consumed = mCurrentMessageParser->readData(buffer, (uint32_t)bufferSize, error);
+    if (error->mHasError) {
+        mCurrentMessageParser->reset();
+        mCurrentMessageParser = nullptr;
+        return 0;
+    }
+
+    // TODO: add a processPartialMessage() function that can send events for partial messages?
+    //       -> for FramebufferUpdate messages, we want to send events for all finished rects, even
+    //          before the full message has been received
+
+    if (mCurrentMessageParser->isFinished()) {
+        ORV_DEBUG(mContext, "message type %d (%s) completed", (int)mCurrentMessageParser->messageType(), mCurrentMessageParser->messageTypeString());
+        const ServerMessage messageType = mCurrentMessageParser->messageType();
+        orv_event_t* e = mCurrentMessageParser->processFinishedMessage(error);
+        mCurrentMessageParser = nullptr;
+        if (error->mHasError) {
+            if (e) {
+                orv_event_destroy(e);
+            }
+            return 0;
+        }
+        mListener->serverMessageFinished(messageType, e);
+    }
+    return consumed;
+}
+
 } // namespace vnc
 } // namespace openrv
 
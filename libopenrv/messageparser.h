@@ -18,6 +18,7 @@
 #define OPENRV_MESSAGEPARSER_H
 
 #include "orvvncclient.h"
+#include "decodearena.h"
 
 #include <vector>
 
@@ -86,6 +87,7 @@ protected:
 };
 
 class RectDataParserBase;
+class FramebufferMipmaps;
 
 class MessageParserFramebufferUpdate : public MessageParserBase
 {
@@ -101,6 +103,12 @@ public:
     }
 
     void resetConnection();
+    void reserveDecodeBuffers();
+    const DecodeArena& decodeArena() const;
+    const orv_statistics_t& statistics() const;
+    uint64_t statisticsGeneration() const;
+    void addUpdateLatency(uint64_t latencyUs);
+    void setMipmaps(FramebufferMipmaps* mipmaps);
 
 protected:
     struct RectHeader
@@ -116,6 +124,8 @@ protected:
 protected:
     uint32_t readRect(const char* buffer, uint32_t bufferSize, orv_error_t* error);
     void clearRectEvents();
+    void freeRectEvents();
+    orv_encoding_statistics_t* findEncodingStatistics(int32_t encodingType);
     RectDataParserBase* findRectParserForEncoding(EncodingType encodingType, orv_error_t* error);
     int addRectDataParser(RectDataParserBase* parser);
 protected:
@@ -133,16 +143,53 @@ protected:
      * Protected by @ref mCursorMutex, all accesses em MUST lock the mutex first.
      **/
     orv_cursor_t& mCursorData;
+    /**
+     * Downscaled copies of @ref mFramebuffer that are updated for every rect, NULL if not used.
+     * Thread safe on its own, see @ref FramebufferMipmaps.
+     **/
+    FramebufferMipmaps* mMipmaps = nullptr;
 private:
     const orv_communication_pixel_format_t& mCurrentPixelFormat;
     const uint16_t& mCurrentFramebufferWidth;
     const uint16_t& mCurrentFramebufferHeight;
+    /**
+     * Temporary buffers of all rect data parsers, reset after every rect. Must be declared before
+     * the parsers are created.
+     **/
+    DecodeArena mDecodeArena;
     bool mHasHeader = false;
     uint16_t mNumberOfRectanglesSent = 0;
     uint16_t mCurrentRectIndex = 0;
     RectHeader mCurrentRectHeader;
     RectDataParserBase* mCurrentRectParser = nullptr;
+    /**
+     * One event per rect of the current message. Grows as required, but is not freed between
+     * messages, see @ref clearRectEvents().
+     **/
     orv_event_t** mRectEvent = nullptr;
+    uint32_t mRectEventCapacity = 0;
+    /**
+     * The ORV_EVENT_FRAMEBUFFER_UPDATED_BATCH event of the current message, if @ref
+     * orv_config_t::mBatchFramebufferEvents is set. Otherwise @ref mRectEvent is used.
+     **/
+    orv_event_t* mBatchEvent = nullptr;
+    /**
+     * Statistics of the current connection, reset by @ref resetConnection().
+     **/
+    orv_statistics_t mStatistics;
+    /**
+     * Incremented whenever @ref mStatistics changed: On every finished FramebufferUpdate, every
+     * added latency and on @ref resetConnection(). Changes within an update are published only
+     * together with the finished update.
+     **/
+    uint64_t mStatisticsGeneration = 0;
+    /**
+     * Entry in @ref mStatistics for the encoding of the current rect, NULL if the statistics are
+     * full (see @ref ORV_MAX_ENCODING_STATISTICS).
+     **/
+    orv_encoding_statistics_t* mCurrentEncodingStatistics = nullptr;
+    uint64_t mUpdatesPerSecondIntervalStartUs = 0;
+    uint64_t mUpdatesPerSecondIntervalStartUpdates = 0;
     uint16_t mSentRectEvents = 0;
     std::vector<RectDataParserBase*> mAllRectDataParsers;
     int mParserRawIndex = -1;
@@ -154,6 +201,33 @@ private:
     int mParserHextileIndex = -1;
     int mParserZRLEIndex = -1;
 };
+
+/**
+ * @return The arena used for the temporary buffers of the rect data parsers. Must be called by
+ *         the connection thread only.
+ **/
+inline const DecodeArena& MessageParserFramebufferUpdate::decodeArena() const
+{
+    return mDecodeArena;
+}
+
+/**
+ * @return The decoding statistics of the current connection. Must be called by the connection
+ *         thread only.
+ **/
+inline const orv_statistics_t& MessageParserFramebufferUpdate::statistics() const
+{
+    return mStatistics;
+}
+
+/**
+ * @return A number that changes whenever @ref statistics() changed, see @ref
+ *         mStatisticsGeneration. Must be called by the connection thread only.
+ **/
+inline uint64_t MessageParserFramebufferUpdate::statisticsGeneration() const
+{
+    return mStatisticsGeneration;
+}
 class MessageParserSetColourMapEntries : public MessageParserBase
 {
 public:
@@ -234,6 +308,49 @@ private:
     uint32_t mTextConsumed = 0;
 };
 
+/**
+ * Drives the message parsers of a connection: picks the parser for each server message, feeds it
+ * the received data and passes the results to a @ref Listener.
+ *
+ * Used by the @ref openrv::vnc::ConnectionThread and by @ref SessionReplay, so that a replay
+ * processes the data exactly like the connection did.
+ **/
+class ServerMessageReader
+{
+public:
+    class Listener
+    {
+    public:
+        virtual ~Listener() = default;
+        /**
+         * Called when the first byte of a message of @p messageType has been received.
+         **/
+        virtual void serverMessageStarted(ServerMessage messageType) = 0;
+        /**
+         * Called when a message of @p messageType has been parsed completely. The listener takes
+         * ownership of @p event, which may be NULL if the message generated no event.
+         **/
+        virtual void serverMessageFinished(ServerMessage messageType, orv_event_t* event) = 0;
+    };
+
+public:
+    ServerMessageReader(struct orv_context_t* ctx, MessageParserFramebufferUpdate* framebufferUpdate, MessageParserSetColourMapEntries* setColourMapEntries, MessageParserServerCutText* serverCutText, Listener* listener);
+
+    void reset();
+    size_t processData(const char* buffer, size_t bufferSize, orv_error_t* error);
+
+protected:
+    size_t processMessageData(const char* buffer, size_t bufferSize, orv_error_t* error);
+
+private:
+    struct orv_context_t* mContext = nullptr;
+    MessageParserFramebufferUpdate* mMessageFramebufferUpdate = nullptr;
+    MessageParserSetColourMapEntries* mMessageSetColourMapEntries = nullptr;
+    MessageParserServerCutText* mMessageServerCutText = nullptr;
+    Listener* mListener = nullptr;
+    MessageParserBase* mCurrentMessageParser = nullptr;
+};
+
 } // namespace vnc
 } // namespace openrv
 
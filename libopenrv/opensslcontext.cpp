@@ -14,6 +14,8 @@
  * limitations under the License.
  */
 
+#define ORV_LOG_FILE_CATEGORY ORV_LOG_CATEGORY_SOCKET
+
 #include "opensslcontext.h"
 
 #include <libopenrv/libopenrv.h>
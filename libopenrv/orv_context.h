@@ -25,6 +25,7 @@ namespace vnc {
     class OrvVncClient;
 }
 class EventQueue;
+class EventPool;
 
 } // namespace openrv
 
@@ -47,6 +48,12 @@ struct orv_context_t
      **/
     openrv::EventQueue* mEventQueue = nullptr;
 
+    /**
+     * Pool of the frequently sent events, see @ref openrv::EventPool. Events are obtained from the
+     * pool by the connection thread only.
+     **/
+    openrv::EventPool* mEventPool = nullptr;
+
     union UserDataUnion
     {
         void* mPointerData;
@@ -20,9 +20,14 @@
 #include <libopenrv/libopenrv.h>
 #include "socket.h"
 #include "threadnotifier.h"
+#include "latencytesterstatistics.h"
+#include "utils.h"
 
+#include <inttypes.h>
 #include <string.h>
 #include <stdlib.h>
+#include <algorithm>
+#include <deque>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
@@ -32,12 +37,30 @@
 #include <arpa/inet.h>
 #include <sys/time.h>
 
+/**
+ * Size of the update response message: magic cookie and type, 8 coordinates and 3 timestamps of 2
+ * int64 values each.
+ **/
+static const int gUpdateResponseSize = 4 + (4*2) * 4 + (3*2) * 8;
+
+/**
+ * An update request that was sent in continuous mode and not yet answered by the server.
+ **/
+struct OutstandingLatencyRequest
+{
+    struct timeval mSendTimestamp;
+    uint64_t mSendUs;
+};
+
 struct orv_latency_tester_client_t
 {
     orv_latency_tester_client_t(orv_context_t* orvContext, const char* hostName, int port, orv_latency_tester_event_callback_t eventCallback, void* userData);
     ~orv_latency_tester_client_t();
     void threadFunction(std::unique_lock<std::mutex> lock);
     void doThread(std::unique_lock<std::mutex>& lock);
+    bool sendUpdateRequest(orv_error_t* error);
+    bool parseUpdateResponse(const uint8_t* message, orv_latency_tester_update_response_t* response);
+    bool runContinuous(std::unique_lock<std::mutex>& lock);
 
     orv_context_t* mOrvContext = nullptr;
     char* mHostName = nullptr;
@@ -54,6 +77,13 @@ struct orv_latency_tester_client_t
     openrv::ThreadNotifierWriter mThreadNotifierWriter;
     bool mIsValid = true;
     bool mWantSendRequest = false;
+    /**
+     * If TRUE, the thread sends requests as configured by @ref mContinuousOptions, see @ref
+     * runContinuous().
+     **/
+    bool mContinuous = false;
+    orv_latency_tester_continuous_options_t mContinuousOptions;
+    openrv::LatencyTesterStatistics mStatistics;
 };
 
 orv_latency_tester_client_t::orv_latency_tester_client_t(orv_context_t* orvContext, const char* hostName, int port, orv_latency_tester_event_callback_t eventCallback, void* userData)
@@ -63,6 +93,7 @@ orv_latency_tester_client_t::orv_latency_tester_client_t(orv_context_t* orvConte
     mEventCallback(eventCallback),
     mUserData(userData)
 {
+    orv_latency_tester_continuous_options_default(&mContinuousOptions);
     if (!openrv::ThreadNotifier::makePipe(&mThreadNotifierWriter, &mThreadNotifierListener)) {
         ORV_ERROR(mOrvContext, "Failed to create pipe");
     }
@@ -144,57 +175,42 @@ void orv_latency_tester_client_t::doThread(std::unique_lock<std::mutex>& lock)
 
     lock.lock();
     while (!mWantQuit) {
-        if (mWantSendRequest) {
-            uint8_t updateRequestMessage[5] = {};
-            memcpy(updateRequestMessage, "lat", 3);
-            updateRequestMessage[3] = 1;
+        if (mContinuous) {
+            if (!runContinuous(lock)) {
+                return;
+            }
+        }
+        else if (mWantSendRequest) {
             lock.unlock();
             orv_error_t error;
             struct timeval sendTimestamp;
             gettimeofday(&sendTimestamp, nullptr);
-            if (!mSocket->writeDataBlocking(updateRequestMessage, 4, &error)) {
+            const uint64_t sendUs = Utils::getTimestampUs();
+            if (!sendUpdateRequest(&error)) {
                 ORV_ERROR(mOrvContext, "Failed to write update request, error: %s", error.mErrorMessage);
                 mSocket->close();
                 return;
             }
-            const int updateResponseSize = 4 + (4*2) * 4 + (3*2) * 8;
-            uint8_t updateResponse[updateResponseSize];
-            if (!mSocket->readDataBlocking(updateResponse, updateResponseSize, &error)) {
+            mStatistics.addSentRequest();
+            uint8_t updateResponse[gUpdateResponseSize];
+            if (!mSocket->readDataBlocking(updateResponse, gUpdateResponseSize, &error)) {
                 ORV_ERROR(mOrvContext, "Failed to read update response, error: %s", error.mErrorMessage);
                 mSocket->close();
                 return;
             }
+            const uint64_t receiveUs = Utils::getTimestampUs();
             struct timeval receiveTimestamp;
             gettimeofday(&receiveTimestamp, nullptr);
-            if (memcmp(updateResponse, "lat", 3) != 0) {
-                ORV_ERROR(mOrvContext, "Magic cookie mismatch in response from server");
-                mSocket->close();
-                return;
-            }
-            if (updateResponse[3] != 1) {
-                ORV_ERROR(mOrvContext, "Unexpected response type %d from server after update request", (int)updateResponse[3]);
+            orv_latency_tester_update_response_t response;
+            if (!parseUpdateResponse(updateResponse, &response)) {
                 mSocket->close();
                 return;
             }
-            orv_latency_tester_update_response_t response;
-            memcpy(&response.mPreviousTopLeftX, updateResponse + 4, 4);
-            memcpy(&response.mPreviousTopLeftY, updateResponse + 8, 4);
-            memcpy(&response.mPreviousBottomRightX, updateResponse + 12, 4);
-            memcpy(&response.mPreviousBottomRightY, updateResponse + 16, 4);
-            memcpy(&response.mNewTopLeftX, updateResponse + 20, 4);
-            memcpy(&response.mNewTopLeftY, updateResponse + 24, 4);
-            memcpy(&response.mNewBottomRightX, updateResponse + 28, 4);
-            memcpy(&response.mNewBottomRightY, updateResponse + 32, 4);
-            memcpy(&response.mServerUpdateTimestampSec, updateResponse + 36, 8);
-            memcpy(&response.mServerUpdateTimestampUSec, updateResponse + 44, 8);
-            memcpy(&response.mServerSendTimestampSec, updateResponse + 52, 8);
-            memcpy(&response.mServerSendTimestampUSec, updateResponse + 60, 8);
-            memcpy(&response.mServerRequestReceiveTimestampSec, updateResponse + 68, 8);
-            memcpy(&response.mServerRequestReceiveTimestampUSec, updateResponse + 76, 8);
             response.mClientSendTimestampSec = sendTimestamp.tv_sec;
             response.mClientSendTimestampUSec = sendTimestamp.tv_usec;
             response.mClientReceiveTimestampSec = receiveTimestamp.tv_sec;
             response.mClientReceiveTimestampUSec = receiveTimestamp.tv_usec;
+            mStatistics.addResponse(response, sendUs, receiveUs);
 
             mEventCallback(this, ORV_LATENCY_TESTER_UPDATE_RESPONSE, &response, mUserData);
 
@@ -209,6 +225,155 @@ void orv_latency_tester_client_t::doThread(std::unique_lock<std::mutex>& lock)
     ORV_DEBUG(mOrvContext, "Finished connection to %s:%d", mHostName, (int)mPort);
 }
 
+bool orv_latency_tester_client_t::sendUpdateRequest(orv_error_t* error)
+{
+    uint8_t updateRequestMessage[4] = {};
+    memcpy(updateRequestMessage, "lat", 3);
+    updateRequestMessage[3] = 1;
+    return mSocket->writeDataBlocking(updateRequestMessage, 4, error);
+}
+
+/**
+ * Parse the update response @p message of @ref gUpdateResponseSize bytes into @p response. The
+ * client timestamps of @p response are not touched.
+ *
+ * @return TRUE on success, FALSE if @p message is not a valid update response.
+ **/
+bool orv_latency_tester_client_t::parseUpdateResponse(const uint8_t* message, orv_latency_tester_update_response_t* response)
+{
+    if (memcmp(message, "lat", 3) != 0) {
+        ORV_ERROR(mOrvContext, "Magic cookie mismatch in response from server");
+        return false;
+    }
+    if (message[3] != 1) {
+        ORV_ERROR(mOrvContext, "Unexpected response type %d from server after update request", (int)message[3]);
+        return false;
+    }
+    memcpy(&response->mPreviousTopLeftX, message + 4, 4);
+    memcpy(&response->mPreviousTopLeftY, message + 8, 4);
+    memcpy(&response->mPreviousBottomRightX, message + 12, 4);
+    memcpy(&response->mPreviousBottomRightY, message + 16, 4);
+    memcpy(&response->mNewTopLeftX, message + 20, 4);
+    memcpy(&response->mNewTopLeftY, message + 24, 4);
+    memcpy(&response->mNewBottomRightX, message + 28, 4);
+    memcpy(&response->mNewBottomRightY, message + 32, 4);
+    memcpy(&response->mServerUpdateTimestampSec, message + 36, 8);
+    memcpy(&response->mServerUpdateTimestampUSec, message + 44, 8);
+    memcpy(&response->mServerSendTimestampSec, message + 52, 8);
+    memcpy(&response->mServerSendTimestampUSec, message + 60, 8);
+    memcpy(&response->mServerRequestReceiveTimestampSec, message + 68, 8);
+    memcpy(&response->mServerRequestReceiveTimestampUSec, message + 76, 8);
+    return true;
+}
+
+/**
+ * Send update requests at the rate of @ref mContinuousOptions, without waiting for the responses
+ * of the previous requests (the server answers requests in order). Request times are scheduled on
+ * the monotonic clock, so a late request does not shift the schedule of the following ones.
+ *
+ * Returns once continuous mode is stopped and all outstanding requests have been answered.
+ *
+ * @pre @p lock is locked, it is locked again when this function returns.
+ *
+ * @return TRUE if continuous mode was stopped (or the client is being destroyed), FALSE on
+ *         connection errors.
+ **/
+bool orv_latency_tester_client_t::runContinuous(std::unique_lock<std::mutex>& lock)
+{
+    std::deque<OutstandingLatencyRequest> outstanding;
+    uint8_t responseBuffer[gUpdateResponseSize];
+    uint32_t responseBufferFill = 0;
+    uint64_t nextRequestUs = Utils::getTimestampUs();
+    while (!mWantQuit && (mContinuous || !outstanding.empty())) {
+        const bool sendRequests = mContinuous;
+        const orv_latency_tester_continuous_options_t options = mContinuousOptions;
+        lock.unlock();
+
+        const uint64_t intervalUs = 1000000 / std::max((uint32_t)1, options.mRequestsPerSecond);
+        uint64_t nowUs = Utils::getTimestampUs();
+        orv_error_t error;
+        if (sendRequests && nowUs >= nextRequestUs) {
+            if (outstanding.size() < std::max((uint32_t)1, options.mMaxOutstandingRequests)) {
+                OutstandingLatencyRequest request;
+                gettimeofday(&request.mSendTimestamp, nullptr);
+                request.mSendUs = Utils::getTimestampUs();
+                if (!sendUpdateRequest(&error)) {
+                    ORV_ERROR(mOrvContext, "Failed to write update request, error: %s", error.mErrorMessage);
+                    lock.lock();
+                    return false;
+                }
+                outstanding.push_back(request);
+                mStatistics.addSentRequest();
+            }
+            else {
+                mStatistics.addSkippedRequest();
+            }
+            nextRequestUs += intervalUs;
+            if (nextRequestUs <= nowUs) {
+                // we fell behind by more than one interval (e.g. the thread was not scheduled),
+                // do not send a burst of requests to catch up
+                nextRequestUs = nowUs + intervalUs;
+            }
+        }
+
+        uint64_t timeoutUs = sendRequests ? nextRequestUs - std::min(nextRequestUs, nowUs) : mSocket->socketReadTimeoutUs();
+        int lastError = 0;
+        bool signalledSocket = false;
+        openrv::Socket::WaitRet ret = mSocket->waitForSignal(timeoutUs / 1000000, timeoutUs % 1000000, true, openrv::Socket::WaitType::Read, &lastError, &signalledSocket);
+        if (ret == openrv::Socket::WaitRet::Error) {
+            ORV_ERROR(mOrvContext, "Failed to wait for update responses, error code: %d", lastError);
+            lock.lock();
+            return false;
+        }
+        if (ret == openrv::Socket::WaitRet::Timeout && !sendRequests) {
+            ORV_ERROR(mOrvContext, "Timeout while waiting for %d outstanding update responses", (int)outstanding.size());
+            lock.lock();
+            return false;
+        }
+        while (signalledSocket) {
+            openrv::SendRecvSocketError callAgainType;
+            const uint32_t read = mSocket->readAvailableDataNonBlocking(responseBuffer + responseBufferFill, gUpdateResponseSize - responseBufferFill, &callAgainType, &error);
+            if (error.mHasError) {
+                ORV_ERROR(mOrvContext, "Failed to read update response, error: %s", error.mErrorMessage);
+                lock.lock();
+                return false;
+            }
+            if (read == 0) {
+                break;
+            }
+            responseBufferFill += read;
+            if (responseBufferFill < (uint32_t)gUpdateResponseSize) {
+                continue;
+            }
+            responseBufferFill = 0;
+            const uint64_t receiveUs = Utils::getTimestampUs();
+            struct timeval receiveTimestamp;
+            gettimeofday(&receiveTimestamp, nullptr);
+            if (outstanding.empty()) {
+                ORV_ERROR(mOrvContext, "Received update response without outstanding request");
+                lock.lock();
+                return false;
+            }
+            const OutstandingLatencyRequest request = outstanding.front();
+            outstanding.pop_front();
+            orv_latency_tester_update_response_t response;
+            if (!parseUpdateResponse(responseBuffer, &response)) {
+                lock.lock();
+                return false;
+            }
+            response.mClientSendTimestampSec = request.mSendTimestamp.tv_sec;
+            response.mClientSendTimestampUSec = request.mSendTimestamp.tv_usec;
+            response.mClientReceiveTimestampSec = receiveTimestamp.tv_sec;
+            response.mClientReceiveTimestampUSec = receiveTimestamp.tv_usec;
+            mStatistics.addResponse(response, request.mSendUs, receiveUs);
+            mEventCallback(this, ORV_LATENCY_TESTER_UPDATE_RESPONSE, &response, mUserData);
+        }
+        lock.lock();
+    }
+    mWantSendRequest = false;
+    return true;
+}
+
 
 extern "C" {
 
@@ -252,5 +417,130 @@ int orv_latency_tester_request_update(struct orv_latency_tester_client_t* client
     return 0;
 }
 
+/**
+ * Reset @p options to the default values, i.e. 20 requests per second with at most 4 outstanding
+ * requests.
+ **/
+void orv_latency_tester_continuous_options_default(orv_latency_tester_continuous_options_t* options)
+{
+    if (!options) {
+        return;
+    }
+    memset(options, 0, sizeof(orv_latency_tester_continuous_options_t));
+    options->mRequestsPerSecond = 20;
+    options->mMaxOutstandingRequests = 4;
+}
+
+/**
+ * Start sending update requests continuously at a fixed rate (instead of one request per call to
+ * @ref orv_latency_tester_request_update()), with up to @ref
+ * orv_latency_tester_continuous_options_t::mMaxOutstandingRequests requests in flight. Each
+ * response is reported using a ORV_LATENCY_TESTER_UPDATE_RESPONSE event, as usual.
+ *
+ * If continuous mode is already running, only the options are changed. Otherwise the statistics
+ * (see @ref orv_latency_tester_get_statistics()) are reset.
+ *
+ * @param options The options to use, NULL to use the defaults.
+ *
+ * @return 0 on success, non-zero if the client is not connected.
+ **/
+int orv_latency_tester_start_continuous(struct orv_latency_tester_client_t* client, const orv_latency_tester_continuous_options_t* options)
+{
+    if (!client) {
+        return 1;
+    }
+    std::unique_lock<std::mutex> lock(client->mMutex);
+    if (!client->mIsValid) {
+        return 1;
+    }
+    if (options) {
+        client->mContinuousOptions = *options;
+    }
+    else {
+        orv_latency_tester_continuous_options_default(&client->mContinuousOptions);
+    }
+    if (!client->mContinuous) {
+        client->mStatistics.reset();
+    }
+    client->mContinuous = true;
+    client->mWaitCondition.notify_all();
+    lock.unlock();
+    client->mThreadNotifierWriter.sendNotification();
+    return 0;
+}
+
+/**
+ * Stop continuous mode, see @ref orv_latency_tester_start_continuous(). Responses to requests that
+ * are still outstanding are reported nevertheless. The statistics are kept.
+ **/
+void orv_latency_tester_stop_continuous(struct orv_latency_tester_client_t* client)
+{
+    if (!client) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(client->mMutex);
+    client->mContinuous = false;
+    lock.unlock();
+    client->mThreadNotifierWriter.sendNotification();
+}
+
+/**
+ * Report that the framebuffer of the VNC connection that shows the desktop the latency tester
+ * paints on has been updated in the specified rect, normally in response to the
+ * ORV_EVENT_FRAMEBUFFER_UPDATED events. This is used to calculate the VNC delivery latency of
+ * @ref orv_latency_tester_statistics_t, the application should call it as soon as possible after
+ * receiving the event.
+ **/
+void orv_latency_tester_report_framebuffer_update(struct orv_latency_tester_client_t* client, uint16_t x, uint16_t y, uint16_t w, uint16_t h)
+{
+    if (!client) {
+        return;
+    }
+    client->mStatistics.addFramebufferUpdate(x, y, w, h, Utils::getTimestampUs());
+}
+
+/**
+ * Retrieve the statistics of the update requests of @p client, both of continuous mode and of
+ * single requests made using @ref orv_latency_tester_request_update().
+ **/
+void orv_latency_tester_get_statistics(struct orv_latency_tester_client_t* client, orv_latency_tester_statistics_t* statistics)
+{
+    if (!statistics) {
+        return;
+    }
+    if (!client) {
+        memset(statistics, 0, sizeof(orv_latency_tester_statistics_t));
+        return;
+    }
+    client->mStatistics.getStatistics(statistics);
+}
+
+static void printHistogramToLog(const struct orv_context_t* ctx, const char* name, const orv_latency_tester_histogram_t* h)
+{
+    ORV_DEBUG(ctx, "  %s: %" PRIu64 " samples, min: %" PRIu64 " us, mean: %" PRIu64 " us, max: %" PRIu64 " us, p50: %" PRIu64 " us, p95: %" PRIu64 " us, p99: %" PRIu64 " us",
+            name,
+            h->mCount,
+            h->mMinUs,
+            h->mCount > 0 ? h->mTotalUs / h->mCount : 0,
+            h->mMaxUs,
+            h->mPercentiles.mP50Us,
+            h->mPercentiles.mP95Us,
+            h->mPercentiles.mP99Us);
+}
+
+/**
+ * Convenience/debugging function that dumps @p statistics to the log callback in @p ctx.
+ **/
+void orv_latency_tester_statistics_print_to_log(const struct orv_context_t* ctx, const orv_latency_tester_statistics_t* statistics)
+{
+    const orv_latency_tester_statistics_t* s = statistics;
+    ORV_DEBUG(ctx, "Latency tester statistics: %" PRIu64 " requests sent, %" PRIu64 " responses, %" PRIu64 " skipped, %" PRIu64 " delivered", s->mRequestsSent, s->mResponsesReceived, s->mSkippedRequests, s->mDeliveredUpdates);
+    ORV_DEBUG(ctx, "  Clock offset: %" PRId64 " us (+/- %" PRIu64 " us)", s->mClockOffsetUs, s->mClockOffsetDelayUs / 2);
+    printHistogramToLog(ctx, "Round trip  ", &s->mRoundTrip);
+    printHistogramToLog(ctx, "Network     ", &s->mNetwork);
+    printHistogramToLog(ctx, "Server paint", &s->mServerPaint);
+    printHistogramToLog(ctx, "VNC delivery", &s->mVncDelivery);
+}
+
 
 }
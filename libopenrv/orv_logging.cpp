@@ -19,6 +19,7 @@
 
 #include <stdio.h>
 #include <stdarg.h>
+#include <mutex>
 #define TIME_STRING_LEN 100
 #ifndef WIN32
 #include <sys/time.h>
@@ -32,24 +33,84 @@ struct timeval
 
 extern "C" {
 
-void orv_log(const orv_context_t* ctx, int severity, const char* func, const char* file, int line, const char* msg, ...)
+#ifdef __GNUC__
+__attribute__((format(printf, 6, 0)))
+#endif
+static void orv_vlog(const orv_context_t* ctx, int severity, const char* func, const char* file, int line, const char* msg, va_list list)
+{
+    static const size_t bufferSize = 1024;
+    char buffer[bufferSize + 1];
+    int s = vsnprintf(buffer, bufferSize, msg, list);
+    if (s < 0) {
+        s = 0;
+    }
+    else if ((size_t)s > bufferSize) {
+        s = bufferSize;
+    }
+    buffer[s] = '\0';
+    ctx->mConfig.mLogCallback(severity, func, file, line, buffer);
+}
+
+/**
+ * @return Non-zero if a message with @p severity in @p category (see @ref orv_log_category_t)
+ *         would be forwarded to the log callback of @p ctx, i.e. @p ctx has a log callback, @p
+ *         severity is at least @ref orv_config_t::mMinLogSeverity and @p category is not disabled
+ *         in @ref orv_config_t::mDisabledLogCategories. Warnings and errors are never filtered by
+ *         category.
+ **/
+int orv_log_is_enabled(const orv_context_t* ctx, int severity, int category)
 {
     if (!ctx || !ctx->mConfig.mLogCallback) {
+        return 0;
+    }
+    if (severity < ctx->mConfig.mMinLogSeverity) {
+        return 0;
+    }
+    if (severity < ORV_LOGGING_SEVERITY_WARNING && (ctx->mConfig.mDisabledLogCategories & category) != 0) {
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Like @ref orv_log(), but for a message of @p category (see @ref orv_log_category_t). The message
+ * is formatted only if it is enabled, see @ref orv_log_is_enabled().
+ **/
+void orv_log_category(const orv_context_t* ctx, int severity, int category, const char* func, const char* file, int line, const char* msg, ...)
+{
+    if (!orv_log_is_enabled(ctx, severity, category)) {
         return;
     }
-    static const size_t bufferSize = 1024;
-    char buffer[bufferSize + 1];
     va_list list;
     va_start(list, msg);
-    size_t s = vsnprintf(buffer, bufferSize, msg, list);
-    buffer[s] = '\0';
-    ctx->mConfig.mLogCallback(severity, func, file, line, buffer);
+    orv_vlog(ctx, severity, func, file, line, msg, list);
     va_end(list);
 }
 
-/* TODO: make thread-safe */
+void orv_log(const orv_context_t* ctx, int severity, const char* func, const char* file, int line, const char* msg, ...)
+{
+    if (!orv_log_is_enabled(ctx, severity, ORV_LOG_CATEGORY_GENERAL)) {
+        return;
+    }
+    va_list list;
+    va_start(list, msg);
+    orv_vlog(ctx, severity, func, file, line, msg, list);
+    va_end(list);
+}
+
+/**
+ * Serializes the output of @ref orv_log_stdoutstderr(), so that messages of different threads are
+ * not interleaved.
+ **/
+static std::mutex gStdoutStderrMutex;
+
+/**
+ * NOTE: This writes on the calling thread (normally the connection thread), which therefore may
+ *       block on stdout. See @ref orv_log_async() for a non-blocking alternative.
+ **/
 void orv_log_stdoutstderr(int severity, const char* func, const char* file, int line, const char* msg)
 {
+    std::lock_guard<std::mutex> lock(gStdoutStderrMutex);
     FILE* f = stdout;
     if (severity >= ORV_LOGGING_SEVERITY_WARNING) {
         f = stderr;
@@ -58,7 +119,10 @@ void orv_log_stdoutstderr(int severity, const char* func, const char* file, int
     struct timeval t;
     char timeString[TIME_STRING_LEN + 1] = {};
     gettimeofday(&t, nullptr);
-    strftime(timeString, TIME_STRING_LEN, "%Y-%m-%d %H:%M:%S", localtime((const time_t*)&t.tv_sec));
+    const time_t seconds = (time_t)t.tv_sec;
+    struct tm localTime;
+    localtime_r(&seconds, &localTime);
+    strftime(timeString, TIME_STRING_LEN, "%Y-%m-%d %H:%M:%S", &localTime);
 #else
     const char* timeString = "";
 #endif // WIN32
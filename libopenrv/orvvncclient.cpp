@@ -21,6 +21,7 @@
 #include "orvvncclient.h"
 #include "orvclientdefines.h"
 #include "orvvncclientshareddata.h"
+#include "viewportregion.h"
 #include <libopenrv/orv_logging.h>
 #include <libopenrv/libopenrv.h>
 #include <libopenrv/orv_error.h>
@@ -33,6 +34,7 @@
 #include "socket.h"
 #include "threadnotifier.h"
 #include "rfb3xhandshake.h"
+#include "eventpool.h"
 #if defined(OPENRV_HAVE_MBEDTLS)
 #include "mbedtlscontext.h"
 #endif // OPENRV_HAVE_MBEDTLS
@@ -51,6 +53,7 @@
 #include <unistd.h>
 #endif // _MSC_VER
 #include <algorithm>
+#include <array>
 #include <list>
 #include <string.h>
 #include <limits>
@@ -65,6 +68,29 @@
 // TODO: Probably make configurable per-connection
 #define ORV_SOCKET_TIMEOUT_SECONDS 120
 
+// Pointer motion events are limited to at most this many events per round trip time of the
+// connection (in addition to orv_connect_options_t::mMaxPointerEventsPerSecond).
+#define ORV_POINTER_EVENTS_PER_ROUND_TRIP 4
+// Upper bound for the delay between two pointer motion events caused by the round trip time, so
+// that the pointer remains usable on very slow links.
+#define ORV_MAX_POINTER_EVENT_INTERVAL_US (100 * 1000)
+// Interval in which the round trip time estimate is queried from the socket.
+#define ORV_ROUND_TRIP_TIME_UPDATE_INTERVAL_US (1000 * 1000)
+// If the automatic refresh has the maximum number of requests outstanding and nothing was received
+// for this long, another request is sent anyway (servers may answer multiple requests with a
+// single update).
+#define ORV_AUTO_REFRESH_STALL_TIMEOUT_US (1000 * 1000)
+// Minimum interval between two update requests while the activity state is
+// ORV_ACTIVITY_STATE_BACKGROUND, i.e. at most 2 requests per second.
+#define ORV_BACKGROUND_UPDATE_REQUEST_INTERVAL_US (500 * 1000)
+// Time without FramebufferUpdate messages after which a pending SetPixelFormat is sent although
+// update requests are still unanswered, as the count is too high if the server merged requests.
+// A server that answers every request keeps sending updates meanwhile, even on slow links.
+#define ORV_PIXEL_FORMAT_CHANGE_TIMEOUT_US (1000 * 1000)
+// Maximum number of send timestamps of unanswered update requests that are remembered for the
+// latency measurement. The oldest timestamps are dropped beyond this.
+#define ORV_MAX_PENDING_UPDATE_REQUEST_TIMESTAMPS 16
+
 // We use RGB888 in our internal framebuffer, independent from the format used for communication.
 #define ORV_INTERNAL_FRAMEBUFFER_BYTES_PER_PIXEL 3
 
@@ -109,8 +135,19 @@ bool operator!=(const orv_communication_pixel_format_t& p1, const orv_communicat
     return !(p1 == p2);
 }
 
+/**
+ * Reduce the timeout @p waitTimeoutUs (0 meaning "none") to @p delayUs, if that is shorter. A @p
+ * delayUs of 0 is ignored.
+ **/
+static void mergeWaitTimeout(uint64_t* waitTimeoutUs, uint64_t delayUs)
+{
+    if (delayUs > 0 && (*waitTimeoutUs == 0 || delayUs < *waitTimeoutUs)) {
+        *waitTimeoutUs = delayUs;
+    }
+}
+
 
-class ConnectionThread
+class ConnectionThread : protected ServerMessageReader::Listener
 {
 public:
     ConnectionThread(orv_context_t* ctx, ThreadNotifierListener* pipeListener, bool sharedAccess, OrvVncClientSharedData* data);
@@ -127,18 +164,26 @@ protected:
     void allocateFramebufferMutexLocked(orv_error_t* error);
 
     bool handleStartConnectionState();
-    bool handleConnectedState();
+    bool handleConnectedState(uint64_t* waitTimeoutUs);
+    bool handleAutoRefresh(orv_error_t* error, uint64_t* delayUs);
+    bool updateRequestPermitted(uint64_t nowUs, uint64_t* delayUs) const;
+    void changePixelFormat(const orv_communication_pixel_format_t& format);
+    bool sendPendingPixelFormat(uint64_t nowUs, uint64_t* delayUs, orv_error_t* error);
+    uint64_t pointerEventIntervalUs(uint64_t nowUs);
     bool startConnection(orv_error_t* error);
     bool startVncProtocol(orv_error_t* error);
     bool startVncProtocolRfb3x(orv_error_t* error);
     void negotiateProtocolVersion(orv_error_t* error);
     void performClientAndServerInit(orv_error_t* error, bool sharedAccess);
-    size_t processMessageData(const char* buffer, size_t bufferSize, orv_error_t* error);
-    void processMessageBell();
+    virtual void serverMessageStarted(ServerMessage messageType) override;
+    virtual void serverMessageFinished(ServerMessage messageType, orv_event_t* event) override;
     //void processMessageSetColourMapEntries(MessageParserSetColourMapEntries* msg);
     bool sendSetPixelFormat(orv_error_t* error, const orv_communication_pixel_format_t& format);
     void sendSetEncodings(orv_error_t* error);
     bool sendFramebufferUpdateRequest(orv_error_t* error, bool incremental, uint16_t x, uint16_t y, uint16_t w, uint16_t h);
+    bool sendViewportFramebufferUpdateRequest(orv_error_t* error, const RequestFramebuffer& request);
+    void clearPendingUpdateRequests();
+    bool takeAnsweredUpdateRequest(uint64_t firstByteUs, uint64_t* requestSentUs);
     void sendKeyEvent(orv_error_t* error, bool down, uint32_t key);
     void sendPointerEvent(orv_error_t* error, uint16_t x, uint16_t y, uint8_t buttonMask);
     void sendClientCutText(orv_error_t* error, const char* text, uint32_t textLen);
@@ -165,6 +210,119 @@ private:
     uint16_t mCurrentFramebufferHeight = 0;
     size_t mFinishedFramebufferUpdateRequests = 0;
 
+    /**
+     * Copy of @ref OrvVncClientSharedData::mMaxPointerEventsPerSecond. Copied on connection start.
+     **/
+    uint16_t mMaxPointerEventsPerSecond = 0;
+    uint64_t mLastPointerEventSentUs = 0;
+    uint64_t mRoundTripTimeUs = 0;
+    uint64_t mRoundTripTimeUpdatedUs = 0;
+    uint64_t mSentPointerEvents = 0;
+    uint64_t mSentKeyEvents = 0;
+    /**
+     * Ring buffer of the times the FramebufferUpdateRequests that have not yet been answered were
+     * sent. The request with sequence number n is stored at index n %
+     * ORV_MAX_PENDING_UPDATE_REQUEST_TIMESTAMPS, the requests from @ref mFirstPendingUpdateRequest
+     * up to (excluding) @ref mSentUpdateRequestCount are pending. See @ref
+     * takeAnsweredUpdateRequest(). Used for @ref orv_statistics_t::mUpdateLatencyTotalUs and @ref
+     * orv_update_latency_t::mRequestSentUs.
+     **/
+    std::array<uint64_t, ORV_MAX_PENDING_UPDATE_REQUEST_TIMESTAMPS> mPendingUpdateRequestSentUs;
+    uint64_t mSentUpdateRequestCount = 0;
+    uint64_t mFirstPendingUpdateRequest = 0;
+    /**
+     * Time the first byte of the FramebufferUpdate message that is currently being received
+     * arrived. Used for @ref orv_update_latency_t::mFirstByteUs.
+     **/
+    uint64_t mFramebufferUpdateFirstByteUs = 0;
+    /**
+     * TRUE while a FramebufferUpdate message is being received, i.e. between @ref
+     * serverMessageStarted() and @ref serverMessageFinished().
+     **/
+    bool mReceivingFramebufferUpdate = false;
+    /**
+     * Time the most recent FramebufferUpdate message was received completely, 0 if none was
+     * received on this connection yet. Used by @ref sendPendingPixelFormat().
+     **/
+    uint64_t mFramebufferUpdateFinishedUs = 0;
+    /**
+     * The @ref MessageParserFramebufferUpdate::statisticsGeneration() of the statistics last copied
+     * to @ref OrvVncClientSharedData::mStatistics.
+     **/
+    uint64_t mSharedStatisticsGeneration = 0;
+    /**
+     * Restriction of the update requests to @ref OrvVncClientSharedData::mViewport. Reset on
+     * connection start.
+     **/
+    ViewportRegion mViewportRegion;
+    /**
+     * The most recent update request of the application, before it was restricted by @ref
+     * mViewportRegion. Repeated when the viewport changes.
+     **/
+    RequestFramebuffer mLastUpdateRequest;
+    bool mHaveLastUpdateRequest = false;
+    /**
+     * Copies of @ref OrvVncClientSharedData::mAutoRefresh and @ref
+     * OrvVncClientSharedData::mAutoRefreshOptions.
+     **/
+    bool mAutoRefresh = false;
+    orv_auto_refresh_options_t mAutoRefreshOptions = {};
+    /**
+     * The value of @ref OrvVncClientSharedData::mAutoRefreshTicks last seen, and whether a tick was
+     * received that was not yet used for a request.
+     **/
+    uint64_t mAutoRefreshTicks = 0;
+    bool mAutoRefreshTickPending = false;
+    /**
+     * Number of requests of the automatic refresh that were not yet answered (as far as we can
+     * tell, see @ref ORV_AUTO_REFRESH_STALL_TIMEOUT_US).
+     **/
+    uint32_t mAutoRefreshOutstanding = 0;
+    uint64_t mAutoRefreshSentUs = 0;
+    /**
+     * Time the most recent request of the automatic refresh was sent or the most recent update
+     * was finished.
+     **/
+    uint64_t mAutoRefreshActivityUs = 0;
+    /**
+     * Copy of @ref OrvVncClientSharedData::mActivityState.
+     **/
+    orv_activity_state_t mActivityState = ORV_ACTIVITY_STATE_VISIBLE;
+    /**
+     * Set while the pixel format of @ref ORV_COMM_QUALITY_PROFILE_LOW is used because of @ref
+     * ORV_ACTIVITY_STATE_BACKGROUND. Format changes of the application are applied only once this
+     * is cleared again.
+     **/
+    bool mLowBandwidthFormat = false;
+    /**
+     * Set if an update request was sent while @ref mLowBandwidthFormat was set, i.e. parts of the
+     * framebuffer may have been received in the low quality.
+     **/
+    bool mReducedQualityUpdates = false;
+    /**
+     * Update request of the application that is held back, see @ref updateRequestPermitted().
+     * Only the most recent request is kept.
+     **/
+    RequestFramebuffer mDeferredUpdateRequest;
+    bool mHaveDeferredUpdateRequest = false;
+    /**
+     * Time the most recent request was sent by @ref sendViewportFramebufferUpdateRequest(), 0 if
+     * none was sent on this connection yet.
+     **/
+    uint64_t mLastUpdateRequestSentUs = 0;
+    /**
+     * Number of FramebufferUpdateRequest messages sent that were not yet answered by a
+     * FramebufferUpdate (as far as we can tell, servers may answer multiple requests at once).
+     **/
+    uint32_t mUnansweredUpdateRequests = 0;
+    /**
+     * Pixel format set by @ref changePixelFormat() that was not yet sent, because updates in the
+     * previous format may still be on the way.
+     **/
+    orv_communication_pixel_format_t mPendingPixelFormat;
+    bool mPixelFormatChangePending = false;
+    uint64_t mPixelFormatChangeRequestedUs = 0;
+
     /**
      * Copy of @ref OrvVncClientSharedData::mPort. Copied on connection start and used internally by this
      * thread only.
@@ -175,15 +333,20 @@ private:
      * this thread only.
      **/
     char mHostName[ORV_MAX_HOSTNAME_LEN + 1] = {};
+    /**
+     * Transport of the connection, derived from @ref OrvVncClientSharedData::mTransportType on
+     * connection start.
+     **/
+    TransportType mTransportType = TransportType::Tcp;
     char* mPassword = nullptr;
     size_t mPasswordLength = 0;
     MbedTlsContext* mMbedTlsContext = nullptr;
     OpenSSLContext* mOpenSSLContext = nullptr;
 
-    MessageParserBase* mCurrentMessageParser = nullptr;
     MessageParserFramebufferUpdate mMessageFramebufferUpdate;
     MessageParserSetColourMapEntries mMessageSetColourMapEntries;
     MessageParserServerCutText mMessageServerCutText;
+    ServerMessageReader mServerMessageReader;
 };
 
 /**
@@ -320,7 +483,7 @@ bool OrvVncClient::connectToHost(const char* hostName, uint16_t port, const orv_
         }
         return false;
     }
-    if (port == 0) {
+    if (port == 0 && options->mTransportType == ORV_TRANSPORT_TCP) {
         if (error) {
             orv_error_set(error, ORV_ERR_GENERIC, 0, "Invalid port");
         }
@@ -335,9 +498,14 @@ bool OrvVncClient::connectToHost(const char* hostName, uint16_t port, const orv_
     mCommunicationData->mHostName[ORV_MAX_HOSTNAME_LEN] = 0;
     mPort = port;
     mCommunicationData->mPort = port;
+    mCommunicationData->mTransportType = options->mTransportType;
+    mCommunicationData->mSocketOptions = options->mSocketOptions;
     mCommunicationData->mState = ConnectionState::StartConnection;
     mCommunicationData->mRequestQualityProfile = options->mCommunicationQualityProfile;
     orv_communication_pixel_format_copy(&mCommunicationData->mRequestFormat, &options->mCommunicationPixelFormat);
+    mCommunicationData->mMaxPointerEventsPerSecond = options->mMaxPointerEventsPerSecond;
+    mCommunicationData->mLastQueuedButtonMask = 0;
+    mCommunicationData->mCoalescedPointerEvents = 0;
     mCommunicationData->mAbortFlag = mCommunicationData->mWantQuitThread;
     mCommunicationData->mUserRequestedDisconnect = false;
     ORV_DEBUG(mContext, "Triggering thread to connect to %s:%d", mHostName, (int)mPort);
@@ -438,6 +606,65 @@ void OrvVncClient::sendFramebufferUpdateRequest(bool incremental, uint16_t x, ui
     }
 }
 
+/**
+ * Enable or disable the automatic refresh, see @ref orv_start_auto_refresh().
+ **/
+void OrvVncClient::setAutoRefresh(bool enabled, const orv_auto_refresh_options_t& options)
+{
+    std::unique_lock<std::mutex> lock(mCommunicationData->mMutex);
+    mCommunicationData->mAutoRefresh = enabled;
+    mCommunicationData->mAutoRefreshOptions = options;
+    mCommunicationData->mAutoRefreshChanged = true;
+    wakeThread();
+}
+
+/**
+ * Set the activity state, see @ref orv_set_activity_state().
+ **/
+void OrvVncClient::setActivityState(orv_activity_state_t state)
+{
+    std::unique_lock<std::mutex> lock(mCommunicationData->mMutex);
+    if (state != mCommunicationData->mActivityState) {
+        mCommunicationData->mActivityState = state;
+        mCommunicationData->mActivityStateChanged = true;
+        wakeThread();
+    }
+}
+
+orv_activity_state_t OrvVncClient::activityState() const
+{
+    std::unique_lock<std::mutex> lock(mCommunicationData->mMutex);
+    return mCommunicationData->mActivityState;
+}
+
+/**
+ * See @ref orv_auto_refresh_tick().
+ **/
+void OrvVncClient::autoRefreshTick()
+{
+    std::unique_lock<std::mutex> lock(mCommunicationData->mMutex);
+    mCommunicationData->mAutoRefreshTicks++;
+    if (mCommunicationData->mAutoRefresh && mCommunicationData->mAutoRefreshOptions.mWaitForTick) {
+        wakeThread();
+    }
+}
+
+/**
+ * Set the viewport that incremental update requests are restricted to, see @ref
+ * orv_set_viewport(). If @p enabled is FALSE, the viewport is removed and all other parameters are
+ * ignored.
+ **/
+void OrvVncClient::setViewport(bool enabled, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint16_t margin)
+{
+    const Viewport viewport = enabled ? Viewport(x, y, w, h, margin) : Viewport();
+    std::unique_lock<std::mutex> lock(mCommunicationData->mMutex);
+    if (viewport != mCommunicationData->mViewport) {
+        mCommunicationData->mViewport = viewport;
+        mCommunicationData->mViewportChanged = true;
+        wakeThread();
+    }
+}
+
 /**
  * @param key Keycode as used by the RFB protocol
  **/
@@ -461,7 +688,25 @@ void OrvVncClient::sendPointerEvent(int x, int y, uint8_t buttonMask)
     y = std::max(y, 0);
     x = std::min(x, (int)mCommunicationData->mFramebuffer.mWidth);
     y = std::min(y, (int)mCommunicationData->mFramebuffer.mHeight);
-    mCommunicationData->mClientSendEvents.push_back(ClientSendEvent(ClientSendEvent::Type::Pointer, x, y, buttonMask));
+    std::list<ClientSendEvent>& sendEvents = mCommunicationData->mClientSendEvents;
+    if (!sendEvents.empty()) {
+        // Coalesce motion: if the last pending event is a pointer motion with the same button
+        // mask, simply move it to the new position.
+        // NOTE: The thread has already been woken up for the pending event (or delays it
+        //       intentionally, see ConnectionThread::handleConnectedState()), so no wakeThread()
+        //       call is required here.
+        ClientSendEvent& last = sendEvents.back();
+        if (last.mType == ClientSendEvent::Type::Pointer && !last.mButtonTransition && last.mButtonMask == buttonMask) {
+            last.mX = x;
+            last.mY = y;
+            mCommunicationData->mCoalescedPointerEvents++;
+            return;
+        }
+    }
+    ClientSendEvent e(ClientSendEvent::Type::Pointer, x, y, buttonMask);
+    e.mButtonTransition = (buttonMask != mCommunicationData->mLastQueuedButtonMask);
+    mCommunicationData->mLastQueuedButtonMask = buttonMask;
+    sendEvents.push_back(e);
     wakeThread();
 }
 
@@ -490,6 +735,13 @@ void OrvVncClient::getInfo(orv_connection_info_t* info, orv_vnc_server_capabilit
         info->mFramebufferHeight = mCommunicationData->mFramebuffer.mHeight;
         info->mReceivedBytes = mCommunicationData->mReceivedBytes;
         info->mSentBytes = mCommunicationData->mSentBytes;
+        info->mSentPointerEvents = mCommunicationData->mSentPointerEvents;
+        info->mSentKeyEvents = mCommunicationData->mSentKeyEvents;
+        info->mCoalescedPointerEvents = mCommunicationData->mCoalescedPointerEvents;
+        info->mDecodeBufferSize = mCommunicationData->mDecodeBufferSize;
+        info->mDecodeBufferAllocations = mCommunicationData->mDecodeBufferAllocations;
+        info->mEventAllocations = mContext->mEventPool->heapAllocations();
+        info->mSocketOptions = mCommunicationData->mConnectionInfo.mSocketOptions;
         orv_communication_pixel_format_copy(&info->mDefaultPixelFormat, &mCommunicationData->mConnectionInfo.mDefaultPixelFormat);
         info->mDefaultFramebufferWidth = mCommunicationData->mConnectionInfo.mDefaultFramebufferWidth;
         info->mDefaultFramebufferHeight = mCommunicationData->mConnectionInfo.mDefaultFramebufferHeight;
@@ -502,6 +754,56 @@ void OrvVncClient::getInfo(orv_connection_info_t* info, orv_vnc_server_capabilit
     }
 }
 
+/**
+ * Copy the statistics of the current connection to @p statistics, see @ref orv_get_statistics().
+ **/
+void OrvVncClient::getStatistics(orv_statistics_t* statistics)
+{
+    if (!statistics) {
+        return;
+    }
+    orv_statistics_reset(statistics);
+    std::unique_lock<std::mutex> lock(mCommunicationData->mMutex);
+    if (mCommunicationData->mState != ConnectionState::Connected) {
+        return;
+    }
+    *statistics = mCommunicationData->mStatistics;
+}
+
+/**
+ * Retrieve the latency report of the current connection, see @ref orv_get_latency_report().
+ **/
+void OrvVncClient::getLatencyReport(orv_latency_report_t* report)
+{
+    if (!report) {
+        return;
+    }
+    {
+        std::unique_lock<std::mutex> lock(mCommunicationData->mMutex);
+        if (mCommunicationData->mState != ConnectionState::Connected) {
+            orv_latency_report_reset(report);
+            return;
+        }
+    }
+    mCommunicationData->mLatencyTracer.getReport(report);
+}
+
+/**
+ * See @ref orv_set_latency_trace_file().
+ **/
+bool OrvVncClient::setLatencyTraceFile(const char* fileName, orv_error_t* error)
+{
+    return mCommunicationData->mLatencyTracer.setTraceFile(fileName, error);
+}
+
+/**
+ * See @ref orv_set_capture_file().
+ **/
+bool OrvVncClient::setCaptureFile(const char* fileName, orv_error_t* error)
+{
+    return mCommunicationData->mSessionCapture.open(fileName, error);
+}
+
 bool OrvVncClient::isViewOnly() const
 {
     return mViewOnly;
@@ -515,6 +817,7 @@ void OrvVncClient::setViewOnly(bool viewOnly)
 const orv_framebuffer_t* OrvVncClient::acquireFramebuffer()
 {
     mCommunicationData->mMutex.lock();
+    mCommunicationData->mLatencyTracer.markPresented(Utils::getTimestampUs());
     // TODO: if not yet connected (anymore): guarantee we return a NULL pointer
     // FIXME: also decide whether the mutex is immediately released in that case...
     return &mCommunicationData->mFramebuffer;
@@ -525,6 +828,16 @@ void OrvVncClient::releaseFramebuffer()
     mCommunicationData->mMutex.unlock();
 }
 
+const orv_framebuffer_t* OrvVncClient::acquireMipmap(int level)
+{
+    return mCommunicationData->mMipmaps.acquire(level);
+}
+
+void OrvVncClient::releaseMipmap()
+{
+    mCommunicationData->mMipmaps.release();
+}
+
 const orv_cursor_t* OrvVncClient::acquireCursor()
 {
     mCommunicationData->mMutex.lock();
@@ -821,6 +1134,7 @@ const char* OrvVncClient::getEventTypeString(orv_event_type_t eventType)
         CASE(ORV_EVENT_FRAMEBUFFER_UPDATE_REQUEST_FINISHED);
         CASE(ORV_EVENT_BELL);
         CASE(ORV_EVENT_CURSOR_UPDATED);
+        CASE(ORV_EVENT_FRAMEBUFFER_UPDATED_BATCH);
         // no default entry to trigger compiler warning
     }
 #undef CASE
@@ -931,6 +1245,12 @@ bool ConnectionThread::startVncProtocolRfb3x(orv_error_t* error)
     orv_communication_quality_profile_t initialQualityProfile = mCommunicationData->mRequestQualityProfile;
     orv_communication_pixel_format_t initialCustomPixelFormat;
     orv_communication_pixel_format_copy(&initialCustomPixelFormat, &mCommunicationData->mRequestFormat);
+    mActivityState = mCommunicationData->mActivityState;
+    mCommunicationData->mActivityStateChanged = false;
+    mLowBandwidthFormat = (mActivityState == ORV_ACTIVITY_STATE_BACKGROUND);
+    if (mLowBandwidthFormat) {
+        initialQualityProfile = ORV_COMM_QUALITY_PROFILE_LOW;
+    }
     // save current server info as defaults
     orv_communication_pixel_format_copy(&mCommunicationData->mCommunicationPixelFormat, &mCurrentPixelFormat);
     mCommunicationData->mConnectionInfo.mDefaultFramebufferWidth = mConnectionInfo.mDefaultFramebufferWidth;
@@ -963,6 +1283,19 @@ bool ConnectionThread::startVncProtocolRfb3x(orv_error_t* error)
     if (error->mHasError) {
         return false;
     }
+    mMessageFramebufferUpdate.reserveDecodeBuffers();
+
+    // NOTE: The mipmaps are never locked while the framebuffer is locked (see
+    //       FramebufferMipmaps), so they are resized first. An invalid size is reported by
+    //       allocateFramebufferMutexLocked().
+    if (mContext->mConfig.mSkipFramebuffer) {
+        mCommunicationData->mMipmaps.clear();
+    }
+    else if (checkFramebufferSize(mCurrentFramebufferWidth, mCurrentFramebufferHeight, ORV_INTERNAL_FRAMEBUFFER_BYTES_PER_PIXEL * 8, error)) {
+        if (!mCommunicationData->mMipmaps.resize(mCurrentFramebufferWidth, mCurrentFramebufferHeight, mContext->mConfig.mMipmapLevels, error)) {
+            return false;
+        }
+    }
 
     mCommunicationData->mMutex.lock();
     mCommunicationData->mFramebuffer.mWidth = mCurrentFramebufferWidth;
@@ -975,6 +1308,22 @@ bool ConnectionThread::startVncProtocolRfb3x(orv_error_t* error)
     free(mCommunicationData->mConnectionInfo.mDesktopName);
     mCommunicationData->mConnectionInfo.mDesktopName = strdup(mConnectionInfo.mDesktopName);
     allocateFramebufferMutexLocked(error);
+    mViewportRegion.reset(mCurrentFramebufferWidth, mCurrentFramebufferHeight);
+    mViewportRegion.setViewport(mCommunicationData->mViewport);
+    mCommunicationData->mViewportChanged = false;
+    mHaveLastUpdateRequest = false;
+    mAutoRefresh = mCommunicationData->mAutoRefresh;
+    mAutoRefreshOptions = mCommunicationData->mAutoRefreshOptions;
+    mCommunicationData->mAutoRefreshChanged = false;
+    mAutoRefreshTicks = mCommunicationData->mAutoRefreshTicks;
+    mAutoRefreshTickPending = true;
+    mAutoRefreshOutstanding = 0;
+    mAutoRefreshSentUs = 0;
+    mAutoRefreshActivityUs = 0;
+    mReducedQualityUpdates = false;
+    mHaveDeferredUpdateRequest = false;
+    mLastUpdateRequestSentUs = 0;
+    mPixelFormatChangePending = false;
     if (!error->mHasError) {
         changeStateMutexLocked(ConnectionState::Connected);
     }
@@ -1355,9 +1704,11 @@ ConnectionThread::ConnectionThread(orv_context_t* ctx, ThreadNotifierListener* p
       mSocket(ctx, pipeListener, communicationData),
       mMessageFramebufferUpdate(ctx, &mCommunicationData->mMutex, &mCommunicationData->mMutex, &mCommunicationData->mFramebuffer, &mCommunicationData->mCursorData, &mCurrentPixelFormat, &mCurrentFramebufferWidth, &mCurrentFramebufferHeight),
       mMessageSetColourMapEntries(ctx),
-      mMessageServerCutText(ctx)
+      mMessageServerCutText(ctx),
+      mServerMessageReader(ctx, &mMessageFramebufferUpdate, &mMessageSetColourMapEntries, &mMessageServerCutText, this)
 {
     ORV_DEBUG(mContext, "Constructing connection thread %p", this);
+    mMessageFramebufferUpdate.setMipmaps(&mCommunicationData->mMipmaps);
     orv_communication_pixel_format_reset(&mConnectionInfo.mDefaultPixelFormat);
     mReceiveBuffer = new char[mMaxReceiveBufferSize + 1];
 
@@ -1376,6 +1727,7 @@ ConnectionThread::~ConnectionThread()
 {
     ORV_DEBUG(mContext, "Destructing connection thread %p", this);
     mSocket.close();
+    mCommunicationData->mSessionCapture.endSession(Utils::getTimestampUs());
     delete[] mReceiveBuffer;
     mConnectionInfo.reset();
 }
@@ -1419,25 +1771,15 @@ void ConnectionThread::handleConnectedSocketData(SendRecvSocketError* callAgainT
         return;
     }
     *callAgainType = SendRecvSocketError::CallAgainWaitForRead; // next select() should wait for read, write is required in special cases only (SSL renegotiation).
+    if (!mCommunicationData->mSessionCapture.writeData(mReceiveBuffer + mReceiveBufferOffset, s, Utils::getTimestampUs())) {
+        ORV_WARNING(mContext, "Failed to write to the capture file, capture stopped.");
+    }
     size_t receiveBufferLen = mReceiveBufferOffset + s;
-    size_t offset = 0;
-    bool ok = true;
-    while (ok && offset < receiveBufferLen) {
-        orv_error_t error;
-        size_t consumedBytes = processMessageData(mReceiveBuffer + offset, receiveBufferLen - offset, &error);
-        //ORV_DEBUG(mContext, "Processed message data in buffer. Offset=%d, receiveBufferLen=%d, consumed=%d, error=%d", (int)offset, (int)receiveBufferLen, (int)consumedBytes, (int)error.mHasError);
-        if (error.mHasError) {
-            ORV_DEBUG(mContext, "Disconnecting due to error in processMessageData");
-            disconnectWithError(error);
-            return;
-        }
-        if (consumedBytes == 0) {
-            // wait for more data
-            ok = false;
-        }
-        else {
-            offset += consumedBytes;
-        }
+    const size_t offset = mServerMessageReader.processData(mReceiveBuffer, receiveBufferLen, &error);
+    if (error.mHasError) {
+        ORV_DEBUG(mContext, "Disconnecting due to error in processMessageData");
+        disconnectWithError(error);
+        return;
     }
     if (offset > receiveBufferLen) {
         ORV_ERROR(mContext, "Buffer offset %u exceeds buffer contents length %u", (unsigned int)offset, (unsigned int)receiveBufferLen);
@@ -1460,84 +1802,54 @@ void ConnectionThread::handleConnectedSocketData(SendRecvSocketError* callAgainT
 }
 
 /**
- * @return The number of bytes consumed from @p buffer.
- *         If more data is required, 0 is returned.
+ * Called by @ref mServerMessageReader when a message of @p messageType starts.
  **/
-size_t ConnectionThread::processMessageData(const char* buffer, size_t bufferSize, orv_error_t* error)
+void ConnectionThread::serverMessageStarted(ServerMessage messageType)
 {
-    orv_error_reset(error);
-    if (bufferSize == 0) {
-        return 0;
-    }
-    if (!mCurrentMessageParser) {
-        uint8_t messageType = buffer[0];
-        ORV_DEBUG(mContext, "Have new message of type %d (%s)", (int)messageType, OrvVncClient::getServerMessageTypeString((ServerMessage)messageType));
-        uint32_t offset = 1;
-        switch ((ServerMessage)messageType) {
-            case ServerMessage::FramebufferUpdate:
-                mCurrentMessageParser = &mMessageFramebufferUpdate;
-                break;
-            case ServerMessage::SetColourMapEntries:
-                mCurrentMessageParser = &mMessageSetColourMapEntries;
-                break;
-            case ServerMessage::Bell:
-                // message already complete
-                processMessageBell();
-                return offset;
-            case ServerMessage::ServerCutText:
-                mCurrentMessageParser = &mMessageServerCutText;
-                break;
-            default:
-                ORV_ERROR(mContext, "Unexpected message type %d, cannot handle message. Protocol error.", (int)messageType);
-                orv_error_set(error, ORV_ERR_PROTOCOL_ERROR, 100, "Unexpected message type %d, cannot handle message.", (int)messageType);
-                mCurrentMessageParser = nullptr;
-                return 0;
-        }
-        mCurrentMessageParser->reset();
-    }
-    ORV_DEBUG(mContext, "processing data for message type %d (%s), bytes in buffer: %d", (int)mCurrentMessageParser->messageType(), mCurrentMessageParser->messageTypeString(), (int)bufferSize);
-    uint32_t consumed = mCurrentMessageParser->readData(buffer, bufferSize, error);
-    if (error->mHasError) {
-        mCurrentMessageParser->reset();
-        mCurrentMessageParser = nullptr;
-        return 0;
-    }
-
-    // TODO: add a processPartialMessage() function that can send events for partial messages?
-    //       -> for FramebufferUpdate messages, we want to send events for all finished rects, even
-    //          before the full message has been received
-
-    if (mCurrentMessageParser->isFinished()) {
-        ORV_DEBUG(mContext, "message type %d (%s) completed", (int)mCurrentMessageParser->messageType(), mCurrentMessageParser->messageTypeString());
-        orv_event_t* e = mCurrentMessageParser->processFinishedMessage(error);
-        mCurrentMessageParser = nullptr;
-        if (error->mHasError) {
-            if (e) {
-                orv_event_destroy(e);
-            }
-            return 0;
-        }
-        if (e) {
-            if (e->mEventType == ORV_EVENT_FRAMEBUFFER_UPDATE_REQUEST_FINISHED) {
-                if (mFinishedFramebufferUpdateRequests == 0) {
-                    mCommunicationData->mMutex.lock();
-                    mCommunicationData->mHaveFramebufferUpdateResponse = true;
-                    mCommunicationData->mMutex.unlock();
-                }
-                mFinishedFramebufferUpdateRequests++;
-                if (mFinishedFramebufferUpdateRequests == 1 || (mFinishedFramebufferUpdateRequests % 100 == 0)) {
-                    ORV_DEBUG(mContext, "Finished %d framebuffer update requests up until now. Received bytes so far: %d, sent: %d", (int)mFinishedFramebufferUpdateRequests, (int)mSocket.receivedBytes(), (int)mSocket.sentBytes());
-                }
-            }
-            sendEvent(e);
-        }
+    if (messageType == ServerMessage::FramebufferUpdate) {
+        mFramebufferUpdateFirstByteUs = Utils::getTimestampUs();
+        mReceivingFramebufferUpdate = true;
     }
-    return consumed;
 }
 
-void ConnectionThread::processMessageBell()
+/**
+ * Called by @ref mServerMessageReader when a message of @p messageType has been parsed
+ * completely. Sends the @p event (if any) to the application.
+ **/
+void ConnectionThread::serverMessageFinished(ServerMessage messageType, orv_event_t* event)
 {
-    orv_event_t* event = orv_event_init(ORV_EVENT_BELL);
+    mSocket.notifyMessageReceived();
+    if (messageType == ServerMessage::FramebufferUpdate) {
+        mReceivingFramebufferUpdate = false;
+        mFramebufferUpdateFinishedUs = Utils::getTimestampUs();
+    }
+    if (!event) {
+        return;
+    }
+    if (event->mEventType == ORV_EVENT_FRAMEBUFFER_UPDATE_REQUEST_FINISHED) {
+        const uint64_t decodeFinishedUs = Utils::getTimestampUs();
+        uint64_t requestSentUs = mFramebufferUpdateFirstByteUs;
+        if (takeAnsweredUpdateRequest(mFramebufferUpdateFirstByteUs, &requestSentUs)) {
+            mMessageFramebufferUpdate.addUpdateLatency(decodeFinishedUs - requestSentUs);
+        }
+        mCommunicationData->mLatencyTracer.addUpdate(requestSentUs, mFramebufferUpdateFirstByteUs, decodeFinishedUs);
+        if (mFinishedFramebufferUpdateRequests == 0) {
+            mCommunicationData->mMutex.lock();
+            mCommunicationData->mHaveFramebufferUpdateResponse = true;
+            mCommunicationData->mMutex.unlock();
+        }
+        mFinishedFramebufferUpdateRequests++;
+        if (mUnansweredUpdateRequests > 0) {
+            mUnansweredUpdateRequests--;
+        }
+        if (mAutoRefreshOutstanding > 0) {
+            mAutoRefreshOutstanding--;
+        }
+        mAutoRefreshActivityUs = decodeFinishedUs;
+        if (mFinishedFramebufferUpdateRequests == 1 || (mFinishedFramebufferUpdateRequests % 100 == 0)) {
+            ORV_DEBUG(mContext, "Finished %d framebuffer update requests up until now. Received bytes so far: %d, sent: %d", (int)mFinishedFramebufferUpdateRequests, (int)mSocket.receivedBytes(), (int)mSocket.sentBytes());
+        }
+    }
     sendEvent(event);
 }
 
@@ -1578,6 +1890,7 @@ void ConnectionThread::closeSocket()
     mOpenSSLContext = new OpenSSLContext();
 #endif // OPENRV_HAVE_OPENSSL
     mSocket.close();
+    mCommunicationData->mSessionCapture.endSession(Utils::getTimestampUs());
     mReceiveBufferOffset = 0;
     orv_vnc_server_capabilities_reset(&mServerCapabilities);
     mConnectionInfo.reset();
@@ -1641,6 +1954,10 @@ void ConnectionThread::run()
         ConnectionState connectionState = mCommunicationData->mState;
         mCommunicationData->mReceivedBytes = mSocket.receivedBytes();
         mCommunicationData->mSentBytes = mSocket.sentBytes();
+        mCommunicationData->mSentPointerEvents = mSentPointerEvents;
+        mCommunicationData->mSentKeyEvents = mSentKeyEvents;
+        mCommunicationData->mDecodeBufferSize = mMessageFramebufferUpdate.decodeArena().capacity();
+        mCommunicationData->mDecodeBufferAllocations = mMessageFramebufferUpdate.decodeArena().heapAllocations();
         mCommunicationData->mMutex.unlock();
         if (wantQuitThread) {
             break;
@@ -1668,6 +1985,7 @@ void ConnectionThread::run()
         bool connectionStateHandled = false;
         bool doSelect = false;
         bool selectForSocket = false;
+        uint64_t waitTimeoutUs = 0;
         switch (connectionState) {
             case ConnectionState::ConnectionPending:
             {
@@ -1697,7 +2015,7 @@ void ConnectionThread::run()
                 // Here we send any pending messages to the server, wait for data and process data
                 // received from the server.
                 connectionStateHandled = true;
-                if (handleConnectedState()) {
+                if (handleConnectedState(&waitTimeoutUs)) {
                     doSelect = true;
                     selectForSocket = true;
                 }
@@ -1711,14 +2029,29 @@ void ConnectionThread::run()
             disconnectWithError(error);
         }
         else if (doSelect) {
+            // NOTE: the application thread only records presented updates, the trace file (if
+            //       any) is written here.
+            mCommunicationData->mLatencyTracer.writePendingTraceEvents();
+
             // sync sent/received bytes prior to waiting for data, in case the wait takes longer.
             mCommunicationData->mMutex.lock();
             mCommunicationData->mReceivedBytes = mSocket.receivedBytes();
             mCommunicationData->mSentBytes = mSocket.sentBytes();
+            mCommunicationData->mSentPointerEvents = mSentPointerEvents;
+            mCommunicationData->mSentKeyEvents = mSentKeyEvents;
+            mCommunicationData->mDecodeBufferSize = mMessageFramebufferUpdate.decodeArena().capacity();
+            mCommunicationData->mDecodeBufferAllocations = mMessageFramebufferUpdate.decodeArena().heapAllocations();
+            // NOTE: the statistics are large, copy them only if they changed.
+            if (mMessageFramebufferUpdate.statisticsGeneration() != mSharedStatisticsGeneration) {
+                mCommunicationData->mStatistics = mMessageFramebufferUpdate.statistics();
+                mSharedStatisticsGeneration = mMessageFramebufferUpdate.statisticsGeneration();
+            }
             mCommunicationData->mMutex.unlock();
 
             int lastError = 0;
-            const bool useTimeout = false;
+            // NOTE: A timeout is used only if handleConnectedState() delayed a pointer event, an
+            //       update request of the application or the next request of the automatic refresh.
+            const bool useTimeout = (waitTimeoutUs > 0);
             bool signalledSocket = false;
             Socket::WaitType waitType = Socket::WaitType::NoSocketWait;
             if (selectForSocket) {
@@ -1729,7 +2062,7 @@ void ConnectionThread::run()
                     waitType = Socket::WaitType::Read;
                 }
             }
-            Socket::WaitRet waitRet = mSocket.waitForSignal(0, 0, useTimeout, waitType, &lastError, &signalledSocket);
+            Socket::WaitRet waitRet = mSocket.waitForSignal(waitTimeoutUs / (1000 * 1000), waitTimeoutUs % (1000 * 1000), useTimeout, waitType, &lastError, &signalledSocket);
             nextSelectSocketCallAgainType = SendRecvSocketError::CallAgainWaitForRead; // current wait finished, next wait is for read, unless proven otherwise.
             switch (waitRet) {
                 case Socket::WaitRet::Error:
@@ -1838,6 +2171,7 @@ bool ConnectionThread::handleStartConnectionState()
         abortConnectWithError(error, authTypeFromVncSecurityType(mConnectionInfo.mSelectedVNCSecurityType));
         return false;
     }
+    mCommunicationData->mSessionCapture.startSession(mCurrentFramebufferWidth, mCurrentFramebufferHeight, mCurrentPixelFormat, Utils::getTimestampUs());
     orv_event_t* event = orv_event_connect_result_init(mHostName, mPort, mCurrentFramebufferWidth, mCurrentFramebufferHeight, mConnectionInfo.mDesktopName, &mCurrentPixelFormat, authTypeFromVncSecurityType(mConnectionInfo.mSelectedVNCSecurityType), nullptr);
     sendEvent(event);
     return true;
@@ -1852,14 +2186,35 @@ bool ConnectionThread::handleStartConnectionState()
  * This function does @em not wait for data on the socket and does not read new data from the
  * socket - receiving data is handled separately from this function.
  *
+ * Pointer motion events are rate limited (see @ref pointerEventIntervalUs()): If the only pending
+ * client event is a pointer motion (no button transition) and the previous pointer event was sent
+ * too recently, the event remains in @ref OrvVncClientSharedData::mClientSendEvents, where further
+ * motion is coalesced into it by @ref OrvVncClient::sendPointerEvent(). Key events and button
+ * transitions are always sent immediately (together with all events queued before them, to
+ * retain the order).
+ *
+ * The next request of the automatic refresh is sent by @ref handleAutoRefresh(), if it is due.
+ *
+ * Update requests of the application are held back in @ref mDeferredUpdateRequest while they are
+ * not permitted (see @ref updateRequestPermitted()). Changes of the activity state switch between
+ * the pixel format of the application and the low bandwidth format and send a catch-up request
+ * when the connection becomes visible again. Pixel format changes are sent by @ref
+ * sendPendingPixelFormat() once the server answered all update requests (or stopped sending
+ * updates for a while).
+ *
+ * @param waitTimeoutUs Output parameter. Set to the time in us after which this function should
+ *        be called again to send a delayed pointer event, a deferred update request or a request
+ *        of the automatic refresh, or to 0 if nothing was delayed.
+ *
  * @return FALSE on error, otherwise TRUE. If this function returns FALSE, the connection has been
  *         closed and a @ref ORV_EVENT_DISCONNECTED event has been sent.
  **/
-bool ConnectionThread::handleConnectedState()
+bool ConnectionThread::handleConnectedState(uint64_t* waitTimeoutUs)
 {
+    *waitTimeoutUs = 0;
     std::unique_lock<std::mutex> lock(mCommunicationData->mMutex);
     orv_communication_pixel_format_t requestFormat;
-    if (mCommunicationData->mWantSendRequestFormat && mCommunicationData->mRequestQualityProfile == ORV_COMM_QUALITY_PROFILE_CUSTOM) {
+    if (mCommunicationData->mRequestQualityProfile == ORV_COMM_QUALITY_PROFILE_CUSTOM) {
         orv_communication_pixel_format_copy(&requestFormat, &mCommunicationData->mRequestFormat);
     }
     orv_communication_quality_profile_t qualityProfile = mCommunicationData->mRequestQualityProfile;
@@ -1868,25 +2223,117 @@ bool ConnectionThread::handleConnectedState()
     bool wantSendFramebufferUpdateRequest = mCommunicationData->mWantSendFramebufferUpdateRequest;
     mCommunicationData->mWantSendFramebufferUpdateRequest = false;
     RequestFramebuffer framebufferUpdateRequest = mCommunicationData->mRequestFramebuffer;
+    const bool viewportChanged = mCommunicationData->mViewportChanged;
+    mCommunicationData->mViewportChanged = false;
+    const Viewport viewport = mCommunicationData->mViewport;
+    const bool activityStateChanged = mCommunicationData->mActivityStateChanged;
+    mCommunicationData->mActivityStateChanged = false;
+    const orv_activity_state_t activityState = mCommunicationData->mActivityState;
+    if (mCommunicationData->mAutoRefreshChanged) {
+        mCommunicationData->mAutoRefreshChanged = false;
+        mAutoRefresh = mCommunicationData->mAutoRefresh;
+        mAutoRefreshOptions = mCommunicationData->mAutoRefreshOptions;
+    }
+    if (mCommunicationData->mAutoRefreshTicks != mAutoRefreshTicks) {
+        mAutoRefreshTicks = mCommunicationData->mAutoRefreshTicks;
+        mAutoRefreshTickPending = true;
+    }
     std::list<ClientSendEvent> sendEvents;
-    std::swap(sendEvents, mCommunicationData->mClientSendEvents);
+    bool delaySendEvents = false;
+    if (mCommunicationData->mClientSendEvents.size() == 1) {
+        const ClientSendEvent& e = mCommunicationData->mClientSendEvents.front();
+        if (e.mType == ClientSendEvent::Type::Pointer && !e.mButtonTransition) {
+            const uint64_t nowUs = Utils::getTimestampUs();
+            const uint64_t nextSendUs = mLastPointerEventSentUs + pointerEventIntervalUs(nowUs);
+            if (mLastPointerEventSentUs != 0 && nowUs < nextSendUs) {
+                delaySendEvents = true;
+                *waitTimeoutUs = nextSendUs - nowUs;
+            }
+        }
+    }
+    if (!delaySendEvents) {
+        std::swap(sendEvents, mCommunicationData->mClientSendEvents);
+    }
     lock.unlock();
-    if (wantSendRequestFormat) {
-        orv_error_t error;
-        orv_error_reset(&error);
+    if (activityStateChanged && activityState != mActivityState) {
+        const orv_activity_state_t previousState = mActivityState;
+        mActivityState = activityState;
+        ORV_DEBUG(mContext, "Activity state changed from %d to %d", (int)previousState, (int)activityState);
+        bool catchUp = (previousState == ORV_ACTIVITY_STATE_PAUSED);
+        if (activityState == ORV_ACTIVITY_STATE_BACKGROUND && !mLowBandwidthFormat) {
+            orv_communication_pixel_format_t format;
+            OrvVncClient::makePixelFormat(&format, mContext, ORV_COMM_QUALITY_PROFILE_LOW, &mConnectionInfo.mDefaultPixelFormat, nullptr);
+            changePixelFormat(format);
+            mLowBandwidthFormat = true;
+        }
+        else if (activityState == ORV_ACTIVITY_STATE_VISIBLE && mLowBandwidthFormat) {
+            orv_communication_pixel_format_t format;
+            OrvVncClient::makePixelFormat(&format, mContext, qualityProfile, &mConnectionInfo.mDefaultPixelFormat, &requestFormat);
+            if (mReducedQualityUpdates && format != mCurrentPixelFormat) {
+                // refreshed by the non-incremental request that the next incremental request
+                // plans for the stale tiles (see ViewportRegion::planRequest())
+                mViewportRegion.markAllStale();
+                catchUp = true;
+            }
+            mLowBandwidthFormat = false;
+            mReducedQualityUpdates = false;
+            wantSendRequestFormat = true;
+        }
+        if (catchUp && !wantSendFramebufferUpdateRequest && !mHaveDeferredUpdateRequest && mHaveLastUpdateRequest) {
+            // The server remembers the changes since the last update, so an incremental request
+            // is sufficient to catch up.
+            wantSendFramebufferUpdateRequest = true;
+            framebufferUpdateRequest = mLastUpdateRequest;
+            framebufferUpdateRequest.mIncremental = true;
+        }
+    }
+    if (wantSendRequestFormat && !mLowBandwidthFormat) {
         orv_communication_pixel_format_t format;
         OrvVncClient::makePixelFormat(&format, mContext, qualityProfile, &mConnectionInfo.mDefaultPixelFormat, &requestFormat);
-        if (!sendSetPixelFormat(&error, format)) {
+        changePixelFormat(format);
+    }
+    if (mPixelFormatChangePending) {
+        orv_error_t error;
+        uint64_t pixelFormatDelayUs = 0;
+        if (!sendPendingPixelFormat(Utils::getTimestampUs(), &pixelFormatDelayUs, &error)) {
             disconnectWithError(error);
             return false;
         }
+        mergeWaitTimeout(waitTimeoutUs, pixelFormatDelayUs);
+    }
+    if (viewportChanged) {
+        mViewportRegion.setViewport(viewport);
+        if (!wantSendFramebufferUpdateRequest && !mHaveDeferredUpdateRequest && mHaveLastUpdateRequest) {
+            // Repeat the last request, so that areas that became visible are refreshed now and
+            // not with the next request of the application (which may be sent only after the
+            // pending request was answered, i.e. possibly never on a static screen).
+            wantSendFramebufferUpdateRequest = true;
+            framebufferUpdateRequest = mLastUpdateRequest;
+            framebufferUpdateRequest.mIncremental = true;
+        }
     }
     if (wantSendFramebufferUpdateRequest) {
-        orv_error_t error;
-        orv_error_reset(&error);
-        if (!sendFramebufferUpdateRequest(&error, framebufferUpdateRequest.mIncremental, framebufferUpdateRequest.mX, framebufferUpdateRequest.mY, framebufferUpdateRequest.mW, framebufferUpdateRequest.mH)) {
-            disconnectWithError(error);
-            return false;
+        if (mHaveDeferredUpdateRequest && !mDeferredUpdateRequest.mIncremental) {
+            // NOTE: a held back non-incremental request must not be degraded by a newer
+            //       incremental one (typically the request for the same rect).
+            framebufferUpdateRequest.mIncremental = false;
+        }
+        mDeferredUpdateRequest = framebufferUpdateRequest;
+        mHaveDeferredUpdateRequest = true;
+    }
+    if (mHaveDeferredUpdateRequest) {
+        uint64_t activityDelayUs = 0;
+        if (updateRequestPermitted(Utils::getTimestampUs(), &activityDelayUs)) {
+            orv_error_t error;
+            orv_error_reset(&error);
+            mHaveDeferredUpdateRequest = false;
+            if (!sendViewportFramebufferUpdateRequest(&error, mDeferredUpdateRequest)) {
+                disconnectWithError(error);
+                return false;
+            }
+        }
+        else {
+            mergeWaitTimeout(waitTimeoutUs, activityDelayUs);
         }
     }
     if (!sendEvents.empty()) {
@@ -1897,9 +2344,12 @@ bool ConnectionThread::handleConnectedState()
             switch (e.mType) {
                 case ClientSendEvent::Type::Key:
                     sendKeyEvent(&error, e.mDown, e.mKey);
+                    mSentKeyEvents++;
                     break;
                 case ClientSendEvent::Type::Pointer:
                     sendPointerEvent(&error, e.mX, e.mY, e.mButtonMask);
+                    mLastPointerEventSentUs = Utils::getTimestampUs();
+                    mSentPointerEvents++;
                     break;
                 case ClientSendEvent::Type::Invalid:
                     break;
@@ -1911,9 +2361,190 @@ bool ConnectionThread::handleConnectedState()
             }
         }
     }
+    if (mAutoRefresh) {
+        orv_error_t error;
+        uint64_t autoRefreshDelayUs = 0;
+        if (!handleAutoRefresh(&error, &autoRefreshDelayUs)) {
+            disconnectWithError(error);
+            return false;
+        }
+        mergeWaitTimeout(waitTimeoutUs, autoRefreshDelayUs);
+    }
+    return true;
+}
+
+/**
+ * Send the next request of the automatic refresh (see @ref orv_start_auto_refresh()), if it is
+ * due: A tick was received (if required), less than the maximum number of requests are
+ * outstanding and the target frame rate permits it.
+ *
+ * The request is an incremental request for the full framebuffer, unless nothing was requested
+ * on this connection yet. It is restricted to the viewport and held back (see @ref
+ * updateRequestPermitted()) like requests of the application.
+ *
+ * @param delayUs Output parameter. Set to the time in us after which this function should be
+ *        called again, if the request is delayed by the frame rate or the outstanding requests.
+ *        0 if the request was sent or waits for data from the server or a tick only.
+ *
+ * @return FALSE on error (@p error is set), otherwise TRUE.
+ **/
+bool ConnectionThread::handleAutoRefresh(orv_error_t* error, uint64_t* delayUs)
+{
+    orv_error_reset(error);
+    *delayUs = 0;
+    if (mAutoRefreshOptions.mWaitForTick && !mAutoRefreshTickPending) {
+        return true;
+    }
+    const uint64_t nowUs = Utils::getTimestampUs();
+    if (!updateRequestPermitted(nowUs, delayUs)) {
+        return true;
+    }
+    const uint32_t maxOutstanding = std::max(mAutoRefreshOptions.mMaxOutstandingRequests, (uint32_t)1);
+    if (mAutoRefreshOutstanding >= maxOutstanding) {
+        if (nowUs < mAutoRefreshActivityUs + ORV_AUTO_REFRESH_STALL_TIMEOUT_US) {
+            *delayUs = mAutoRefreshActivityUs + ORV_AUTO_REFRESH_STALL_TIMEOUT_US - nowUs;
+            return true;
+        }
+        ORV_DEBUG(mContext, "No update for %d outstanding auto refresh requests, sending another request", (int)mAutoRefreshOutstanding);
+        mAutoRefreshOutstanding = maxOutstanding - 1;
+        // the server merged the requests, their timestamps would be attributed to later updates
+        clearPendingUpdateRequests();
+    }
+    if (mAutoRefreshOptions.mTargetFps > 0 && mAutoRefreshSentUs != 0) {
+        const uint64_t nextSendUs = mAutoRefreshSentUs + (1000 * 1000) / mAutoRefreshOptions.mTargetFps;
+        if (nowUs < nextSendUs) {
+            *delayUs = nextSendUs - nowUs;
+            return true;
+        }
+    }
+    const bool incremental = mHaveLastUpdateRequest || mFinishedFramebufferUpdateRequests > 0;
+    const RequestFramebuffer request(incremental, 0, 0, mCurrentFramebufferWidth, mCurrentFramebufferHeight);
+    if (!sendViewportFramebufferUpdateRequest(error, request)) {
+        return false;
+    }
+    mAutoRefreshTickPending = false;
+    mAutoRefreshOutstanding++;
+    mAutoRefreshSentUs = nowUs;
+    mAutoRefreshActivityUs = nowUs;
+    return true;
+}
+
+/**
+ * Check whether an update request may be sent at @p nowUs.
+ *
+ * While a pixel format change is pending, requests are held back so that the unanswered requests
+ * drain, until @ref sendPendingPixelFormat() sent the change. Otherwise this depends on the
+ * activity state (see @ref orv_set_activity_state()): Requests are permitted always for @ref
+ * ORV_ACTIVITY_STATE_VISIBLE, never for @ref ORV_ACTIVITY_STATE_PAUSED and for @ref
+ * ORV_ACTIVITY_STATE_BACKGROUND if the previous request was sent at least @ref
+ * ORV_BACKGROUND_UPDATE_REQUEST_INTERVAL_US ago.
+ *
+ * @param delayUs Output parameter. Set to the time in us after which a request may be permitted,
+ *        or 0 if it is permitted now or only after a change of the activity state or an update
+ *        of the server.
+ **/
+bool ConnectionThread::updateRequestPermitted(uint64_t nowUs, uint64_t* delayUs) const
+{
+    *delayUs = 0;
+    if (mPixelFormatChangePending) {
+        return false;
+    }
+    switch (mActivityState) {
+        case ORV_ACTIVITY_STATE_VISIBLE:
+            return true;
+        case ORV_ACTIVITY_STATE_BACKGROUND:
+        {
+            const uint64_t nextSendUs = mLastUpdateRequestSentUs + ORV_BACKGROUND_UPDATE_REQUEST_INTERVAL_US;
+            if (mLastUpdateRequestSentUs == 0 || nowUs >= nextSendUs) {
+                return true;
+            }
+            *delayUs = nextSendUs - nowUs;
+            return false;
+        }
+        case ORV_ACTIVITY_STATE_PAUSED:
+            return false;
+    }
     return true;
 }
 
+/**
+ * Switch to the pixel @p format for the communication. The SetPixelFormat message is sent by @ref
+ * sendPendingPixelFormat(), as the server may already be encoding updates for the previous requests
+ * in the current format, which could not be decoded otherwise. A pending change that was not yet
+ * sent is replaced (or cancelled, if @p format is the current format).
+ **/
+void ConnectionThread::changePixelFormat(const orv_communication_pixel_format_t& format)
+{
+    if (format == mCurrentPixelFormat) {
+        mPixelFormatChangePending = false;
+        return;
+    }
+    mPendingPixelFormat = format;
+    if (!mPixelFormatChangePending) {
+        mPixelFormatChangePending = true;
+        mPixelFormatChangeRequestedUs = Utils::getTimestampUs();
+    }
+}
+
+/**
+ * Send the pixel format set by @ref changePixelFormat(), if all update requests have been answered
+ * or no FramebufferUpdate was received for @ref ORV_PIXEL_FORMAT_CHANGE_TIMEOUT_US at @p nowUs
+ * (counted from the change request at the earliest). In the latter case the server most likely
+ * merged some requests, so they will never be answered and @ref mUnansweredUpdateRequests is
+ * reset. While an update is being received, the change is never sent, as a slow server that
+ * answers every request may still be sending updates in the previous format.
+ *
+ * @param delayUs Output parameter. Set to the time in us after which the change is sent
+ *        regardless of unanswered requests, or 0 if it was sent, nothing is pending or the change
+ *        waits for the update that is being received.
+ *
+ * @return FALSE on error (@p error is set), otherwise TRUE.
+ **/
+bool ConnectionThread::sendPendingPixelFormat(uint64_t nowUs, uint64_t* delayUs, orv_error_t* error)
+{
+    orv_error_reset(error);
+    *delayUs = 0;
+    if (!mPixelFormatChangePending) {
+        return true;
+    }
+    if (mUnansweredUpdateRequests > 0) {
+        if (mReceivingFramebufferUpdate) {
+            // checked again once the update was received
+            return true;
+        }
+        const uint64_t quietSinceUs = std::max(mPixelFormatChangeRequestedUs, mFramebufferUpdateFinishedUs);
+        const uint64_t timeoutUs = quietSinceUs + ORV_PIXEL_FORMAT_CHANGE_TIMEOUT_US;
+        if (nowUs < timeoutUs) {
+            *delayUs = timeoutUs - nowUs;
+            return true;
+        }
+        ORV_DEBUG(mContext, "%d update requests still unanswered, but no updates were received recently, assuming they were merged by the server and sending the pixel format change", (int)mUnansweredUpdateRequests);
+        mUnansweredUpdateRequests = 0;
+    }
+    mPixelFormatChangePending = false;
+    return sendSetPixelFormat(error, mPendingPixelFormat);
+}
+
+/**
+ * @return The minimum interval in us between two pointer motion events sent to the server. This
+ *         is the interval derived from @ref mMaxPointerEventsPerSecond, increased on links with a
+ *         high round trip time (at most @ref ORV_POINTER_EVENTS_PER_ROUND_TRIP events per round
+ *         trip, but no more than @ref ORV_MAX_POINTER_EVENT_INTERVAL_US).
+ **/
+uint64_t ConnectionThread::pointerEventIntervalUs(uint64_t nowUs)
+{
+    if (mRoundTripTimeUpdatedUs == 0 || nowUs >= mRoundTripTimeUpdatedUs + ORV_ROUND_TRIP_TIME_UPDATE_INTERVAL_US) {
+        mRoundTripTimeUs = mSocket.roundTripTimeUs();
+        mRoundTripTimeUpdatedUs = nowUs;
+    }
+    uint64_t intervalUs = 0;
+    if (mMaxPointerEventsPerSecond > 0) {
+        intervalUs = (1000 * 1000) / mMaxPointerEventsPerSecond;
+    }
+    const uint64_t roundTripIntervalUs = std::min((uint64_t)ORV_MAX_POINTER_EVENT_INTERVAL_US, mRoundTripTimeUs / ORV_POINTER_EVENTS_PER_ROUND_TRIP);
+    return std::max(intervalUs, roundTripIntervalUs);
+}
+
 /**
  * @pre The @ref mMutex is locked
  * @pre @ref mCommunicationData::mState is @ref ConnectionState::StartConnection
@@ -1944,12 +2575,37 @@ bool ConnectionThread::startConnection(orv_error_t* error)
     mCommunicationData->mMutex.lock();
     bool abort = mCommunicationData->mAbortFlag;
     mPort = mCommunicationData->mPort;
+    switch (mCommunicationData->mTransportType) {
+        case ORV_TRANSPORT_UNIX_SOCKET:
+            mTransportType = TransportType::UnixDomain;
+            break;
+        case ORV_TRANSPORT_MEMORY_PIPE:
+            mTransportType = TransportType::MemoryPipe;
+            break;
+        case ORV_TRANSPORT_TCP:
+        default:
+            mTransportType = TransportType::Tcp;
+            break;
+    }
     strncpy(mHostName, mCommunicationData->mHostName, ORV_MAX_HOSTNAME_LEN);
     mHostName[ORV_MAX_HOSTNAME_LEN] = '\0';
     mPasswordLength = mCommunicationData->mPasswordLength;
     mCommunicationData->mPasswordLength = 0;
     mPassword = mCommunicationData->mPassword; // NOTE: we take ownership!
     mCommunicationData->mPassword = nullptr;
+    mMaxPointerEventsPerSecond = mCommunicationData->mMaxPointerEventsPerSecond;
+    mSocket.setSocketOptions(mCommunicationData->mSocketOptions);
+    mLastPointerEventSentUs = 0;
+    mRoundTripTimeUs = 0;
+    mRoundTripTimeUpdatedUs = 0;
+    mSentPointerEvents = 0;
+    mSentKeyEvents = 0;
+    clearPendingUpdateRequests();
+    mUnansweredUpdateRequests = 0;
+    mFramebufferUpdateFirstByteUs = 0;
+    mReceivingFramebufferUpdate = false;
+    mFramebufferUpdateFinishedUs = 0;
+    mCommunicationData->mLatencyTracer.reset();
     orv_vnc_server_capabilities_reset(&mServerCapabilities);
     orv_vnc_server_capabilities_reset(&mCommunicationData->mServerCapabilities);
     mConnectionInfo.reset();
@@ -1974,7 +2630,7 @@ bool ConnectionThread::startConnection(orv_error_t* error)
         }
         return false;
     }
-    if (mPort == 0) {
+    if (mPort == 0 && mTransportType == TransportType::Tcp) {
         orv_error_set(error, ORV_ERR_CONNECT_ERROR_GENERIC, 0, "Invalid parameters: port==0 is not allowed");
         return false;
     }
@@ -1991,13 +2647,19 @@ bool ConnectionThread::startConnection(orv_error_t* error)
 
     mSocket.setSocketTimeoutSeconds(ORV_SOCKET_TIMEOUT_SECONDS);
 
-    if (!mSocket.makeSocketAndConnectBlockingTo(mHostName, mPort, error)) {
+    if (!mSocket.connectBlocking(mTransportType, mHostName, mPort, error)) {
         if (!error->mHasError) {
             orv_error_set(error, ORV_ERR_CONNECT_ERROR_GENERIC, 0, "Internal error: Connect failed, but have no detailed error message");
         }
         return false;
     }
 
+    mSocket.queryEffectiveSocketOptions(&mConnectionInfo.mSocketOptions);
+    mCommunicationData->mMutex.lock();
+    mCommunicationData->mConnectionInfo.mSocketOptions = mConnectionInfo.mSocketOptions;
+    mCommunicationData->mMutex.unlock();
+
+    mServerMessageReader.reset();
     mMessageFramebufferUpdate.resetConnection();
 
     return true;
@@ -2054,6 +2716,9 @@ bool ConnectionThread::sendSetPixelFormat(orv_error_t* error, const orv_communic
     }
     orv_error_reset(error);
     mCurrentPixelFormat = format;
+    if (!mCommunicationData->mSessionCapture.writePixelFormat(mCurrentPixelFormat, Utils::getTimestampUs())) {
+        ORV_WARNING(mContext, "Failed to write to the capture file, capture stopped.");
+    }
     std::unique_lock<std::mutex> lock(mCommunicationData->mMutex);
     mCommunicationData->mCommunicationPixelFormat = mCurrentPixelFormat;
     return true;
@@ -2085,15 +2750,21 @@ void ConnectionThread::sendSetEncodings(orv_error_t* error)
 
         (int32_t)EncodingType::Raw,
     };
-    static const uint16_t numberOfEncodings = sizeof(supportedEncodings) / sizeof(int32_t);
-    static const size_t bufferSize = 4 + 4 * numberOfEncodings;
-    char buffer[bufferSize];
+    static const uint16_t maxNumberOfEncodings = sizeof(supportedEncodings) / sizeof(int32_t);
+    char buffer[4 + 4 * maxNumberOfEncodings];
+    uint16_t numberOfEncodings = 0;
+    for (uint16_t i = 0; i < maxNumberOfEncodings; i++) {
+        if (mContext->mConfig.mSkipFramebuffer && supportedEncodings[i] == (int32_t)EncodingType::CopyRect) {
+            // CopyRect requires the previous framebuffer contents, which are not maintained
+            continue;
+        }
+        Writer::writeInt32(buffer + 4 + 4*numberOfEncodings, supportedEncodings[i]);
+        numberOfEncodings++;
+    }
     Writer::writeUInt8(buffer + 0, (uint8_t)ClientMessage::SetEncodings);
     Writer::writeUInt8(buffer + 1, 0);
     Writer::writeUInt16(buffer + 2, numberOfEncodings);
-    for (uint16_t i = 0; i < numberOfEncodings; i++) {
-        Writer::writeInt32(buffer + 4 + 4*i, supportedEncodings[i]);
-    }
+    const size_t bufferSize = 4 + 4 * numberOfEncodings;
     if (!mSocket.writeDataBlocking(buffer, bufferSize, error)) {
         if (error->mErrorCode == ORV_ERR_USER_INTERRUPTION) {
             return;
@@ -2115,6 +2786,9 @@ bool ConnectionThread::sendFramebufferUpdateRequest(orv_error_t* error, bool inc
     Writer::writeUInt16(buffer + 4, y);
     Writer::writeUInt16(buffer + 6, w);
     Writer::writeUInt16(buffer + 8, h);
+    // NOTE: taken before writing, the thread may be preempted after the write, which would make
+    //       the measured latency shorter than the real one.
+    const uint64_t sentUs = Utils::getTimestampUs();
     if (!mSocket.writeDataBlocking(buffer, bufferSize, error)) {
         if (error->mErrorCode == ORV_ERR_USER_INTERRUPTION) {
             return false;
@@ -2122,10 +2796,78 @@ bool ConnectionThread::sendFramebufferUpdateRequest(orv_error_t* error, bool inc
         orv_error_set(error, ORV_ERR_GENERIC, 0, "Failed to send FramebufferUpdateRequest message to server, attempted to write %d bytes", (int)bufferSize);
         return false;
     }
+    if (mSentUpdateRequestCount - mFirstPendingUpdateRequest >= ORV_MAX_PENDING_UPDATE_REQUEST_TIMESTAMPS) {
+        mFirstPendingUpdateRequest++;
+    }
+    mPendingUpdateRequestSentUs[mSentUpdateRequestCount % ORV_MAX_PENDING_UPDATE_REQUEST_TIMESTAMPS] = sentUs;
+    mSentUpdateRequestCount++;
+    mUnansweredUpdateRequests++;
     orv_error_reset(error);
     return true;
 }
 
+/**
+ * Forget the send times of all pending update requests, see @ref mPendingUpdateRequestSentUs.
+ **/
+void ConnectionThread::clearPendingUpdateRequests()
+{
+    mFirstPendingUpdateRequest = mSentUpdateRequestCount;
+}
+
+/**
+ * Find the update request that is answered by the FramebufferUpdate whose first byte arrived at
+ * @p firstByteUs, i.e. the most recent request that was sent before that time. Servers may answer
+ * several requests with a single update, so all older pending requests are considered to be
+ * answered as well and are dropped, otherwise they would be attributed to later updates. Requests
+ * sent after @p firstByteUs remain pending.
+ *
+ * @param requestSentUs Output parameter that receives the time the request was sent. Not
+ *        modified if no request was found.
+ * @return TRUE if a request was found, FALSE if no pending request was sent before @p firstByteUs.
+ **/
+bool ConnectionThread::takeAnsweredUpdateRequest(uint64_t firstByteUs, uint64_t* requestSentUs)
+{
+    bool found = false;
+    while (mFirstPendingUpdateRequest < mSentUpdateRequestCount) {
+        const uint64_t sentUs = mPendingUpdateRequestSentUs[mFirstPendingUpdateRequest % ORV_MAX_PENDING_UPDATE_REQUEST_TIMESTAMPS];
+        if (sentUs > firstByteUs) {
+            break;
+        }
+        *requestSentUs = sentUs;
+        found = true;
+        mFirstPendingUpdateRequest++;
+    }
+    return found;
+}
+
+/**
+ * Send the update @p request of the application, restricted to the viewport by @ref
+ * mViewportRegion. This may send an additional non-incremental request before @p request to
+ * refresh stale areas, or nothing at all if @p request lies completely outside of the viewport.
+ *
+ * @return FALSE on error (@p error is set), otherwise TRUE.
+ **/
+bool ConnectionThread::sendViewportFramebufferUpdateRequest(orv_error_t* error, const RequestFramebuffer& request)
+{
+    orv_error_reset(error);
+    mLastUpdateRequest = request;
+    mHaveLastUpdateRequest = true;
+    mLastUpdateRequestSentUs = Utils::getTimestampUs();
+    if (mLowBandwidthFormat && !mPixelFormatChangePending) {
+        mReducedQualityUpdates = true;
+    }
+    RequestFramebuffer refresh;
+    RequestFramebuffer restricted;
+    if (!mViewportRegion.planRequest(request, &refresh, &restricted)) {
+        ORV_DEBUG(mContext, "FramebufferUpdateRequest for x=%d, y=%d, size=%dx%d is outside of the viewport, not sent", (int)request.mX, (int)request.mY, (int)request.mW, (int)request.mH);
+        return true;
+    }
+    if (refresh.mW > 0 && !sendFramebufferUpdateRequest(error, refresh.mIncremental, refresh.mX, refresh.mY, refresh.mW, refresh.mH)) {
+        return false;
+    }
+    return sendFramebufferUpdateRequest(error, restricted.mIncremental, restricted.mX, restricted.mY, restricted.mW, restricted.mH);
+}
+
 void ConnectionThread::sendKeyEvent(orv_error_t* error, bool down, uint32_t key)
 {
     static const size_t bufferSize = 8;
@@ -2318,6 +3060,9 @@ void ConnectionThread::changeStateMutexLocked(ConnectionState state)
  *
  * Note: This allocates the @em internal framebuffer with the @em internal pixel format, which does
  * not have to match the pixel format used in the communication with the server.
+ *
+ * If @ref orv_config_t::mSkipFramebuffer is set, only the size is checked and the framebuffer array
+ * remains NULL.
  **/
 void ConnectionThread::allocateFramebufferMutexLocked(orv_error_t* error)
 {
@@ -2325,6 +3070,12 @@ void ConnectionThread::allocateFramebufferMutexLocked(orv_error_t* error)
     if (!checkFramebufferSize(mCommunicationData->mFramebuffer.mWidth, mCommunicationData->mFramebuffer.mHeight, mCommunicationData->mFramebuffer.mBitsPerPixel, error)) {
         return;
     }
+    if (mContext->mConfig.mSkipFramebuffer) {
+        free(mCommunicationData->mFramebuffer.mFramebuffer);
+        mCommunicationData->mFramebuffer.mFramebuffer = nullptr;
+        mCommunicationData->mFramebuffer.mSize = 0;
+        return;
+    }
     size_t size = (size_t)mCommunicationData->mFramebuffer.mWidth * (size_t)mCommunicationData->mFramebuffer.mHeight * (size_t)mCommunicationData->mFramebuffer.mBytesPerPixel;
     if (size == 0) {
         size = 1;
@@ -51,14 +51,25 @@ public:
     bool isConnected() const;
     void sendFramebufferUpdateRequest(bool incremental, uint16_t x, uint16_t y, uint16_t w, uint16_t h);
     void sendFramebufferUpdateRequest(bool incremental);
+    void setViewport(bool enabled, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint16_t margin);
+    void setAutoRefresh(bool enabled, const orv_auto_refresh_options_t& options);
+    void autoRefreshTick();
+    void setActivityState(orv_activity_state_t state);
+    orv_activity_state_t activityState() const;
     void sendKeyEvent(bool down, uint32_t key);
     void sendPointerEvent(int x, int y, uint8_t buttonMask);
     void getInfo(orv_connection_info_t* info, orv_vnc_server_capabilities_t* capabilities);
+    void getStatistics(orv_statistics_t* statistics);
+    void getLatencyReport(orv_latency_report_t* report);
+    bool setLatencyTraceFile(const char* fileName, orv_error_t* error);
+    bool setCaptureFile(const char* fileName, orv_error_t* error);
     bool isViewOnly() const;
     void setViewOnly(bool viewOnly);
 
     const orv_framebuffer_t* acquireFramebuffer();
     void releaseFramebuffer();
+    const orv_framebuffer_t* acquireMipmap(int level);
+    void releaseMipmap();
     const orv_cursor_t* acquireCursor();
     void releaseCursor();
 
@@ -71,6 +71,26 @@ bool operator!=(const RequestFramebuffer& f1, const RequestFramebuffer& f2)
     return !(f1 == f2);
 }
 
+bool operator==(const Viewport& v1, const Viewport& v2)
+{
+    if (!v1.mEnabled && !v2.mEnabled) {
+        return true;
+    }
+    if (v1.mEnabled == v2.mEnabled &&
+        v1.mX == v2.mX &&
+        v1.mY == v2.mY &&
+        v1.mW == v2.mW &&
+        v1.mH == v2.mH &&
+        v1.mMargin == v2.mMargin) {
+        return true;
+    }
+    return false;
+}
+
+bool operator!=(const Viewport& v1, const Viewport& v2)
+{
+    return !(v1 == v2);
+}
 
 } // namespace vnc
 } // namespace openrv
@@ -19,6 +19,9 @@
 
 #include <libopenrv/libopenrv.h>
 #include "rfbtypes.h"
+#include "latencytracer.h"
+#include "framebuffermipmaps.h"
+#include "sessioncapture.h"
 
 #include <mutex>
 #include <condition_variable>
@@ -77,6 +80,12 @@ struct ConnectionInfo
      **/
     char* mDesktopName = nullptr;
 
+    /**
+     * The socket options in effect on the connection, see @ref
+     * openrv::Socket::queryEffectiveSocketOptions().
+     **/
+    orv_socket_options_t mSocketOptions = {};
+
 public:
     ConnectionInfo()
     {
@@ -135,6 +144,12 @@ struct ClientSendEvent
     uint16_t mX = 0;
     uint16_t mY = 0;
     uint8_t mButtonMask = 0;
+    /**
+     * TRUE if @ref mButtonMask differs from the mask of the previously queued pointer event, i.e.
+     * this event presses or releases a button. Such events are never coalesced with subsequent
+     * events and never delayed.
+     **/
+    bool mButtonTransition = false;
 
     // Key events:
     bool mDown = false;
@@ -165,6 +180,34 @@ struct RequestFramebuffer
 bool operator==(const RequestFramebuffer& p1, const RequestFramebuffer& p2);
 bool operator!=(const RequestFramebuffer& p1, const RequestFramebuffer& p2);
 
+/**
+ * Helper struct that stores the viewport set by @ref orv_set_viewport().
+ **/
+struct Viewport
+{
+    Viewport() = default;
+    Viewport(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint16_t margin)
+        : mEnabled(true),
+          mX(x),
+          mY(y),
+          mW(w),
+          mH(h),
+          mMargin(margin)
+    {
+    }
+    /**
+     * If FALSE, no viewport is set and all other values are ignored.
+     **/
+    bool mEnabled = false;
+    uint16_t mX = 0;
+    uint16_t mY = 0;
+    uint16_t mW = 0;
+    uint16_t mH = 0;
+    uint16_t mMargin = 0;
+};
+bool operator==(const Viewport& v1, const Viewport& v2);
+bool operator!=(const Viewport& v1, const Viewport& v2);
+
 /**
  * Data of @ref OrvVncClient shared between the @ref OrvVncClient and the connection thread that the @ref
  * OrvVncClient controls.
@@ -181,6 +224,12 @@ struct OrvVncClientSharedData
     ConnectionState mState = ConnectionState::NotConnected;
     char mHostName[ORV_MAX_HOSTNAME_LEN + 1] = {};
     uint16_t mPort = 0;
+    orv_transport_type_t mTransportType = ORV_TRANSPORT_TCP;
+    /**
+     * Copy of @ref orv_connect_options_t::mSocketOptions, copied by the connection thread on
+     * connection start.
+     **/
+    orv_socket_options_t mSocketOptions = {};
     char* mUser = nullptr;
     char* mPassword = nullptr;
     size_t mPasswordLength = 0;
@@ -189,7 +238,54 @@ struct OrvVncClientSharedData
     bool mWantSendRequestFormat = false;
     bool mWantSendFramebufferUpdateRequest = false;
     std::list<ClientSendEvent> mClientSendEvents;
+    /**
+     * Button mask of the most recent pointer event added to @ref mClientSendEvents. Used to detect
+     * button transitions, see @ref ClientSendEvent::mButtonTransition.
+     **/
+    uint8_t mLastQueuedButtonMask = 0;
+    /**
+     * Copy of @ref orv_connect_options_t::mMaxPointerEventsPerSecond, copied by the connection
+     * thread on connection start.
+     **/
+    uint16_t mMaxPointerEventsPerSecond = 0;
+    /**
+     * Number of pointer events that were merged into a pending event in @ref mClientSendEvents
+     * instead of being queued separately.
+     **/
+    uint64_t mCoalescedPointerEvents = 0;
     RequestFramebuffer mRequestFramebuffer;
+    /**
+     * The viewport set by the application, see @ref orv_set_viewport(). Kept across connections.
+     **/
+    Viewport mViewport;
+    /**
+     * Set if @ref mViewport was modified and the connection thread did not yet pick it up.
+     **/
+    bool mViewportChanged = false;
+    /**
+     * Settings of the automatic refresh, see @ref orv_start_auto_refresh(). Kept across
+     * connections.
+     **/
+    bool mAutoRefresh = false;
+    orv_auto_refresh_options_t mAutoRefreshOptions = {};
+    /**
+     * Set if @ref mAutoRefresh or @ref mAutoRefreshOptions was modified and the connection thread
+     * did not yet pick it up.
+     **/
+    bool mAutoRefreshChanged = false;
+    /**
+     * Number of calls to @ref orv_auto_refresh_tick() so far. The connection thread compares this
+     * to the number it has seen to detect new ticks.
+     **/
+    uint64_t mAutoRefreshTicks = 0;
+    /**
+     * The state set by @ref orv_set_activity_state(). Kept across connections.
+     **/
+    orv_activity_state_t mActivityState = ORV_ACTIVITY_STATE_VISIBLE;
+    /**
+     * Set if @ref mActivityState was modified and the connection thread did not yet pick it up.
+     **/
+    bool mActivityStateChanged = false;
     orv_framebuffer_t mFramebuffer; // NOTE: normally NOT the same bpp format as sent by server (we normally use RGB internally only)
     orv_cursor_t mCursorData;
     bool mHaveFramebufferUpdateResponse = false;
@@ -230,6 +326,47 @@ struct OrvVncClientSharedData
      * This value is not synced after every send() call, so it may lag behind a little bit.
      **/
     size_t mSentBytes = 0;
+    /**
+     * Copy of @ref openrv::vnc::ConnectionThread::mSentPointerEvents, synced like @ref mSentBytes.
+     **/
+    uint64_t mSentPointerEvents = 0;
+    /**
+     * Copy of @ref openrv::vnc::ConnectionThread::mSentKeyEvents, synced like @ref mSentBytes.
+     **/
+    uint64_t mSentKeyEvents = 0;
+    /**
+     * Copy of the capacity of the decode arena of @ref openrv::vnc::MessageParserFramebufferUpdate,
+     * synced like @ref mSentBytes.
+     **/
+    uint64_t mDecodeBufferSize = 0;
+    /**
+     * Copy of the number of heap allocations of the decode arena of @ref
+     * openrv::vnc::MessageParserFramebufferUpdate, synced like @ref mSentBytes.
+     **/
+    uint64_t mDecodeBufferAllocations = 0;
+    /**
+     * Copy of the statistics of @ref openrv::vnc::MessageParserFramebufferUpdate, synced like @ref
+     * mSentBytes.
+     **/
+    orv_statistics_t mStatistics = {};
+    /**
+     * Latency timestamps of the framebuffer updates of the current connection.
+     *
+     * NOTE: This object is thread safe on its own and is @em not protected by @p mMutex.
+     **/
+    LatencyTracer mLatencyTracer;
+    /**
+     * Downscaled copies of @ref mFramebuffer, see @ref orv_config_t::mMipmapLevels.
+     *
+     * NOTE: This object is thread safe on its own and is @em not protected by @p mMutex.
+     **/
+    FramebufferMipmaps mMipmaps;
+    /**
+     * Capture of the data received by the connection thread, see @ref orv_set_capture_file().
+     *
+     * NOTE: This object is thread safe on its own and is @em not protected by @p mMutex.
+     **/
+    SessionCaptureWriter mSessionCapture;
 
 public:
     OrvVncClientSharedData();
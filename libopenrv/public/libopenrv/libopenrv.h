@@ -80,6 +80,11 @@ extern "C" {
 #define ORV_MAX_USERNAME_LEN 1024*1024*10
 #define ORV_MAX_PASSWORD_LEN 1024*1024*10
 
+/**
+ * Default value of @ref orv_connect_options_t::mMaxPointerEventsPerSecond.
+ **/
+#define ORV_DEFAULT_MAX_POINTER_EVENTS_PER_SECOND 120
+
 /**
  * The maximum width of a framebuffer that will be accepted from a server. If a framebuffer larger
  * than this is received from the server, the connection will be rejected/closed.
@@ -106,6 +111,12 @@ extern "C" {
  **/
 #define ORV_MAX_FRAMEBUFFER_MEMORY (1*1024*1024*1024)
 
+/**
+ * Maximum number of downscaled copies of the framebuffer, see @ref orv_config_t::mMipmapLevels.
+ * Level n has 1/2^n of the framebuffer size, i.e. the smallest level has 1/8 of the size.
+ **/
+#define ORV_MAX_MIPMAP_LEVELS 3
+
 /**
  * Maximum number of encodings that will be stored by this library, see @ref
  * orv_vnc_server_capabilities_t.
@@ -272,8 +283,21 @@ typedef enum orv_event_type_t
      * event data. The name can be used for debugging.
      **/
     ORV_EVENT_THREAD_ABOUT_TO_STOP,
+
+    /**
+     * Event indicating that parts of the framebuffer have been updated. This event replaces the
+     * ORV_EVENT_FRAMEBUFFER_UPDATED events of a complete FramebufferUpdate message, if @ref
+     * orv_config_t::mBatchFramebufferEvents is set: Instead of one event per rect, a single event
+     * with all rects of the message is sent.
+     *
+     * The event provides data of type orv_event_framebuffer_batch_t.
+     **/
+    ORV_EVENT_FRAMEBUFFER_UPDATED_BATCH,
 } orv_event_type_t;
 
+/**
+ * Events are created by the library and must be freed using @ref orv_event_destroy() only.
+ **/
 typedef struct orv_event_t
 {
     orv_event_type_t mEventType;
@@ -414,6 +438,56 @@ typedef struct orv_communication_pixel_format_t
 void orv_communication_pixel_format_reset(orv_communication_pixel_format_t* format);
 void orv_communication_pixel_format_copy(orv_communication_pixel_format_t* dst, const orv_communication_pixel_format_t* src);
 
+/**
+ * Low-level options of the socket used for a connection, see @ref
+ * orv_connect_options_t::mSocketOptions.
+ *
+ * The same struct is used to report the effective values in @ref
+ * orv_connection_info_t::mSocketOptions, as reported by the operating system after the connection
+ * has been established. These may differ from the requested values, e.g. linux doubles the
+ * requested buffer sizes and clamps them to the system limits (net.core.rmem_max/wmem_max).
+ *
+ * Options that are not supported by the platform or the transport (see @ref orv_transport_type_t)
+ * are ignored and are reported as 0.
+ **/
+typedef struct orv_socket_options_t
+{
+    /**
+     * Boolean, 1 to disable Nagle's algorithm (TCP_NODELAY). Enabled by default, as most VNC
+     * client messages are tiny and time critical.
+     **/
+    uint8_t mTcpNoDelay;
+
+    /**
+     * Boolean, 1 to send ACKs immediately instead of delaying them (TCP_QUICKACK). The option is
+     * re-armed once per received message, as the kernel resets it internally. When reported in
+     * @ref orv_connection_info_t, this is the quick ACK state of the socket at the time of the query.
+     *
+     * Linux only, disabled by default.
+     **/
+    uint8_t mTcpQuickAck;
+
+    /**
+     * Size of the receive buffer of the socket in bytes (SO_RCVBUF). Larger values help on links
+     * with a high bandwidth-delay product. 0 uses the system default (which may be auto-tuned by
+     * the operating system).
+     **/
+    int32_t mReceiveBufferSize;
+
+    /**
+     * Size of the send buffer of the socket in bytes (SO_SNDBUF). 0 uses the system default.
+     **/
+    int32_t mSendBufferSize;
+
+    /**
+     * Time in microseconds to busy poll the device queue on blocking receives (SO_BUSY_POLL).
+     * Trades CPU time for receive latency. 0 disables busy polling.
+     *
+     * Linux only, disabled by default. May require CAP_NET_ADMIN to increase the value.
+     **/
+    uint32_t mBusyPollUs;
+} orv_socket_options_t;
+
 typedef struct orv_connection_info_t
 {
     /* TODO: actually some data (hostname, port, received bytes, sent bytes) may also be valid if
@@ -440,8 +514,225 @@ typedef struct orv_connection_info_t
     char mDesktopName[ORV_MAX_DESKTOP_NAME_LENGTH + 1];
     uint64_t mReceivedBytes;
     uint64_t mSentBytes;
+    uint64_t mSentPointerEvents; /**< Number of PointerEvent messages sent to the server **/
+    uint64_t mSentKeyEvents;     /**< Number of KeyEvent messages sent to the server **/
+    /**
+     * Number of pointer events provided by the user that were merged into a previous (not yet sent)
+     * pointer event, see @ref orv_connect_options_t::mMaxPointerEventsPerSecond.
+     **/
+    uint64_t mCoalescedPointerEvents;
+    /**
+     * Size in bytes of the buffer that rect data is decoded into before it is copied to the
+     * framebuffer. The buffer is sized from the framebuffer on connect and grows to the largest rect
+     * received.
+     **/
+    uint64_t mDecodeBufferSize;
+    /**
+     * Number of heap allocations made for the decode buffer. Normally this stops increasing after
+     * the first few framebuffer updates.
+     **/
+    uint64_t mDecodeBufferAllocations;
+    /**
+     * Number of event objects allocated by the context. Events are recycled once destroyed by
+     * @ref orv_event_destroy(), so normally this stops increasing after the first few updates.
+     **/
+    uint64_t mEventAllocations;
+    /**
+     * The effective options of the socket of the connection.
+     **/
+    orv_socket_options_t mSocketOptions;
 } orv_connection_info_t;
 
+/**
+ * Maximum number of different encodings that statistics are collected for, see @ref
+ * orv_statistics_t.
+ **/
+#define ORV_MAX_ENCODING_STATISTICS 16
+
+/**
+ * Decoding statistics of a single encoding (or pseudo-encoding) of a connection.
+ **/
+typedef struct orv_encoding_statistics_t
+{
+    /**
+     * The encoding these statistics apply to. See also @ref orv_get_vnc_encoding_type_string().
+     **/
+    int32_t mEncodingType;
+    uint64_t mRects;
+    uint64_t mPixels;
+    /**
+     * Number of bytes received for rects of this encoding, excluding the rect headers.
+     **/
+    uint64_t mCompressedBytes;
+    /**
+     * Size of the rects of this encoding in the pixel format of the communication, i.e. the number
+     * of bytes the rects would have taken in the Raw encoding.
+     **/
+    uint64_t mDecompressedBytes;
+    /**
+     * Time spent reading (and decompressing) the rect data, in microseconds. Measured only if
+     * @ref orv_config_t::mMeasureDecodeTimes is set.
+     **/
+    uint64_t mReadTimeUs;
+    /**
+     * Time spent copying the rects to the framebuffer, in microseconds. This includes the time
+     * spent waiting for the framebuffer lock. Measured only if @ref
+     * orv_config_t::mMeasureDecodeTimes is set.
+     **/
+    uint64_t mFinishTimeUs;
+} orv_encoding_statistics_t;
+
+/**
+ * Statistics of the current connection, see @ref orv_get_statistics(). All values are reset when a
+ * new connection is made.
+ **/
+typedef struct orv_statistics_t
+{
+    /**
+     * Number of valid entries in @ref mEncodings, in the order the encodings were first used by the
+     * server.
+     **/
+    uint32_t mEncodingCount;
+    orv_encoding_statistics_t mEncodings[ORV_MAX_ENCODING_STATISTICS];
+
+    /**
+     * Number of completely received FramebufferUpdate messages.
+     **/
+    uint64_t mFramebufferUpdates;
+    /**
+     * Total number of rects in all @ref mFramebufferUpdates messages.
+     **/
+    uint64_t mFramebufferUpdateRects;
+    /**
+     * Number of FramebufferUpdate messages per second, measured over the most recent interval of
+     * at least one second that contained updates.
+     **/
+    double mUpdatesPerSecond;
+
+    /**
+     * Number of measured times between sending a FramebufferUpdateRequest and receiving the
+     * complete FramebufferUpdate for it.
+     **/
+    uint64_t mUpdateLatencyCount;
+    uint64_t mUpdateLatencyTotalUs;
+    uint64_t mUpdateLatencyMinUs;
+    uint64_t mUpdateLatencyMaxUs;
+    uint64_t mUpdateLatencyLastUs;
+
+    /**
+     * Total time the connection thread waited for the framebuffer lock (i.e. while the
+     * application held the lock using @ref orv_acquire_framebuffer()), in microseconds.
+     **/
+    uint64_t mFramebufferLockWaitUs;
+    /**
+     * Number of times the framebuffer lock was not immediately available.
+     **/
+    uint64_t mFramebufferLockContentions;
+} orv_statistics_t;
+
+void orv_statistics_reset(orv_statistics_t* statistics);
+void orv_statistics_print_to_log(const struct orv_context_t* ctx, const orv_statistics_t* statistics);
+void orv_get_statistics(const struct orv_context_t* ctx, orv_statistics_t* statistics);
+
+/**
+ * Number of most recent framebuffer updates that are used to calculate the percentiles in @ref
+ * orv_latency_report_t.
+ **/
+#define ORV_LATENCY_WINDOW_SIZE 256
+
+/**
+ * Timestamps of the stages of a single framebuffer update, from requesting the update to the
+ * application acquiring the framebuffer that contains it.
+ *
+ * All timestamps are in microseconds of a monotonic clock with an unspecified epoch, so only
+ * differences are meaningful.
+ **/
+typedef struct orv_update_latency_t
+{
+    /**
+     * Number of the update on the current connection, starting at 0.
+     **/
+    uint64_t mSequence;
+    /**
+     * Time the FramebufferUpdateRequest was written to the socket. If multiple requests were
+     * pending, updates answer them in the order they were sent. If the server sent the update
+     * without a pending request, this equals @ref mFirstByteUs.
+     **/
+    uint64_t mRequestSentUs;
+    /**
+     * Time the first byte of the FramebufferUpdate message was received.
+     **/
+    uint64_t mFirstByteUs;
+    /**
+     * Time the last rect of the FramebufferUpdate message was written to the framebuffer.
+     **/
+    uint64_t mDecodeFinishedUs;
+    /**
+     * Time the application first acquired the framebuffer after @ref mDecodeFinishedUs, see @ref
+     * orv_acquire_framebuffer(). 0 if the framebuffer has not been acquired yet.
+     **/
+    uint64_t mPresentedUs;
+} orv_update_latency_t;
+
+/**
+ * Percentiles of a latency over the @ref ORV_LATENCY_WINDOW_SIZE most recent updates, in
+ * microseconds.
+ **/
+typedef struct orv_latency_percentiles_t
+{
+    uint64_t mP50Us;
+    uint64_t mP95Us;
+    uint64_t mP99Us;
+} orv_latency_percentiles_t;
+
+/**
+ * Latency breakdown of the framebuffer updates of the current connection, see @ref
+ * orv_get_latency_report().
+ **/
+typedef struct orv_latency_report_t
+{
+    /**
+     * Total number of updates received on the current connection.
+     **/
+    uint64_t mUpdateCount;
+    /**
+     * Number of updates the percentiles are calculated from, at most @ref
+     * ORV_LATENCY_WINDOW_SIZE.
+     **/
+    uint32_t mSampleCount;
+    /**
+     * Number of updates the @ref mPresent and @ref mTotal percentiles are calculated from, i.e.
+     * updates in the window that have been presented.
+     **/
+    uint32_t mPresentedSampleCount;
+    /**
+     * The most recent update. Only valid if @ref mUpdateCount is non-zero.
+     **/
+    orv_update_latency_t mLastUpdate;
+    /**
+     * Time from sending the request to receiving the first byte of the response, i.e. network
+     * round trip plus server processing time.
+     **/
+    orv_latency_percentiles_t mNetwork;
+    /**
+     * Time from receiving the first byte of the response to the last rect being decoded,
+     * including the time to transfer the remaining data.
+     **/
+    orv_latency_percentiles_t mDecode;
+    /**
+     * Time from the last rect being decoded to the application acquiring the framebuffer.
+     **/
+    orv_latency_percentiles_t mPresent;
+    /**
+     * Time from sending the request to the application acquiring the framebuffer.
+     **/
+    orv_latency_percentiles_t mTotal;
+} orv_latency_report_t;
+
+void orv_latency_report_reset(orv_latency_report_t* report);
+void orv_latency_report_print_to_log(const struct orv_context_t* ctx, const orv_latency_report_t* report);
+void orv_get_latency_report(const struct orv_context_t* ctx, orv_latency_report_t* report);
+
 /**
  * Struct that holds a "capability" of the server. This is primarily used when the "Tight" security
  * type is enabled, as the server can then report the capabilities it supports. However this struct
@@ -575,6 +866,18 @@ typedef struct orv_event_framebuffer_t
     uint16_t mHeight;
 } orv_event_framebuffer_t;
 
+/**
+ * Data for the @ref ORV_EVENT_FRAMEBUFFER_UPDATED_BATCH event.
+ **/
+typedef struct orv_event_framebuffer_batch_t
+{
+    uint32_t mRectCount;
+    /**
+     * Array of @ref mRectCount rects that have been updated. Owned by the event.
+     **/
+    orv_event_framebuffer_t* mRects;
+} orv_event_framebuffer_batch_t;
+
 orv_event_t* orv_event_init(orv_event_type_t type);
 orv_event_t* orv_event_connect_result_init(const char* hostName, uint16_t port, uint16_t width, uint16_t height, const char* desktopName, const orv_communication_pixel_format_t* format, orv_auth_type_t authType, const orv_error_t* error);
 orv_event_t* orv_event_disconnected_init(const char* hostName, uint16_t port, uint8_t gracefulExit, const orv_error_t* error);
@@ -584,6 +887,68 @@ void orv_event_print_to_log(const struct orv_context_t* ctx, const orv_event_t*
 
 typedef void (*orv_event_callback_t)(struct orv_context_t* ctx, orv_event_t* event);
 
+/**
+ * Layout of the pixels in @ref orv_rect_sink_data_t::mPixels.
+ **/
+typedef enum orv_rect_sink_format_t
+{
+    /**
+     * The pixels use the pixel format of the communication with the server, as provided in @ref
+     * orv_rect_sink_data_t::mPixelFormat, i.e. as decoded from the network without conversion.
+     **/
+    ORV_RECT_SINK_FORMAT_COMMUNICATION,
+    /**
+     * The pixels use the format of the internal framebuffer (see @ref orv_framebuffer_t), i.e. 3
+     * bytes (RGB) per pixel.
+     **/
+    ORV_RECT_SINK_FORMAT_RGB888,
+} orv_rect_sink_format_t;
+
+/**
+ * Data provided to the @ref orv_config_t::mRectSinkCallback for every decoded rect.
+ **/
+typedef struct orv_rect_sink_data_t
+{
+    /**
+     * Position and size of the rect in the framebuffer.
+     **/
+    uint16_t mX;
+    uint16_t mY;
+    uint16_t mWidth;
+    uint16_t mHeight;
+    /**
+     * The RFB encoding the rect was received with (see @ref orv_get_vnc_encoding_type_string()).
+     **/
+    int32_t mEncodingType;
+    /**
+     * If @ref mEncodingType is CopyRect, the position the rect was copied from. Otherwise 0.
+     **/
+    uint16_t mSrcX;
+    uint16_t mSrcY;
+    orv_rect_sink_format_t mFormat;
+    /**
+     * The pixel format of the communication with the server, describes @ref mPixels if @ref
+     * mFormat is ORV_RECT_SINK_FORMAT_COMMUNICATION.
+     **/
+    orv_communication_pixel_format_t mPixelFormat;
+    uint8_t mBytesPerPixel;
+    /**
+     * The pixels of the rect, line by line. Pixel (x, y) of the rect starts at
+     * mPixels + y * mStride + x * mBytesPerPixel.
+     *
+     * The data is owned by the library and valid during the callback only. This never points
+     * into the internal framebuffer: depending on the encoding, this points into internal decode
+     * buffers or into a copy of the rect.
+     **/
+    const uint8_t* mPixels;
+    /**
+     * Bytes per line in @ref mPixels.
+     **/
+    uint32_t mStride;
+} orv_rect_sink_data_t;
+
+typedef void (*orv_rect_sink_callback_t)(struct orv_context_t* ctx, const orv_rect_sink_data_t* rect);
+
 /**
  * Implementation of an event callback that stores all events in an internal queue that can be
  * polled using orv_poll_event().
@@ -620,6 +985,81 @@ typedef struct orv_config_t
      * is fired.
      **/
     void* mUserData[ORV_USER_DATA_COUNT];
+
+    /**
+     * If non-zero, a single ORV_EVENT_FRAMEBUFFER_UPDATED_BATCH event is sent per
+     * FramebufferUpdate message instead of one ORV_EVENT_FRAMEBUFFER_UPDATED event per rect.
+     *
+     * Disabled by default.
+     **/
+    uint8_t mBatchFramebufferEvents;
+
+    /**
+     * Minimum severity (see @ref orv_logging_severity_t) of messages that are forwarded to @ref
+     * mLogCallback. Messages with a lower severity are discarded before they are formatted.
+     *
+     * Defaults to @ref ORV_LOGGING_SEVERITY_DEBUG, i.e. all messages. See also @ref
+     * ORV_LOG_MIN_SEVERITY to remove messages at compile time.
+     **/
+    int mMinLogSeverity;
+    /**
+     * Bitmask of @ref orv_log_category_t values whose debug and info messages are discarded.
+     * Warnings and errors are always forwarded (if they pass @ref mMinLogSeverity).
+     *
+     * For example, set to (ORV_LOG_CATEGORY_ALL & ~ORV_LOG_CATEGORY_PARSER) to trace the parser
+     * only.
+     *
+     * Defaults to 0, i.e. all categories are enabled.
+     **/
+    uint32_t mDisabledLogCategories;
+
+    /**
+     * Optional callback that receives the pixels of every rect as soon as the rect was decoded,
+     * before the ORV_EVENT_FRAMEBUFFER_UPDATED event of the rect is sent. This allows consumers
+     * that do not need a persistent framebuffer (e.g. recorders, thumbnail generators) to use the
+     * decoded data directly, without acquiring and copying the framebuffer (see @ref
+     * orv_acquire_framebuffer()).
+     *
+     * This function is called by the connection thread of the context, after the rect was written
+     * to the framebuffer (if any) and without any internal lock held, so it may call other
+     * functions of the library, e.g. @ref orv_acquire_framebuffer(). Decoding of further data
+     * waits for this function, so it should return quickly.
+     *
+     * NULL (the default) to disable.
+     **/
+    orv_rect_sink_callback_t mRectSinkCallback;
+    /**
+     * If non-zero, the library does not maintain the internal framebuffer at all: decoded rects
+     * are provided to @ref mRectSinkCallback only and @ref orv_acquire_framebuffer() provides a
+     * framebuffer with a NULL @ref orv_framebuffer_t::mFramebuffer (but valid size).
+     *
+     * As the CopyRect encoding requires the previous framebuffer contents, it is not requested
+     * from the server in this mode.
+     *
+     * Disabled by default.
+     **/
+    uint8_t mSkipFramebuffer;
+    /**
+     * Number of downscaled copies ("mipmap levels") of the framebuffer that the library maintains,
+     * at most ORV_MAX_MIPMAP_LEVELS. Level n has 1/2^n of the framebuffer size (rounded up) and is
+     * box filtered from level n-1, e.g. 3 provides copies of 1/2, 1/4 and 1/8 size.
+     *
+     * The levels are updated by the connection thread in the region of every decoded rect and
+     * can be read using @ref orv_acquire_mipmap() independently of the framebuffer, e.g. for
+     * thumbnails. The library never locks the mipmaps and the framebuffer at the same time, so the
+     * application may hold both, acquired in any order.
+     *
+     * Ignored if @ref mSkipFramebuffer is set. Defaults to 0, i.e. disabled.
+     **/
+    uint8_t mMipmapLevels;
+    /**
+     * If non-zero, the time spent decoding each rect is measured and reported in @ref
+     * orv_encoding_statistics_t::mReadTimeUs and @ref orv_encoding_statistics_t::mFinishTimeUs.
+     * This reads the clock several times per rect, so it is meant for benchmarks and profiling.
+     *
+     * Disabled by default, the times are reported as 0 then.
+     **/
+    uint8_t mMeasureDecodeTimes;
 } orv_config_t;
 
 void orv_config_zero(orv_config_t* cfg);
@@ -627,6 +1067,34 @@ void orv_config_copy(orv_config_t* dst, const orv_config_t* src);
 void orv_config_default(orv_config_t* cfg);
 
 
+/**
+ * Transport used by @ref orv_connect() to reach the server.
+ **/
+typedef enum orv_transport_type_t
+{
+    /**
+     * Normal TCP connection to host and port.
+     **/
+    ORV_TRANSPORT_TCP = 0,
+
+    /**
+     * Unix domain stream socket. The host parameter of @ref orv_connect() is the path of the
+     * socket, the port is ignored.
+     *
+     * NOTE: Not supported on windows.
+     **/
+    ORV_TRANSPORT_UNIX_SOCKET,
+
+    /**
+     * In-process connection to a server running in the same process, e.g. for benchmarks and
+     * tests. The host parameter of @ref orv_connect() is the name of the server's listener, the
+     * port is ignored.
+     *
+     * NOTE: Not supported on windows.
+     **/
+    ORV_TRANSPORT_MEMORY_PIPE
+} orv_transport_type_t;
+
 /**
  * Optional parameters to @ref orv_connect().
  **/
@@ -649,15 +1117,90 @@ typedef struct orv_connect_options_t
      * This is meant for advanced usage.
      **/
     struct orv_communication_pixel_format_t mCommunicationPixelFormat;
+
+    /**
+     * Maximum number of pointer motion events per second that are sent to the server.
+     *
+     * Consecutive pointer events with an unchanged button mask are coalesced while waiting to be
+     * sent, i.e. only the most recent position is sent. Events that change the button mask and key
+     * events are never coalesced or delayed.
+     *
+     * On slow links the rate is reduced further, depending on the round trip time of the
+     * connection (if known).
+     *
+     * 0 disables the fixed limit, the rate then depends on the round trip time only.
+     **/
+    uint16_t mMaxPointerEventsPerSecond;
+
+    /**
+     * The transport used for the connection. Default is @ref ORV_TRANSPORT_TCP.
+     **/
+    orv_transport_type_t mTransportType;
+
+    /**
+     * Options applied to the socket before connecting. See @ref orv_socket_options_default() for
+     * the defaults and @ref orv_connection_info_t::mSocketOptions for the values that are
+     * actually in effect.
+     **/
+    orv_socket_options_t mSocketOptions;
 } orv_connect_options_t;
 
+void orv_socket_options_default(orv_socket_options_t* options);
 void orv_connect_options_default(orv_connect_options_t* options);
 
+/**
+ * Options of the library-driven refresh, see @ref orv_start_auto_refresh().
+ **/
+typedef struct orv_auto_refresh_options_t
+{
+    /**
+     * Maximum number of update requests per second, 0 for no limit, i.e. the next request is
+     * sent as soon as an update completes.
+     **/
+    uint32_t mTargetFps;
+    /**
+     * Maximum number of update requests that have been sent but not yet been answered by the
+     * server. Values below 1 are treated as 1.
+     **/
+    uint32_t mMaxOutstandingRequests;
+    /**
+     * If non-zero, every request additionally waits for a call to @ref orv_auto_refresh_tick(),
+     * e.g. to align the requests to the vertical sync of the display.
+     **/
+    uint8_t mWaitForTick;
+} orv_auto_refresh_options_t;
+
+void orv_auto_refresh_options_default(orv_auto_refresh_options_t* options);
+
+/**
+ * How visible a connection currently is to the user, see @ref orv_set_activity_state(). Used to
+ * reduce the load caused by connections that are not (fully) visible.
+ **/
+typedef enum orv_activity_state_t
+{
+    /**
+     * The framebuffer is visible, updates are requested as usual. This is the default.
+     **/
+    ORV_ACTIVITY_STATE_VISIBLE = 0,
+    /**
+     * The framebuffer is visible at a reduced size only or not in the focus of the user (e.g. a
+     * thumbnail or a background tab). Update requests are rate limited and the pixel format of
+     * @ref ORV_COMM_QUALITY_PROFILE_LOW is used.
+     **/
+    ORV_ACTIVITY_STATE_BACKGROUND,
+    /**
+     * The framebuffer is not visible at all (e.g. a minimized or occluded window). No update
+     * requests are sent, but the connection remains established.
+     **/
+    ORV_ACTIVITY_STATE_PAUSED
+} orv_activity_state_t;
+
 
 typedef struct orv_context_t orv_context_t;
 
 orv_context_t* orv_init(const orv_config_t* cfg);
 void orv_destroy(orv_context_t* ctx);
+void orv_clear_dns_cache(void);
 
 int orv_set_credentials(orv_context_t* ctx, const char* user, const char* password);
 int orv_connect(orv_context_t* ctx, const char* host, uint16_t port, const orv_connect_options_t* options, orv_error_t* error);
@@ -667,8 +1210,21 @@ int orv_is_connected(orv_context_t* ctx);
 
 void orv_request_framebuffer_update(orv_context_t* ctx, uint16_t x, uint16_t y, uint16_t w, uint16_t h);
 void orv_request_framebuffer_update_full(orv_context_t* ctx);
+void orv_request_framebuffer_update_non_incremental(orv_context_t* ctx, uint16_t x, uint16_t y, uint16_t w, uint16_t h);
+void orv_set_viewport(orv_context_t* ctx, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint16_t margin);
+void orv_clear_viewport(orv_context_t* ctx);
+void orv_start_auto_refresh(orv_context_t* ctx, const orv_auto_refresh_options_t* options);
+void orv_stop_auto_refresh(orv_context_t* ctx);
+void orv_auto_refresh_tick(orv_context_t* ctx);
+void orv_set_activity_state(orv_context_t* ctx, orv_activity_state_t state);
+orv_activity_state_t orv_get_activity_state(orv_context_t* ctx);
 
 orv_event_t* orv_poll_event(orv_context_t* ctx);
+int orv_poll_events(orv_context_t* ctx, orv_event_t** events, int maxCount);
+int orv_wait_events(orv_context_t* ctx, int timeoutMs);
+int orv_get_event_fd(orv_context_t* ctx);
+int orv_set_latency_trace_file(orv_context_t* ctx, const char* fileName, orv_error_t* error);
+int orv_set_capture_file(orv_context_t* ctx, const char* fileName, orv_error_t* error);
 
 void orv_set_user_data(orv_context_t* ctx, orv_user_data_t index, void* userData);
 void orv_set_user_data_int(orv_context_t* ctx, orv_user_data_t index, int userData);
@@ -762,6 +1318,8 @@ typedef enum orv_mouse_button_flag_t
 
 const orv_framebuffer_t* orv_acquire_framebuffer(orv_context_t* ctx);
 void orv_release_framebuffer(orv_context_t* ctx);
+const orv_framebuffer_t* orv_acquire_mipmap(orv_context_t* ctx, int level);
+void orv_release_mipmap(orv_context_t* ctx);
 
 const orv_cursor_t* orv_acquire_cursor(orv_context_t* ctx);
 void orv_release_cursor(orv_context_t* ctx);
@@ -17,6 +17,8 @@
 #ifndef OPENRV_ORV_LATENCYTESTERCLIENT_H
 #define OPENRV_ORV_LATENCYTESTERCLIENT_H
 
+#include <libopenrv/libopenrv.h>
+
 #include <stdint.h>
 
 #ifdef __cplusplus
@@ -91,10 +93,106 @@ typedef enum orv_latency_tester_event_type_t
 
 typedef void (*orv_latency_tester_event_callback_t)(struct orv_latency_tester_client_t* client, orv_latency_tester_event_type_t event, const void* eventData, void* userData);
 
+/**
+ * Options of the continuous mode, see @ref orv_latency_tester_start_continuous().
+ **/
+typedef struct orv_latency_tester_continuous_options_t
+{
+    /**
+     * Number of update requests sent per second.
+     **/
+    uint32_t mRequestsPerSecond;
+    /**
+     * Maximum number of requests that have been sent but not yet been answered by the server. If
+     * this number is reached when the next request is due, the request is skipped (see @ref
+     * orv_latency_tester_statistics_t::mSkippedRequests).
+     **/
+    uint32_t mMaxOutstandingRequests;
+} orv_latency_tester_continuous_options_t;
+
+/**
+ * Number of buckets of @ref orv_latency_tester_histogram_t.
+ **/
+#define ORV_LATENCY_TESTER_HISTOGRAM_BUCKETS 24
+/**
+ * Number of most recent samples that the percentiles of @ref orv_latency_tester_histogram_t are
+ * calculated from.
+ **/
+#define ORV_LATENCY_TESTER_WINDOW_SIZE 1024
+
+/**
+ * Distribution of a latency component, in microseconds.
+ **/
+typedef struct orv_latency_tester_histogram_t
+{
+    uint64_t mCount;
+    uint64_t mMinUs;
+    uint64_t mMaxUs;
+    uint64_t mTotalUs;
+    /**
+     * Percentiles over the @ref ORV_LATENCY_TESTER_WINDOW_SIZE most recent samples.
+     **/
+    orv_latency_percentiles_t mPercentiles;
+    /**
+     * Logarithmic histogram of all samples: bucket 0 counts values below 2us, bucket i > 0 counts
+     * values in [2^i, 2^(i+1)) us. The last bucket also counts all larger values.
+     **/
+    uint64_t mBuckets[ORV_LATENCY_TESTER_HISTOGRAM_BUCKETS];
+} orv_latency_tester_histogram_t;
+
+/**
+ * Statistics of the update requests of a latency tester client, see @ref
+ * orv_latency_tester_get_statistics().
+ *
+ * With t1 being the time the client sent a request, t2 the time the server received it, t3 the
+ * time the server sent the response and t4 the time the client received it, the latency of each
+ * request is split into:
+ * - network: (t4 - t1) - (t3 - t2), i.e. the round trip without the server processing time
+ * - server paint: time from t2 until the server performed the paint
+ * - VNC delivery: time from the server performing the paint until the painted area was updated in
+ *   the framebuffer of the VNC client (see @ref orv_latency_tester_report_framebuffer_update()).
+ *   This combines timestamps of both clocks and is corrected by @ref mClockOffsetUs.
+ **/
+typedef struct orv_latency_tester_statistics_t
+{
+    uint64_t mRequestsSent;
+    uint64_t mResponsesReceived;
+    uint64_t mSkippedRequests;
+    /**
+     * Number of responses whose paint was found in a framebuffer update of the VNC client.
+     **/
+    uint64_t mDeliveredUpdates;
+    /**
+     * Estimated offset of the server clock relative to the client clock, i.e. server time minus
+     * client time, in microseconds. NTP style: ((t2 - t1) + (t3 - t4)) / 2 of the sample with the
+     * lowest network delay among the @ref ORV_LATENCY_TESTER_WINDOW_SIZE most recent samples.
+     *
+     * NOTE: The client uses a monotonic clock with an unspecified epoch, so only the stability of
+     *       this value is meaningful, not the value itself.
+     **/
+    int64_t mClockOffsetUs;
+    /**
+     * The network delay of the sample @ref mClockOffsetUs was calculated from, i.e. the maximum
+     * error of the offset is half this value. 0 if no response was received yet.
+     **/
+    uint64_t mClockOffsetDelayUs;
+    orv_latency_tester_histogram_t mRoundTrip;
+    orv_latency_tester_histogram_t mNetwork;
+    orv_latency_tester_histogram_t mServerPaint;
+    orv_latency_tester_histogram_t mVncDelivery;
+} orv_latency_tester_statistics_t;
+
 struct orv_latency_tester_client_t* orv_latency_tester_connect(struct orv_context_t* orvContext, orv_latency_tester_event_callback_t callback, void* userData, const char* hostName, int port);
 void orv_latency_tester_disconnect(struct orv_latency_tester_client_t* client);
 int orv_latency_tester_request_update(struct orv_latency_tester_client_t* client);
 
+void orv_latency_tester_continuous_options_default(orv_latency_tester_continuous_options_t* options);
+int orv_latency_tester_start_continuous(struct orv_latency_tester_client_t* client, const orv_latency_tester_continuous_options_t* options);
+void orv_latency_tester_stop_continuous(struct orv_latency_tester_client_t* client);
+void orv_latency_tester_report_framebuffer_update(struct orv_latency_tester_client_t* client, uint16_t x, uint16_t y, uint16_t w, uint16_t h);
+void orv_latency_tester_get_statistics(struct orv_latency_tester_client_t* client, orv_latency_tester_statistics_t* statistics);
+void orv_latency_tester_statistics_print_to_log(const struct orv_context_t* ctx, const orv_latency_tester_statistics_t* statistics);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -17,6 +17,8 @@
 #ifndef OPENRV_ORV_LOGGING_H
 #define OPENRV_ORV_LOGGING_H
 
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif /* __cplusplus */
@@ -27,11 +29,43 @@ extern "C" {
 #define ORV_LOGGING_FUNCINFO 0
 #endif /* __GNUC__ */
 
+/**
+ * Compile-time minimum severity of the ORV_DEBUG/ORV_INFO/ORV_WARNING/ORV_ERROR macros. Messages
+ * with a lower severity are compiled out entirely (their arguments are never evaluated), e.g. define
+ * to 1 (@ref ORV_LOGGING_SEVERITY_INFO) to remove all ORV_DEBUG() calls.
+ *
+ * Defaults to 0, i.e. all messages are compiled in and filtered at runtime only, see @ref
+ * orv_config_t::mMinLogSeverity.
+ **/
+#ifndef ORV_LOG_MIN_SEVERITY
+#define ORV_LOG_MIN_SEVERITY 0
+#endif /* ORV_LOG_MIN_SEVERITY */
+
+/**
+ * The category of the ORV_DEBUG/ORV_INFO/ORV_WARNING/ORV_ERROR macros in the current file. A
+ * source file can define this before including any header to assign its messages to a different
+ * @ref orv_log_category_t.
+ **/
+#ifndef ORV_LOG_FILE_CATEGORY
+#define ORV_LOG_FILE_CATEGORY ORV_LOG_CATEGORY_GENERAL
+#endif /* ORV_LOG_FILE_CATEGORY */
+
+/**
+ * Log the printf-style message to @p ctx if @p severity and @p category are enabled. The
+ * enabled-check is performed before the arguments are evaluated, so disabled messages are cheap.
+ **/
+#define ORV_LOG(ctx, severity, category, ...) \
+    do { \
+        if ((severity) >= ORV_LOG_MIN_SEVERITY && orv_log_is_enabled(ctx, severity, category)) { \
+            orv_log_category(ctx, severity, category, ORV_LOGGING_FUNCINFO, __FILE__, __LINE__, __VA_ARGS__); \
+        } \
+    } while (0)
+
 #ifndef NO_OPENRV_DEBUG_MACROS
-#define ORV_DEBUG(ctx, ...) orv_log(ctx, ORV_LOGGING_SEVERITY_DEBUG, ORV_LOGGING_FUNCINFO, __FILE__, __LINE__, __VA_ARGS__)
-#define ORV_INFO(ctx, ...) orv_log(ctx, ORV_LOGGING_SEVERITY_INFO, ORV_LOGGING_FUNCINFO, __FILE__, __LINE__, __VA_ARGS__)
-#define ORV_WARNING(ctx, ...) orv_log(ctx, ORV_LOGGING_SEVERITY_WARNING, ORV_LOGGING_FUNCINFO, __FILE__, __LINE__, __VA_ARGS__)
-#define ORV_ERROR(ctx, ...) orv_log(ctx, ORV_LOGGING_SEVERITY_ERROR, ORV_LOGGING_FUNCINFO, __FILE__, __LINE__, __VA_ARGS__)
+#define ORV_DEBUG(ctx, ...) ORV_LOG(ctx, ORV_LOGGING_SEVERITY_DEBUG, ORV_LOG_FILE_CATEGORY, __VA_ARGS__)
+#define ORV_INFO(ctx, ...) ORV_LOG(ctx, ORV_LOGGING_SEVERITY_INFO, ORV_LOG_FILE_CATEGORY, __VA_ARGS__)
+#define ORV_WARNING(ctx, ...) ORV_LOG(ctx, ORV_LOGGING_SEVERITY_WARNING, ORV_LOG_FILE_CATEGORY, __VA_ARGS__)
+#define ORV_ERROR(ctx, ...) ORV_LOG(ctx, ORV_LOGGING_SEVERITY_ERROR, ORV_LOG_FILE_CATEGORY, __VA_ARGS__)
 #endif /* NO_OPENRV_DEBUG_MACROS */
 
 struct orv_context_t;
@@ -44,6 +78,31 @@ typedef enum
     ORV_LOGGING_SEVERITY_ERROR = 3
 } orv_logging_severity_t;
 
+/**
+ * Subsystems of the library that log messages, used as bitmask in @ref
+ * orv_config_t::mDisabledLogCategories.
+ **/
+typedef enum
+{
+    /**
+     * Everything not covered by a more specific category, e.g. connection management and events.
+     **/
+    ORV_LOG_CATEGORY_GENERAL = 0x01,
+    /**
+     * Socket and transport level messages (connect, send, receive, TLS).
+     **/
+    ORV_LOG_CATEGORY_SOCKET = 0x02,
+    /**
+     * Parsing of server messages and rect data, i.e. the decode hot path.
+     **/
+    ORV_LOG_CATEGORY_PARSER = 0x04,
+    /**
+     * Protocol version negotiation, security types and authentication.
+     **/
+    ORV_LOG_CATEGORY_HANDSHAKE = 0x08,
+    ORV_LOG_CATEGORY_ALL = 0xff
+} orv_log_category_t;
+
 /**
  * @param msg The message to print. Is guaranteed to end in NUL (\0) and should NOT provide a
  *        newline (\n) before the terminating NUL.
@@ -64,12 +123,74 @@ extern void orv_log(const struct orv_context_t* ctx, int severity, const char* f
 #endif
     ;
 
+extern void orv_log_category(const struct orv_context_t* ctx, int severity, int category, const char* func, const char* file, int line, const char* msg, ...)
+#ifdef __GNUC__
+    __attribute__((format(printf, 7, 8)))
+#endif
+    ;
+
+extern int orv_log_is_enabled(const struct orv_context_t* ctx, int severity, int category);
+
 /**
  * Simple implementation for a @ref orv_log_callback callback, that simply prints the data to stdout
  * and stderr.
  **/
 extern void orv_log_stdoutstderr(int severity, const char* func, const char* file, int line, const char* msg);
 
+typedef enum
+{
+    /**
+     * Human readable text, in the same format as @ref orv_log_stdoutstderr().
+     **/
+    ORV_LOG_ASYNC_FORMAT_TEXT = 0,
+    /**
+     * Compact binary format, only supported if a file is used. The file starts with the 8 bytes
+     * "ORVLOG01", followed by the records. Each record consists of a uint64_t timestamp
+     * (microseconds since the unix epoch), int32_t line, uint8_t severity, uint8_t (reserved),
+     * uint16_t message length, uint16_t function length, uint16_t file length (all in host byte
+     * order), followed by the message, function and file strings (not NUL-terminated).
+     **/
+    ORV_LOG_ASYNC_FORMAT_BINARY = 1
+} orv_log_async_format_t;
+
+typedef struct orv_log_async_config_t
+{
+    /**
+     * File to write the log to. If NULL, debug and info messages are written to stdout, warnings
+     * and errors to stderr (like @ref orv_log_stdoutstderr()).
+     **/
+    const char* mFileName;
+    orv_log_async_format_t mFormat;
+} orv_log_async_config_t;
+
+typedef struct orv_log_async_statistics_t
+{
+    /**
+     * Number of messages written by the writer thread.
+     **/
+    uint64_t mWritten;
+    /**
+     * Number of messages that were dropped because the queue of the writer thread was full,
+     * indexed by @ref orv_logging_severity_t.
+     **/
+    uint64_t mDropped[4];
+} orv_log_async_statistics_t;
+
+extern void orv_log_async_config_default(orv_log_async_config_t* config);
+extern int orv_log_async_start(const orv_log_async_config_t* config);
+extern void orv_log_async_stop(void);
+extern void orv_log_async_get_statistics(orv_log_async_statistics_t* statistics);
+
+/**
+ * Implementation of a @ref orv_log_callback_t callback that never blocks the calling thread on
+ * I/O: the messages are queued in a bounded lock-free buffer and written by a background thread,
+ * see @ref orv_log_async_start(). If the buffer is full, messages are dropped (debug and info
+ * messages first) and counted, see @ref orv_log_async_get_statistics().
+ *
+ * If the backend has not been started, this behaves like @ref orv_log_stdoutstderr().
+ **/
+extern void orv_log_async(int severity, const char* func, const char* file, int line, const char* msg);
+
 
 #ifdef __cplusplus
 } /* extern "C" */
@@ -14,6 +14,8 @@
  * limitations under the License.
  */
 
+#define ORV_LOG_FILE_CATEGORY ORV_LOG_CATEGORY_PARSER
+
 #include "messageparser.h"
 #include <libopenrv/orv_logging.h>
 #include <libopenrv/libopenrv.h>
@@ -22,6 +24,8 @@
 #include "writer.h"
 #include "orv_context.h"
 #include "rectdataparser.h"
+#include "decodearena.h"
+#include "utils.h"
 
 #include <assert.h>
 #include <sys/types.h>
@@ -51,6 +55,9 @@ namespace openrv {
 namespace vnc {
 
 /**
+ * @param decodeArena The arena that temporary buffers of the current rect are allocated from, see
+ *        @ref DecodeArena. The arena is shared by all parsers of a connection.
+ *        The pointer must remain valid for the lifetime of this object.
  * @param currentPixelFormat The pixel format that the communication takes place in.
  *        The pointer must remain valid for the lifetime of this object.
  *        The contents of this object @em must remain @em unchanged for the full duration of reading
@@ -71,8 +78,9 @@ namespace vnc {
  *        The value of this variable @em must remain @em unchanged for the full duration of reading
  *        a rect, similar to @p currentPixelFormat.
  **/
-RectDataParserBase::RectDataParserBase(orv_context_t* ctx, const orv_communication_pixel_format_t* currentPixelFormat, const uint16_t* currentFramebufferWidth, const uint16_t* currentFramebufferHeight)
+RectDataParserBase::RectDataParserBase(orv_context_t* ctx, DecodeArena* decodeArena, const orv_communication_pixel_format_t* currentPixelFormat, const uint16_t* currentFramebufferWidth, const uint16_t* currentFramebufferHeight)
     : mContext(ctx),
+      mDecodeArena(*decodeArena),
       mCurrentPixelFormat(*currentPixelFormat),
       mCurrentFramebufferWidth(*currentFramebufferWidth),
       mCurrentFramebufferHeight(*currentFramebufferHeight)
@@ -92,6 +100,15 @@ void RectDataParserBase::setCurrentRect(uint16_t x, uint16_t y, uint16_t w, uint
     mCurrentRect.mH = h;
 }
 
+/**
+ * Set the encoding of the current rect, as received from the server. This is provided to the rect
+ * sink (see @ref orv_config_t::mRectSinkCallback) only.
+ **/
+void RectDataParserBase::setCurrentEncodingType(int32_t encodingType)
+{
+    mCurrentEncodingType = encodingType;
+}
+
 /**
  * Reset this object, so that the next rect can be parsed.
  *
@@ -103,6 +120,7 @@ void RectDataParserBase::setCurrentRect(uint16_t x, uint16_t y, uint16_t w, uint
 void RectDataParserBase::reset()
 {
     setCurrentRect(0, 0, 0, 0);
+    mFramebufferLockWaitUs = 0;
 }
 
 /**
@@ -125,13 +143,30 @@ void RectDataParserBase::resetConnection()
  *        framebufferMutex.
  *        The pointer must remain valid for the lifetime of this object.
  **/
-RectDataParserRealRectBase::RectDataParserRealRectBase(orv_context_t* ctx, std::mutex* framebufferMutex, orv_framebuffer_t* framebuffer, const orv_communication_pixel_format_t* currentPixelFormat, const uint16_t* currentFramebufferWidth, const uint16_t* currentFramebufferHeight)
-    : RectDataParserBase(ctx, currentPixelFormat, currentFramebufferWidth, currentFramebufferHeight),
+RectDataParserRealRectBase::RectDataParserRealRectBase(orv_context_t* ctx, DecodeArena* decodeArena, std::mutex* framebufferMutex, orv_framebuffer_t* framebuffer, const orv_communication_pixel_format_t* currentPixelFormat, const uint16_t* currentFramebufferWidth, const uint16_t* currentFramebufferHeight)
+    : RectDataParserBase(ctx, decodeArena, currentPixelFormat, currentFramebufferWidth, currentFramebufferHeight),
       mFramebufferMutex(*framebufferMutex),
       mFramebuffer(*framebuffer)
 {
 }
 
+/**
+ * Lock the @ref mFramebufferMutex. If the mutex is currently held by a different thread (normally
+ * the application, see @ref orv_acquire_framebuffer()), the time spent waiting is added to @ref
+ * mFramebufferLockWaitUs.
+ **/
+std::unique_lock<std::mutex> RectDataParserRealRectBase::lockFramebuffer()
+{
+    std::unique_lock<std::mutex> lock(mFramebufferMutex, std::try_to_lock);
+    if (!lock.owns_lock()) {
+        const uint64_t startUs = Utils::getTimestampUs();
+        lock.lock();
+        // NOTE: count at least 1us, so that every contention is visible to the caller
+        mFramebufferLockWaitUs += std::max((uint64_t)1, Utils::getTimestampUs() - startUs);
+    }
+    return lock;
+}
+
 /**
  * @pre The @ref mFramebufferMutex is LOCKED
  *
@@ -165,6 +200,87 @@ bool RectDataParserRealRectBase::checkRectParametersForFramebufferMutexLocked(or
     return true;
 }
 
+/**
+ * @return TRUE if the application provided a rect sink (see @ref
+ *         orv_config_t::mRectSinkCallback), otherwise FALSE.
+ **/
+bool RectDataParserRealRectBase::hasRectSink() const
+{
+    return mContext->mConfig.mRectSinkCallback != nullptr;
+}
+
+/**
+ * @pre The @ref mFramebufferMutex is LOCKED by @p lock
+ *
+ * Provide the decoded @p pixels of @ref mCurrentRect to the rect sink of the application, if any.
+ * The @p pixels must remain valid until this function returns only and must not point into the
+ * @ref mFramebuffer.
+ *
+ * The @p lock is released before the rect sink is called (if there is one), so that the
+ * application can call other functions of the library from the rect sink. The caller must not
+ * access the @ref mFramebuffer afterwards.
+ *
+ * @param srcX The source x position of a CopyRect rect, otherwise 0.
+ * @param srcY The source y position of a CopyRect rect, otherwise 0.
+ **/
+void RectDataParserRealRectBase::unlockAndDeliverToRectSink(std::unique_lock<std::mutex>* lock, orv_rect_sink_format_t format, const uint8_t* pixels, uint32_t stride, uint16_t srcX, uint16_t srcY)
+{
+    if (!hasRectSink()) {
+        return;
+    }
+    orv_rect_sink_data_t data;
+    memset(&data, 0, sizeof(orv_rect_sink_data_t));
+    data.mX = mCurrentRect.mX;
+    data.mY = mCurrentRect.mY;
+    data.mWidth = mCurrentRect.mW;
+    data.mHeight = mCurrentRect.mH;
+    data.mEncodingType = mCurrentEncodingType;
+    data.mSrcX = srcX;
+    data.mSrcY = srcY;
+    data.mFormat = format;
+    orv_communication_pixel_format_copy(&data.mPixelFormat, &mCurrentPixelFormat);
+    if (format == ORV_RECT_SINK_FORMAT_RGB888) {
+        data.mBytesPerPixel = 3;
+    }
+    else {
+        data.mBytesPerPixel = mCurrentPixelFormat.mBitsPerPixel / 8;
+    }
+    data.mPixels = pixels;
+    data.mStride = stride;
+    lock->unlock();
+    mContext->mConfig.mRectSinkCallback(mContext, &data);
+}
+
+/**
+ * @pre The @ref mFramebufferMutex is LOCKED by @p lock
+ * @pre The @ref mCurrentRect has been written to the @ref mFramebuffer, which is maintained.
+ *
+ * Convenience function that provides the @ref mCurrentRect of the @ref mFramebuffer to the rect
+ * sink. As the sink is called without the @p lock (see @ref unlockAndDeliverToRectSink()), the
+ * rect is copied to the @ref mDecodeArena first.
+ **/
+void RectDataParserRealRectBase::unlockAndDeliverFramebufferRectToRectSink(std::unique_lock<std::mutex>* lock, uint16_t srcX, uint16_t srcY, orv_error_t* error)
+{
+    if (!hasRectSink()) {
+        return;
+    }
+    uint32_t size = 0;
+    if (!calculateRectBufferSizeFor(&size, mCurrentRect.mW, mCurrentRect.mH, mFramebuffer.mBitsPerPixel) || size == 0) {
+        return;
+    }
+    uint8_t* pixels = (uint8_t*)mDecodeArena.allocate(size);
+    if (!pixels) {
+        orv_error_set(error, ORV_ERR_GENERIC, 0, "Failed to allocate %u bytes for rect sink data", (unsigned int)size);
+        return;
+    }
+    const uint32_t framebufferStride = (uint32_t)mFramebuffer.mWidth * mFramebuffer.mBytesPerPixel;
+    const uint32_t stride = (uint32_t)mCurrentRect.mW * mFramebuffer.mBytesPerPixel;
+    for (uint16_t y = 0; y < mCurrentRect.mH; y++) {
+        memcpy(pixels + (size_t)y * stride, mFramebuffer.mFramebuffer + (size_t)(mCurrentRect.mY + y) * framebufferStride + (size_t)mCurrentRect.mX * mFramebuffer.mBytesPerPixel, stride);
+    }
+    unlockAndDeliverToRectSink(lock, ORV_RECT_SINK_FORMAT_RGB888, pixels, stride, srcX, srcY);
+}
+
 /**
  * Calculate the size of the buffer required to store pixels for the specified rect size with the
  * specified @p bitsPerPixel.
@@ -229,8 +345,8 @@ void RectDataParserRealRectBase::fillSubrectInRect(uint8_t* rectData, uint16_t r
     }
 }
 
-RectDataParserRaw::RectDataParserRaw(struct orv_context_t* context, std::mutex* framebufferMutex, orv_framebuffer_t* framebuffer, const orv_communication_pixel_format_t* currentPixelFormat, const uint16_t* currentFramebufferWidth, const uint16_t* currentFramebufferHeight)
-    : RectDataParserRealRectBase(context, framebufferMutex, framebuffer, currentPixelFormat, currentFramebufferWidth, currentFramebufferHeight)
+RectDataParserRaw::RectDataParserRaw(struct orv_context_t* context, DecodeArena* decodeArena, std::mutex* framebufferMutex, orv_framebuffer_t* framebuffer, const orv_communication_pixel_format_t* currentPixelFormat, const uint16_t* currentFramebufferWidth, const uint16_t* currentFramebufferHeight)
+    : RectDataParserRealRectBase(context, decodeArena, framebufferMutex, framebuffer, currentPixelFormat, currentFramebufferWidth, currentFramebufferHeight)
 {
 }
 
@@ -241,8 +357,7 @@ RectDataParserRaw::~RectDataParserRaw()
 
 void RectDataParserRaw::clear()
 {
-    free(mCurrentRectData);
-    mCurrentRectData = nullptr;
+    mCurrentRectData = nullptr; // owned by mDecodeArena
     mCurrentRectDataSize = 0;
     mExpectedBytes = 0;
     mConsumed = 0;
@@ -268,9 +383,8 @@ uint32_t RectDataParserRaw::readRectData(const char* buffer, uint32_t bufferSize
             return 0;
         }
 
-        free(mCurrentRectData);
         mCurrentRectDataSize = expectedBytes;
-        mCurrentRectData = (uint8_t*)malloc(mCurrentRectDataSize);
+        mCurrentRectData = (uint8_t*)mDecodeArena.allocate(mCurrentRectDataSize);
     }
 
     if (!mCurrentRectData || mCurrentRectDataSize == 0) {
@@ -295,7 +409,7 @@ bool RectDataParserRaw::canFinishRect() const
 
 void RectDataParserRaw::finishRect(orv_error_t* error)
 {
-    std::unique_lock<std::mutex> lock(mFramebufferMutex);
+    std::unique_lock<std::mutex> lock = lockFramebuffer();
     if (!checkRectParametersForFramebufferMutexLocked(error)) {
         return;
     }
@@ -309,6 +423,10 @@ void RectDataParserRaw::finishRect(orv_error_t* error)
         orv_error_set(error, ORV_ERR_GENERIC, 0, "Internal error: %s assumes internal RGB framebuffer, but have bytesperpixel %d", __PRETTY_FUNCTION__, (int)mFramebuffer.mBytesPerPixel);
         return;
     }
+    if (!mFramebuffer.mFramebuffer) {
+        unlockAndDeliverToRectSink(&lock, ORV_RECT_SINK_FORMAT_COMMUNICATION, mCurrentRectData, (uint32_t)mCurrentRect.mW * remoteBpp, 0, 0);
+        return;
+    }
 
     // TODO: optimizations.
     //  1) provide dedicated optimized function for the most common case(s).
@@ -360,6 +478,7 @@ void RectDataParserRaw::finishRect(orv_error_t* error)
         orv_error_set(error, ORV_ERR_GENERIC, 0, "Invalid value for BitsPerPixel: %d", (int)mCurrentPixelFormat.mBitsPerPixel);
         return;
     }
+    unlockAndDeliverToRectSink(&lock, ORV_RECT_SINK_FORMAT_COMMUNICATION, mCurrentRectData, (uint32_t)mCurrentRect.mW * remoteBpp, 0, 0);
 }
 
 
@@ -370,8 +489,8 @@ void RectDataParserRaw::reset()
 }
 
 
-RectDataParserCopyRect::RectDataParserCopyRect(struct orv_context_t* context, std::mutex* framebufferMutex, orv_framebuffer_t* framebuffer, const orv_communication_pixel_format_t* currentPixelFormat, const uint16_t* currentFramebufferWidth, const uint16_t* currentFramebufferHeight)
-    : RectDataParserRealRectBase(context, framebufferMutex, framebuffer, currentPixelFormat, currentFramebufferWidth, currentFramebufferHeight)
+RectDataParserCopyRect::RectDataParserCopyRect(struct orv_context_t* context, DecodeArena* decodeArena, std::mutex* framebufferMutex, orv_framebuffer_t* framebuffer, const orv_communication_pixel_format_t* currentPixelFormat, const uint16_t* currentFramebufferWidth, const uint16_t* currentFramebufferHeight)
+    : RectDataParserRealRectBase(context, decodeArena, framebufferMutex, framebuffer, currentPixelFormat, currentFramebufferWidth, currentFramebufferHeight)
 {
 }
 
@@ -397,22 +516,28 @@ uint32_t RectDataParserCopyRect::readRectData(const char* buffer, uint32_t buffe
 
 void RectDataParserCopyRect::finishRect(orv_error_t* error)
 {
-    std::unique_lock<std::mutex> lock(mFramebufferMutex);
+    std::unique_lock<std::mutex> lock = lockFramebuffer();
     if (!checkRectParametersForFramebufferMutexLocked(error)) {
         return;
     }
+    if (!mFramebuffer.mFramebuffer) {
+        // NOTE: CopyRect is not requested if the framebuffer is skipped
+        orv_error_set(error, ORV_ERR_PROTOCOL_ERROR, 0, "Received CopyRect rect, but CopyRect was not requested.");
+        return;
+    }
     ORV_DEBUG(mContext, "Performing framebuffer update for CopyRect data");
     const size_t lineSize = mCurrentRect.mW * mFramebuffer.mBytesPerPixel;
-    uint8_t* rect = (uint8_t*)malloc(mCurrentRect.mH * lineSize);
-    for (int y = 0; y < mCurrentRect.mH; y++) {
+    // Copy in place, without a temporary copy of the rect: If the destination is below the source,
+    // copy bottom-up, otherwise top-down, so that no source line is overwritten before it was
+    // copied. memmove() handles overlaps within a line.
+    const bool bottomUp = mCurrentRect.mY > mSrcY;
+    for (int i = 0; i < mCurrentRect.mH; i++) {
+        const int y = bottomUp ? (mCurrentRect.mH - 1 - i) : i;
         const uint8_t* src = mFramebuffer.mFramebuffer + ((mSrcY + y) * mFramebuffer.mWidth + mSrcX) * mFramebuffer.mBytesPerPixel;
-        memcpy(rect + y * lineSize, src, lineSize);
-    }
-    for (int y = 0; y < mCurrentRect.mH; y++) {
         uint8_t* dst = mFramebuffer.mFramebuffer + ((mCurrentRect.mY + y) * mFramebuffer.mWidth + mCurrentRect.mX) * mFramebuffer.mBytesPerPixel;
-        memcpy(dst, rect + y * lineSize, lineSize);
+        memmove(dst, src, lineSize);
     }
-    free(rect);
+    unlockAndDeliverFramebufferRectToRectSink(&lock, mSrcX, mSrcY, error);
     //ORV_DEBUG(mContext, "Finished performing framebuffer update for CopyRect data, rect x=%d y=%d w=%d h=%d", (int)mCurrentRect.mX, (int)mCurrentRect.mY, (int)mCurrentRect.mW, (int)mCurrentRect.mH);
 }
 
@@ -434,8 +559,8 @@ void RectDataParserCopyRect::reset()
 
 
 
-RectDataParserRRE::RectDataParserRRE(struct orv_context_t* context, std::mutex* framebufferMutex, orv_framebuffer_t* framebuffer, const orv_communication_pixel_format_t* currentPixelFormat, const uint16_t* currentFramebufferWidth, const uint16_t* currentFramebufferHeight, bool isCompressedRRE)
-    : RectDataParserRealRectBase(context, framebufferMutex, framebuffer, currentPixelFormat, currentFramebufferWidth, currentFramebufferHeight),
+RectDataParserRRE::RectDataParserRRE(struct orv_context_t* context, DecodeArena* decodeArena, std::mutex* framebufferMutex, orv_framebuffer_t* framebuffer, const orv_communication_pixel_format_t* currentPixelFormat, const uint16_t* currentFramebufferWidth, const uint16_t* currentFramebufferHeight, bool isCompressedRRE)
+    : RectDataParserRealRectBase(context, decodeArena, framebufferMutex, framebuffer, currentPixelFormat, currentFramebufferWidth, currentFramebufferHeight),
       mIsCompressedRRE(isCompressedRRE)
 {
 }
@@ -456,8 +581,7 @@ void RectDataParserRRE::clear()
     mTotalSubRectanglesCount = 0;
     mFinishedSubRectanglesCount = 0;
     mHasRREHeader = false;
-    free(mSubRectangles);
-    mSubRectangles = nullptr;
+    mSubRectangles = nullptr; // owned by mDecodeArena
     memset(mBackgroundPixelValue, 0, 3);
 }
 
@@ -480,11 +604,14 @@ uint32_t RectDataParserRRE::readRectData(const char* buffer, uint32_t bufferSize
         }
         mFinishedSubRectanglesCount = 0;
         mHasRREHeader = true;
-        free(mSubRectangles);
         mSubRectangles = nullptr;
         //ORV_DEBUG(mContext, "Received RRE header, expecting %d sub-rectangles", (int)mTotalSubRectanglesCount);
         if (mTotalSubRectanglesCount > 0) {
-            mSubRectangles = (SubRectangle*)malloc(mTotalSubRectanglesCount * sizeof(SubRectangle));
+            mSubRectangles = (SubRectangle*)mDecodeArena.allocate(mTotalSubRectanglesCount * sizeof(SubRectangle));
+            if (!mSubRectangles) {
+                orv_error_set(error, ORV_ERR_GENERIC, 0, "Failed to allocate memory for %u subrectangles in RRE encoding", (unsigned int)mTotalSubRectanglesCount);
+                return 0;
+            }
         }
     }
     const size_t bytesPerSubRect = (mIsCompressedRRE ? (4*1) : (4*2)) + (mCurrentPixelFormat.mBitsPerPixel / 8);
@@ -528,7 +655,7 @@ bool RectDataParserRRE::canFinishRect() const
 
 void RectDataParserRRE::finishRect(orv_error_t* error)
 {
-    std::unique_lock<std::mutex> lock(mFramebufferMutex);
+    std::unique_lock<std::mutex> lock = lockFramebuffer();
     if (!checkRectParametersForFramebufferMutexLocked(error)) {
         return;
     }
@@ -538,6 +665,10 @@ void RectDataParserRRE::finishRect(orv_error_t* error)
         return;
     }
     const int bytesPerPixel = 3; // SubRectangle uses 3 bytes per pixel. Framebuffer must do so as well.
+    if (!mFramebuffer.mFramebuffer) {
+        finishRectWithoutFramebufferMutexLocked(&lock, error);
+        return;
+    }
     for (int rectY = 0; rectY < mCurrentRect.mH; rectY++) {
         const int dstY = mCurrentRect.mY + rectY;
         for (int rectX = 0; rectX < mCurrentRect.mW; rectX++) {
@@ -561,12 +692,47 @@ void RectDataParserRRE::finishRect(orv_error_t* error)
             }
         }
     }
+    unlockAndDeliverFramebufferRectToRectSink(&lock, 0, 0, error);
     //ORV_DEBUG(mContext, "Finished performing framebuffer update for RRE data");
 }
 
+/**
+ * @pre The @ref mFramebufferMutex is LOCKED by @p lock
+ *
+ * Variant of @ref finishRect() if the framebuffer is not maintained: The rect is painted into a
+ * temporary buffer for the rect sink, if any. The @p lock is released before the rect sink is
+ * called.
+ **/
+void RectDataParserRRE::finishRectWithoutFramebufferMutexLocked(std::unique_lock<std::mutex>* lock, orv_error_t* error)
+{
+    if (!hasRectSink()) {
+        return;
+    }
+    uint32_t size = 0;
+    const uint8_t bpp = 3; // SubRectangle uses 3 bytes per pixel (RGB)
+    if (!calculateRectBufferSizeFor(&size, mCurrentRect.mW, mCurrentRect.mH, bpp * 8)) {
+        orv_error_set(error, ORV_ERR_PROTOCOL_ERROR, 0, "Server sent rect of size %dx%d in RRE encoding, which exceeds 32 bit size.", (int)mCurrentRect.mW, (int)mCurrentRect.mH);
+        return;
+    }
+    if (size == 0) {
+        return;
+    }
+    uint8_t* rectData = (uint8_t*)mDecodeArena.allocate(size);
+    if (!rectData) {
+        orv_error_set(error, ORV_ERR_GENERIC, 0, "Failed to allocate %u bytes for RRE rect data", (unsigned int)size);
+        return;
+    }
+    fillSubrectInRect(rectData, mCurrentRect.mW, 0, 0, mCurrentRect.mW, mCurrentRect.mH, mBackgroundPixelValue, bpp);
+    for (uint32_t subrectIndex = 0; subrectIndex < mFinishedSubRectanglesCount; subrectIndex++) {
+        const SubRectangle* subrect = mSubRectangles + subrectIndex;
+        fillSubrectInRect(rectData, mCurrentRect.mW, subrect->mX, subrect->mY, subrect->mW, subrect->mH, subrect->mPixelValue, bpp);
+    }
+    unlockAndDeliverToRectSink(lock, ORV_RECT_SINK_FORMAT_RGB888, rectData, (uint32_t)mCurrentRect.mW * bpp, 0, 0);
+}
 
-RectDataParserHextile::RectDataParserHextile(struct orv_context_t* context, std::mutex* framebufferMutex, orv_framebuffer_t* framebuffer, const orv_communication_pixel_format_t* currentPixelFormat, const uint16_t* currentFramebufferWidth, const uint16_t* currentFramebufferHeight)
-    : RectDataParserRealRectBase(context, framebufferMutex, framebuffer, currentPixelFormat, currentFramebufferWidth, currentFramebufferHeight)
+
+RectDataParserHextile::RectDataParserHextile(struct orv_context_t* context, DecodeArena* decodeArena, std::mutex* framebufferMutex, orv_framebuffer_t* framebuffer, const orv_communication_pixel_format_t* currentPixelFormat, const uint16_t* currentFramebufferWidth, const uint16_t* currentFramebufferHeight)
+    : RectDataParserRealRectBase(context, decodeArena, framebufferMutex, framebuffer, currentPixelFormat, currentFramebufferWidth, currentFramebufferHeight)
 {
 }
 
@@ -588,8 +754,7 @@ void RectDataParserHextile::clear()
     mExpectedTileColumns = 0;
     mExpectedTileRows = 0;
     mExpectedTotalTiles = 0;
-    free(mCurrentRectData);
-    mCurrentRectData = nullptr;
+    mCurrentRectData = nullptr; // owned by mDecodeArena
     mCurrentRectDataSize = 0;
     memset(mCurrentBackgroundColor, 0, mMaxBytesPerPixel);
     memset(mCurrentForegroundColor, 0, mMaxBytesPerPixel);
@@ -635,8 +800,11 @@ uint32_t RectDataParserHextile::readRectData(const char* buffer, uint32_t buffer
             orv_error_set(error, ORV_ERR_PROTOCOL_ERROR, 0, "Server sent rect of size %dx%d with %d bytes per pixel in Hextile encoding. This is impossible, invalid data received.", (int)mCurrentRect.mW, (int)mCurrentRect.mH, (int)mCurrentPixelFormat.mBitsPerPixel/8);
             return 0;
         }
-        free(mCurrentRectData);
-        mCurrentRectData = (uint8_t*)malloc(std::max((uint32_t)1, expectedTotalRectSize));
+        mCurrentRectData = (uint8_t*)mDecodeArena.allocate(expectedTotalRectSize);
+        if (!mCurrentRectData) {
+            orv_error_set(error, ORV_ERR_GENERIC, 0, "Failed to allocate %u bytes for rect in Hextile encoding", (unsigned int)expectedTotalRectSize);
+            return 0;
+        }
         mCurrentRectDataSize = expectedTotalRectSize;
         //ORV_DEBUG(mContext, "Initialized reader for Hextile encoding. Expecting %dx%d tiles, currentRect: Width=%d,Height=%d", (int)mExpectedTileColumns, (int)mExpectedTileRows, (int)mCurrentRect.mW, (int)mCurrentRect.mH);
     }
@@ -849,7 +1017,7 @@ bool RectDataParserHextile::canFinishRect() const
 
 void RectDataParserHextile::finishRect(orv_error_t* error)
 {
-    std::unique_lock<std::mutex> lock(mFramebufferMutex);
+    std::unique_lock<std::mutex> lock = lockFramebuffer();
     if (!checkRectParametersForFramebufferMutexLocked(error)) {
         return;
     }
@@ -859,23 +1027,26 @@ void RectDataParserHextile::finishRect(orv_error_t* error)
         return;
     }
     const uint8_t remoteBpp = mCurrentPixelFormat.mBitsPerPixel / 8;
-    for (int rectY = 0; rectY < mCurrentRect.mH; rectY++) {
-        const int dstY = mCurrentRect.mY + rectY;
-        const uint8_t* srcRectLine = mCurrentRectData + rectY * mCurrentRect.mW * remoteBpp;
-        for (int rectX = 0; rectX < mCurrentRect.mW; rectX++) {
-            const int dstX = mCurrentRect.mX + rectX;
-            uint8_t* pDst = mFramebuffer.mFramebuffer + (dstY * mFramebuffer.mWidth + dstX) * mFramebuffer.mBytesPerPixel;
-            const uint8_t* pSrc = srcRectLine + rectX * remoteBpp;
-            Reader::readPixel(pDst, pSrc, mCurrentPixelFormat);
+    if (mFramebuffer.mFramebuffer) {
+        for (int rectY = 0; rectY < mCurrentRect.mH; rectY++) {
+            const int dstY = mCurrentRect.mY + rectY;
+            const uint8_t* srcRectLine = mCurrentRectData + rectY * mCurrentRect.mW * remoteBpp;
+            for (int rectX = 0; rectX < mCurrentRect.mW; rectX++) {
+                const int dstX = mCurrentRect.mX + rectX;
+                uint8_t* pDst = mFramebuffer.mFramebuffer + (dstY * mFramebuffer.mWidth + dstX) * mFramebuffer.mBytesPerPixel;
+                const uint8_t* pSrc = srcRectLine + rectX * remoteBpp;
+                Reader::readPixel(pDst, pSrc, mCurrentPixelFormat);
+            }
         }
     }
+    unlockAndDeliverToRectSink(&lock, ORV_RECT_SINK_FORMAT_COMMUNICATION, mCurrentRectData, (uint32_t)mCurrentRect.mW * remoteBpp, 0, 0);
 }
 
 
 
 
-RectDataParserCursor::RectDataParserCursor(struct orv_context_t* context, std::mutex* cursorMutex, orv_cursor_t* cursorData, const orv_communication_pixel_format_t* currentPixelFormat, const uint16_t* currentFramebufferWidth, const uint16_t* currentFramebufferHeight)
-    : RectDataParserBase(context, currentPixelFormat, currentFramebufferWidth, currentFramebufferHeight),
+RectDataParserCursor::RectDataParserCursor(struct orv_context_t* context, DecodeArena* decodeArena, std::mutex* cursorMutex, orv_cursor_t* cursorData, const orv_communication_pixel_format_t* currentPixelFormat, const uint16_t* currentFramebufferWidth, const uint16_t* currentFramebufferHeight)
+    : RectDataParserBase(context, decodeArena, currentPixelFormat, currentFramebufferWidth, currentFramebufferHeight),
       mCursorMutex(*cursorMutex),
       mCursorData(*cursorData)
 {
@@ -897,14 +1068,16 @@ uint32_t RectDataParserCursor::readRectData(const char* buffer, uint32_t bufferS
             return 0;
         }
         mExpectedCursorBytes = (uint32_t)expectedCursorBytesTmp;
-        free(mCursor);
-        mCursor = (uint8_t*)malloc(std::max((size_t)mExpectedCursorBytes, (size_t)1));
+        mCursor = (uint8_t*)mDecodeArena.allocate(mExpectedCursorBytes);
         mCursorBytesRead = 0;
 
         // multiplication of 2 uint16_t always fit into a 32 bit uint.
         mExpectedCursorBitmaskBytes = ((((uint32_t)mCurrentRect.mW) + 7) / 8) * ((uint32_t)mCurrentRect.mH);
-        free(mCursorMask);
-        mCursorMask = (uint8_t*)malloc(std::max((size_t)mExpectedCursorBitmaskBytes, (size_t)1));
+        mCursorMask = (uint8_t*)mDecodeArena.allocate(mExpectedCursorBitmaskBytes);
+        if (!mCursor || !mCursorMask) {
+            orv_error_set(error, ORV_ERR_GENERIC, 0, "Failed to allocate memory for cursor of size %dx%d", (int)mCurrentRect.mW, (int)mCurrentRect.mH);
+            return 0;
+        }
         mCursorBitmaskBytesRead = 0;
 
         mIsInitialized = true;
@@ -1043,9 +1216,8 @@ void RectDataParserCursor::reset()
 
 void RectDataParserCursor::clear()
 {
-    free(mCursor);
+    // NOTE: mCursor and mCursorMask are owned by mDecodeArena
     mCursor = nullptr;
-    free(mCursorMask);
     mCursorMask = nullptr;
     mExpectedCursorBytes = 0;
     mExpectedCursorBitmaskBytes = 0;
@@ -1054,8 +1226,8 @@ void RectDataParserCursor::clear()
     mIsInitialized = false;
 }
 
-RectDataParserZlibPlain::RectDataParserZlibPlain(struct orv_context_t* context, std::mutex* framebufferMutex, orv_framebuffer_t* framebuffer, const orv_communication_pixel_format_t* currentPixelFormat, const uint16_t* currentFramebufferWidth, const uint16_t* currentFramebufferHeight, const char* owningEncodingString)
-    : RectDataParserRealRectBase(context, framebufferMutex, framebuffer, currentPixelFormat, currentFramebufferWidth, currentFramebufferHeight)
+RectDataParserZlibPlain::RectDataParserZlibPlain(struct orv_context_t* context, DecodeArena* decodeArena, std::mutex* framebufferMutex, orv_framebuffer_t* framebuffer, const orv_communication_pixel_format_t* currentPixelFormat, const uint16_t* currentFramebufferWidth, const uint16_t* currentFramebufferHeight, const char* owningEncodingString)
+    : RectDataParserRealRectBase(context, decodeArena, framebufferMutex, framebuffer, currentPixelFormat, currentFramebufferWidth, currentFramebufferHeight)
 {
     mOwningEncodingString = strdup(owningEncodingString);
 }
@@ -1110,7 +1282,11 @@ uint32_t RectDataParserZlibPlain::readRectData(const char* buffer, uint32_t buff
             orv_error_set(error, ORV_ERR_PROTOCOL_ERROR, 0, "Server tried to allocate %u bytes for zlib data in encoding '%s', which exceeds valid size. Refusing to do so.", (uint32_t)mExpectedCompressedDataLength, mOwningEncodingString);
             return 0;
         }
-        mCompressedData = (uint8_t*)malloc(std::max((size_t)1, (size_t)mExpectedCompressedDataLength));
+        mCompressedData = (uint8_t*)mDecodeArena.allocate(mExpectedCompressedDataLength);
+        if (!mCompressedData) {
+            orv_error_set(error, ORV_ERR_GENERIC, 0, "Failed to allocate %u bytes for zlib data in encoding '%s'", (uint32_t)mExpectedCompressedDataLength, mOwningEncodingString);
+            return 0;
+        }
         mHasZlibHeader = true;
         if (mExpectedCompressedDataLength == 0) {
             return consumed;
@@ -1151,8 +1327,7 @@ void RectDataParserZlibPlain::clear()
 {
     mExpectedCompressedDataLength = 0;
     mCompressedDataReceived = 0;
-    free(mCompressedData);
-    mCompressedData = nullptr;
+    mCompressedData = nullptr; // owned by mDecodeArena
     mCompressedDataUncompressedLength = 0;
     mHasZlibHeader = false;
 
@@ -1269,9 +1444,9 @@ uint32_t RectDataParserZlibPlain::uncompressTo(uint8_t* buffer, uint32_t bufferS
 }
 
 
-RectDataParserZlib::RectDataParserZlib(struct orv_context_t* context, std::mutex* framebufferMutex, orv_framebuffer_t* framebuffer, const orv_communication_pixel_format_t* currentPixelFormat, const uint16_t* currentFramebufferWidth, const uint16_t* currentFramebufferHeight)
-    : RectDataParserRaw(context, framebufferMutex, framebuffer, currentPixelFormat, currentFramebufferWidth, currentFramebufferHeight),
-      mZlibPlainParser(context, framebufferMutex, framebuffer, currentPixelFormat, currentFramebufferWidth, currentFramebufferHeight, "Zlib")
+RectDataParserZlib::RectDataParserZlib(struct orv_context_t* context, DecodeArena* decodeArena, std::mutex* framebufferMutex, orv_framebuffer_t* framebuffer, const orv_communication_pixel_format_t* currentPixelFormat, const uint16_t* currentFramebufferWidth, const uint16_t* currentFramebufferHeight)
+    : RectDataParserRaw(context, decodeArena, framebufferMutex, framebuffer, currentPixelFormat, currentFramebufferWidth, currentFramebufferHeight),
+      mZlibPlainParser(context, decodeArena, framebufferMutex, framebuffer, currentPixelFormat, currentFramebufferWidth, currentFramebufferHeight, "Zlib")
 {
 }
 
@@ -1300,14 +1475,17 @@ uint32_t RectDataParserZlib::readRectData(const char* buffer, uint32_t bufferSiz
             orv_error_set(error, ORV_ERR_PROTOCOL_ERROR, 0, "Server sent rect of size %dx%d with %d bytes per pixel in Zlib encoding, which exceeds 32 bit size. This is impossible, invalid data received.", (int)mCurrentRect.mW, (int)mCurrentRect.mH, (int)mCurrentPixelFormat.mBitsPerPixel/8);
             return 0;
         }
-        free(mUncompressedData);
         mUncompressedData = nullptr;
         mUncompressedDataOffset = 0;
         if (mUncompressedDataSize == 0) {
             orv_error_set(error, ORV_ERR_GENERIC, 0, "Internal error: Invalid uncompressed data size 0");
             return 0;
         }
-        mUncompressedData = (uint8_t*)malloc(mUncompressedDataSize);
+        mUncompressedData = (uint8_t*)mDecodeArena.allocate(mUncompressedDataSize);
+        if (!mUncompressedData) {
+            orv_error_set(error, ORV_ERR_GENERIC, 0, "Failed to allocate %u bytes for uncompressed data in Zlib encoding", (unsigned int)mUncompressedDataSize);
+            return 0;
+        }
     }
 
     if (!mZlibPlainParser.hasUncompressibleData()) {
@@ -1353,8 +1531,7 @@ uint32_t RectDataParserZlib::readRectData(const char* buffer, uint32_t bufferSiz
 
 void RectDataParserZlib::clear()
 {
-    free(mUncompressedData);
-    mUncompressedData = nullptr;
+    mUncompressedData = nullptr; // owned by mDecodeArena
     mUncompressedDataSize = 0;
     mUncompressedDataOffset = 0;
 }
@@ -1367,9 +1544,9 @@ void RectDataParserZlib::reset()
 }
 
 
-RectDataParserZRLE::RectDataParserZRLE(struct orv_context_t* context, std::mutex* framebufferMutex, orv_framebuffer_t* framebuffer, const orv_communication_pixel_format_t* currentPixelFormat, const uint16_t* currentFramebufferWidth, const uint16_t* currentFramebufferHeight)
-    : RectDataParserRealRectBase(context, framebufferMutex, framebuffer, currentPixelFormat, currentFramebufferWidth, currentFramebufferHeight),
-      mZlibPlainParser(context, framebufferMutex, framebuffer, currentPixelFormat, currentFramebufferWidth, currentFramebufferHeight, "ZRLE")
+RectDataParserZRLE::RectDataParserZRLE(struct orv_context_t* context, DecodeArena* decodeArena, std::mutex* framebufferMutex, orv_framebuffer_t* framebuffer, const orv_communication_pixel_format_t* currentPixelFormat, const uint16_t* currentFramebufferWidth, const uint16_t* currentFramebufferHeight)
+    : RectDataParserRealRectBase(context, decodeArena, framebufferMutex, framebuffer, currentPixelFormat, currentFramebufferWidth, currentFramebufferHeight),
+      mZlibPlainParser(context, decodeArena, framebufferMutex, framebuffer, currentPixelFormat, currentFramebufferWidth, currentFramebufferHeight, "ZRLE")
 {
 }
 
@@ -1438,7 +1615,7 @@ void RectDataParserZRLE::reset()
 
 void RectDataParserZRLE::clear()
 {
-    free(mUncompressedData);
+    // NOTE: mUncompressedData and mCurrentRectData are owned by mDecodeArena
     mUncompressedData = nullptr;
     mUncompressedDataMaxSize = 0;
     mUncompressedDataOffset = 0;
@@ -1449,7 +1626,6 @@ void RectDataParserZRLE::clear()
     mExpectedTileRows = 0;
     mExpectedTileColumns = 0;
     mExpectedTotalTiles = 0;
-    free(mCurrentRectData);
     mCurrentRectData = nullptr;
     mCurrentRectDataSize = 0;
     clearCurrentTile();
@@ -1501,19 +1677,21 @@ uint32_t RectDataParserZRLE::readRectData(const char* buffer, uint32_t bufferSiz
             orv_error_set(error, ORV_ERR_PROTOCOL_ERROR, 0, "Server sent rect of size %dx%d with %d bytes per pixel in Hextile encoding. This is impossible, invalid data received.", (int)mCurrentRect.mW, (int)mCurrentRect.mH, (int)mCurrentPixelFormat.mBitsPerPixel/8);
             return 0;
         }
-        free(mUncompressedData);
         mUncompressedData = nullptr;
         mUncompressedDataOffset = 0;
         mUncompressedConsumedOffset = 0;
-        free(mCurrentRectData);
         mCurrentRectData = nullptr;
         mCurrentRectDataSize = 0;
         if (mUncompressedDataMaxSize == 0) {
             orv_error_set(error, ORV_ERR_GENERIC, 0, "Internal error: Invalid uncompressed data size 0");
             return 0;
         }
-        mUncompressedData = (uint8_t*)malloc(mUncompressedDataMaxSize);
-        mCurrentRectData = (uint8_t*)malloc(std::max((uint32_t)1, expectedTotalRectSize));
+        mUncompressedData = (uint8_t*)mDecodeArena.allocate(mUncompressedDataMaxSize);
+        mCurrentRectData = (uint8_t*)mDecodeArena.allocate(expectedTotalRectSize);
+        if (!mUncompressedData || !mCurrentRectData) {
+            orv_error_set(error, ORV_ERR_GENERIC, 0, "Failed to allocate memory for rect in ZRLE encoding");
+            return 0;
+        }
         mCurrentRectDataSize = expectedTotalRectSize;
     }
 
@@ -1941,7 +2119,7 @@ bool RectDataParserZRLE::canFinishRect() const
 
 void RectDataParserZRLE::finishRect(orv_error_t* error)
 {
-    std::unique_lock<std::mutex> lock(mFramebufferMutex);
+    std::unique_lock<std::mutex> lock = lockFramebuffer();
     if (!checkRectParametersForFramebufferMutexLocked(error)) {
         return;
     }
@@ -1954,6 +2132,10 @@ void RectDataParserZRLE::finishRect(orv_error_t* error)
     // NOTE: mCurrentRectData uses mCurrentPixelFormat.mBitsPerPixel/8 (not mZrleBytesPerPixel)
 
     const int remoteBpp = mCurrentPixelFormat.mBitsPerPixel / 8;
+    if (!mFramebuffer.mFramebuffer) {
+        unlockAndDeliverToRectSink(&lock, ORV_RECT_SINK_FORMAT_COMMUNICATION, mCurrentRectData, (uint32_t)mCurrentRect.mW * remoteBpp, 0, 0);
+        return;
+    }
     if (mCurrentPixelFormat.mBitsPerPixel == 8) {
         for (int srcY = 0; srcY < mCurrentRect.mH; srcY++) {
             const int dstY = mCurrentRect.mY + srcY;
@@ -1991,6 +2173,7 @@ void RectDataParserZRLE::finishRect(orv_error_t* error)
         orv_error_set(error, ORV_ERR_GENERIC, 0, "Invalid value for BitsPerPixel: %d", (int)mCurrentPixelFormat.mBitsPerPixel);
         return;
     }
+    unlockAndDeliverToRectSink(&lock, ORV_RECT_SINK_FORMAT_COMMUNICATION, mCurrentRectData, (uint32_t)mCurrentRect.mW * remoteBpp, 0, 0);
     //ORV_DEBUG(mContext, "Finished performing framebuffer update for ZRLE data");
 }
 
@@ -23,6 +23,8 @@ struct z_stream_s;
 namespace openrv {
 namespace vnc {
 
+class DecodeArena;
+
 /**
  * Base class for parsing rect data in a FramebufferUpdate message.
  *
@@ -31,10 +33,11 @@ namespace vnc {
 class RectDataParserBase
 {
 public:
-    explicit RectDataParserBase(orv_context_t* ctx, const orv_communication_pixel_format_t* currentPixelFormat, const uint16_t* currentFramebufferWidth, const uint16_t* currentFramebufferHeight);
+    explicit RectDataParserBase(orv_context_t* ctx, DecodeArena* decodeArena, const orv_communication_pixel_format_t* currentPixelFormat, const uint16_t* currentFramebufferWidth, const uint16_t* currentFramebufferHeight);
     virtual ~RectDataParserBase() = default;
 
     void setCurrentRect(uint16_t x, uint16_t y, uint16_t w, uint16_t h);
+    void setCurrentEncodingType(int32_t encodingType);
 
     /**
      * @pre The rect size in @ref mCurrentRectHeader is initialized and valid.
@@ -81,6 +84,8 @@ public:
     virtual void reset();
     virtual void resetConnection();
 
+    uint64_t framebufferLockWaitUs() const;
+
 protected:
     struct Rect
     {
@@ -93,6 +98,11 @@ protected:
     bool checkRectParametersForFramebufferMutexLocked(orv_error_t* error);
 protected:
     struct orv_context_t* mContext = nullptr;
+    /**
+     * Arena that all temporary buffers of a rect are allocated from. The buffers are valid until
+     * @ref reset() is called, which must drop all pointers into the arena.
+     **/
+    DecodeArena& mDecodeArena;
     /**
      * Current pixel format of the communication with the server.
      *
@@ -115,8 +125,27 @@ protected:
      **/
     const uint16_t& mCurrentFramebufferHeight;
     Rect mCurrentRect;
+    /**
+     * The encoding of the current rect as received from the server. Normally the encoding of this
+     * parser, but some parsers handle multiple encodings (e.g. Zlib uses the Raw parser).
+     **/
+    int32_t mCurrentEncodingType = 0;
+    /**
+     * Time spent waiting for the framebuffer lock for the current rect, see @ref
+     * RectDataParserRealRectBase::lockFramebuffer(). Reset by @ref reset().
+     **/
+    uint64_t mFramebufferLockWaitUs = 0;
 };
 
+/**
+ * @return The time in microseconds that was spent waiting for the framebuffer lock for the
+ *         current rect. 0 if the lock was immediately available.
+ **/
+inline uint64_t RectDataParserBase::framebufferLockWaitUs() const
+{
+    return mFramebufferLockWaitUs;
+}
+
 /**
  * Base class for parsing rect data in a FramebufferUpdate message. This class is the base class for
  * "real" rects, i.e. non-pseudo-encodings.
@@ -127,21 +156,28 @@ protected:
 class RectDataParserRealRectBase : public RectDataParserBase
 {
 public:
-    RectDataParserRealRectBase(orv_context_t* ctx, std::mutex* framebufferMutex, orv_framebuffer_t* framebuffer, const orv_communication_pixel_format_t* currentPixelFormat, const uint16_t* currentFramebufferWidth, const uint16_t* currentFramebufferHeight);
+    RectDataParserRealRectBase(orv_context_t* ctx, DecodeArena* decodeArena, std::mutex* framebufferMutex, orv_framebuffer_t* framebuffer, const orv_communication_pixel_format_t* currentPixelFormat, const uint16_t* currentFramebufferWidth, const uint16_t* currentFramebufferHeight);
     virtual ~RectDataParserRealRectBase() = default;
 
     virtual bool isPseudoEncoding() const override;
 
 protected:
+    std::unique_lock<std::mutex> lockFramebuffer();
     bool checkRectParametersForFramebufferMutexLocked(orv_error_t* error);
     static bool calculateRectBufferSizeFor(uint32_t* bufferSize, uint16_t rectWidth, uint16_t rectHeight, uint8_t bitsPerPixel);
     static void fillSubrectInRect(uint8_t* rectData, uint16_t rectWidth, uint16_t subrectXInRect, uint16_t subrectYInRect, uint16_t subrectWidth, uint16_t subrectHeight, const uint8_t* color, uint8_t bpp);
+    bool hasRectSink() const;
+    void unlockAndDeliverToRectSink(std::unique_lock<std::mutex>* lock, orv_rect_sink_format_t format, const uint8_t* pixels, uint32_t stride, uint16_t srcX, uint16_t srcY);
+    void unlockAndDeliverFramebufferRectToRectSink(std::unique_lock<std::mutex>* lock, uint16_t srcX, uint16_t srcY, orv_error_t* error);
 protected:
     std::mutex& mFramebufferMutex;
     /**
      * Reference to framebuffer of @ref openrv::vnc::ConnectionThread.
      *
      * Protected by @ref mFramebufferMutex, all accesses em MUST lock the mutex first.
+     *
+     * The @ref orv_framebuffer_t::mFramebuffer is NULL if the framebuffer is not maintained (see
+     * @ref orv_config_t::mSkipFramebuffer), then the rects are delivered to the rect sink only.
      **/
     orv_framebuffer_t& mFramebuffer;
 };
@@ -152,7 +188,7 @@ protected:
 class RectDataParserRaw : public RectDataParserRealRectBase
 {
 public:
-    RectDataParserRaw(struct orv_context_t* context, std::mutex* framebufferMutex, orv_framebuffer_t* framebuffer, const orv_communication_pixel_format_t* currentPixelFormat, const uint16_t* currentFramebufferWidth, const uint16_t* currentFramebufferHeight);
+    RectDataParserRaw(struct orv_context_t* context, DecodeArena* decodeArena, std::mutex* framebufferMutex, orv_framebuffer_t* framebuffer, const orv_communication_pixel_format_t* currentPixelFormat, const uint16_t* currentFramebufferWidth, const uint16_t* currentFramebufferHeight);
     virtual ~RectDataParserRaw();
 
     virtual uint32_t readRectData(const char* buffer, uint32_t bufferSize, orv_error_t* error) override;
@@ -176,7 +212,7 @@ private:
 class RectDataParserCopyRect : public RectDataParserRealRectBase
 {
 public:
-    RectDataParserCopyRect(struct orv_context_t* context, std::mutex* framebufferMutex, orv_framebuffer_t* framebuffer, const orv_communication_pixel_format_t* currentPixelFormat, const uint16_t* currentFramebufferWidth, const uint16_t* currentFramebufferHeight);
+    RectDataParserCopyRect(struct orv_context_t* context, DecodeArena* decodeArena, std::mutex* framebufferMutex, orv_framebuffer_t* framebuffer, const orv_communication_pixel_format_t* currentPixelFormat, const uint16_t* currentFramebufferWidth, const uint16_t* currentFramebufferHeight);
     virtual ~RectDataParserCopyRect();
 
     virtual uint32_t readRectData(const char* buffer, uint32_t bufferSize, orv_error_t* error) override;
@@ -196,7 +232,7 @@ private:
 class RectDataParserRRE : public RectDataParserRealRectBase
 {
 public:
-    RectDataParserRRE(struct orv_context_t* context, std::mutex* framebufferMutex, orv_framebuffer_t* framebuffer, const orv_communication_pixel_format_t* currentPixelFormat, const uint16_t* currentFramebufferWidth, const uint16_t* currentFramebufferHeight, bool isCompressedRRE);
+    RectDataParserRRE(struct orv_context_t* context, DecodeArena* decodeArena, std::mutex* framebufferMutex, orv_framebuffer_t* framebuffer, const orv_communication_pixel_format_t* currentPixelFormat, const uint16_t* currentFramebufferWidth, const uint16_t* currentFramebufferHeight, bool isCompressedRRE);
     virtual ~RectDataParserRRE();
 
     virtual uint32_t readRectData(const char* buffer, uint32_t bufferSize, orv_error_t* error) override;
@@ -215,6 +251,7 @@ protected:
     };
 protected:
     void clear();
+    void finishRectWithoutFramebufferMutexLocked(std::unique_lock<std::mutex>* lock, orv_error_t* error);
 
 private:
     /**
@@ -235,7 +272,7 @@ private:
 class RectDataParserHextile : public RectDataParserRealRectBase
 {
 public:
-    RectDataParserHextile(struct orv_context_t* context, std::mutex* framebufferMutex, orv_framebuffer_t* framebuffer, const orv_communication_pixel_format_t* currentPixelFormat, const uint16_t* currentFramebufferWidth, const uint16_t* currentFramebufferHeight);
+    RectDataParserHextile(struct orv_context_t* context, DecodeArena* decodeArena, std::mutex* framebufferMutex, orv_framebuffer_t* framebuffer, const orv_communication_pixel_format_t* currentPixelFormat, const uint16_t* currentFramebufferWidth, const uint16_t* currentFramebufferHeight);
     virtual ~RectDataParserHextile();
 
     virtual uint32_t readRectData(const char* buffer, uint32_t bufferSize, orv_error_t* error) override;
@@ -292,7 +329,7 @@ private:
 class RectDataParserCursor : public RectDataParserBase
 {
 public:
-    RectDataParserCursor(struct orv_context_t* context, std::mutex* cursorMutex, orv_cursor_t* cursorData, const orv_communication_pixel_format_t* currentPixelFormat, const uint16_t* currentFramebufferWidth, const uint16_t* currentFramebufferHeight);
+    RectDataParserCursor(struct orv_context_t* context, DecodeArena* decodeArena, std::mutex* cursorMutex, orv_cursor_t* cursorData, const orv_communication_pixel_format_t* currentPixelFormat, const uint16_t* currentFramebufferWidth, const uint16_t* currentFramebufferHeight);
     virtual ~RectDataParserCursor();
 
     virtual uint32_t readRectData(const char* buffer, uint32_t bufferSize, orv_error_t* error) override;
@@ -333,7 +370,7 @@ private:
 class RectDataParserZlibPlain : public RectDataParserRealRectBase
 {
 public:
-    RectDataParserZlibPlain(struct orv_context_t* context, std::mutex* framebufferMutex, orv_framebuffer_t* framebuffer, const orv_communication_pixel_format_t* currentPixelFormat, const uint16_t* currentFramebufferWidth, const uint16_t* currentFramebufferHeight, const char* owningEncodingString);
+    RectDataParserZlibPlain(struct orv_context_t* context, DecodeArena* decodeArena, std::mutex* framebufferMutex, orv_framebuffer_t* framebuffer, const orv_communication_pixel_format_t* currentPixelFormat, const uint16_t* currentFramebufferWidth, const uint16_t* currentFramebufferHeight, const char* owningEncodingString);
     virtual ~RectDataParserZlibPlain();
 
     virtual uint32_t readRectData(const char* buffer, uint32_t bufferSize, orv_error_t* error) override;
@@ -368,7 +405,7 @@ private:
 class RectDataParserZlib : public RectDataParserRaw
 {
 public:
-    RectDataParserZlib(struct orv_context_t* context, std::mutex* framebufferMutex, orv_framebuffer_t* framebuffer, const orv_communication_pixel_format_t* currentPixelFormat, const uint16_t* currentFramebufferWidth, const uint16_t* currentFramebufferHeight);
+    RectDataParserZlib(struct orv_context_t* context, DecodeArena* decodeArena, std::mutex* framebufferMutex, orv_framebuffer_t* framebuffer, const orv_communication_pixel_format_t* currentPixelFormat, const uint16_t* currentFramebufferWidth, const uint16_t* currentFramebufferHeight);
     virtual ~RectDataParserZlib();
 
     virtual uint32_t readRectData(const char* buffer, uint32_t bufferSize, orv_error_t* error) override;
@@ -394,7 +431,7 @@ private:
 class RectDataParserZRLE : public RectDataParserRealRectBase
 {
 public:
-    RectDataParserZRLE(struct orv_context_t* context, std::mutex* framebufferMutex, orv_framebuffer_t* framebuffer, const orv_communication_pixel_format_t* currentPixelFormat, const uint16_t* currentFramebufferWidth, const uint16_t* currentFramebufferHeight);
+    RectDataParserZRLE(struct orv_context_t* context, DecodeArena* decodeArena, std::mutex* framebufferMutex, orv_framebuffer_t* framebuffer, const orv_communication_pixel_format_t* currentPixelFormat, const uint16_t* currentFramebufferWidth, const uint16_t* currentFramebufferHeight);
     virtual ~RectDataParserZRLE();
 
     virtual uint32_t readRectData(const char* buffer, uint32_t bufferSize, orv_error_t* error) override;
@@ -14,6 +14,8 @@
  * limitations under the License.
  */
 
+#define ORV_LOG_FILE_CATEGORY ORV_LOG_CATEGORY_HANDSHAKE
+
 #include "rfb3xhandshake.h"
 #include "socket.h"
 #include "reader.h"
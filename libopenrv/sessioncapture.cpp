@@ -0,0 +1,294 @@
+/*
+ * Copyright (C) 2018 Monument-Software GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "sessioncapture.h"
+#include "reader.h"
+#include "writer.h"
+#include <libopenrv/orv_error.h>
+#include <libopenrv/orv_errorcodes.h>
+
+#include <errno.h>
+#include <string.h>
+
+namespace openrv {
+namespace vnc {
+
+static void writeUInt64(char* buffer, uint64_t v)
+{
+    Writer::writeUInt32(buffer + 0, (uint32_t)(v >> 32));
+    Writer::writeUInt32(buffer + 4, (uint32_t)(v & 0xffffffff));
+}
+
+static uint64_t readUInt64(const char* buffer)
+{
+    return (((uint64_t)Reader::readUInt32(buffer + 0)) << 32) | (uint64_t)Reader::readUInt32(buffer + 4);
+}
+
+/**
+ * Write @p format as RFB PIXEL_FORMAT (16 bytes) to @p buffer.
+ **/
+static void writePixelFormat(char* buffer, const orv_communication_pixel_format_t& format)
+{
+    Writer::writeUInt8(buffer + 0, format.mBitsPerPixel);
+    Writer::writeUInt8(buffer + 1, format.mDepth);
+    Writer::writeUInt8(buffer + 2, format.mBigEndian ? 1 : 0);
+    Writer::writeUInt8(buffer + 3, format.mTrueColor ? 1 : 0);
+    Writer::writeUInt16(buffer + 4, format.mColorMax[0]);
+    Writer::writeUInt16(buffer + 6, format.mColorMax[1]);
+    Writer::writeUInt16(buffer + 8, format.mColorMax[2]);
+    Writer::writeUInt8(buffer + 10, format.mColorShift[0]);
+    Writer::writeUInt8(buffer + 11, format.mColorShift[1]);
+    Writer::writeUInt8(buffer + 12, format.mColorShift[2]);
+    memset(buffer + 13, 0, 3);
+}
+
+SessionCaptureWriter::SessionCaptureWriter()
+    : mIsCapturing(false)
+{
+}
+
+SessionCaptureWriter::~SessionCaptureWriter()
+{
+    close();
+}
+
+/**
+ * Open @p fileName for writing, the next connection started using @ref startSession() will be
+ * captured to it. A previously opened file is closed. If @p fileName is NULL, only the previous
+ * file is closed.
+ *
+ * @return TRUE on success, otherwise FALSE and @p error is set accordingly.
+ **/
+bool SessionCaptureWriter::open(const char* fileName, orv_error_t* error)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    closeMutexLocked();
+    if (!fileName) {
+        orv_error_reset(error);
+        return true;
+    }
+    mFile = fopen(fileName, "wb");
+    if (!mFile) {
+        orv_error_set(error, ORV_ERR_GENERIC, 0, "Failed to open capture file '%s', errno=%d", fileName, errno);
+        return false;
+    }
+    orv_error_reset(error);
+    return true;
+}
+
+void SessionCaptureWriter::close()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    closeMutexLocked();
+}
+
+void SessionCaptureWriter::closeMutexLocked()
+{
+    mIsCapturing = false;
+    if (mFile) {
+        fclose(mFile);
+        mFile = nullptr;
+    }
+}
+
+/**
+ * Start capturing the connection that has just been established, if a capture file has been
+ * opened and no connection has been captured to it yet. Otherwise this function does nothing.
+ *
+ * @param framebufferWidth, framebufferHeight, format The parameters of the connection negotiated
+ *        by the handshake.
+ **/
+void SessionCaptureWriter::startSession(uint16_t framebufferWidth, uint16_t framebufferHeight, const orv_communication_pixel_format_t& format, uint64_t timestampUs)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (!mFile || mIsCapturing) {
+        return;
+    }
+    char header[ORV_CAPTURE_HEADER_SIZE] = {};
+    memcpy(header, ORV_CAPTURE_MAGIC, ORV_CAPTURE_MAGIC_LENGTH);
+    Writer::writeUInt16(header + 8, framebufferWidth);
+    Writer::writeUInt16(header + 10, framebufferHeight);
+    vnc::writePixelFormat(header + 12, format);
+    // bytes 28..31 are reserved
+    if (fwrite(header, 1, ORV_CAPTURE_HEADER_SIZE, mFile) != ORV_CAPTURE_HEADER_SIZE) {
+        closeMutexLocked();
+        return;
+    }
+    mStartTimeUs = timestampUs;
+    mIsCapturing = true;
+}
+
+/**
+ * Append the @p bufferSize bytes received from the server in @p buffer to the capture, if a
+ * connection is being captured.
+ *
+ * @return FALSE if writing to the file failed, then the capture has been stopped and the file
+ *         closed. Otherwise TRUE.
+ **/
+bool SessionCaptureWriter::writeData(const char* buffer, uint32_t bufferSize, uint64_t timestampUs)
+{
+    if (!mIsCapturing) {
+        return true;
+    }
+    std::lock_guard<std::mutex> lock(mMutex);
+    return writeRecordMutexLocked(CaptureRecordType::Data, buffer, bufferSize, timestampUs);
+}
+
+/**
+ * Record that the client switched to the pixel format @p format, if a connection is being
+ * captured.
+ *
+ * @return See @ref writeData().
+ **/
+bool SessionCaptureWriter::writePixelFormat(const orv_communication_pixel_format_t& format, uint64_t timestampUs)
+{
+    if (!mIsCapturing) {
+        return true;
+    }
+    char payload[16];
+    vnc::writePixelFormat(payload, format);
+    std::lock_guard<std::mutex> lock(mMutex);
+    return writeRecordMutexLocked(CaptureRecordType::PixelFormat, payload, 16, timestampUs);
+}
+
+/**
+ * Finish the capture of the current connection, if any, and close the file.
+ **/
+void SessionCaptureWriter::endSession(uint64_t timestampUs)
+{
+    if (!mIsCapturing) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (writeRecordMutexLocked(CaptureRecordType::End, nullptr, 0, timestampUs)) {
+        closeMutexLocked();
+    }
+}
+
+bool SessionCaptureWriter::writeRecordMutexLocked(CaptureRecordType type, const char* payload, uint32_t payloadSize, uint64_t timestampUs)
+{
+    if (!mIsCapturing) {
+        // closed by another thread in the meantime
+        return true;
+    }
+    char header[ORV_CAPTURE_RECORD_HEADER_SIZE];
+    Writer::writeUInt8(header + 0, (uint8_t)type);
+    writeUInt64(header + 1, (timestampUs >= mStartTimeUs) ? (timestampUs - mStartTimeUs) : 0);
+    Writer::writeUInt32(header + 9, payloadSize);
+    bool ok = (fwrite(header, 1, ORV_CAPTURE_RECORD_HEADER_SIZE, mFile) == ORV_CAPTURE_RECORD_HEADER_SIZE);
+    if (ok && payloadSize > 0) {
+        ok = (fwrite(payload, 1, payloadSize, mFile) == payloadSize);
+    }
+    if (!ok) {
+        closeMutexLocked();
+    }
+    return ok;
+}
+
+
+SessionCaptureReader::~SessionCaptureReader()
+{
+    close();
+}
+
+/**
+ * Open the capture file @p fileName and read its header into @p header.
+ *
+ * @return TRUE on success, otherwise FALSE and @p error is set accordingly.
+ **/
+bool SessionCaptureReader::open(const char* fileName, CaptureHeader* header, orv_error_t* error)
+{
+    close();
+    mFile = fopen(fileName, "rb");
+    if (!mFile) {
+        orv_error_set(error, ORV_ERR_GENERIC, 0, "Failed to open capture file '%s', errno=%d", fileName, errno);
+        return false;
+    }
+    char buffer[ORV_CAPTURE_HEADER_SIZE];
+    if (fread(buffer, 1, ORV_CAPTURE_HEADER_SIZE, mFile) != ORV_CAPTURE_HEADER_SIZE || memcmp(buffer, ORV_CAPTURE_MAGIC, ORV_CAPTURE_MAGIC_LENGTH) != 0) {
+        orv_error_set(error, ORV_ERR_GENERIC, 0, "'%s' is not a capture file", fileName);
+        close();
+        return false;
+    }
+    header->mFramebufferWidth = Reader::readUInt16(buffer + 8);
+    header->mFramebufferHeight = Reader::readUInt16(buffer + 10);
+    readPixelFormat(&header->mPixelFormat, buffer + 12);
+    orv_error_reset(error);
+    return true;
+}
+
+void SessionCaptureReader::close()
+{
+    if (mFile) {
+        fclose(mFile);
+        mFile = nullptr;
+    }
+}
+
+/**
+ * Read the next record of the capture.
+ *
+ * @param payload Output parameter that receives the payload of the record, resized to the payload
+ *        size.
+ *
+ * @return TRUE if a record was read. FALSE at the end of the file, if the file is truncated
+ *         within the record or on error, only in the latter case @p error is set.
+ **/
+bool SessionCaptureReader::readRecord(CaptureRecordType* type, uint64_t* timestampUs, std::vector<char>* payload, orv_error_t* error)
+{
+    orv_error_reset(error);
+    if (!mFile) {
+        orv_error_set(error, ORV_ERR_GENERIC, 0, "No capture file opened");
+        return false;
+    }
+    char header[ORV_CAPTURE_RECORD_HEADER_SIZE];
+    if (fread(header, 1, ORV_CAPTURE_RECORD_HEADER_SIZE, mFile) != ORV_CAPTURE_RECORD_HEADER_SIZE) {
+        return false;
+    }
+    *type = (CaptureRecordType)Reader::readUInt8(header + 0);
+    *timestampUs = readUInt64(header + 1);
+    const uint32_t payloadSize = Reader::readUInt32(header + 9);
+    if (payloadSize > ORV_CAPTURE_MAX_RECORD_SIZE) {
+        orv_error_set(error, ORV_ERR_GENERIC, 0, "Invalid record size %u in capture file", (unsigned int)payloadSize);
+        return false;
+    }
+    payload->resize(payloadSize);
+    if (payloadSize > 0 && fread(payload->data(), 1, payloadSize, mFile) != payloadSize) {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Read the RFB PIXEL_FORMAT (16 bytes) in @p buffer into @p format.
+ **/
+void SessionCaptureReader::readPixelFormat(orv_communication_pixel_format_t* format, const char* buffer)
+{
+    format->mBitsPerPixel = Reader::readUInt8(buffer + 0);
+    format->mDepth = Reader::readUInt8(buffer + 1);
+    format->mBigEndian = (buffer[2] != 0);
+    format->mTrueColor = (buffer[3] != 0);
+    format->mColorMax[0] = Reader::readUInt16(buffer + 4);
+    format->mColorMax[1] = Reader::readUInt16(buffer + 6);
+    format->mColorMax[2] = Reader::readUInt16(buffer + 8);
+    format->mColorShift[0] = Reader::readUInt8(buffer + 10);
+    format->mColorShift[1] = Reader::readUInt8(buffer + 11);
+    format->mColorShift[2] = Reader::readUInt8(buffer + 12);
+}
+
+} // namespace vnc
+} // namespace openrv
+
@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2018 Monument-Software GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OPENRV_SESSIONCAPTURE_H
+#define OPENRV_SESSIONCAPTURE_H
+
+#include <libopenrv/libopenrv.h>
+
+#include <stdio.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+struct orv_error_t;
+
+/**
+ * Magic bytes at the start of every capture file, see @ref openrv::vnc::SessionCaptureWriter.
+ **/
+#define ORV_CAPTURE_MAGIC "ORVCAP01"
+#define ORV_CAPTURE_MAGIC_LENGTH 8
+/**
+ * Size of the header of a capture file, including @ref ORV_CAPTURE_MAGIC.
+ **/
+#define ORV_CAPTURE_HEADER_SIZE 32
+/**
+ * Size of the header of a single record in a capture file (type, timestamp and payload length).
+ **/
+#define ORV_CAPTURE_RECORD_HEADER_SIZE 13
+/**
+ * Maximum payload size of a single record that is accepted when reading a capture file. Data
+ * records never exceed the receive buffer of the connection thread, so larger values indicate a
+ * corrupt file.
+ **/
+#define ORV_CAPTURE_MAX_RECORD_SIZE (16*1024*1024)
+
+namespace openrv {
+namespace vnc {
+
+enum class CaptureRecordType
+{
+    /**
+     * Bytes received from the server, exactly as returned by a single read from the socket.
+     **/
+    Data = 1,
+    /**
+     * The client switched to a new pixel format (16 bytes, RFB PIXEL_FORMAT). Data records after
+     * this record have to be parsed using the new format.
+     **/
+    PixelFormat = 2,
+    /**
+     * The connection was closed. Captures without this record have been truncated (e.g. the
+     * application crashed), but are still usable.
+     **/
+    End = 3,
+};
+
+/**
+ * Parameters of a captured connection that are negotiated during the handshake, which itself is
+ * not part of the capture.
+ **/
+struct CaptureHeader
+{
+    uint16_t mFramebufferWidth = 0;
+    uint16_t mFramebufferHeight = 0;
+    orv_communication_pixel_format_t mPixelFormat;
+};
+
+/**
+ * Writes the server-to-client byte stream of a single connection to a capture file, so that the
+ * connection can later be replayed without a network using @ref SessionReplay.
+ *
+ * Only the data received after the handshake is captured, the parameters negotiated by the
+ * handshake are stored in the header of the file (see @ref CaptureHeader). All values are stored in
+ * network byte order:
+ * @li Header: @ref ORV_CAPTURE_MAGIC, framebuffer width and height (16 bit each), the pixel format
+ *     (RFB PIXEL_FORMAT, 16 bytes) and 4 reserved bytes.
+ * @li Followed by any number of records: type (8 bit, see @ref CaptureRecordType), timestamp in us
+ *     relative to the start of the capture (64 bit), payload length (32 bit) and the payload.
+ *
+ * The file is opened by @ref open() (normally by the application thread), the connection thread
+ * then starts the capture using @ref startSession() once the next connection has been established
+ * and ends it using @ref endSession() when the connection is closed, which also closes the file.
+ *
+ * This class is thread safe, it uses an internal mutex.
+ **/
+class SessionCaptureWriter
+{
+public:
+    SessionCaptureWriter();
+    ~SessionCaptureWriter();
+    SessionCaptureWriter(const SessionCaptureWriter&) = delete;
+    SessionCaptureWriter& operator=(const SessionCaptureWriter&) = delete;
+
+    bool open(const char* fileName, orv_error_t* error);
+    void close();
+    void startSession(uint16_t framebufferWidth, uint16_t framebufferHeight, const orv_communication_pixel_format_t& format, uint64_t timestampUs);
+    bool writeData(const char* buffer, uint32_t bufferSize, uint64_t timestampUs);
+    bool writePixelFormat(const orv_communication_pixel_format_t& format, uint64_t timestampUs);
+    void endSession(uint64_t timestampUs);
+
+private:
+    bool writeRecordMutexLocked(CaptureRecordType type, const char* payload, uint32_t payloadSize, uint64_t timestampUs);
+    void closeMutexLocked();
+
+private:
+    std::mutex mMutex;
+    /**
+     * TRUE while a connection is being captured. Allows @ref writeData() to return without locking
+     * @ref mMutex if no capture is active.
+     **/
+    std::atomic<bool> mIsCapturing;
+    FILE* mFile = nullptr;
+    uint64_t mStartTimeUs = 0;
+};
+
+/**
+ * Reads a capture file written by @ref SessionCaptureWriter.
+ **/
+class SessionCaptureReader
+{
+public:
+    SessionCaptureReader() = default;
+    ~SessionCaptureReader();
+    SessionCaptureReader(const SessionCaptureReader&) = delete;
+    SessionCaptureReader& operator=(const SessionCaptureReader&) = delete;
+
+    bool open(const char* fileName, CaptureHeader* header, orv_error_t* error);
+    void close();
+    bool readRecord(CaptureRecordType* type, uint64_t* timestampUs, std::vector<char>* payload, orv_error_t* error);
+
+    static void readPixelFormat(orv_communication_pixel_format_t* format, const char* buffer);
+
+private:
+    FILE* mFile = nullptr;
+};
+
+} // namespace vnc
+} // namespace openrv
+
+#endif
+
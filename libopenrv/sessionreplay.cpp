@@ -0,0 +1,201 @@
+/*
+ * Copyright (C) 2018 Monument-Software GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define ORV_LOG_FILE_CATEGORY ORV_LOG_CATEGORY_PARSER
+
+#include "sessionreplay.h"
+#include <libopenrv/orv_logging.h>
+#include <libopenrv/orv_error.h>
+#include <libopenrv/orv_errorcodes.h>
+#include "orv_context.h"
+#include "eventpool.h"
+#include "utils.h"
+
+#include <string.h>
+#include <chrono>
+#include <thread>
+
+#define UNUSED(x) (void)x
+
+namespace openrv {
+namespace vnc {
+
+/**
+ * Bytes per pixel of the framebuffer of the replay. Same format as the internal framebuffer of the
+ * connection thread.
+ **/
+static const uint8_t gReplayFramebufferBytesPerPixel = 3;
+
+SessionReplay::SessionReplay(orv_context_t* ctx)
+    : mContext(ctx),
+      mMessageFramebufferUpdate(ctx, &mFramebufferMutex, &mFramebufferMutex, &mFramebuffer, &mCursorData, &mCurrentPixelFormat, &mCurrentFramebufferWidth, &mCurrentFramebufferHeight),
+      mMessageSetColourMapEntries(ctx),
+      mMessageServerCutText(ctx),
+      mServerMessageReader(ctx, &mMessageFramebufferUpdate, &mMessageSetColourMapEntries, &mMessageServerCutText, this)
+{
+    memset(&mFramebuffer, 0, sizeof(orv_framebuffer_t));
+    memset(&mCursorData, 0, sizeof(orv_cursor_t));
+    orv_communication_pixel_format_reset(&mCurrentPixelFormat);
+}
+
+SessionReplay::~SessionReplay()
+{
+    free(mFramebuffer.mFramebuffer);
+    free(mCursorData.mCursor);
+}
+
+/**
+ * Replay the capture @p fileName.
+ *
+ * @param recordedSpeed If TRUE, the data is processed at the times it was received in the captured
+ *        connection. Otherwise the data is processed as fast as possible, which is normally used to
+ *        measure the decoding performance.
+ * @param result Output parameter that receives the results of the replay. Also set if the replay
+ *        fails, then it holds the results up to the error.
+ *
+ * @return TRUE on success, otherwise FALSE and @p error is set accordingly. A truncated capture is
+ *         @em not an error, see @ref SessionReplayResult::mComplete.
+ **/
+bool SessionReplay::replay(const char* fileName, bool recordedSpeed, SessionReplayResult* result, orv_error_t* error)
+{
+    *result = SessionReplayResult();
+    SessionCaptureReader reader;
+    CaptureHeader header;
+    if (!reader.open(fileName, &header, error)) {
+        return false;
+    }
+    const uint8_t bytesPerPixel = (uint8_t)((header.mPixelFormat.mBitsPerPixel + 7) / 8);
+    if (header.mFramebufferWidth == 0 || header.mFramebufferHeight == 0 ||
+            (uint64_t)header.mFramebufferWidth * header.mFramebufferHeight * bytesPerPixel > (uint64_t)ORV_MAX_FRAMEBUFFER_MEMORY) {
+        orv_error_set(error, ORV_ERR_GENERIC, 0, "Invalid framebuffer size %dx%d in capture file", (int)header.mFramebufferWidth, (int)header.mFramebufferHeight);
+        return false;
+    }
+    if (!OrvVncClient::isPixelFormatValidForReceive(header.mPixelFormat)) {
+        orv_error_set(error, ORV_ERR_GENERIC, 0, "Invalid pixel format in capture file");
+        return false;
+    }
+    result->mFramebufferWidth = header.mFramebufferWidth;
+    result->mFramebufferHeight = header.mFramebufferHeight;
+
+    {
+        std::lock_guard<std::mutex> lock(mFramebufferMutex);
+        free(mFramebuffer.mFramebuffer);
+        mFramebuffer.mWidth = header.mFramebufferWidth;
+        mFramebuffer.mHeight = header.mFramebufferHeight;
+        mFramebuffer.mBytesPerPixel = gReplayFramebufferBytesPerPixel;
+        mFramebuffer.mBitsPerPixel = gReplayFramebufferBytesPerPixel * 8;
+        mFramebuffer.mSize = (size_t)mFramebuffer.mWidth * mFramebuffer.mHeight * mFramebuffer.mBytesPerPixel;
+        mFramebuffer.mFramebuffer = (uint8_t*)calloc(mFramebuffer.mSize, 1);
+        if (!mFramebuffer.mFramebuffer) {
+            orv_error_set(error, ORV_ERR_GENERIC, 0, "Failed to allocate framebuffer of size %dx%d", (int)mFramebuffer.mWidth, (int)mFramebuffer.mHeight);
+            return false;
+        }
+    }
+    mCurrentFramebufferWidth = header.mFramebufferWidth;
+    mCurrentFramebufferHeight = header.mFramebufferHeight;
+    mCurrentPixelFormat = header.mPixelFormat;
+    mReceiveBuffer.clear();
+    mServerMessageReader.reset();
+    mMessageFramebufferUpdate.resetConnection();
+    mResult = result;
+
+    const uint64_t startUs = Utils::getTimestampUs();
+    std::vector<char> payload;
+    CaptureRecordType type = CaptureRecordType::Data;
+    uint64_t timestampUs = 0;
+    bool ok = true;
+    while (ok && reader.readRecord(&type, &timestampUs, &payload, error)) {
+        result->mRecords++;
+        result->mRecordedDurationUs = timestampUs;
+        if (recordedSpeed) {
+            const uint64_t nowUs = Utils::getTimestampUs();
+            if (startUs + timestampUs > nowUs) {
+                std::this_thread::sleep_for(std::chrono::microseconds(startUs + timestampUs - nowUs));
+            }
+        }
+        switch (type) {
+            case CaptureRecordType::Data:
+                result->mBytes += payload.size();
+                ok = processData(payload.data(), (uint32_t)payload.size(), result, error);
+                break;
+            case CaptureRecordType::PixelFormat:
+                if (payload.size() != 16) {
+                    orv_error_set(error, ORV_ERR_GENERIC, 0, "Invalid PixelFormat record of size %u in capture file", (unsigned int)payload.size());
+                    ok = false;
+                    break;
+                }
+                SessionCaptureReader::readPixelFormat(&mCurrentPixelFormat, payload.data());
+                if (!OrvVncClient::isPixelFormatValidForReceive(mCurrentPixelFormat)) {
+                    orv_error_set(error, ORV_ERR_GENERIC, 0, "Invalid pixel format in capture file");
+                    ok = false;
+                }
+                break;
+            case CaptureRecordType::End:
+                result->mComplete = true;
+                break;
+            default:
+                ORV_WARNING(mContext, "Ignoring unknown record type %d in capture file", (int)type);
+                break;
+        }
+    }
+    mResult = nullptr;
+    result->mReplayDurationUs = Utils::getTimestampUs() - startUs;
+    result->mStatistics = mMessageFramebufferUpdate.statistics();
+    if (error->mHasError) {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Append the @p bufferSize bytes of a Data record to @ref mReceiveBuffer and process all complete
+ * messages, like @ref openrv::vnc::ConnectionThread::handleConnectedSocketData() does.
+ **/
+bool SessionReplay::processData(const char* buffer, uint32_t bufferSize, SessionReplayResult* result, orv_error_t* error)
+{
+    const uint64_t startUs = Utils::getTimestampUs();
+    mReceiveBuffer.insert(mReceiveBuffer.end(), buffer, buffer + bufferSize);
+    const size_t offset = mServerMessageReader.processData(mReceiveBuffer.data(), mReceiveBuffer.size(), error);
+    if (error->mHasError) {
+        return false;
+    }
+    mReceiveBuffer.erase(mReceiveBuffer.begin(), mReceiveBuffer.begin() + offset);
+    result->mProcessingTimeUs += Utils::getTimestampUs() - startUs;
+    return true;
+}
+
+void SessionReplay::serverMessageStarted(ServerMessage messageType)
+{
+    UNUSED(messageType);
+}
+
+void SessionReplay::serverMessageFinished(ServerMessage messageType, orv_event_t* event)
+{
+    UNUSED(messageType);
+    mResult->mMessages++;
+    if (event) {
+        sendEvent(event);
+    }
+}
+
+void SessionReplay::sendEvent(orv_event_t* event)
+{
+    mContext->mConfig.mEventCallback(mContext, event);
+}
+
+} // namespace vnc
+} // namespace openrv
+
@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2018 Monument-Software GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OPENRV_SESSIONREPLAY_H
+#define OPENRV_SESSIONREPLAY_H
+
+#include "messageparser.h"
+#include "sessioncapture.h"
+
+#include <mutex>
+#include <vector>
+
+namespace openrv {
+namespace vnc {
+
+/**
+ * Results of a @ref SessionReplay::replay() call.
+ **/
+struct SessionReplayResult
+{
+    uint16_t mFramebufferWidth = 0;
+    uint16_t mFramebufferHeight = 0;
+    uint64_t mRecords = 0;
+    /**
+     * Number of bytes received from the server in the captured connection.
+     **/
+    uint64_t mBytes = 0;
+    /**
+     * Number of completely parsed server messages (of all types).
+     **/
+    uint64_t mMessages = 0;
+    /**
+     * TRUE if the capture ended with an End record, FALSE if the capture was truncated.
+     **/
+    bool mComplete = false;
+    /**
+     * Duration of the captured connection, i.e. the timestamp of the last record.
+     **/
+    uint64_t mRecordedDurationUs = 0;
+    /**
+     * Total duration of the replay, including reading the file and (for replays at the recorded
+     * speed) waiting.
+     **/
+    uint64_t mReplayDurationUs = 0;
+    /**
+     * Time spent parsing and decoding the messages, i.e. the time the connection thread would have
+     * spent processing the received data.
+     **/
+    uint64_t mProcessingTimeUs = 0;
+    /**
+     * Decoding statistics of the replay, see @ref MessageParserFramebufferUpdate::statistics().
+     * The latency fields are not used, as no requests are made.
+     **/
+    orv_statistics_t mStatistics = {};
+};
+
+/**
+ * Replays a connection captured by @ref SessionCaptureWriter without a network.
+ *
+ * The captured data is fed through the same @ref ServerMessageReader and message parsers the
+ * connection thread uses (in particular @ref MessageParserFramebufferUpdate) in exactly the same
+ * chunks as it was received,
+ * so replaying the same capture with different builds of the library allows to compare their
+ * decoding performance for the workload of the captured connection.
+ *
+ * The replay decodes into a framebuffer owned by this object. Events generated by the parsers are
+ * sent to the event callback of the context, so a dedicated context (that is not connected)
+ * should be used.
+ **/
+class SessionReplay : protected ServerMessageReader::Listener
+{
+public:
+    explicit SessionReplay(struct orv_context_t* ctx);
+    ~SessionReplay();
+    SessionReplay(const SessionReplay&) = delete;
+    SessionReplay& operator=(const SessionReplay&) = delete;
+
+    bool replay(const char* fileName, bool recordedSpeed, SessionReplayResult* result, orv_error_t* error);
+    const orv_framebuffer_t& framebuffer() const;
+
+protected:
+    virtual void serverMessageStarted(ServerMessage messageType) override;
+    virtual void serverMessageFinished(ServerMessage messageType, orv_event_t* event) override;
+
+private:
+    bool processData(const char* buffer, uint32_t bufferSize, SessionReplayResult* result, orv_error_t* error);
+    void sendEvent(orv_event_t* event);
+
+private:
+    struct orv_context_t* mContext = nullptr;
+    std::mutex mFramebufferMutex;
+    orv_framebuffer_t mFramebuffer;
+    orv_cursor_t mCursorData;
+    orv_communication_pixel_format_t mCurrentPixelFormat;
+    uint16_t mCurrentFramebufferWidth = 0;
+    uint16_t mCurrentFramebufferHeight = 0;
+    /**
+     * Data that has not been consumed by the parsers yet, like the receive buffer of the
+     * connection thread.
+     **/
+    std::vector<char> mReceiveBuffer;
+    /**
+     * The result of the current @ref replay() call.
+     **/
+    SessionReplayResult* mResult = nullptr;
+    MessageParserFramebufferUpdate mMessageFramebufferUpdate;
+    MessageParserSetColourMapEntries mMessageSetColourMapEntries;
+    MessageParserServerCutText mMessageServerCutText;
+    ServerMessageReader mServerMessageReader;
+};
+
+inline const orv_framebuffer_t& SessionReplay::framebuffer() const
+{
+    return mFramebuffer;
+}
+
+} // namespace vnc
+} // namespace openrv
+
+#endif
+
@@ -14,11 +14,16 @@
  * limitations under the License.
  */
 
+#define ORV_LOG_FILE_CATEGORY ORV_LOG_CATEGORY_SOCKET
+
 #include "socket.h"
 #include <libopenrv/libopenrv.h>
 #include "threadnotifier.h"
 #include "orvvncclientshareddata.h"
 #include "orvclientdefines.h"
+#include "utils.h"
+#include "memorypipe.h"
+#include "dnscache.h"
 #if defined(OPENRV_HAVE_MBEDTLS)
 #include "mbedtlscontext.h"
 #endif // OPENRV_HAVE_MBEDTLS
@@ -28,6 +33,7 @@
 
 #if !defined(_MSC_VER)
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <unistd.h>
 #include <netinet/tcp.h>
 #include <netdb.h>
@@ -45,19 +51,8 @@
 
 #if defined(_MSC_VER)
 #define ssize_t int
-static bool g_time_win32_time_initialized = false;
-static LARGE_INTEGER g_time_win32_performance_frequency; // # of ticks per second
 #endif // _MSC_VER
 
-#ifdef __MACH__
-// osx does not implement clock_gettime().
-#include <mach/mach_time.h>
-#include <mutex>
-static bool g_time_mach_time_initialized = false;
-static double g_time_mach_timebase = 0.0;
-static uint64_t g_time_mach_timestart = 0;
-#endif // __MACH__
-
 #if !defined(_MSC_VER)
 inline void closesocket(int fd)
 {
@@ -67,9 +62,14 @@ inline void closesocket(int fd)
 
 #define ORV_SUB_ERROR_CODE_READ_WRITE_TIMEOUT 100
 
+/**
+ * Delay between two parallel connection attempts in @ref
+ * openrv::Socket::makeSocketAndConnectBlockingTo(). RFC 8305 recommends 250ms.
+ **/
+#define ORV_CONNECTION_ATTEMPT_DELAY_US (250 * 1000)
+
 namespace openrv {
 
-static uint64_t getTimestampUs();
 static void makeTimeout(uint64_t* timeoutSec, uint64_t* timeoutUsec, uint64_t lastActivityTimeUs, uint64_t currentTimeUs, uint64_t timeoutUs);
 static int getLastErrorCode();
 
@@ -86,6 +86,7 @@ Socket::Socket(orv_context_t* ctx, ThreadNotifierListener* pipeListener, vnc::Or
 {
     mCommunicationDataMutex = &communicationData->mMutex;
     mCommunicationDataUserRequestedDisconnect = &communicationData->mUserRequestedDisconnect;
+    orv_socket_options_default(&mSocketOptions);
 }
 
 /**
@@ -97,6 +98,7 @@ Socket::Socket(orv_context_t* ctx, ThreadNotifierListener* pipeListener, std::mu
       mCommunicationDataMutex(sharedDataMutex),
       mCommunicationDataUserRequestedDisconnect(sharedDataUserRequestedDisconnect)
 {
+    orv_socket_options_default(&mSocketOptions);
 }
 
 Socket::~Socket()
@@ -108,7 +110,8 @@ Socket::~Socket()
  * Request and initialize a socket, i.e. call @ref ::socket() and set initial options. Initial
  * options most notably include
  * - timeout, see @ref timeoutSeconds()
- * - disable Nagle's algorithm
+ * - disable Nagle's algorithm (unless disabled in @ref setSocketOptions())
+ * - the remaining options of @ref setSocketOptions()
  *
  * NOTE: This function is normally not used directly, but internally by @ref
  * makeSocketAndConnectBlockingTo(), because it requires the address/protocol family (which is
@@ -144,7 +147,37 @@ bool Socket::makeSocket(int addressFamily, orv_error_t* error)
         orv_error_set(error, ORV_ERR_CONNECT_ERROR_GENERIC, 0, "Failed to create socket");
         return false;
     }
+    mTransportType = (addressFamily == AF_INET || addressFamily == AF_INET6) ? TransportType::Tcp : TransportType::UnixDomain;
+    return setupSocketFd(error);
+}
+
+/**
+ * Take ownership of the already connected @p fd (e.g. obtained from @ref
+ * MemoryPipeListener::connectTo()) and set it up like a socket created by @ref makeSocket().
+ *
+ * @return TRUE on success, FALSE on error. On error, @p fd is closed.
+ **/
+bool Socket::openConnectedFd(int fd, TransportType transportType, orv_error_t* error)
+{
+    if (isOpened()) {
+        closesocket(fd);
+        orv_error_set(error, ORV_ERR_CONNECT_ERROR_GENERIC, 0, "Internal error: Unable to open new socket, another socket already opened");
+        return false;
+    }
+    resetStatistics();
+    mSocketFd = fd;
+    mTransportType = transportType;
+    return setupSocketFd(error);
+}
 
+/**
+ * Internal helper function for @ref makeSocket() and @ref openConnectedFd() that sets the
+ * initial options of the freshly created @ref mSocketFd.
+ *
+ * On failure, the socket is closed.
+ **/
+bool Socket::setupSocketFd(orv_error_t* error)
+{
     // Make socket non-blocking
 #if !defined(_MSC_VER)
     {
@@ -187,13 +220,17 @@ bool Socket::makeSocket(int addressFamily, orv_error_t* error)
     // NOTE: This implies that send(sock, buffer, 1, flags); send(sock, buffer, 1, flags); are very
     //       bad. Instead only a single send() should be used.
     int flag = 1;
-    if (setsockopt(mSocketFd, IPPROTO_TCP, TCP_NODELAY, (char*)&flag, sizeof(int)) < 0) { // NOTE: win32 takes char* instead of void*
-        orv_error_set(error, ORV_ERR_CONNECT_ERROR_GENERIC, 1, "Failed to disable Nagle's algorithm on socket");
-        closesocket(mSocketFd);
-        mSocketFd = -1;
-        return false;
+    if (mTransportType == TransportType::Tcp && mSocketOptions.mTcpNoDelay) {
+        if (setsockopt(mSocketFd, IPPROTO_TCP, TCP_NODELAY, (char*)&flag, sizeof(int)) < 0) { // NOTE: win32 takes char* instead of void*
+            orv_error_set(error, ORV_ERR_CONNECT_ERROR_GENERIC, 1, "Failed to disable Nagle's algorithm on socket");
+            closesocket(mSocketFd);
+            mSocketFd = -1;
+            return false;
+        }
     }
 
+    applyOptionalSocketOptions();
+
 #ifdef SO_NOSIGPIPE
     // Do not send SIGPIPE on send() if socket was closed by remote
     flag = 1;
@@ -313,12 +350,12 @@ bool Socket::writeDataBlocking(const void* buf, size_t nbyte, orv_error_t* error
             return true;
         }
         if (s > 0 || lastActivityTimeUs == 0) {
-            lastActivityTimeUs = getTimestampUs();
+            lastActivityTimeUs = Utils::getTimestampUs();
         }
 
         uint64_t currentTimeUs = lastActivityTimeUs; // if s>0, no timeout possible (timeout==0 not supported)
         if (s <= 0) {
-            uint64_t currentTimeUs = getTimestampUs();
+            uint64_t currentTimeUs = Utils::getTimestampUs();
             uint64_t timeDiffUs = (currentTimeUs - lastActivityTimeUs);
             if (timeDiffUs > socketWriteTimeoutUs()) {
                 orv_error_set(error, ORV_ERR_WRITE_FAILED, ORV_SUB_ERROR_CODE_READ_WRITE_TIMEOUT, "Timeout trying to write %u bytes to socket, only %u bytes sent so far.", (unsigned int)nbyte, (unsigned int)sentBytes);
@@ -412,12 +449,12 @@ bool Socket::readDataBlocking(void* buf, size_t nbyte, orv_error_t* error)
             return true;
         }
         if (s > 0 || lastActivityTimeUs == 0) {
-            lastActivityTimeUs = getTimestampUs();
+            lastActivityTimeUs = Utils::getTimestampUs();
         }
 
         uint64_t currentTimeUs = lastActivityTimeUs; // if s>0, no timeout possible (timeout==0 not supported)
         if (s <= 0) {
-            uint64_t currentTimeUs = getTimestampUs();
+            uint64_t currentTimeUs = Utils::getTimestampUs();
             uint64_t timeDiffUs = (currentTimeUs - lastActivityTimeUs);
             if (timeDiffUs > socketReadTimeoutUs()) {
                 orv_error_set(error, ORV_ERR_READ_FAILED, ORV_SUB_ERROR_CODE_READ_WRITE_TIMEOUT, "Timeout trying to read %u bytes from socket, only %u bytes read so far.", (unsigned int)nbyte, (unsigned int)readBytes);
@@ -534,6 +571,13 @@ uint32_t Socket::readAvailableDataNonBlocking(void* buf, size_t nbyte, SendRecvS
  * Connect to the remote server and block until the connect has finished, either successfully or
  * with failure. This function assumes the internal socket was not yet created.
  *
+ * The host name is resolved using the process-wide @ref DnsCache. If multiple addresses are
+ * found, connection attempts are made in parallel following RFC 8305 ("Happy Eyeballs v2"): The
+ * address families are interleaved (starting with the most preferred one as returned by
+ * getaddrinfo()) and a new attempt is started every @ref ORV_CONNECTION_ATTEMPT_DELAY_US
+ * microseconds or as soon as the previous attempt failed. The first attempt that succeeds is used,
+ * all others are closed. This avoids long connect times on dual-stack networks with broken IPv6.
+ *
  * This function uses non-blocking sockets internally and select() to wait for the results. In
  * addition, the select() also listens on @ref ThreadNotifierListener which is used to abort a
  * connection (see @ref orv_disconnect()).
@@ -548,52 +592,424 @@ bool Socket::makeSocketAndConnectBlockingTo(const char* hostName, uint16_t port,
         return false;
     }
 
-    char portString[11] = {};
-    snprintf(portString, 10, "%d", (int)port);
-
-    struct addrinfo hints;
-    memset(&hints, 0, sizeof(struct addrinfo));
-    hints.ai_family = AF_UNSPEC;
-    hints.ai_socktype = SOCK_STREAM;
-    hints.ai_protocol = IPPROTO_TCP;
-    hints.ai_flags = 0; // FIXME:  AI_DEFAULT is not available on windows, is 0 sufficient?
-    struct addrinfo* firstInfo = nullptr;
-    int ret = getaddrinfo(hostName, portString, &hints, &firstInfo);
-    if (ret != 0 || !firstInfo) {
-        if (firstInfo) {
-            freeaddrinfo(firstInfo);
-        }
-        orv_error_set(error, ORV_ERR_CONNECT_ERROR_NO_SUCH_HOST, 0, "No such host: '%s'", hostName);
+    std::vector<ResolvedAddress> addresses;
+    if (!DnsCache::resolve(hostName, port, &addresses, error)) {
         return false;
     }
+    sortAddressesForConnect(&addresses);
+
+#if !defined(_MSC_VER)
+    const bool connected = connectParallelBlocking(addresses, hostName, port, error);
+#else // _MSC_VER
+    // TODO: parallel attempts on windows (requires one WSAEVENT per attempt). For now try the
+    //       addresses one after another.
+    bool connected = false;
+    for (const ResolvedAddress& address : addresses) {
+        orv_error_reset(error);
+        if (!makeSocket(address.mAddress.ss_family, error)) {
+            ORV_ERROR(mContext, "Failed to create socket.");
+            return false;
+        }
+        if (connectSocketBlocking((const sockaddr*)&address.mAddress, address.mAddressLength, hostName, port, error)) {
+            connected = true;
+            break;
+        }
+        close();
+        if (error->mErrorCode == ORV_ERR_USER_INTERRUPTION) {
+            return false;
+        }
+    }
+#endif // _MSC_VER
+    if (!connected && error->mErrorCode != ORV_ERR_USER_INTERRUPTION) {
+        // Host may have moved, do not keep a possibly outdated result.
+        DnsCache::invalidate(hostName, port);
+    }
+    return connected;
+}
+
+/**
+ * Reorder @p addresses as recommended by RFC 8305 section 4: Interleave the address families,
+ * starting with the family of the first (i.e. most preferred) address. The relative order of the
+ * addresses of each family is kept.
+ **/
+void Socket::sortAddressesForConnect(std::vector<ResolvedAddress>* addresses)
+{
+    if (addresses->size() <= 1) {
+        return;
+    }
+    const int firstFamily = addresses->front().mAddress.ss_family;
+    std::vector<ResolvedAddress> first;
+    std::vector<ResolvedAddress> second;
+    for (const ResolvedAddress& address : *addresses) {
+        if (address.mAddress.ss_family == firstFamily) {
+            first.push_back(address);
+        }
+        else {
+            second.push_back(address);
+        }
+    }
+    addresses->clear();
+    for (size_t i = 0; i < std::max(first.size(), second.size()); i++) {
+        if (i < first.size()) {
+            addresses->push_back(first[i]);
+        }
+        if (i < second.size()) {
+            addresses->push_back(second[i]);
+        }
+    }
+}
+
+#if !defined(_MSC_VER)
+/**
+ * Internal helper function for @ref makeSocketAndConnectBlockingTo() that performs the parallel
+ * connection attempts to @p addresses (in the given order).
+ *
+ * On success the winning socket is stored in @ref mSocketFd, all other sockets are closed.
+ *
+ * @param hostName, port Used for error messages only.
+ **/
+bool Socket::connectParallelBlocking(const std::vector<ResolvedAddress>& addresses, const char* hostName, uint16_t port, orv_error_t* error)
+{
+    struct PendingAttempt
+    {
+        int mFd;
+        size_t mAddressIndex;
+    };
+    std::vector<PendingAttempt> pending;
+    auto closePending = [&pending]() {
+        for (const PendingAttempt& attempt : pending) {
+            closesocket(attempt.mFd);
+        }
+        pending.clear();
+    };
+
+    const uint64_t startTimeUs = Utils::getTimestampUs();
+    uint64_t nextAttemptTimeUs = startTimeUs;
+    size_t nextAddressIndex = 0;
+    int lastConnectError = 0;
+    while (true) {
+        const uint64_t currentTimeUs = Utils::getTimestampUs();
+        if (currentTimeUs - startTimeUs > socketConnectTimeoutUs()) {
+            closePending();
+            orv_error_set(error, ORV_ERR_CONNECT_ERROR_TIMEOUT, 0, "Connection to %s:%d failed, connect timeout", hostName, (int)port);
+            return false;
+        }
+
+        // Start the next attempt if the delay has passed or no attempt is running anymore.
+        while (nextAddressIndex < addresses.size() && (pending.empty() || currentTimeUs >= nextAttemptTimeUs)) {
+            const ResolvedAddress& address = addresses[nextAddressIndex];
+            const size_t addressIndex = nextAddressIndex;
+            nextAddressIndex++;
+            nextAttemptTimeUs = currentTimeUs + ORV_CONNECTION_ATTEMPT_DELAY_US;
+            if (!makeSocket(address.mAddress.ss_family, error)) {
+                closePending();
+                ORV_ERROR(mContext, "Failed to create socket.");
+                return false;
+            }
+            const int fd = mSocketFd;
+            mSocketFd = -1;
+            if (connect(fd, (const sockaddr*)&address.mAddress, address.mAddressLength) == 0) {
+                // call succeeded immediately
+                closePending();
+                mSocketFd = fd;
+                return true;
+            }
+            const int lastError = getLastErrorCode();
+            if (lastError != EINPROGRESS) {
+                closesocket(fd);
+                lastConnectError = lastError;
+                continue;
+            }
+            ORV_DEBUG(mContext, "Started connection attempt %d to %s:%d", (int)(addressIndex + 1), hostName, (int)port);
+            pending.push_back(PendingAttempt{fd, addressIndex});
+            break;
+        }
+        if (pending.empty()) {
+            // All addresses failed immediately.
+            makeConnectError(error, hostName, port, lastConnectError);
+            return false;
+        }
 
-    struct sockaddr_storage serverAddr;
-    socklen_t serverAddrLen = 0;
-    for (struct addrinfo* addr = firstInfo; addr; addr = addr->ai_next) {
-        if (addr->ai_family != AF_INET && addr->ai_family != AF_INET6) {
-            ORV_DEBUG(mContext, "Ignoring addrinfo with unexpected ai_family %x", (int)addr->ai_family);
+        fd_set readfds;
+        fd_set writefds;
+        FD_ZERO(&readfds);
+        FD_ZERO(&writefds);
+        const int pipeFd = mPipeListener->pipeReadFd();
+        FD_SET(pipeFd, &readfds);
+        int nfds = pipeFd;
+        for (const PendingAttempt& attempt : pending) {
+            FD_SET(attempt.mFd, &writefds);
+            nfds = std::max(nfds, attempt.mFd);
+        }
+        uint64_t timeoutSec = 0;
+        uint64_t timeoutUsec = 0;
+        makeTimeout(&timeoutSec, &timeoutUsec, startTimeUs, currentTimeUs, socketConnectTimeoutUs());
+        if (nextAddressIndex < addresses.size()) {
+            const uint64_t untilNextAttemptUs = nextAttemptTimeUs > currentTimeUs ? nextAttemptTimeUs - currentTimeUs : 0;
+            if (untilNextAttemptUs < timeoutSec * 1000 * 1000 + timeoutUsec) {
+                timeoutSec = untilNextAttemptUs / (1000 * 1000);
+                timeoutUsec = untilNextAttemptUs % (1000 * 1000);
+            }
+        }
+        struct timeval timeout;
+        timeout.tv_sec = timeoutSec;
+        timeout.tv_usec = timeoutUsec;
+        int ret = select(nfds + 1, &readfds, &writefds, nullptr, &timeout);
+        if (ret < 0) {
+            const int lastError = getLastErrorCode();
+            if (lastError == EINTR) {
+                continue;
+            }
+            closePending();
+            makeConnectSelectError(error, hostName, port, lastError);
+            return false;
+        }
+        if (ret == 0) {
             continue;
         }
-        // use first suitable entry.
-        memcpy(&serverAddr, addr->ai_addr, addr->ai_addrlen);
-        serverAddrLen = addr->ai_addrlen;
-        break;
+        if (FD_ISSET(pipeFd, &readfds)) {
+            mPipeListener->swallowPipeData();
+            bool wantAbort = false;
+            mCommunicationDataMutex->lock();
+            wantAbort = *mCommunicationDataUserRequestedDisconnect;
+            mCommunicationDataMutex->unlock();
+            if (wantAbort) {
+                closePending();
+                orv_error_set(error, ORV_ERR_USER_INTERRUPTION, 0, ORV_ERROR_MSG_USER_INTERRUPTION);
+                return false;
+            }
+        }
+        for (size_t i = 0; i < pending.size(); ) {
+            const PendingAttempt attempt = pending[i];
+            if (!FD_ISSET(attempt.mFd, &writefds)) {
+                i++;
+                continue;
+            }
+            int socketError = 0;
+            socklen_t optLen = sizeof(int);
+            if (getsockopt(attempt.mFd, SOL_SOCKET, SO_ERROR, &socketError, &optLen) != 0) {
+                socketError = getLastErrorCode();
+            }
+            if (socketError == 0) {
+                ORV_DEBUG(mContext, "Connection attempt %d to %s:%d succeeded", (int)(attempt.mAddressIndex + 1), hostName, (int)port);
+                pending.erase(pending.begin() + i);
+                closePending();
+                mSocketFd = attempt.mFd;
+                return true;
+            }
+            ORV_DEBUG(mContext, "Connection attempt %d to %s:%d failed, errno=%d", (int)(attempt.mAddressIndex + 1), hostName, (int)port, socketError);
+            closesocket(attempt.mFd);
+            lastConnectError = socketError;
+            pending.erase(pending.begin() + i);
+            // RFC 8305: Start the next attempt immediately when an attempt fails.
+            nextAttemptTimeUs = 0;
+        }
+    }
+}
+#endif // !_MSC_VER
+
+/**
+ * Internal helper function for @ref setupSocketFd() that applies the options of @ref
+ * mSocketOptions other than TCP_NODELAY.
+ *
+ * These options are hints only: Failure to set an option is logged, but does not fail the
+ * connection. The values in effect can be queried using @ref queryEffectiveSocketOptions().
+ **/
+void Socket::applyOptionalSocketOptions()
+{
+    // NOTE: Buffer sizes must be set before connect(), so that the TCP window scale option is
+    //       negotiated accordingly.
+    if (mSocketOptions.mReceiveBufferSize > 0) {
+        int size = mSocketOptions.mReceiveBufferSize;
+        if (setsockopt(mSocketFd, SOL_SOCKET, SO_RCVBUF, (char*)&size, sizeof(int)) < 0) {
+            ORV_WARNING(mContext, "Failed to set receive buffer size to %d, errno=%d", size, getLastErrorCode());
+        }
+    }
+    if (mSocketOptions.mSendBufferSize > 0) {
+        int size = mSocketOptions.mSendBufferSize;
+        if (setsockopt(mSocketFd, SOL_SOCKET, SO_SNDBUF, (char*)&size, sizeof(int)) < 0) {
+            ORV_WARNING(mContext, "Failed to set send buffer size to %d, errno=%d", size, getLastErrorCode());
+        }
     }
-    if (firstInfo) {
-        freeaddrinfo(firstInfo);
+    if (mTransportType != TransportType::Tcp) {
+        return;
     }
+#if defined(__linux__)
+    if (mSocketOptions.mTcpQuickAck) {
+        int flag = 1;
+        if (setsockopt(mSocketFd, IPPROTO_TCP, TCP_QUICKACK, &flag, sizeof(int)) < 0) {
+            ORV_WARNING(mContext, "Failed to enable TCP_QUICKACK, errno=%d", getLastErrorCode());
+        }
+        mQuickAckArmed = true;
+    }
+    if (mSocketOptions.mBusyPollUs > 0) {
+        int busyPollUs = (int)std::min(mSocketOptions.mBusyPollUs, (uint32_t)INT32_MAX);
+        if (setsockopt(mSocketFd, SOL_SOCKET, SO_BUSY_POLL, &busyPollUs, sizeof(int)) < 0) {
+            ORV_WARNING(mContext, "Failed to set SO_BUSY_POLL to %d us, errno=%d", busyPollUs, getLastErrorCode());
+        }
+    }
+#endif // __linux__
+}
 
-    if (serverAddrLen <= 0) {
-        orv_error_set(error, ORV_ERR_CONNECT_ERROR_NO_SUCH_HOST, 0, "No such host: '%s' (no supported address family found for host)", hostName);
-        return false;
+/**
+ * Set the @p options that are applied to sockets created by this object.
+ *
+ * NOTE: The options are applied when a new socket is created only, i.e. this must be called before
+ *       connecting.
+ **/
+void Socket::setSocketOptions(const orv_socket_options_t& options)
+{
+    mSocketOptions = options;
+}
+
+/**
+ * Query the socket options that are currently in effect on the socket from the operating system
+ * and write them to @p options.
+ *
+ * If no socket is open, @p options is reset to all zeros. Options that are not supported on this
+ * platform or by the current transport are reported as 0.
+ *
+ * NOTE: TCP_QUICKACK is not a persistent flag in the kernel, the value reported is whether the
+ *       socket is currently in quick ACK mode.
+ **/
+void Socket::queryEffectiveSocketOptions(orv_socket_options_t* options) const
+{
+    memset(options, 0, sizeof(orv_socket_options_t));
+    if (mSocketFd == -1) {
+        return;
+    }
+    int value = 0;
+    socklen_t len = sizeof(int);
+    if (getsockopt(mSocketFd, SOL_SOCKET, SO_RCVBUF, (char*)&value, &len) == 0) {
+        options->mReceiveBufferSize = value;
     }
+    value = 0;
+    len = sizeof(int);
+    if (getsockopt(mSocketFd, SOL_SOCKET, SO_SNDBUF, (char*)&value, &len) == 0) {
+        options->mSendBufferSize = value;
+    }
+    if (mTransportType != TransportType::Tcp) {
+        return;
+    }
+    value = 0;
+    len = sizeof(int);
+    if (getsockopt(mSocketFd, IPPROTO_TCP, TCP_NODELAY, (char*)&value, &len) == 0) {
+        options->mTcpNoDelay = value ? 1 : 0;
+    }
+#if defined(__linux__)
+    value = 0;
+    len = sizeof(int);
+    if (getsockopt(mSocketFd, IPPROTO_TCP, TCP_QUICKACK, &value, &len) == 0) {
+        options->mTcpQuickAck = value ? 1 : 0;
+    }
+    value = 0;
+    len = sizeof(int);
+    if (getsockopt(mSocketFd, SOL_SOCKET, SO_BUSY_POLL, &value, &len) == 0) {
+        options->mBusyPollUs = (uint32_t)value;
+    }
+#endif // __linux__
+}
+
+/**
+ * Called by the user of this object whenever a complete message has been received, so that the
+ * next receive re-arms TCP_QUICKACK (if requested).
+ *
+ * NOTE: The kernel leaves quick ACK mode on its own, so the option has to be set again
+ *       repeatedly. Doing so once per message (rather than after every receive) keeps the number of
+ *       syscalls low for messages that arrive in many chunks.
+ **/
+void Socket::notifyMessageReceived()
+{
+    mQuickAckArmed = false;
+}
+
+/**
+ * Connect to the specified transport and block until the connect has finished, either
+ * successfully or with failure.
+ *
+ * @param address The host name for @ref TransportType::Tcp, the socket path for @ref
+ *        TransportType::UnixDomain or the listener name for @ref TransportType::MemoryPipe.
+ * @param port The port for @ref TransportType::Tcp, ignored otherwise.
+ *
+ * @return TRUE if the connection has been established, otherwise FALSE. If this function returns
+ *         FALSE, @p error will hold the reason for failure.
+ **/
+bool Socket::connectBlocking(TransportType transportType, const char* address, uint16_t port, orv_error_t* error)
+{
+    switch (transportType) {
+        case TransportType::Tcp:
+            return makeSocketAndConnectBlockingTo(address, port, error);
+        case TransportType::UnixDomain:
+            return makeSocketAndConnectBlockingToUnixSocket(address, error);
+        case TransportType::MemoryPipe:
+            return connectToMemoryPipe(address, error);
+    }
+    orv_error_set(error, ORV_ERR_CONNECT_ERROR_GENERIC, 0, "Internal error: Invalid transport type %d", (int)transportType);
+    return false;
+}
 
-    if (!makeSocket(serverAddr.ss_family, error)) {
+/**
+ * Connect to the unix-domain stream socket at @p path and block until the connect has finished.
+ * This function assumes the internal socket was not yet created.
+ *
+ * @return TRUE if the connection has been established, otherwise FALSE. If this function returns
+ *         FALSE, @p error will hold the reason for failure.
+ **/
+bool Socket::makeSocketAndConnectBlockingToUnixSocket(const char* path, orv_error_t* error)
+{
+#if defined(_MSC_VER)
+    orv_error_set(error, ORV_ERR_CONNECT_ERROR_GENERIC, 0, "Unix-domain sockets are not supported on this platform");
+    return false;
+#else // _MSC_VER
+    if (isOpened()) {
+        orv_error_set(error, ORV_ERR_CONNECT_ERROR_GENERIC, 0, "Internal error: Unable to open new socket, another socket already opened");
+        return false;
+    }
+    struct sockaddr_un serverAddr;
+    memset(&serverAddr, 0, sizeof(serverAddr));
+    serverAddr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(serverAddr.sun_path)) {
+        orv_error_set(error, ORV_ERR_CONNECT_ERROR_NO_SUCH_HOST, 0, "Unix socket path too long: '%s'", path);
+        return false;
+    }
+    strncpy(serverAddr.sun_path, path, sizeof(serverAddr.sun_path) - 1);
+    if (!makeSocket(AF_UNIX, error)) {
         ORV_ERROR(mContext, "Failed to create socket.");
         return false;
     }
+    return connectSocketBlocking((const sockaddr*)&serverAddr, sizeof(serverAddr), path, 0, error);
+#endif // _MSC_VER
+}
+
+/**
+ * Connect to the in-process @ref MemoryPipeListener with the specified @p name. This function
+ * never blocks, the listener accepts connections asynchronously.
+ *
+ * @return TRUE if the connection has been established, otherwise FALSE. If this function returns
+ *         FALSE, @p error will hold the reason for failure.
+ **/
+bool Socket::connectToMemoryPipe(const char* name, orv_error_t* error)
+{
+    if (isOpened()) {
+        orv_error_set(error, ORV_ERR_CONNECT_ERROR_GENERIC, 0, "Internal error: Unable to open new socket, another socket already opened");
+        return false;
+    }
+    int fd = MemoryPipeListener::connectTo(name, error);
+    if (fd == -1) {
+        return false;
+    }
+    return openConnectedFd(fd, TransportType::MemoryPipe, error);
+}
 
-    if (connect(mSocketFd, (const sockaddr*)&serverAddr, serverAddrLen) == 0) {
+/**
+ * Internal helper function that calls connect() on the (non-blocking) @ref mSocketFd and waits
+ * until the connect has finished.
+ *
+ * @param hostName, port Used for error messages only.
+ **/
+bool Socket::connectSocketBlocking(const struct sockaddr* address, size_t addressLength, const char* hostName, uint16_t port, orv_error_t* error)
+{
+    if (connect(mSocketFd, address, (socklen_t)addressLength) == 0) {
         // call succeeded immediately
         // NOTE: this rarely happens, normally we have EINPROGRESS for non-blocking socets
         return true;
@@ -616,14 +1032,14 @@ bool Socket::makeSocketAndConnectBlockingTo(const char* hostName, uint16_t port,
         }
     }
 
-    const uint64_t startTimeUs = getTimestampUs();
+    const uint64_t startTimeUs = Utils::getTimestampUs();
     uint64_t currentTimeUs = 0;
     while (true) {
         if (currentTimeUs == 0) {
             currentTimeUs = startTimeUs;
         }
         else {
-            currentTimeUs = getTimestampUs();
+            currentTimeUs = Utils::getTimestampUs();
             uint64_t timeDiffUs = (currentTimeUs - startTimeUs);
             if (timeDiffUs > socketConnectTimeoutUs()) {
                 orv_error_set(error, ORV_ERR_CONNECT_ERROR_TIMEOUT, 0, "Connection to %s:%d failed, connect timeout", hostName, (int)port);
@@ -704,6 +1120,30 @@ void Socket::resetStatistics()
     mSentBytes = 0;
 }
 
+/**
+ * @return The smoothed round trip time of the connection in us, as estimated by the TCP stack of the
+ *         OS. 0 if the socket is not opened or if the estimate is not available on this platform.
+ *
+ * NOTE: Currently implemented on linux only (TCP_INFO). This is a syscall, callers that use this
+ *       value frequently should cache it.
+ **/
+uint64_t Socket::roundTripTimeUs() const
+{
+    if (mSocketFd == -1 || mTransportType != TransportType::Tcp) {
+        return 0;
+    }
+#if defined(__linux__)
+    struct tcp_info info;
+    socklen_t len = sizeof(info);
+    if (getsockopt(mSocketFd, IPPROTO_TCP, TCP_INFO, &info, &len) != 0) {
+        return 0;
+    }
+    return (uint64_t)info.tcpi_rtt;
+#else // __linux__
+    return 0;
+#endif // __linux__
+}
+
 /**
  * @param errorCode The error code to make the error for, either errno (on unix) or
  *        WSAGetLastError() (on windows).
@@ -982,57 +1422,6 @@ static int getLastErrorCode()
 #endif // _MSC_VER
 }
 
-/**
- * Get current time (relative to an @em undefined clock, i.e. can not be used as some kind of
- * calender time) in us. This value is meant to be @em monotonic.
- **/
-static uint64_t getTimestampUs()
-{
-#if defined(_MSC_VER)
-    // win32 does not have clock_gettime()
-    // NOTE: QueryPerformanceCounter() and QueryPerformanceFrequency() may return non-zero
-    //       on windows before XP only.
-    //       on systems >= XP we can assume they always succeed.
-    //       we do not support systems prior XP anyway.
-    if (!g_time_win32_time_initialized) {
-        std::atomic_thread_fence(std::memory_order_acquire); // the READ operation (on g_time_win32_time_initialized) must not be performed after this point
-        static std::mutex m;
-        std::lock_guard<std::mutex> lock(m);
-        if (!g_time_win32_time_initialized) {
-            QueryPerformanceFrequency(&g_time_win32_performance_frequency);
-            g_time_win32_time_initialized = true;
-        }
-    }
-    LARGE_INTEGER t;
-    QueryPerformanceCounter(&t);
-    return (uint64_t)((t.QuadPart * 1000 * 1000) / g_time_win32_performance_frequency.QuadPart);
-#elif defined(__MACH__)
-    // MACH (OSX, iOS) does not implement clock_gettime()
-    if (!g_time_mach_time_initialized) {
-        // initialize global variables on the first call
-        // NOTE: See also https://developer.apple.com/library/mac/qa/qa1398/_index.html
-        std::atomic_thread_fence(std::memory_order_acquire); // the READ operation (on g_time_mach_time_initialized) must not be performed after this point
-        static std::mutex m;
-        std::lock_guard<std::mutex> lock(m);
-        if (!g_time_mach_time_initialized) {
-            mach_timebase_info_data_t t;
-            mach_timebase_info(&t);
-            g_time_mach_timebase = t.numer;
-            g_time_mach_timebase /= t.denom;
-            g_time_mach_timestart = mach_absolute_time();
-            std::atomic_thread_fence(std::memory_order_release); // the READ/WRITE operations must not be performed after the following WRITE operation(s) (on g_time_mach_time_initialized).
-            g_time_mach_time_initialized = true;
-        }
-    }
-    uint64_t diffNano = (mach_absolute_time() - g_time_mach_timestart) * g_time_mach_timebase;
-    return diffNano / 1000;
-#else
-    struct timespec ts;
-    clock_gettime(CLOCK_MONOTONIC, &ts);
-    return ts.tv_sec * 1000 * 1000 + ts.tv_nsec / 1000;
-#endif
-}
-
 inline static void makeTimeout(uint64_t* timeoutSec, uint64_t* timeoutUsec, uint64_t lastActivityTimeUs, uint64_t currentTimeUs, uint64_t timeoutUs)
 {
     if (currentTimeUs < lastActivityTimeUs) {
@@ -1088,6 +1477,15 @@ SendRecvSocketError Socket::receiveData(void* buf, size_t nbyte, ssize_t* bytesR
         return SendRecvSocketError::ClosedByRemote;
     }
     if (s > 0) {
+#if defined(__linux__)
+        if (mSocketOptions.mTcpQuickAck && !mQuickAckArmed && mTransportType == TransportType::Tcp) {
+            // TCP_QUICKACK is reset by the kernel when it enters delayed-ACK mode again, so it
+            // is re-armed on the first data of each message, see notifyMessageReceived().
+            int flag = 1;
+            setsockopt(mSocketFd, IPPROTO_TCP, TCP_QUICKACK, &flag, sizeof(int));
+            mQuickAckArmed = true;
+        }
+#endif // __linux__
         return SendRecvSocketError::NoError;
     }
     *lastError = getLastErrorCode();
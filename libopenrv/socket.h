@@ -17,13 +17,17 @@
 #ifndef OPENRV_SOCKET_H
 #define OPENRV_SOCKET_H
 
+#include <libopenrv/libopenrv.h>
+
 #include <stdlib.h>
 #include <sys/types.h>
 #include <stdint.h>
 #include <mutex>
+#include <vector>
 
 struct orv_error_t;
 struct orv_context_t;
+struct sockaddr;
 
 namespace openrv {
 
@@ -33,6 +37,7 @@ namespace vnc {
 }
 class MbedTlsContext;
 class OpenSSLContext;
+struct ResolvedAddress;
 
 /**
  * Enum used by @ref Socket, @ref OpenSSLContext and @ref MbedTlsContext as return value for send
@@ -67,9 +72,35 @@ enum class SendRecvSocketError
     InternalErrorUnreachableCode,
 };
 
+/**
+ * The transport used by a @ref Socket to reach the remote side.
+ **/
+enum class TransportType
+{
+    /**
+     * TCP connection to a host and port.
+     **/
+    Tcp,
+    /**
+     * Unix-domain stream socket, the "host name" is the path to the socket. Useful for servers on
+     * the same machine (or in the same container), avoids the TCP stack.
+     **/
+    UnixDomain,
+    /**
+     * In-process connection to a @ref MemoryPipeListener, the "host name" is the name of the
+     * listener. No network is involved, meant for deterministic benchmarks and tests of the full
+     * protocol stack.
+     **/
+    MemoryPipe,
+};
+
 /**
  * Wrapper class for a socket fd.
  *
+ * The fd may be a TCP socket, a unix-domain socket or one end of an in-process memory pipe, see
+ * @ref TransportType and @ref connectBlocking(). All other functions of this class (and
+ * therefore all users of this class) are independent of the transport.
+ *
  * Internally this class uses non-blocking sockets and provides a blocking socket API. All blocking
  * socket calls in this class return either if
  * - the operation has completed
@@ -118,11 +149,16 @@ public:
     Socket& operator=(const Socket&) = delete;
 
     bool makeSocket(int addressFamily, struct orv_error_t* error);
+    bool openConnectedFd(int fd, TransportType transportType, struct orv_error_t* error);
     void close();
     bool writeDataBlocking(const void* buf, size_t nbyte, orv_error_t* error);
     bool readDataBlocking(void* buf, size_t nbyte, orv_error_t* error);
     uint32_t readAvailableDataNonBlocking(void* buf, size_t nbyte, SendRecvSocketError* callAgainType, orv_error_t* error);
+    bool connectBlocking(TransportType transportType, const char* address, uint16_t port, orv_error_t* error);
     bool makeSocketAndConnectBlockingTo(const char* hostName, uint16_t port, orv_error_t* error);
+    bool makeSocketAndConnectBlockingToUnixSocket(const char* path, orv_error_t* error);
+    bool connectToMemoryPipe(const char* name, orv_error_t* error);
+    TransportType transportType() const;
 
     void setEncryptionContext(MbedTlsContext* mbedTlsContext);
     void setEncryptionContext(OpenSSLContext* openSSLContext);
@@ -130,6 +166,10 @@ public:
 
     bool isOpened() const;
     int socketFd() const;
+    void setSocketOptions(const orv_socket_options_t& options);
+    const orv_socket_options_t& socketOptions() const;
+    void queryEffectiveSocketOptions(orv_socket_options_t* options) const;
+    void notifyMessageReceived();
     void setSocketTimeoutSeconds(int timeoutSeconds);
     int socketTimeoutSeconds() const;
     uint64_t socketReadTimeoutUs() const;
@@ -139,11 +179,19 @@ public:
     void resetStatistics();
     size_t receivedBytes() const;
     size_t sentBytes() const;
+    uint64_t roundTripTimeUs() const;
 
     WaitRet waitForSignal(uint64_t timeoutSec, uint64_t timeoutUsec, bool useTimeout, WaitType waitType, int* lastError, bool* signalledSocket = nullptr, bool* signalledPipe = nullptr);
 
 protected:
+    bool setupSocketFd(orv_error_t* error);
+    void applyOptionalSocketOptions();
+#if !defined(_MSC_VER)
+    bool connectParallelBlocking(const std::vector<ResolvedAddress>& addresses, const char* hostName, uint16_t port, orv_error_t* error);
+#endif // !_MSC_VER
+    bool connectSocketBlocking(const struct sockaddr* address, size_t addressLength, const char* hostName, uint16_t port, orv_error_t* error);
 protected:
+    static void sortAddressesForConnect(std::vector<ResolvedAddress>* addresses);
     static void makeConnectError(orv_error_t* error, const char* hostName, uint16_t port, int errorCode);
     static void makeConnectSelectError(orv_error_t* error, const char* hostName, uint16_t port, int errorCode);
 
@@ -158,6 +206,16 @@ private:
     std::mutex* mCommunicationDataMutex = nullptr;
     bool* mCommunicationDataUserRequestedDisconnect = nullptr;
     int mSocketFd = -1;
+    TransportType mTransportType = TransportType::Tcp;
+    /**
+     * The requested socket options, applied by @ref setupSocketFd().
+     **/
+    orv_socket_options_t mSocketOptions;
+    /**
+     * TRUE once TCP_QUICKACK has been re-armed for the message currently being received, see @ref
+     * notifyMessageReceived().
+     **/
+    bool mQuickAckArmed = false;
     int mSocketTimeoutSeconds = 10;
 #ifdef _MSC_VER
     void* mSocketEvent = nullptr;
@@ -192,6 +250,23 @@ inline int Socket::socketFd() const
     return mSocketFd;
 }
 
+/**
+ * @return The transport of the current (or most recent) connection.
+ **/
+inline TransportType Socket::transportType() const
+{
+    return mTransportType;
+}
+
+/**
+ * @return The socket options requested using @ref setSocketOptions(). See @ref
+ *         queryEffectiveSocketOptions() for the values actually in effect.
+ **/
+inline const orv_socket_options_t& Socket::socketOptions() const
+{
+    return mSocketOptions;
+}
+
 /**
  * @return The number of bytes received on this socket by recv() calls, see @ref
  *         readDataBlocking()and @ref readAvailableDataNonBlocking().
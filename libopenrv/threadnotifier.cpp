@@ -16,9 +16,15 @@
 
 #include "threadnotifier.h"
 
+#include <stdint.h>
+
 #if !defined(_MSC_VER)
 #include <unistd.h>
 #include <sys/socket.h>
+#include <fcntl.h>
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#endif // __linux__
 #else // _MSC_VER
 #include <Windows.h>
 #endif // _MSC_VER
@@ -38,11 +44,14 @@ ThreadNotifierWriter::~ThreadNotifierWriter()
 /**
  * @param pipeWriteFd The write-end of the local pipe. This object takes ownership of the fd
  *        and closes it on destruction.
+ * @param isEventFd TRUE if @p pipeWriteFd is an eventfd (linux only) rather than the write-end of
+ *        a pipe.
  **/
-void ThreadNotifierWriter::setWriteFd(int pipeWriteFd)
+void ThreadNotifierWriter::setWriteFd(int pipeWriteFd, bool isEventFd)
 {
     close();
     mPipeWriteFd = pipeWriteFd;
+    mIsEventFd = isEventFd;
 }
 #else // _MSC_VER
 /**
@@ -57,6 +66,15 @@ void ThreadNotifierWriter::setWriteHandle(void* pipeWriteHandle)
 }
 #endif // _MSC_VER
 
+/**
+ * Set the "wake pending" flag that is shared with the corresponding @ref ThreadNotifierListener,
+ * see @ref ThreadNotifier::makePipe().
+ **/
+void ThreadNotifierWriter::setWakePendingFlag(const std::shared_ptr<std::atomic<bool>>& wakePending)
+{
+    mWakePending = wakePending;
+}
+
 void ThreadNotifierWriter::close()
 {
 #ifndef _MSC_VER
@@ -74,13 +92,25 @@ void ThreadNotifierWriter::close()
 
 /**
  * Write a byte to the local pipe, signalling the other thread to wake up.
+ *
+ * If a previous notification has not yet been swallowed by the listener, this function returns
+ * immediately without writing to the pipe: The listener is going to wake up anyway.
  **/
 void ThreadNotifierWriter::sendNotification()
 {
+    if (mWakePending && mWakePending->exchange(true, std::memory_order_acq_rel)) {
+        return;
+    }
 #ifndef _MSC_VER
     if (mPipeWriteFd != -1) {
-        char c = 1;
-        ::write(mPipeWriteFd, &c, 1);
+        if (mIsEventFd) {
+            uint64_t value = 1;
+            ::write(mPipeWriteFd, &value, sizeof(value));
+        }
+        else {
+            char c = 1;
+            ::write(mPipeWriteFd, &c, 1);
+        }
     }
 #else // _MSC_VER
     if (mPipeWriteHandle != 0) {
@@ -102,11 +132,14 @@ ThreadNotifierListener::~ThreadNotifierListener()
 /**
  * @param pipeReadFd The read-end of the local pipe. This object takes ownership of the fd and
  *        closes it on destruction.
+ * @param isEventFd TRUE if @p pipeReadFd is an eventfd (linux only) rather than the read-end of a
+ *        pipe. The eventfd must be non-blocking.
  **/
-void ThreadNotifierListener::setReadFd(int pipeReadFd)
+void ThreadNotifierListener::setReadFd(int pipeReadFd, bool isEventFd)
 {
     close();
     mPipeReadFd = pipeReadFd;
+    mIsEventFd = isEventFd;
 }
 #else // _MSC_VER
 /**
@@ -121,6 +154,14 @@ void ThreadNotifierListener::setReadHandle(void* pipeReadHandle)
 }
 #endif // _MSC_VER
 
+/**
+ * See @ref ThreadNotifierWriter::setWakePendingFlag().
+ **/
+void ThreadNotifierListener::setWakePendingFlag(const std::shared_ptr<std::atomic<bool>>& wakePending)
+{
+    mWakePending = wakePending;
+}
+
 void ThreadNotifierListener::close()
 {
 #ifndef _MSC_VER
@@ -140,6 +181,13 @@ void ThreadNotifierListener::close()
  * @pre Called by connection thread
  *
  * Swallow data written to the local pipe, so that it can be used again to signal the thread.
+ *
+ * NOTE: The "wake pending" flag is cleared only @em after the pipe has been drained. A
+ *       notification sent in between is skipped by the writer, however the caller checks the
+ *       shared state after this function anyway, so it is not lost.
+ *       If nothing could be read although the flag is set, a writer has set the flag but not yet
+ *       written to the pipe. The flag is kept in that case, so that the pipe never remains
+ *       readable while the flag is cleared.
  **/
 void ThreadNotifierListener::swallowPipeData()
 {
@@ -147,6 +195,17 @@ void ThreadNotifierListener::swallowPipeData()
     if (mPipeReadFd == -1) {
         return;
     }
+    if (mIsEventFd) {
+        // reading an eventfd resets its counter, a single read is sufficient.
+        uint64_t value = 0;
+        if (::read(mPipeReadFd, &value, sizeof(value)) != (ssize_t)sizeof(value)) {
+            return;
+        }
+        if (mWakePending) {
+            mWakePending->store(false, std::memory_order_release);
+        }
+        return;
+    }
     struct timeval timeout;
     timeout.tv_sec = 0;
     timeout.tv_usec = 0;
@@ -155,28 +214,72 @@ void ThreadNotifierListener::swallowPipeData()
     FD_SET(mPipeReadFd, &readfds);
     const int nfds = mPipeReadFd + 1;
     bool moreData = true;
+    bool readData = false;
     while (moreData) {
         int ret = select(nfds, &readfds, nullptr, nullptr, &timeout);
         if (ret > 0) {
             char c;
-            ::read(mPipeReadFd, &c, 1);
+            if (::read(mPipeReadFd, &c, 1) == 1) {
+                readData = true;
+            }
         }
         else {
             moreData = false;
         }
     }
+    if (!readData) {
+        return;
+    }
 #else // _MSC_VER
     if (mPipeReadHandle == nullptr) {
         return;
     }
     ResetEvent((HANDLE)mPipeReadHandle);
 #endif // _MSC_VER
+    if (mWakePending) {
+        mWakePending->store(false, std::memory_order_release);
+    }
 }
 
 
-bool ThreadNotifier::makePipe(ThreadNotifierWriter* writer, ThreadNotifierListener* listener)
+/**
+ * Create a local pipe (or equivalent) and assign its ends to @p writer and @p listener.
+ *
+ * On linux an eventfd is used, unless @p allowEventFd is FALSE (or the eventfd cannot be
+ * created), on other unix platforms a pipe and on windows an Event object.
+ *
+ * If @p coalesceNotifications is FALSE, no "wake pending" flag is shared between @p writer and @p
+ * listener, so every notification is written to the pipe. This is meant for benchmarking only.
+ *
+ * @return TRUE on success, FALSE if the pipe could not be created (e.g. no more fds available).
+ **/
+bool ThreadNotifier::makePipe(ThreadNotifierWriter* writer, ThreadNotifierListener* listener, bool allowEventFd, bool coalesceNotifications)
 {
+    std::shared_ptr<std::atomic<bool>> wakePending;
+    if (coalesceNotifications) {
+        wakePending = std::make_shared<std::atomic<bool>>(false);
+    }
+    writer->setWakePendingFlag(wakePending);
+    listener->setWakePendingFlag(wakePending);
 #ifndef _MSC_VER
+#if defined(__linux__)
+    if (allowEventFd) {
+        int eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (eventFd != -1) {
+            // NOTE: writer and listener both take ownership of their fd, so the writer uses a
+            //       duplicate.
+            int writeFd = dup(eventFd);
+            if (writeFd != -1) {
+                writer->setWriteFd(writeFd, true);
+                listener->setReadFd(eventFd, true);
+                return true;
+            }
+            ::close(eventFd);
+        }
+    }
+#else // __linux__
+    (void)allowEventFd;
+#endif // __linux__
     int pipeFds[2];
     if (pipe(pipeFds) != 0) {
         return false;
@@ -184,6 +287,7 @@ bool ThreadNotifier::makePipe(ThreadNotifierWriter* writer, ThreadNotifierListen
     writer->setWriteFd(pipeFds[1]);
     listener->setReadFd(pipeFds[0]);
 #else // _MSC_VER
+    (void)allowEventFd;
     SECURITY_ATTRIBUTES* attr = nullptr;
     bool manualReset = true;
     bool initialState = false;
@@ -18,6 +18,8 @@
 #define OPENRV_THREADNOTIFIER_H
 
 #include <mutex>
+#include <atomic>
+#include <memory>
 
 namespace openrv {
 
@@ -25,6 +27,11 @@ namespace openrv {
  * Wrapper class for the write-end of a local pipe. This object provides a @ref sendNotification()
  * method that can be used to wake up the thread that listens on the read-end of the pipe, so that
  * the thread can do something.
+ *
+ * On linux an eventfd is used instead of a pipe, if available (see @ref ThreadNotifier::makePipe()).
+ * In both cases the "pipe" is written to only if no notification is pending already, i.e. if the
+ * listener has swallowed all previous notifications. Redundant notifications therefore cost an
+ * atomic operation only, no syscall.
  **/
 class ThreadNotifierWriter
 {
@@ -37,19 +44,26 @@ public:
 
     bool isValid() const;
 #ifndef _MSC_VER
-    void setWriteFd(int pipeWriteFd);
+    void setWriteFd(int pipeWriteFd, bool isEventFd = false);
     int pipeWriteFd() const;
 #else // _MSC_VER
     void setWriteHandle(void* pipeWriteHandle);
     void* pipeWriteHandle() const;
 #endif // _MSC_VER
+    void setWakePendingFlag(const std::shared_ptr<std::atomic<bool>>& wakePending);
 
 private:
 #ifndef _MSC_VER
     int mPipeWriteFd = -1;
+    bool mIsEventFd = false;
 #else // _MSC_VER
     void* mPipeWriteHandle = nullptr; // actually a HANDLE
 #endif // _MSC_VER
+    /**
+     * Flag shared with the @ref ThreadNotifierListener. TRUE while a notification has been written
+     * but not yet been swallowed by the listener. May be NULL, then every notification is written.
+     **/
+    std::shared_ptr<std::atomic<bool>> mWakePending;
 };
 
 /**
@@ -67,20 +81,27 @@ public:
     void swallowPipeData();
 
     bool isValid() const;
+    bool isNotificationPending() const;
 #ifndef _MSC_VER
-    void setReadFd(int pipeReadFd);
+    void setReadFd(int pipeReadFd, bool isEventFd = false);
     int pipeReadFd() const;
 #else // _MSC_VER
     void setReadHandle(void* pipeReadHandle);
     void* pipeReadHandle() const;
 #endif // _MSC_VER
+    void setWakePendingFlag(const std::shared_ptr<std::atomic<bool>>& wakePending);
 
 private:
 #ifndef _MSC_VER
     int mPipeReadFd = -1;
+    bool mIsEventFd = false;
 #else // _MSC_VER
     void* mPipeReadHandle = nullptr; // actually a HANDLE
 #endif // _MSC_VER
+    /**
+     * See @ref ThreadNotifierWriter::mWakePending.
+     **/
+    std::shared_ptr<std::atomic<bool>> mWakePending;
 };
 
 /**
@@ -90,7 +111,7 @@ private:
 class ThreadNotifier
 {
 public:
-    static bool makePipe(ThreadNotifierWriter* writer, ThreadNotifierListener* listener);
+    static bool makePipe(ThreadNotifierWriter* writer, ThreadNotifierListener* listener, bool allowEventFd = true, bool coalesceNotifications = true);
 };
 
 /**
@@ -141,6 +162,19 @@ inline bool ThreadNotifierListener::isValid() const
     return true;
 }
 
+/**
+ * @return TRUE if a notification has been sent that has not yet been swallowed using @ref
+ *         swallowPipeData(). Always TRUE if no "wake pending" flag is used, as the state is unknown
+ *         then.
+ **/
+inline bool ThreadNotifierListener::isNotificationPending() const
+{
+    if (!mWakePending) {
+        return true;
+    }
+    return mWakePending->load(std::memory_order_acquire);
+}
+
 #ifndef _MSC_VER
 inline int ThreadNotifierListener::pipeReadFd() const
 {
@@ -21,6 +21,24 @@
 #include <string.h>
 #include <ctype.h>
 
+#if defined(_MSC_VER)
+#include <Windows.h>
+#include <atomic>
+#include <mutex>
+static bool g_time_win32_time_initialized = false;
+static LARGE_INTEGER g_time_win32_performance_frequency; // # of ticks per second
+#elif defined(__MACH__)
+// osx does not implement clock_gettime().
+#include <mach/mach_time.h>
+#include <atomic>
+#include <mutex>
+static bool g_time_mach_time_initialized = false;
+static double g_time_mach_timebase = 0.0;
+static uint64_t g_time_mach_timestart = 0;
+#else
+#include <time.h>
+#endif
+
 /**
  * Dump a buffer as hex, decimal and optionally ascii to @p dst.
  *
@@ -161,3 +179,53 @@ size_t Utils::dumpHexTo(char* dst, uint32_t dstSize, const uint8_t* src, uint32_
     return dstPos;
 }
 
+/**
+ * Get current time (relative to an @em undefined clock, i.e. can not be used as some kind of
+ * calender time) in us. This value is meant to be @em monotonic.
+ **/
+uint64_t Utils::getTimestampUs()
+{
+#if defined(_MSC_VER)
+    // win32 does not have clock_gettime()
+    // NOTE: QueryPerformanceCounter() and QueryPerformanceFrequency() may return non-zero
+    //       on windows before XP only.
+    //       on systems >= XP we can assume they always succeed.
+    //       we do not support systems prior XP anyway.
+    if (!g_time_win32_time_initialized) {
+        std::atomic_thread_fence(std::memory_order_acquire); // the READ operation (on g_time_win32_time_initialized) must not be performed after this point
+        static std::mutex m;
+        std::lock_guard<std::mutex> lock(m);
+        if (!g_time_win32_time_initialized) {
+            QueryPerformanceFrequency(&g_time_win32_performance_frequency);
+            g_time_win32_time_initialized = true;
+        }
+    }
+    LARGE_INTEGER t;
+    QueryPerformanceCounter(&t);
+    return (uint64_t)((t.QuadPart * 1000 * 1000) / g_time_win32_performance_frequency.QuadPart);
+#elif defined(__MACH__)
+    // MACH (OSX, iOS) does not implement clock_gettime()
+    if (!g_time_mach_time_initialized) {
+        // initialize global variables on the first call
+        // NOTE: See also https://developer.apple.com/library/mac/qa/qa1398/_index.html
+        std::atomic_thread_fence(std::memory_order_acquire); // the READ operation (on g_time_mach_time_initialized) must not be performed after this point
+        static std::mutex m;
+        std::lock_guard<std::mutex> lock(m);
+        if (!g_time_mach_time_initialized) {
+            mach_timebase_info_data_t t;
+            mach_timebase_info(&t);
+            g_time_mach_timebase = t.numer;
+            g_time_mach_timebase /= t.denom;
+            g_time_mach_timestart = mach_absolute_time();
+            std::atomic_thread_fence(std::memory_order_release); // the READ/WRITE operations must not be performed after the following WRITE operation(s) (on g_time_mach_time_initialized).
+            g_time_mach_time_initialized = true;
+        }
+    }
+    uint64_t diffNano = (mach_absolute_time() - g_time_mach_timestart) * g_time_mach_timebase;
+    return diffNano / 1000;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 * 1000 + ts.tv_nsec / 1000;
+#endif
+}
@@ -34,6 +34,7 @@ public:
     static size_t writeUInt16AsHexWithPrefix(char* dst, uint16_t value);
     static size_t writeUInt32AsHex(char* dst, uint32_t value);
     static size_t writeUInt32AsHexWithPrefix(char* dst, uint32_t value);
+    static uint64_t getTimestampUs();
 };
 
 /**
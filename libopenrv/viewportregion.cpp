@@ -0,0 +1,213 @@
+/*
+ * Copyright (C) 2018 Monument-Software GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "viewportregion.h"
+
+#include <algorithm>
+
+namespace openrv {
+namespace vnc {
+
+/**
+ * @return TRUE if the range @p tileStart to @p tileEnd (exclusive) of a tile lies within @p start
+ *         to @p end.
+ **/
+static bool rangeCovers(uint32_t start, uint32_t end, uint32_t tileStart, uint32_t tileEnd)
+{
+    return start <= tileStart && tileEnd <= end;
+}
+
+/**
+ * Start tracking a framebuffer of size @p framebufferWidth x @p framebufferHeight, all tiles are
+ * initially up to date. The viewport is kept.
+ **/
+void ViewportRegion::reset(uint16_t framebufferWidth, uint16_t framebufferHeight)
+{
+    mFramebufferWidth = framebufferWidth;
+    mFramebufferHeight = framebufferHeight;
+    mColumns = ((uint32_t)framebufferWidth + mTileSize - 1) / mTileSize;
+    mRows = ((uint32_t)framebufferHeight + mTileSize - 1) / mTileSize;
+    mStaleTiles.assign((size_t)mColumns * mRows, 0);
+    mStaleTileCount = 0;
+}
+
+/**
+ * Use @p viewport for all subsequent calls to @ref planRequest(). A disabled @p viewport removes
+ * the restriction, the stale tiles are then refreshed by the next incremental request that
+ * contains them.
+ **/
+void ViewportRegion::setViewport(const Viewport& viewport)
+{
+    mViewport = viewport;
+}
+
+/**
+ * Mark the whole framebuffer as stale, e.g. because its contents were received in a reduced
+ * quality. The tiles are refreshed by the next incremental requests that contain them.
+ **/
+void ViewportRegion::markAllStale()
+{
+    markTiles(0, 0, mColumns, mRows, true);
+}
+
+/**
+ * Calculate the tiles that the viewport plus its margin covers, clipped to the framebuffer. @p
+ * column2 and @p row2 are exclusive.
+ *
+ * @return FALSE if the viewport is empty (or outside of the framebuffer), then the output
+ *         parameters are not modified.
+ **/
+bool ViewportRegion::viewportTiles(uint32_t* column1, uint32_t* row1, uint32_t* column2, uint32_t* row2) const
+{
+    if (mViewport.mW == 0 || mViewport.mH == 0) {
+        return false;
+    }
+    const uint32_t x1 = (mViewport.mX > mViewport.mMargin) ? (uint32_t)mViewport.mX - mViewport.mMargin : 0;
+    const uint32_t y1 = (mViewport.mY > mViewport.mMargin) ? (uint32_t)mViewport.mY - mViewport.mMargin : 0;
+    const uint32_t x2 = std::min((uint32_t)mViewport.mX + mViewport.mW + mViewport.mMargin, (uint32_t)mFramebufferWidth);
+    const uint32_t y2 = std::min((uint32_t)mViewport.mY + mViewport.mH + mViewport.mMargin, (uint32_t)mFramebufferHeight);
+    if (x1 >= x2 || y1 >= y2) {
+        return false;
+    }
+    *column1 = x1 / mTileSize;
+    *row1 = y1 / mTileSize;
+    *column2 = (x2 + mTileSize - 1) / mTileSize;
+    *row2 = (y2 + mTileSize - 1) / mTileSize;
+    return true;
+}
+
+void ViewportRegion::markTiles(uint32_t column1, uint32_t row1, uint32_t column2, uint32_t row2, bool stale)
+{
+    for (uint32_t row = row1; row < row2; row++) {
+        for (uint32_t column = column1; column < column2; column++) {
+            uint8_t& tile = mStaleTiles[(size_t)row * mColumns + column];
+            if ((tile != 0) != stale) {
+                tile = stale ? 1 : 0;
+                if (stale) {
+                    mStaleTileCount++;
+                }
+                else {
+                    mStaleTileCount--;
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Calculate the messages that are sent to the server for the framebuffer update @p request of the
+ * application and update the stale tiles accordingly, i.e. the messages must be sent.
+ *
+ * Non-incremental requests are never restricted. Incremental requests are restricted to the
+ * viewport into @p restricted. If the restricted request contains stale tiles, @p refresh is set to
+ * a non-incremental request for their bounding box, which must be sent before @p restricted.
+ * Otherwise the width of @p refresh is 0.
+ *
+ * NOTE: Stale tiles that are only partially covered by the restricted request (i.e. if the
+ *       application requested a rect that is not aligned to the tiles) are refreshed, but remain
+ *       stale, as the remaining part of the tile is still outdated.
+ *
+ * @return TRUE if @p restricted (and @p refresh, if set) must be sent, FALSE if the request lies
+ *         completely outside of the viewport and nothing has to be sent.
+ **/
+bool ViewportRegion::planRequest(const RequestFramebuffer& request, RequestFramebuffer* refresh, RequestFramebuffer* restricted)
+{
+    *refresh = RequestFramebuffer(false, 0, 0, 0, 0);
+    *restricted = request;
+    uint32_t x1 = std::min(request.mX, mFramebufferWidth);
+    uint32_t y1 = std::min(request.mY, mFramebufferHeight);
+    uint32_t x2 = std::min((uint32_t)request.mX + request.mW, (uint32_t)mFramebufferWidth);
+    uint32_t y2 = std::min((uint32_t)request.mY + request.mH, (uint32_t)mFramebufferHeight);
+    if (x1 >= x2 || y1 >= y2) {
+        // NOTE: nothing of the framebuffer requested, leave it to the server how to handle this.
+        return true;
+    }
+    if (!request.mIncremental) {
+        const uint32_t column1 = (x1 + mTileSize - 1) / mTileSize;
+        const uint32_t row1 = (y1 + mTileSize - 1) / mTileSize;
+        const uint32_t column2 = (x2 == mFramebufferWidth) ? mColumns : x2 / mTileSize;
+        const uint32_t row2 = (y2 == mFramebufferHeight) ? mRows : y2 / mTileSize;
+        if (column1 < column2 && row1 < row2) {
+            markTiles(column1, row1, column2, row2, false);
+        }
+        return true;
+    }
+    if (mViewport.mEnabled) {
+        const uint32_t column1 = x1 / mTileSize;
+        const uint32_t row1 = y1 / mTileSize;
+        const uint32_t column2 = (x2 + mTileSize - 1) / mTileSize;
+        const uint32_t row2 = (y2 + mTileSize - 1) / mTileSize;
+        uint32_t viewportColumn1 = 0;
+        uint32_t viewportRow1 = 0;
+        uint32_t viewportColumn2 = 0;
+        uint32_t viewportRow2 = 0;
+        viewportTiles(&viewportColumn1, &viewportRow1, &viewportColumn2, &viewportRow2);
+        // the server may drop all changes outside of the restricted request
+        for (uint32_t row = row1; row < row2; row++) {
+            const bool rowInViewport = row >= viewportRow1 && row < viewportRow2;
+            for (uint32_t column = column1; column < column2; column++) {
+                if (!rowInViewport || column < viewportColumn1 || column >= viewportColumn2) {
+                    markTiles(column, row, column + 1, row + 1, true);
+                }
+            }
+        }
+        x1 = std::max(x1, viewportColumn1 * mTileSize);
+        y1 = std::max(y1, viewportRow1 * mTileSize);
+        x2 = std::min(x2, viewportColumn2 * mTileSize);
+        y2 = std::min(y2, viewportRow2 * mTileSize);
+        if (x1 >= x2 || y1 >= y2) {
+            return false;
+        }
+        *restricted = RequestFramebuffer(true, (uint16_t)x1, (uint16_t)y1, (uint16_t)(x2 - x1), (uint16_t)(y2 - y1));
+    }
+    if (mStaleTileCount == 0) {
+        return true;
+    }
+    uint32_t refreshColumn1 = mColumns;
+    uint32_t refreshRow1 = mRows;
+    uint32_t refreshColumn2 = 0;
+    uint32_t refreshRow2 = 0;
+    for (uint32_t row = y1 / mTileSize; row < (y2 + mTileSize - 1) / mTileSize; row++) {
+        const uint32_t tileY1 = row * mTileSize;
+        const uint32_t tileY2 = std::min(tileY1 + mTileSize, (uint32_t)mFramebufferHeight);
+        for (uint32_t column = x1 / mTileSize; column < (x2 + mTileSize - 1) / mTileSize; column++) {
+            if (!mStaleTiles[(size_t)row * mColumns + column]) {
+                continue;
+            }
+            refreshColumn1 = std::min(refreshColumn1, column);
+            refreshRow1 = std::min(refreshRow1, row);
+            refreshColumn2 = std::max(refreshColumn2, column + 1);
+            refreshRow2 = std::max(refreshRow2, row + 1);
+            const uint32_t tileX1 = column * mTileSize;
+            const uint32_t tileX2 = std::min(tileX1 + mTileSize, (uint32_t)mFramebufferWidth);
+            if (rangeCovers(x1, x2, tileX1, tileX2) && rangeCovers(y1, y2, tileY1, tileY2)) {
+                markTiles(column, row, column + 1, row + 1, false);
+            }
+        }
+    }
+    if (refreshColumn1 < refreshColumn2) {
+        const uint32_t refreshX1 = std::max(x1, refreshColumn1 * mTileSize);
+        const uint32_t refreshY1 = std::max(y1, refreshRow1 * mTileSize);
+        const uint32_t refreshX2 = std::min(x2, refreshColumn2 * mTileSize);
+        const uint32_t refreshY2 = std::min(y2, refreshRow2 * mTileSize);
+        *refresh = RequestFramebuffer(false, (uint16_t)refreshX1, (uint16_t)refreshY1, (uint16_t)(refreshX2 - refreshX1), (uint16_t)(refreshY2 - refreshY1));
+    }
+    return true;
+}
+
+} // namespace vnc
+} // namespace openrv
+
@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2018 Monument-Software GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OPENRV_VIEWPORTREGION_H
+#define OPENRV_VIEWPORTREGION_H
+
+#include "orvvncclientshareddata.h"
+
+#include <stdint.h>
+#include <vector>
+
+namespace openrv {
+namespace vnc {
+
+/**
+ * Restriction of the framebuffer update requests to the viewport of the application (see @ref
+ * orv_set_viewport()), used by the connection thread only.
+ *
+ * Incremental requests are restricted to the viewport plus its margin, expanded to full tiles of
+ * @ref mTileSize pixels. The server is not required to remember changes outside of the requested
+ * region, so the tiles that were requested by the application but cut off by the viewport are
+ * marked as stale. Once a stale tile is part of a restricted request again (i.e. after the
+ * viewport moved), it is refreshed by an additional non-incremental request.
+ *
+ * This class is not thread safe.
+ **/
+class ViewportRegion
+{
+public:
+    /**
+     * Edge length of the tiles the stale state is tracked for.
+     **/
+    static const uint16_t mTileSize = 64;
+
+public:
+    void reset(uint16_t framebufferWidth, uint16_t framebufferHeight);
+    void setViewport(const Viewport& viewport);
+    void markAllStale();
+    bool planRequest(const RequestFramebuffer& request, RequestFramebuffer* refresh, RequestFramebuffer* restricted);
+    uint32_t staleTileCount() const;
+
+private:
+    bool viewportTiles(uint32_t* column1, uint32_t* row1, uint32_t* column2, uint32_t* row2) const;
+    void markTiles(uint32_t column1, uint32_t row1, uint32_t column2, uint32_t row2, bool stale);
+
+private:
+    uint16_t mFramebufferWidth = 0;
+    uint16_t mFramebufferHeight = 0;
+    uint32_t mColumns = 0;
+    uint32_t mRows = 0;
+    Viewport mViewport;
+    /**
+     * One entry per tile, row by row. Non-zero if the tile is stale.
+     **/
+    std::vector<uint8_t> mStaleTiles;
+    uint32_t mStaleTileCount = 0;
+};
+
+/**
+ * @return The number of tiles that are currently stale.
+ **/
+inline uint32_t ViewportRegion::staleTileCount() const
+{
+    return mStaleTileCount;
+}
+
+} // namespace vnc
+} // namespace openrv
+
+#endif
+
@@ -137,6 +137,12 @@ bool OrvContext::event(QEvent* e)
             handleFramebufferUpdatedEvent(data);
             break;
         }
+        case ORV_EVENT_FRAMEBUFFER_UPDATED_BATCH:
+        {
+            const orv_event_framebuffer_batch_t* data = (orv_event_framebuffer_batch_t*)orvEvent->mOrvEvent->mEventData;
+            handleFramebufferUpdatedBatchEvent(data);
+            break;
+        }
         case ORV_EVENT_FRAMEBUFFER_UPDATE_REQUEST_FINISHED:
             handleFramebufferUpdateRequestFinishedEvent();
             break;
@@ -192,6 +198,18 @@ void OrvContext::handleFramebufferUpdatedEvent(const orv_event_framebuffer_t* da
     emit framebufferUpdated(data);
 }
 
+/**
+ * Called for @ref ORV_EVENT_FRAMEBUFFER_UPDATED_BATCH events. The default implementation calls
+ * @ref handleFramebufferUpdatedEvent() for every rect of the batch, i.e. emits @ref
+ * framebufferUpdated once per rect.
+ **/
+void OrvContext::handleFramebufferUpdatedBatchEvent(const orv_event_framebuffer_batch_t* data)
+{
+    for (uint32_t i = 0; i < data->mRectCount; i++) {
+        handleFramebufferUpdatedEvent(&data->mRects[i]);
+    }
+}
+
 /**
  * Called for @ref ORV_EVENT_FRAMEBUFFER_UPDATE_REQUEST_FINISHED events. The default implementation emits @ref
  * framebufferUpdateRequestFinished.
@@ -238,6 +256,7 @@ void orv_qt_callback(orv_context_t* context, orv_event_t* event)
         case ORV_EVENT_DISCONNECTED:
         case ORV_EVENT_CUT_TEXT:
         case ORV_EVENT_FRAMEBUFFER_UPDATED:
+        case ORV_EVENT_FRAMEBUFFER_UPDATED_BATCH:
         case ORV_EVENT_FRAMEBUFFER_UPDATE_REQUEST_FINISHED:
         case ORV_EVENT_CURSOR_UPDATED:
         case ORV_EVENT_BELL:
@@ -56,6 +56,7 @@ protected:
     virtual void handleDisconnectedEvent(const orv_disconnected_t* data);
     virtual void handleCutTextEvent(const QString& text);
     virtual void handleFramebufferUpdatedEvent(const orv_event_framebuffer_t* data);
+    virtual void handleFramebufferUpdatedBatchEvent(const orv_event_framebuffer_batch_t* data);
     virtual void handleFramebufferUpdateRequestFinishedEvent();
     virtual void handleCursorUpdatedEvent();
 
@@ -182,7 +182,6 @@ void TopWidget::connectToHost(const QString& host, int port, const QString& pass
         connect(mQtOrvContext, SIGNAL(disconnected(const orv_disconnected_t*)), this, SLOT(handleDisconnectedEvent(const orv_disconnected_t*)));
         connect(mQtOrvContext, SIGNAL(cutText(const QString&)), this, SLOT(handleCutTextEvent(const QString&)));
         connect(mQtOrvContext, SIGNAL(framebufferUpdated(const orv_event_framebuffer_t*)), this, SLOT(handleFramebufferUpdatedEvent(const orv_event_framebuffer_t*)));
-        connect(mQtOrvContext, SIGNAL(framebufferUpdateRequestFinished()), this, SLOT(handleFramebufferUpdateRequestFinishedEvent()));
         connect(mQtOrvContext, SIGNAL(cursorUpdated()), this, SLOT(handleCursorUpdatedEvent()));
         connect(mQtOrvContext, SIGNAL(bell()), this, SLOT(handleBellEvent()));
         if (!mQtOrvContext->orvContext()) {
@@ -263,13 +262,9 @@ void TopWidget::handleConnectEvent(const orv_connect_result_t* data)
     QString desktopName = QString::fromLatin1(data->mDesktopName); // TODO: is latin-1 correct? what encoding does desktopname use?
     mOrvWidget->setFramebufferSize(data->mFramebufferWidth, data->mFramebufferHeight, desktopName);
     mLayout->setCurrentWidget(mOrvWidget);
-#if 0
-    const uint16_t x = 0;
-    const uint16_t y = 0;
-    orv_request_framebuffer_update(mQtOrvContext->orvContext(), x, y, mOrvWidget->framebufferWidth(), mOrvWidget->framebufferHeight());
-#else
-    orv_request_framebuffer_update_full(mQtOrvContext->orvContext());
-#endif
+    // NOTE: the library sends the initial request and all further requests itself, each as soon
+    //       as the previous update has been received.
+    orv_start_auto_refresh(mQtOrvContext->orvContext(), nullptr);
 }
 
 void TopWidget::handleDisconnectedEvent(const orv_disconnected_t* data)
@@ -344,15 +339,6 @@ void TopWidget::handleFramebufferUpdatedEvent(const orv_event_framebuffer_t* dat
 #endif
 }
 
-void TopWidget::handleFramebufferUpdateRequestFinishedEvent()
-{
-    // TODO: make configurable!
-    // -> make extremely low for server latency tests!
-    //const int updateDelay = 200; // do not update immediately to reduce network usage
-    const int updateDelay = 0;
-    QTimer::singleShot(updateDelay, this, SLOT(requestFramebufferUpdate()));
-}
-
 void TopWidget::handleCursorUpdatedEvent()
 {
     if (!mQtOrvContext) {
@@ -433,19 +419,6 @@ void TopWidget::connectionInfoDestroyed()
     mConnectionInfoDialog = nullptr;
 }
 
-/**
- * Send a framebuffer update request to the server.
- *
- * This message needs to be sent regularly (whenever a response to the previous message has been
- * finished), otherwise we receive no more updates
- **/
-void TopWidget::requestFramebufferUpdate()
-{
-    if (mQtOrvContext) {
-        orv_request_framebuffer_update_full(mQtOrvContext->orvContext());
-    }
-}
-
 void latencyTesterEventCallback(struct orv_latency_tester_client_t* client, orv_latency_tester_event_type_t event, const void* eventData, void* userData)
 {
     // NOTE: is called on a different thread!
@@ -92,11 +92,9 @@ protected slots:
     void handleDisconnectedEvent(const orv_disconnected_t* data);
     void handleCutTextEvent(const QString& text);
     void handleFramebufferUpdatedEvent(const orv_event_framebuffer_t* data);
-    void handleFramebufferUpdateRequestFinishedEvent();
     void handleCursorUpdatedEvent();
     void handleBellEvent();
     void abortConnect();
-    void requestFramebufferUpdate();
     void connectionInfoDestroyed();
     void saveToServerList(const QString& host, int port, const QString& password, const QString& name, bool savePassword, int internalServerId, bool viewOnly, orv_communication_quality_profile_t qualityProfile, const orv_communication_pixel_format_t& customPixelFormat);
     void connectToHost(const QModelIndex& index);
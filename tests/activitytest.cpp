@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2018 Monument-Software GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/**
+ * Switches a connection to @ref ORV_ACTIVITY_STATE_BACKGROUND while the automatic refresh keeps
+ * several requests outstanding.
+ *
+ * On a static desktop the mock server merges these requests, so some are never answered. The low
+ * bandwidth pixel format must be used nevertheless, and updates must be received in it.
+ *
+ * On a changing desktop behind a slow link the server answers every request, but the updates take
+ * longer than @ref ORV_PIXEL_FORMAT_CHANGE_TIMEOUT_US to arrive. The pixel format must not change
+ * before they were received, otherwise they would be decoded in the wrong format.
+ **/
+
+#include "testutil.h"
+
+#include <chrono>
+#include <thread>
+
+using namespace openrv;
+
+static uint8_t communicationBitsPerPixel(orv_context_t* ctx)
+{
+    orv_connection_info_t info;
+    orv_vnc_server_capabilities_t capabilities;
+    orv_get_vnc_connection_info(ctx, &info, &capabilities);
+    return info.mCommunicationPixelFormat.mBitsPerPixel;
+}
+
+static bool testBackgroundPixelFormat(const bench::MockServerOptions& serverOptions)
+{
+    test::TestServer server(serverOptions);
+    orv_error_t error;
+    ORV_TEST_CHECK(server.server()->listen(&error));
+    server.start();
+
+    test::TestClient client;
+    ORV_TEST_CHECK(client.connect("127.0.0.1", server.server()->port(), ORV_TRANSPORT_TCP));
+    orv_request_framebuffer_update_full(client.context());
+    ORV_TEST_CHECK(client.waitForEventType(10000, ORV_EVENT_FRAMEBUFFER_UPDATE_REQUEST_FINISHED));
+    ORV_TEST_CHECK(communicationBitsPerPixel(client.context()) == 32);
+
+    orv_auto_refresh_options_t autoRefreshOptions;
+    orv_auto_refresh_options_default(&autoRefreshOptions);
+    autoRefreshOptions.mTargetFps = 0;
+    autoRefreshOptions.mMaxOutstandingRequests = 3;
+    orv_start_auto_refresh(client.context(), &autoRefreshOptions);
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    // updates decoded in the wrong pixel format end the connection with a protocol error
+    bool disconnected = false;
+    auto checkDisconnected = [&disconnected](const orv_event_t* event) {
+        disconnected = disconnected || event->mEventType == ORV_EVENT_DISCONNECTED;
+        return disconnected;
+    };
+    orv_set_activity_state(client.context(), ORV_ACTIVITY_STATE_BACKGROUND);
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (communicationBitsPerPixel(client.context()) != 8 && !disconnected && std::chrono::steady_clock::now() < deadline) {
+        client.waitForEvent(20, checkDisconnected);
+    }
+    ORV_TEST_CHECK(communicationBitsPerPixel(client.context()) == 8);
+
+    // let the outstanding requests drain, so that the next finished request is our own
+    orv_stop_auto_refresh(client.context());
+    client.waitForEvent(2000, checkDisconnected);
+    ORV_TEST_CHECK(!disconnected);
+    ORV_TEST_CHECK(orv_is_connected(client.context()));
+    orv_request_framebuffer_update_non_incremental(client.context(), 0, 0, serverOptions.mWidth, serverOptions.mHeight);
+    ORV_TEST_CHECK(client.waitForEventType(10000, ORV_EVENT_FRAMEBUFFER_UPDATE_REQUEST_FINISHED));
+    return true;
+}
+
+int main()
+{
+    bench::MockServerOptions serverOptions;
+    serverOptions.mPort = 0;
+    serverOptions.mWidth = 320;
+    serverOptions.mHeight = 200;
+    serverOptions.mScenario = bench::MockScenario::Static;
+    if (!testBackgroundPixelFormat(serverOptions)) {
+        return 1;
+    }
+
+    // every update carries the 160x100 noise rect in Raw encoding, i.e. 64000 bytes at 32 bpp, so
+    // the outstanding requests take more than a second to drain
+    serverOptions.mScenario = bench::MockScenario::Noise;
+    serverOptions.mEncodings = {};
+    serverOptions.mBandwidthBytesPerSecond = 128000;
+    serverOptions.mLatencyMs = 300;
+    if (!testBackgroundPixelFormat(serverOptions)) {
+        return 1;
+    }
+    return 0;
+}
+
@@ -0,0 +1,311 @@
+/*
+ * Copyright (C) 2018 Monument-Software GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/**
+ * Counts the heap allocations of the library while it receives incremental updates from a mock
+ * server. After a warm-up, receiving and decoding an update must not allocate at all, neither in
+ * the decoder (see @ref openrv::DecodeArena) nor for events, request bookkeeping or any other
+ * container.
+ *
+ * The global operator new and (with glibc) malloc(), calloc() and realloc() are replaced by
+ * counting versions. The mock server runs in a child process, so that its allocations are not
+ * counted.
+ **/
+
+#include "testutil.h"
+
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <vector>
+
+using namespace openrv;
+
+#if defined(__GLIBC__)
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void __libc_free(void* ptr);
+}
+#endif // __GLIBC__
+
+static std::atomic<bool> gCountAllocations(false);
+static std::atomic<uint64_t> gAllocations(0);
+
+static void countAllocation()
+{
+    if (gCountAllocations.load(std::memory_order_relaxed)) {
+        gAllocations++;
+    }
+}
+
+static void* allocate(size_t size)
+{
+    countAllocation();
+#if defined(__GLIBC__)
+    return __libc_malloc(size == 0 ? 1 : size);
+#else // __GLIBC__
+    return ::malloc(size == 0 ? 1 : size);
+#endif // __GLIBC__
+}
+
+static void deallocate(void* ptr)
+{
+#if defined(__GLIBC__)
+    __libc_free(ptr);
+#else // __GLIBC__
+    ::free(ptr);
+#endif // __GLIBC__
+}
+
+#if defined(__GLIBC__)
+extern "C" void* malloc(size_t size)
+{
+    countAllocation();
+    return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size)
+{
+    countAllocation();
+    return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* ptr, size_t size)
+{
+    countAllocation();
+    return __libc_realloc(ptr, size);
+}
+
+extern "C" void free(void* ptr)
+{
+    __libc_free(ptr);
+}
+#endif // __GLIBC__
+
+void* operator new(size_t size)
+{
+    void* ptr = allocate(size);
+    if (!ptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    return allocate(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    return allocate(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+    deallocate(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    deallocate(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+    deallocate(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept
+{
+    deallocate(ptr);
+}
+
+/**
+ * A @ref bench::MockServer that listens in this process and serves in a forked child process,
+ * which is killed with this object.
+ **/
+class ServerProcess
+{
+public:
+    ServerProcess() = default;
+    ~ServerProcess();
+    ServerProcess(const ServerProcess&) = delete;
+    ServerProcess& operator=(const ServerProcess&) = delete;
+
+    bool start(const bench::MockServerOptions& options);
+    uint16_t port() const;
+
+private:
+    pid_t mPid = -1;
+    uint16_t mPort = 0;
+};
+
+ServerProcess::~ServerProcess()
+{
+    if (mPid > 0) {
+        kill(mPid, SIGKILL);
+        waitpid(mPid, nullptr, 0);
+    }
+}
+
+/**
+ * @pre No other threads are running, as only the calling thread survives in the child.
+ **/
+bool ServerProcess::start(const bench::MockServerOptions& options)
+{
+    bench::MockServer server(options);
+    orv_error_t error;
+    if (!server.listen(&error)) {
+        fprintf(stderr, "Failed to start mock server: %s\n", error.mErrorMessage);
+        return false;
+    }
+    mPort = server.port();
+    mPid = fork();
+    if (mPid == 0) {
+        server.run();
+        _exit(0);
+    }
+    return mPid > 0;
+}
+
+inline uint16_t ServerProcess::port() const
+{
+    return mPort;
+}
+
+/**
+ * Request @p count incremental updates of the whole framebuffer one after another, and acquire
+ * the framebuffer after each, like an application that draws every update.
+ **/
+static bool receiveUpdates(test::TestClient* client, uint16_t w, uint16_t h, int count)
+{
+    for (int i = 0; i < count; i++) {
+        orv_request_framebuffer_update(client->context(), 0, 0, w, h);
+        ORV_TEST_CHECK(client->waitForEventType(5000, ORV_EVENT_FRAMEBUFFER_UPDATE_REQUEST_FINISHED));
+        orv_acquire_framebuffer(client->context());
+        orv_release_framebuffer(client->context());
+    }
+    return true;
+}
+
+/**
+ * Like @ref receiveUpdates(), but keep all events until the last update finished.
+ *
+ * The event pool grows only to the largest number of events that were in use at the same time,
+ * which depends on how fast the events are destroyed. Holding the events makes sure the pool has
+ * enough spare events for the updates that follow.
+ **/
+static bool warmUp(test::TestClient* client, uint16_t w, uint16_t h, int count)
+{
+    std::vector<orv_event_t*> events;
+    int finished = 0;
+    bool ok = true;
+    for (int i = 0; i < count && ok; i++) {
+        orv_request_framebuffer_update(client->context(), 0, 0, w, h);
+        const auto end = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (finished <= i && std::chrono::steady_clock::now() < end) {
+            orv_wait_events(client->context(), 100);
+            while (orv_event_t* event = orv_poll_event(client->context())) {
+                if (event->mEventType == ORV_EVENT_FRAMEBUFFER_UPDATE_REQUEST_FINISHED) {
+                    finished++;
+                }
+                events.push_back(event);
+            }
+        }
+        ok = finished > i;
+        orv_acquire_framebuffer(client->context());
+        orv_release_framebuffer(client->context());
+    }
+    for (orv_event_t* event : events) {
+        orv_event_destroy(event);
+    }
+    ORV_TEST_CHECK(ok);
+    return true;
+}
+
+static bool testUpdatesWithoutAllocations(vnc::EncodingType encoding, const char* encodingName)
+{
+    bench::MockServerOptions serverOptions;
+    serverOptions.mPort = 0;
+    serverOptions.mWidth = 320;
+    serverOptions.mHeight = 200;
+    // NOTE: the noise scenario changes the same rect in every frame, so every update consists of
+    //       the same number of rects. The event pool and the rect event array grow to the largest
+    //       number of rects per update, which would make the result depend on the timing
+    //       otherwise.
+    serverOptions.mScenario = bench::MockScenario::Noise;
+    serverOptions.mFramesPerSecond = 120.0;
+    serverOptions.mEncodings = { encoding };
+    ServerProcess server;
+    ORV_TEST_CHECK(server.start(serverOptions));
+
+    test::TestClient client;
+    ORV_TEST_CHECK(client.connect("127.0.0.1", server.port(), ORV_TRANSPORT_TCP));
+    const uint16_t w = serverOptions.mWidth;
+    const uint16_t h = serverOptions.mHeight;
+    orv_request_framebuffer_update_non_incremental(client.context(), 0, 0, w, h);
+    ORV_TEST_CHECK(client.waitForEventType(5000, ORV_EVENT_FRAMEBUFFER_UPDATE_REQUEST_FINISHED));
+    // buffers grow to the size of the largest update seen so far
+    ORV_TEST_CHECK(warmUp(&client, w, h, 20));
+
+    gAllocations = 0;
+    gCountAllocations = true;
+    const bool received = receiveUpdates(&client, w, h, 50);
+    gCountAllocations = false;
+    ORV_TEST_CHECK(received);
+    if (gAllocations != 0) {
+        fprintf(stderr, "%s: %u allocations while receiving incremental updates\n", encodingName, (unsigned int)gAllocations);
+    }
+    ORV_TEST_CHECK(gAllocations == 0);
+    return true;
+}
+
+int main()
+{
+    if (!testUpdatesWithoutAllocations(vnc::EncodingType::Raw, "Raw")) {
+        return 1;
+    }
+    if (!testUpdatesWithoutAllocations(vnc::EncodingType::RRE, "RRE")) {
+        return 1;
+    }
+    if (!testUpdatesWithoutAllocations(vnc::EncodingType::CoRRE, "CoRRE")) {
+        return 1;
+    }
+    if (!testUpdatesWithoutAllocations(vnc::EncodingType::Hextile, "Hextile")) {
+        return 1;
+    }
+    if (!testUpdatesWithoutAllocations(vnc::EncodingType::zlib, "zlib")) {
+        return 1;
+    }
+    if (!testUpdatesWithoutAllocations(vnc::EncodingType::ZRLE, "ZRLE")) {
+        return 1;
+    }
+    return 0;
+}
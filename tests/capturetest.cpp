@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2018 Monument-Software GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/**
+ * Captures a connection to an in-process mock server using @ref orv_set_capture_file() and
+ * replays the capture using @ref openrv::vnc::SessionReplay: the replay must parse the same
+ * messages and end up with exactly the framebuffer the connection had.
+ **/
+
+#include "testutil.h"
+#include "sessionreplay.h"
+
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+using namespace openrv;
+
+static const int gUpdates = 10;
+
+static void discardEventCallback(orv_context_t* ctx, orv_event_t* event)
+{
+    (void)ctx;
+    orv_event_destroy(event);
+}
+
+static bool testCaptureRoundTrip()
+{
+    bench::MockServerOptions serverOptions;
+    serverOptions.mPort = 0;
+    serverOptions.mWidth = 400;
+    serverOptions.mHeight = 300;
+    serverOptions.mScenario = bench::MockScenario::Windows;
+    serverOptions.mFramesPerSecond = 60.0;
+    test::TestServer server(serverOptions);
+    orv_error_t error;
+    ORV_TEST_CHECK(server.server()->listen(&error));
+    server.start();
+
+    const std::string captureFileName = "/tmp/orv_capture_test_" + std::to_string(getpid()) + ".orv";
+    std::vector<uint8_t> expectedFramebuffer;
+    int updates = 0;
+    {
+        test::TestClient client;
+        ORV_TEST_CHECK(orv_set_capture_file(client.context(), captureFileName.c_str(), &error) == 0);
+        ORV_TEST_CHECK(client.connect("127.0.0.1", server.server()->port(), ORV_TRANSPORT_TCP));
+        orv_request_framebuffer_update_full(client.context());
+        client.waitForEvent(5000, [&client, &updates](const orv_event_t* event) {
+            if (event->mEventType != ORV_EVENT_FRAMEBUFFER_UPDATE_REQUEST_FINISHED) {
+                return false;
+            }
+            updates++;
+            if (updates < gUpdates) {
+                orv_request_framebuffer_update_full(client.context());
+            }
+            return updates >= gUpdates;
+        });
+        ORV_TEST_CHECK(updates == gUpdates);
+
+        // the capture is completed when the connection is closed. Updates that were already
+        // received are captured as well, so they are counted until the connection is closed.
+        orv_disconnect(client.context());
+        bool disconnected = false;
+        client.waitForEvent(5000, [&updates, &disconnected](const orv_event_t* event) {
+            if (event->mEventType == ORV_EVENT_FRAMEBUFFER_UPDATE_REQUEST_FINISHED) {
+                updates++;
+            }
+            disconnected = event->mEventType == ORV_EVENT_DISCONNECTED;
+            return disconnected;
+        });
+        ORV_TEST_CHECK(disconnected);
+        // the framebuffer remains available after the disconnect
+        const orv_framebuffer_t* framebuffer = orv_acquire_framebuffer(client.context());
+        expectedFramebuffer.assign(framebuffer->mFramebuffer, framebuffer->mFramebuffer + framebuffer->mSize);
+        orv_release_framebuffer(client.context());
+    }
+
+    orv_config_t config;
+    orv_config_default(&config);
+    config.mEventCallback = discardEventCallback;
+    config.mLogCallback = nullptr;
+    orv_context_t* ctx = orv_init(&config);
+    ORV_TEST_CHECK(ctx != nullptr);
+    bool replayOk = false;
+    bool framebufferMatches = false;
+    vnc::SessionReplayResult result;
+    {
+        vnc::SessionReplay replay(ctx);
+        replayOk = replay.replay(captureFileName.c_str(), false, &result, &error);
+        if (!replayOk) {
+            fprintf(stderr, "Replay failed: %s\n", error.mErrorMessage);
+        }
+        const orv_framebuffer_t& framebuffer = replay.framebuffer();
+        framebufferMatches = framebuffer.mSize == expectedFramebuffer.size() &&
+                memcmp(framebuffer.mFramebuffer, expectedFramebuffer.data(), framebuffer.mSize) == 0;
+    }
+    orv_destroy(ctx);
+    unlink(captureFileName.c_str());
+
+    ORV_TEST_CHECK(replayOk);
+    ORV_TEST_CHECK(result.mComplete);
+    ORV_TEST_CHECK(result.mFramebufferWidth == serverOptions.mWidth && result.mFramebufferHeight == serverOptions.mHeight);
+    ORV_TEST_CHECK(result.mStatistics.mFramebufferUpdates == (uint64_t)updates);
+    ORV_TEST_CHECK(framebufferMatches);
+    return true;
+}
+
+int main()
+{
+    return testCaptureRoundTrip() ? 0 : 1;
+}
+
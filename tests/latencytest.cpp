@@ -0,0 +1,186 @@
+/*
+ * Copyright (C) 2018 Monument-Software GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/**
+ * Checks the latency measurement of update requests against an in-process mock server with an
+ * artificial latency: every update must be attributed to the request it answers, and the trace
+ * file must contain the "present" stage of the updates the test acquired the framebuffer for. A
+ * second case checks that requests the server merged do not inflate the latency of later updates.
+ **/
+
+#include "testutil.h"
+
+#include <unistd.h>
+#include <string>
+
+using namespace openrv;
+
+static const uint32_t gServerLatencyMs = 50;
+
+static std::string readFile(const char* fileName)
+{
+    std::string content;
+    FILE* file = fopen(fileName, "r");
+    if (!file) {
+        return content;
+    }
+    char buffer[4096];
+    size_t bytes = 0;
+    while ((bytes = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        content.append(buffer, bytes);
+    }
+    fclose(file);
+    return content;
+}
+
+static size_t countOccurrences(const std::string& haystack, const char* needle)
+{
+    size_t count = 0;
+    for (size_t pos = haystack.find(needle); pos != std::string::npos; pos = haystack.find(needle, pos + 1)) {
+        count++;
+    }
+    return count;
+}
+
+static bool testUpdateLatency()
+{
+    bench::MockServerOptions serverOptions;
+    serverOptions.mPort = 0;
+    serverOptions.mWidth = 320;
+    serverOptions.mHeight = 200;
+    serverOptions.mScenario = bench::MockScenario::Noise;
+    serverOptions.mFramesPerSecond = 120.0;
+    serverOptions.mLatencyMs = gServerLatencyMs;
+    test::TestServer server(serverOptions);
+    orv_error_t error;
+    ORV_TEST_CHECK(server.server()->listen(&error));
+    server.start();
+
+    test::TestClient client;
+    const std::string traceFileName = "/tmp/orv_latency_test_" + std::to_string(getpid()) + ".json";
+    ORV_TEST_CHECK(orv_set_latency_trace_file(client.context(), traceFileName.c_str(), &error) == 0);
+    ORV_TEST_CHECK(client.connect("127.0.0.1", server.server()->port(), ORV_TRANSPORT_TCP));
+
+    orv_auto_refresh_options_t autoRefreshOptions;
+    orv_auto_refresh_options_default(&autoRefreshOptions);
+    autoRefreshOptions.mTargetFps = 0;
+    autoRefreshOptions.mMaxOutstandingRequests = 1;
+    orv_start_auto_refresh(client.context(), &autoRefreshOptions);
+    int updates = 0;
+    client.waitForEvent(5000, [&client, &updates](const orv_event_t* event) {
+        if (event->mEventType != ORV_EVENT_FRAMEBUFFER_UPDATE_REQUEST_FINISHED) {
+            return false;
+        }
+        orv_acquire_framebuffer(client.context());
+        orv_release_framebuffer(client.context());
+        updates++;
+        return updates >= 30;
+    });
+    orv_stop_auto_refresh(client.context());
+    ORV_TEST_CHECK(updates >= 30);
+
+    orv_latency_report_t report;
+    orv_get_latency_report(client.context(), &report);
+    ORV_TEST_CHECK(report.mSampleCount >= 30);
+    ORV_TEST_CHECK(report.mPresentedSampleCount > 0);
+    // no update may be attributed to a request sent after the previous update arrived, i.e. each
+    // update waited for the full server latency.
+    const uint64_t minNetworkUs = (uint64_t)gServerLatencyMs * 1000 * 9 / 10;
+    if (report.mNetwork.mP50Us < minNetworkUs) {
+        fprintf(stderr, "Network p50 is %u us, expected at least %u us\n", (unsigned int)report.mNetwork.mP50Us, (unsigned int)minNetworkUs);
+    }
+    ORV_TEST_CHECK(report.mNetwork.mP50Us >= minNetworkUs);
+
+    orv_statistics_t statistics;
+    orv_get_statistics(client.context(), &statistics);
+    ORV_TEST_CHECK(statistics.mUpdateLatencyCount > 0);
+    ORV_TEST_CHECK(statistics.mUpdateLatencyMinUs >= minNetworkUs);
+
+    ORV_TEST_CHECK(orv_set_latency_trace_file(client.context(), nullptr, &error) == 0);
+    const std::string trace = readFile(traceFileName.c_str());
+    unlink(traceFileName.c_str());
+    ORV_TEST_CHECK(countOccurrences(trace, "\"name\":\"network\",") >= 30);
+    ORV_TEST_CHECK(countOccurrences(trace, "\"name\":\"present\",") > 0);
+    ORV_TEST_CHECK(trace.size() > 3 && trace.compare(trace.size() - 3, 3, "\n]\n") == 0);
+    return true;
+}
+
+/**
+ * The mock server merges incremental requests without damage into the next request. The client
+ * requests updates much more often than the desktop changes, so most requests are merged and each
+ * update answers many requests. The latency of each update must be measured from the most recent
+ * of these requests, not from the oldest request that is still remembered.
+ **/
+static bool testMergedRequestLatency()
+{
+    bench::MockServerOptions serverOptions;
+    serverOptions.mPort = 0;
+    serverOptions.mWidth = 320;
+    serverOptions.mHeight = 200;
+    serverOptions.mScenario = bench::MockScenario::Noise;
+    serverOptions.mFramesPerSecond = 5.0;
+    serverOptions.mLatencyMs = 20;
+    test::TestServer server(serverOptions);
+    orv_error_t error;
+    ORV_TEST_CHECK(server.server()->listen(&error));
+    server.start();
+
+    test::TestClient client;
+    ORV_TEST_CHECK(client.connect("127.0.0.1", server.server()->port(), ORV_TRANSPORT_TCP));
+    const uint16_t w = serverOptions.mWidth;
+    const uint16_t h = serverOptions.mHeight;
+    orv_request_framebuffer_update_non_incremental(client.context(), 0, 0, w, h);
+    ORV_TEST_CHECK(client.waitForEventType(5000, ORV_EVENT_FRAMEBUFFER_UPDATE_REQUEST_FINISHED));
+
+    // request an incremental update every 10ms, i.e. about 20 requests per frame of the server
+    const int requestIntervalMs = 10;
+    int updates = 0;
+    for (int i = 0; i < 1000 && updates < 8; i++) {
+        orv_request_framebuffer_update(client.context(), 0, 0, w, h);
+        client.waitForEvent(requestIntervalMs, [&updates](const orv_event_t* event) {
+            if (event->mEventType == ORV_EVENT_FRAMEBUFFER_UPDATE_REQUEST_FINISHED) {
+                updates++;
+            }
+            return false;
+        });
+    }
+    ORV_TEST_CHECK(updates >= 8);
+
+    orv_statistics_t statistics;
+    orv_get_statistics(client.context(), &statistics);
+    ORV_TEST_CHECK(statistics.mUpdateLatencyCount > 0);
+    // if the merged requests were attributed to later updates, the latency would approach the
+    // age of the oldest remembered request, i.e. more than 100ms.
+    const uint64_t maxLatencyUs = ((uint64_t)serverOptions.mLatencyMs + 80) * 1000;
+    if (statistics.mUpdateLatencyMaxUs > maxLatencyUs) {
+        fprintf(stderr, "Maximum update latency is %u us, expected at most %u us\n", (unsigned int)statistics.mUpdateLatencyMaxUs, (unsigned int)maxLatencyUs);
+    }
+    ORV_TEST_CHECK(statistics.mUpdateLatencyMaxUs <= maxLatencyUs);
+    return true;
+}
+
+int main()
+{
+    if (!testUpdateLatency()) {
+        return 1;
+    }
+    if (!testMergedRequestLatency()) {
+        return 1;
+    }
+    return 0;
+}
+
@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2018 Monument-Software GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/**
+ * Receives updates with mipmaps (see @ref orv_config_t::mMipmapLevels) while the application
+ * holds the mipmaps and the framebuffer at the same time, acquired in both orders, which must not
+ * deadlock. Afterwards the first level must be the box filtered framebuffer.
+ **/
+
+#include "testutil.h"
+
+#include <chrono>
+#include <thread>
+
+using namespace openrv;
+
+/**
+ * @return TRUE if @p level is the box filtered @p framebuffer, using the rounding of the library
+ *         (vertical average first, then horizontal average).
+ **/
+static bool isDownscaled(const orv_framebuffer_t* framebuffer, const orv_framebuffer_t* level)
+{
+    const size_t stride = (size_t)framebuffer->mWidth * 3;
+    for (uint16_t y = 0; y < level->mHeight; y++) {
+        for (uint16_t x = 0; x < level->mWidth; x++) {
+            for (int c = 0; c < 3; c++) {
+                const uint8_t* p = framebuffer->mFramebuffer + (size_t)y * 2 * stride + (size_t)x * 2 * 3 + c;
+                const int left = (p[0] + p[stride] + 1) >> 1;
+                const int right = (p[3] + p[stride + 3] + 1) >> 1;
+                if (level->mFramebuffer[((size_t)y * level->mWidth + x) * 3 + c] != (uint8_t)((left + right + 1) >> 1)) {
+                    fprintf(stderr, "Mipmap differs at %d,%d\n", (int)x, (int)y);
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+static bool testMipmapLockOrder()
+{
+    bench::MockServerOptions serverOptions;
+    serverOptions.mPort = 0;
+    serverOptions.mWidth = 320;
+    serverOptions.mHeight = 200;
+    serverOptions.mScenario = bench::MockScenario::Windows;
+    serverOptions.mFramesPerSecond = 120.0;
+    test::TestServer server(serverOptions);
+    orv_error_t error;
+    ORV_TEST_CHECK(server.server()->listen(&error));
+    server.start();
+
+    orv_config_t config;
+    orv_config_default(&config);
+    config.mMinLogSeverity = ORV_LOGGING_SEVERITY_WARNING;
+    config.mMipmapLevels = 2;
+    test::TestClient client(&config);
+    ORV_TEST_CHECK(client.connect("127.0.0.1", server.server()->port(), ORV_TRANSPORT_TCP));
+    orv_request_framebuffer_update_full(client.context());
+    int updates = 0;
+    client.waitForEvent(10000, [&client, &updates](const orv_event_t* event) {
+        if (event->mEventType != ORV_EVENT_FRAMEBUFFER_UPDATE_REQUEST_FINISHED) {
+            return false;
+        }
+        updates++;
+        if (updates < 50) {
+            orv_request_framebuffer_update_full(client.context());
+        }
+        // hold both locks in both orders while the next update is decoded
+        for (int i = 0; i < 20; i++) {
+            const bool mipmapFirst = (i % 2) == 0;
+            if (mipmapFirst) {
+                orv_acquire_mipmap(client.context(), 1);
+            }
+            else {
+                orv_acquire_framebuffer(client.context());
+            }
+            // give the connection thread the chance to lock the other one
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+            if (mipmapFirst) {
+                orv_acquire_framebuffer(client.context());
+            }
+            else {
+                orv_acquire_mipmap(client.context(), 1);
+            }
+            orv_release_mipmap(client.context());
+            orv_release_framebuffer(client.context());
+        }
+        return updates >= 50;
+    });
+    ORV_TEST_CHECK(updates >= 50);
+
+    // no further request is made, so the framebuffer remains unchanged
+    const orv_framebuffer_t* level = orv_acquire_mipmap(client.context(), 1);
+    const orv_framebuffer_t* framebuffer = orv_acquire_framebuffer(client.context());
+    const bool sizeMatches = level->mFramebuffer && framebuffer->mFramebuffer && level->mWidth == framebuffer->mWidth / 2 && level->mHeight == framebuffer->mHeight / 2;
+    const bool downscaled = sizeMatches && isDownscaled(framebuffer, level);
+    orv_release_framebuffer(client.context());
+    orv_release_mipmap(client.context());
+    ORV_TEST_CHECK(sizeMatches);
+    ORV_TEST_CHECK(downscaled);
+    return true;
+}
+
+int main()
+{
+    return testMipmapLockOrder() ? 0 : 1;
+}
+
@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2018 Monument-Software GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/**
+ * Applies random paints and copies to a desktop, records them in a @ref openrv::bench::MockDamage
+ * and applies the taken changes to a client copy of the desktop like a client would (copies in
+ * order, then the dirty rects with the current desktop content). Both must be identical
+ * afterwards, and copies with a valid source must not be turned into dirty rects.
+ **/
+
+#include "testutil.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <random>
+#include <vector>
+
+using namespace openrv;
+
+static const uint16_t gWidth = 96;
+static const uint16_t gHeight = 64;
+
+struct TestDesktop
+{
+    TestDesktop()
+        : mPixels((size_t)gWidth * gHeight, 0)
+    {
+    }
+    void fill(const bench::MockRect& rect, uint32_t value)
+    {
+        for (uint16_t y = rect.mY; y < rect.mY + rect.mH; y++) {
+            std::fill(mPixels.begin() + (size_t)y * gWidth + rect.mX, mPixels.begin() + (size_t)y * gWidth + rect.mX + rect.mW, value);
+        }
+    }
+    void copy(const bench::MockCopy& copy)
+    {
+        const bench::MockRect& dst = copy.mDst;
+        const size_t rowBytes = (size_t)dst.mW * sizeof(uint32_t);
+        for (int i = 0; i < dst.mH; i++) {
+            const int y = (copy.mSrcY >= dst.mY) ? i : dst.mH - 1 - i;
+            memmove(&mPixels[(size_t)(dst.mY + y) * gWidth + dst.mX], &mPixels[(size_t)(copy.mSrcY + y) * gWidth + copy.mSrcX], rowBytes);
+        }
+    }
+    void update(const TestDesktop& source, const bench::MockRect& rect)
+    {
+        for (uint16_t y = rect.mY; y < rect.mY + rect.mH; y++) {
+            memcpy(&mPixels[(size_t)y * gWidth + rect.mX], &source.mPixels[(size_t)y * gWidth + rect.mX], (size_t)rect.mW * sizeof(uint32_t));
+        }
+    }
+    std::vector<uint32_t> mPixels;
+};
+
+static bench::MockRect randomRect(std::mt19937* random, uint16_t maxSize)
+{
+    const uint16_t w = (uint16_t)std::uniform_int_distribution<int>(1, maxSize)(*random);
+    const uint16_t h = (uint16_t)std::uniform_int_distribution<int>(1, maxSize)(*random);
+    const uint16_t x = (uint16_t)std::uniform_int_distribution<int>(0, gWidth - w)(*random);
+    const uint16_t y = (uint16_t)std::uniform_int_distribution<int>(0, gHeight - h)(*random);
+    return bench::MockRect(x, y, w, h);
+}
+
+static bool testRandomDamage()
+{
+    std::mt19937 random(1234);
+    TestDesktop server;
+    TestDesktop client;
+    bench::MockDamage damage;
+    const bench::MockRect full(0, 0, gWidth, gHeight);
+    uint32_t nextValue = 1;
+    for (int round = 0; round < 2000; round++) {
+        const int operations = std::uniform_int_distribution<int>(1, 12)(random);
+        for (int i = 0; i < operations; i++) {
+            if (std::uniform_int_distribution<int>(0, 2)(random) == 0) {
+                const bench::MockRect rect = randomRect(&random, 24);
+                server.fill(rect, nextValue++);
+                damage.addDirty(rect);
+            }
+            else {
+                bench::MockCopy copy;
+                copy.mDst = randomRect(&random, 48);
+                copy.mSrcX = (uint16_t)std::uniform_int_distribution<int>(0, gWidth - copy.mDst.mW)(random);
+                copy.mSrcY = (uint16_t)std::uniform_int_distribution<int>(0, gHeight - copy.mDst.mH)(random);
+                server.copy(copy);
+                damage.addCopy(copy);
+            }
+        }
+        // occasionally answer a request for part of the desktop only
+        const bench::MockRect region = (round % 5 == 0) ? randomRect(&random, 64) : full;
+        std::vector<bench::MockCopy> copies;
+        std::vector<bench::MockRect> dirty;
+        damage.take(region, &copies, &dirty);
+        for (const bench::MockCopy& copy : copies) {
+            client.copy(copy);
+        }
+        for (const bench::MockRect& rect : dirty) {
+            client.update(server, rect);
+        }
+        if (region.mW == gWidth && region.mH == gHeight) {
+            ORV_TEST_CHECK(damage.isEmpty());
+            if (client.mPixels != server.mPixels) {
+                fprintf(stderr, "Client desktop differs after round %d\n", round);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static bool testCopyWithValidSource()
+{
+    bench::MockDamage damage;
+    // more separate changes than tracked rects, spread across the desktop
+    for (uint16_t y = 0; y < gHeight; y += 8) {
+        for (uint16_t x = 0; x < gWidth; x += 8) {
+            damage.addDirty(bench::MockRect(x, y, 1, 1));
+        }
+    }
+    // the source of the copy is between the changes, the copy must be kept
+    bench::MockCopy copy;
+    copy.mDst = bench::MockRect(50, 34, 6, 6);
+    copy.mSrcX = 1;
+    copy.mSrcY = 1;
+    damage.addCopy(copy);
+    std::vector<bench::MockCopy> copies;
+    std::vector<bench::MockRect> dirty;
+    damage.take(bench::MockRect(0, 0, gWidth, gHeight), &copies, &dirty);
+    ORV_TEST_CHECK(copies.size() == 1);
+    uint64_t dirtyPixels = 0;
+    for (const bench::MockRect& rect : dirty) {
+        dirtyPixels += (uint64_t)rect.mW * rect.mH;
+    }
+    // merging the changes covers some unchanged pixels, but not most of the desktop
+    ORV_TEST_CHECK(dirtyPixels < (uint64_t)gWidth * gHeight / 8);
+    return true;
+}
+
+int main()
+{
+    if (!testCopyWithValidSource()) {
+        return 1;
+    }
+    return testRandomDamage() ? 0 : 1;
+}
+
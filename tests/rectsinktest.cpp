@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2018 Monument-Software GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/**
+ * Receives updates with a rect sink (see @ref orv_config_t::mRectSinkCallback) that calls other
+ * functions of the library, which must not deadlock. With a maintained framebuffer, the pixels
+ * provided for CopyRect rects must match the framebuffer.
+ **/
+
+#include "testutil.h"
+
+#include <string.h>
+#include <atomic>
+
+using namespace openrv;
+
+static std::atomic<int> gSinkRects(0);
+static std::atomic<int> gSinkCopyRects(0);
+static std::atomic<int> gSinkMismatches(0);
+
+static void rectSinkCallback(orv_context_t* ctx, const orv_rect_sink_data_t* rect)
+{
+    gSinkRects++;
+    orv_statistics_t statistics;
+    orv_get_statistics(ctx, &statistics);
+    const orv_framebuffer_t* framebuffer = orv_acquire_framebuffer(ctx);
+    if (framebuffer->mFramebuffer && rect->mFormat == ORV_RECT_SINK_FORMAT_RGB888) {
+        gSinkCopyRects++;
+        const size_t framebufferStride = (size_t)framebuffer->mWidth * framebuffer->mBytesPerPixel;
+        for (uint16_t y = 0; y < rect->mHeight; y++) {
+            const uint8_t* expected = framebuffer->mFramebuffer + (size_t)(rect->mY + y) * framebufferStride + (size_t)rect->mX * framebuffer->mBytesPerPixel;
+            if (memcmp(rect->mPixels + (size_t)y * rect->mStride, expected, (size_t)rect->mWidth * rect->mBytesPerPixel) != 0) {
+                gSinkMismatches++;
+                break;
+            }
+        }
+    }
+    orv_release_framebuffer(ctx);
+}
+
+static bool testRectSink(bool skipFramebuffer)
+{
+    gSinkRects = 0;
+    gSinkCopyRects = 0;
+    gSinkMismatches = 0;
+    bench::MockServerOptions serverOptions;
+    serverOptions.mPort = 0;
+    serverOptions.mWidth = 320;
+    serverOptions.mHeight = 200;
+    serverOptions.mScenario = skipFramebuffer ? bench::MockScenario::Noise : bench::MockScenario::Windows;
+    serverOptions.mFramesPerSecond = 60.0;
+    test::TestServer server(serverOptions);
+    orv_error_t error;
+    ORV_TEST_CHECK(server.server()->listen(&error));
+    server.start();
+
+    orv_config_t config;
+    orv_config_default(&config);
+    config.mMinLogSeverity = ORV_LOGGING_SEVERITY_WARNING;
+    config.mRectSinkCallback = rectSinkCallback;
+    config.mSkipFramebuffer = skipFramebuffer ? 1 : 0;
+    test::TestClient client(&config);
+    ORV_TEST_CHECK(client.connect("127.0.0.1", server.server()->port(), ORV_TRANSPORT_TCP));
+    orv_request_framebuffer_update_full(client.context());
+    int updates = 0;
+    client.waitForEvent(5000, [&client, &updates](const orv_event_t* event) {
+        if (event->mEventType != ORV_EVENT_FRAMEBUFFER_UPDATE_REQUEST_FINISHED) {
+            return false;
+        }
+        updates++;
+        orv_request_framebuffer_update_full(client.context());
+        return updates >= 20;
+    });
+    ORV_TEST_CHECK(updates >= 20);
+    ORV_TEST_CHECK(gSinkRects > 0);
+    if (!skipFramebuffer) {
+        ORV_TEST_CHECK(gSinkCopyRects > 0);
+    }
+    ORV_TEST_CHECK(gSinkMismatches == 0);
+    return true;
+}
+
+int main()
+{
+    if (!testRectSink(false)) {
+        return 1;
+    }
+    return testRectSink(true) ? 0 : 1;
+}
+
@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2018 Monument-Software GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "testutil.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace openrv {
+namespace test {
+
+static uint64_t getTimestampMs()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+TestServer::TestServer(const bench::MockServerOptions& options)
+    : mServer(options)
+{
+}
+
+TestServer::~TestServer()
+{
+    if (mThread.joinable()) {
+        mServer.stop();
+        mThread.join();
+    }
+}
+
+void TestServer::start()
+{
+    mThread = std::thread(&bench::MockServer::run, &mServer);
+}
+
+TestClient::TestClient()
+    : TestClient(nullptr)
+{
+}
+
+/**
+ * Create the context using @p config (or the default config if NULL). The event callback of
+ * @p config is replaced by the polling callback.
+ **/
+TestClient::TestClient(const orv_config_t* config)
+{
+    orv_config_t c;
+    if (config) {
+        c = *config;
+    }
+    else {
+        orv_config_default(&c);
+        c.mMinLogSeverity = ORV_LOGGING_SEVERITY_WARNING;
+    }
+    c.mEventCallback = orv_event_callback_polling;
+    mContext = orv_init(&c);
+}
+
+TestClient::~TestClient()
+{
+    if (mContext) {
+        orv_disconnect(mContext);
+        orv_destroy(mContext);
+    }
+}
+
+/**
+ * Connect to @p hostName and wait for the result.
+ *
+ * @return TRUE if the connection was established, otherwise FALSE.
+ **/
+bool TestClient::connect(const char* hostName, uint16_t port, orv_transport_type_t transportType)
+{
+    ORV_TEST_CHECK(mContext != nullptr);
+    orv_connect_options_t connectOptions;
+    orv_connect_options_default(&connectOptions);
+    connectOptions.mTransportType = transportType;
+    orv_error_t error;
+    if (orv_connect(mContext, hostName, port, &connectOptions, &error) != 0) {
+        fprintf(stderr, "Failed to connect to %s: %s\n", hostName, error.mErrorMessage);
+        return false;
+    }
+    bool connected = false;
+    bool haveResult = waitForEvent(5000, [&connected](const orv_event_t* event) {
+        if (event->mEventType != ORV_EVENT_CONNECT_RESULT) {
+            return false;
+        }
+        const orv_connect_result_t* result = (const orv_connect_result_t*)event->mEventData;
+        if (result->mError.mHasError) {
+            fprintf(stderr, "Failed to connect: %s\n", result->mError.mErrorMessage);
+        }
+        connected = !result->mError.mHasError;
+        return true;
+    });
+    ORV_TEST_CHECK(haveResult);
+    return connected;
+}
+
+/**
+ * Poll the events of the context and pass them to @p handler until it returns TRUE or @p
+ * timeoutMs have passed.
+ *
+ * @return TRUE if @p handler accepted an event, FALSE on timeout.
+ **/
+bool TestClient::waitForEvent(int timeoutMs, const std::function<bool(const orv_event_t*)>& handler)
+{
+    const uint64_t endMs = getTimestampMs() + timeoutMs;
+    for (uint64_t nowMs = getTimestampMs(); nowMs < endMs; nowMs = getTimestampMs()) {
+        orv_wait_events(mContext, (int)std::min(endMs - nowMs, (uint64_t)100));
+        while (orv_event_t* event = orv_poll_event(mContext)) {
+            bool done = handler(event);
+            orv_event_destroy(event);
+            if (done) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool TestClient::waitForEventType(int timeoutMs, orv_event_type_t eventType)
+{
+    return waitForEvent(timeoutMs, [eventType](const orv_event_t* event) {
+        return event->mEventType == eventType;
+    });
+}
+
+} // namespace test
+} // namespace openrv
+
@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2018 Monument-Software GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef OPENRV_TESTUTIL_H
+#define OPENRV_TESTUTIL_H
+
+#include "mockserver.h"
+
+#include <libopenrv/libopenrv.h>
+#include <libopenrv/orv_error.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <functional>
+#include <memory>
+#include <thread>
+
+/**
+ * Report a failed check of a test and make the surrounding function return FALSE.
+ **/
+#define ORV_TEST_CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            return false; \
+        } \
+    } while (0)
+
+namespace openrv {
+namespace test {
+
+/**
+ * A @ref bench::MockServer served by a thread of the test during the lifetime of this object.
+ *
+ * Call one (or more) of the listen functions, then @ref start().
+ **/
+class TestServer
+{
+public:
+    explicit TestServer(const bench::MockServerOptions& options);
+    ~TestServer();
+    TestServer(const TestServer&) = delete;
+    TestServer& operator=(const TestServer&) = delete;
+
+    bench::MockServer* server();
+    void start();
+
+private:
+    bench::MockServer mServer;
+    std::thread mThread;
+};
+
+/**
+ * A context of the library that delivers its events by polling, destroyed with this object.
+ **/
+class TestClient
+{
+public:
+    TestClient();
+    explicit TestClient(const orv_config_t* config);
+    ~TestClient();
+    TestClient(const TestClient&) = delete;
+    TestClient& operator=(const TestClient&) = delete;
+
+    orv_context_t* context() const;
+    bool connect(const char* hostName, uint16_t port, orv_transport_type_t transportType);
+    bool waitForEvent(int timeoutMs, const std::function<bool(const orv_event_t*)>& handler);
+    bool waitForEventType(int timeoutMs, orv_event_type_t eventType);
+
+private:
+    orv_context_t* mContext = nullptr;
+};
+
+inline bench::MockServer* TestServer::server()
+{
+    return &mServer;
+}
+
+inline orv_context_t* TestClient::context() const
+{
+    return mContext;
+}
+
+} // namespace test
+} // namespace openrv
+
+#endif
+
@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2018 Monument-Software GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/**
+ * Connects to an in-process mock server over the transport given on the command line ("tcp",
+ * "unix" or "memory-pipe") and checks that a full framebuffer update is received.
+ **/
+
+#include "testutil.h"
+
+#include <string.h>
+#include <unistd.h>
+#include <string>
+
+using namespace openrv;
+
+static bool testTransport(orv_transport_type_t transportType)
+{
+    bench::MockServerOptions serverOptions;
+    serverOptions.mPort = 0;
+    serverOptions.mWidth = 320;
+    serverOptions.mHeight = 200;
+    serverOptions.mScenario = bench::MockScenario::Noise;
+    serverOptions.mFramesPerSecond = 10.0;
+    test::TestServer server(serverOptions);
+    orv_error_t error;
+    std::string hostName = "127.0.0.1";
+    switch (transportType) {
+        case ORV_TRANSPORT_TCP:
+            ORV_TEST_CHECK(server.server()->listen(&error));
+            break;
+        case ORV_TRANSPORT_UNIX_SOCKET:
+            hostName = "/tmp/orv_transport_test_" + std::to_string(getpid()) + ".sock";
+            ORV_TEST_CHECK(server.server()->listenUnixSocket(hostName.c_str(), &error));
+            break;
+        case ORV_TRANSPORT_MEMORY_PIPE:
+            hostName = "orv_transport_test";
+            ORV_TEST_CHECK(server.server()->listenMemoryPipe(hostName.c_str(), &error));
+            break;
+    }
+    server.start();
+
+    test::TestClient client;
+    ORV_TEST_CHECK(client.connect(hostName.c_str(), server.server()->port(), transportType));
+    orv_request_framebuffer_update_full(client.context());
+    uint64_t updatedPixels = 0;
+    bool finished = client.waitForEvent(5000, [&updatedPixels](const orv_event_t* event) {
+        if (event->mEventType == ORV_EVENT_FRAMEBUFFER_UPDATED) {
+            const orv_event_framebuffer_t* data = (const orv_event_framebuffer_t*)event->mEventData;
+            updatedPixels += (uint64_t)data->mWidth * data->mHeight;
+        }
+        else if (event->mEventType == ORV_EVENT_FRAMEBUFFER_UPDATED_BATCH) {
+            const orv_event_framebuffer_batch_t* data = (const orv_event_framebuffer_batch_t*)event->mEventData;
+            for (uint32_t i = 0; i < data->mRectCount; i++) {
+                updatedPixels += (uint64_t)data->mRects[i].mWidth * data->mRects[i].mHeight;
+            }
+        }
+        return event->mEventType == ORV_EVENT_FRAMEBUFFER_UPDATE_REQUEST_FINISHED;
+    });
+    ORV_TEST_CHECK(finished);
+    ORV_TEST_CHECK(updatedPixels >= (uint64_t)serverOptions.mWidth * serverOptions.mHeight);
+    const orv_framebuffer_t* framebuffer = orv_acquire_framebuffer(client.context());
+    bool sizeMatches = framebuffer->mWidth == serverOptions.mWidth && framebuffer->mHeight == serverOptions.mHeight;
+    orv_release_framebuffer(client.context());
+    ORV_TEST_CHECK(sizeMatches);
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s tcp|unix|memory-pipe\n", argv[0]);
+        return 1;
+    }
+    orv_transport_type_t transportType;
+    if (strcmp(argv[1], "tcp") == 0) {
+        transportType = ORV_TRANSPORT_TCP;
+    }
+    else if (strcmp(argv[1], "unix") == 0) {
+        transportType = ORV_TRANSPORT_UNIX_SOCKET;
+    }
+    else if (strcmp(argv[1], "memory-pipe") == 0) {
+        transportType = ORV_TRANSPORT_MEMORY_PIPE;
+    }
+    else {
+        fprintf(stderr, "Unknown transport %s\n", argv[1]);
+        return 1;
+    }
+    return testTransport(transportType) ? 0 : 1;
+}
+
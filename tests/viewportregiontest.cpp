@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2018 Monument-Software GmbH
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/**
+ * Moves the viewport over a desktop whose size is not a multiple of @ref
+ * openrv::vnc::ViewportRegion::mTileSize and checks the requests that @ref
+ * openrv::vnc::ViewportRegion::planRequest() plans for incremental updates of the whole desktop:
+ * the incremental request restricted to the viewport, and the non-incremental request that
+ * refreshes the stale tiles, both clipped at the edges of the framebuffer.
+ **/
+
+#include "testutil.h"
+#include "viewportregion.h"
+
+using namespace openrv;
+using namespace openrv::vnc;
+
+// 5 x 4 tiles, the tiles in the last column are 44 pixels wide, the ones in the last row 8 pixels
+// high.
+static const uint16_t gDesktopWidth = 300;
+static const uint16_t gDesktopHeight = 200;
+static const uint32_t gTileCount = 5 * 4;
+
+static void printRequest(const char* name, const RequestFramebuffer& request)
+{
+    fprintf(stderr, "  %s: incremental=%d, x=%d, y=%d, w=%d, h=%d\n", name, (int)request.mIncremental, (int)request.mX, (int)request.mY, (int)request.mW, (int)request.mH);
+}
+
+/**
+ * Plan the incremental @p request and compare the planned requests to @p expectedRefresh (width 0
+ * if no refresh is expected) and @p expectedRestricted.
+ **/
+static bool checkPlan(ViewportRegion* region, const RequestFramebuffer& request, const RequestFramebuffer& expectedRefresh, const RequestFramebuffer& expectedRestricted)
+{
+    RequestFramebuffer refresh;
+    RequestFramebuffer restricted;
+    ORV_TEST_CHECK(region->planRequest(request, &refresh, &restricted));
+    if (refresh != expectedRefresh || restricted != expectedRestricted) {
+        fprintf(stderr, "Unexpected plan for request:\n");
+        printRequest("request", request);
+        printRequest("refresh", refresh);
+        printRequest("expected refresh", expectedRefresh);
+        printRequest("restricted", restricted);
+        printRequest("expected restricted", expectedRestricted);
+    }
+    ORV_TEST_CHECK(refresh == expectedRefresh);
+    ORV_TEST_CHECK(restricted == expectedRestricted);
+    return true;
+}
+
+static bool testMovingViewport()
+{
+    const RequestFramebuffer fullIncremental(true, 0, 0, gDesktopWidth, gDesktopHeight);
+    const RequestFramebuffer noRefresh(false, 0, 0, 0, 0);
+    ViewportRegion region;
+    region.reset(gDesktopWidth, gDesktopHeight);
+
+    // without a viewport nothing is restricted
+    ORV_TEST_CHECK(checkPlan(&region, fullIncremental, noRefresh, fullIncremental));
+    ORV_TEST_CHECK(region.staleTileCount() == 0);
+
+    // the top left 2x2 tiles are requested, all other tiles become stale
+    region.setViewport(Viewport(0, 0, 100, 100, 0));
+    ORV_TEST_CHECK(checkPlan(&region, fullIncremental, noRefresh, RequestFramebuffer(true, 0, 0, 128, 128)));
+    ORV_TEST_CHECK(region.staleTileCount() == gTileCount - 4);
+
+    // the margin extends the viewport to tile columns 2-4 and rows 1-2, clipped at the right edge.
+    // these tiles were stale and are refreshed, the previous tiles become stale.
+    region.setViewport(Viewport(150, 100, 100, 60, 10));
+    ORV_TEST_CHECK(checkPlan(&region, fullIncremental, RequestFramebuffer(false, 128, 64, 172, 128), RequestFramebuffer(true, 128, 64, 172, 128)));
+    ORV_TEST_CHECK(region.staleTileCount() == gTileCount - 6);
+
+    // the refreshed tiles are not refreshed again
+    ORV_TEST_CHECK(checkPlan(&region, fullIncremental, noRefresh, RequestFramebuffer(true, 128, 64, 172, 128)));
+    ORV_TEST_CHECK(region.staleTileCount() == gTileCount - 6);
+
+    // the viewport exceeds the bottom right corner: only the stale tile of the last row is
+    // refreshed, the tile above it is up to date already.
+    region.setViewport(Viewport(280, 190, 50, 50, 0));
+    ORV_TEST_CHECK(checkPlan(&region, fullIncremental, RequestFramebuffer(false, 256, 192, 44, 8), RequestFramebuffer(true, 256, 128, 44, 72)));
+    ORV_TEST_CHECK(region.staleTileCount() == gTileCount - 2);
+
+    // a viewport outside of the framebuffer restricts the request to nothing
+    region.setViewport(Viewport(400, 300, 10, 10, 0));
+    RequestFramebuffer refresh;
+    RequestFramebuffer restricted;
+    ORV_TEST_CHECK(!region.planRequest(fullIncremental, &refresh, &restricted));
+    ORV_TEST_CHECK(region.staleTileCount() == gTileCount);
+
+    // non-incremental requests are never restricted and make the requested tiles up to date
+    const RequestFramebuffer fullNonIncremental(false, 0, 0, gDesktopWidth, gDesktopHeight);
+    ORV_TEST_CHECK(checkPlan(&region, fullNonIncremental, noRefresh, fullNonIncremental));
+    ORV_TEST_CHECK(region.staleTileCount() == 0);
+    return true;
+}
+
+static bool testMarkAllStale()
+{
+    const RequestFramebuffer fullIncremental(true, 0, 0, gDesktopWidth, gDesktopHeight);
+    ViewportRegion region;
+    region.reset(gDesktopWidth, gDesktopHeight);
+    region.markAllStale();
+    ORV_TEST_CHECK(region.staleTileCount() == gTileCount);
+
+    // only the stale tiles within the viewport are refreshed
+    region.setViewport(Viewport(0, 0, 64, 64, 0));
+    ORV_TEST_CHECK(checkPlan(&region, fullIncremental, RequestFramebuffer(false, 0, 0, 64, 64), RequestFramebuffer(true, 0, 0, 64, 64)));
+    ORV_TEST_CHECK(region.staleTileCount() == gTileCount - 1);
+
+    // an incremental request that is not aligned to the tiles refreshes the stale part of the
+    // request, but the partially covered tiles remain stale
+    region.setViewport(Viewport());
+    const RequestFramebuffer unaligned(true, 10, 10, 100, 100);
+    ORV_TEST_CHECK(checkPlan(&region, unaligned, RequestFramebuffer(false, 10, 10, 100, 100), unaligned));
+    ORV_TEST_CHECK(region.staleTileCount() == gTileCount - 1);
+
+    // without a viewport, the remaining stale tiles are refreshed by the next request of the
+    // whole framebuffer
+    ORV_TEST_CHECK(checkPlan(&region, fullIncremental, RequestFramebuffer(false, 0, 0, gDesktopWidth, gDesktopHeight), fullIncremental));
+    ORV_TEST_CHECK(region.staleTileCount() == 0);
+    return true;
+}
+
+int main()
+{
+    if (!testMovingViewport()) {
+        return 1;
+    }
+    if (!testMarkAllStale()) {
+        return 1;
+    }
+    return 0;
+}